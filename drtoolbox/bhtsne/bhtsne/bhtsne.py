@@ -87,6 +87,9 @@ def _argparse():
     argparse.add_argument('--no_pca', dest='use_pca', action='store_false')
     argparse.set_defaults(use_pca=DEFAULT_USE_PCA)
     argparse.add_argument('-m', '--max_iter', type=int, default=DEFAULT_MAX_ITERATIONS)
+    # Embed the samples of --new into the map (--map) of the input samples
+    argparse.add_argument('--map', type=FileType('r'))
+    argparse.add_argument('--new', type=FileType('r'))
     return argparse
 
 
@@ -103,10 +106,16 @@ def _is_filelike_object(f):
 
 
 def init_bh_tsne(samples, workdir, no_dims=DEFAULT_NO_DIMS, initial_dims=INITIAL_DIMENSIONS, perplexity=DEFAULT_PERPLEXITY,
-            theta=DEFAULT_THETA, randseed=EMPTY_SEED, verbose=False, use_pca=DEFAULT_USE_PCA, max_iter=DEFAULT_MAX_ITERATIONS):
+            theta=DEFAULT_THETA, randseed=EMPTY_SEED, verbose=False, use_pca=DEFAULT_USE_PCA, max_iter=DEFAULT_MAX_ITERATIONS,
+            embedding=None, new_samples=None):
+
+    if new_samples is not None:
+        embedding = np.asarray(embedding, dtype='float64').reshape(len(samples), -1)
+        no_dims = embedding.shape[1]
 
     if use_pca:
-        samples = samples - np.mean(samples, axis=0)
+        mean = np.mean(samples, axis=0)
+        samples = samples - mean
         cov_x = np.dot(np.transpose(samples), samples)
         [eig_val, eig_vec] = np.linalg.eig(cov_x)
 
@@ -119,6 +128,9 @@ def init_bh_tsne(samples, workdir, no_dims=DEFAULT_NO_DIMS, initial_dims=INITIAL
         # truncating the eigen-vectors matrix to keep the most important vectors
         eig_vec = eig_vec[:, :initial_dims]
         samples = np.dot(samples, eig_vec)
+        # The new samples are projected on the same components
+        if new_samples is not None:
+            new_samples = np.dot(new_samples - mean, eig_vec)
 
     # Assume that the dimensionality of the first sample is representative for
     #   the whole batch
@@ -133,19 +145,26 @@ def init_bh_tsne(samples, workdir, no_dims=DEFAULT_NO_DIMS, initial_dims=INITIAL
         # Then write the data
         for sample in samples:
             data_file.write(pack('{}d'.format(len(sample)), *sample))
+        if new_samples is not None:
+            # Transform mode: the map of the samples, then the new samples
+            for point in embedding:
+                data_file.write(pack('{}d'.format(len(point)), *point))
+            data_file.write(pack('i', len(new_samples)))
+            for sample in new_samples:
+                data_file.write(pack('{}d'.format(len(sample)), *sample))
         # Write random seed if specified
-        if randseed != EMPTY_SEED:
+        elif randseed != EMPTY_SEED:
             data_file.write(pack('i', randseed))
 
 def load_data(input_file):
     # Read the data, using numpy's good judgement
     return np.loadtxt(input_file)
 
-def bh_tsne(workdir, verbose=False):
+def bh_tsne(workdir, verbose=False, transform=False):
 
     # Call bh_tsne and let it do its thing
     with open(devnull, 'w') as dev_null:
-        bh_tsne_p = Popen((abspath(BH_TSNE_BIN_PATH), ), cwd=workdir,
+        bh_tsne_p = Popen((abspath(BH_TSNE_BIN_PATH), ) + (('transform', ) if transform else ()), cwd=workdir,
                 # bh_tsne is very noisy on stdout, tell it to use stderr
                 #   if it is to print any output
                 stdout=stderr if verbose else dev_null)
@@ -173,10 +192,15 @@ def bh_tsne(workdir, verbose=False):
         # The last piece of data is the cost for each sample, we ignore it
         #read_unpack('{}d'.format(sample_count), output_file)
 
-def run_bh_tsne(data, no_dims=2, perplexity=50, theta=0.5, randseed=-1, verbose=False, initial_dims=50, use_pca=True, max_iter=1000):
+def run_bh_tsne(data, no_dims=2, perplexity=50, theta=0.5, randseed=-1, verbose=False, initial_dims=50, use_pca=True, max_iter=1000,
+        embedding=None, new_data=None):
     '''
     Run TSNE based on the Barnes-HT algorithm
 
+    If the map of data (embedding) and new samples (new_data) are given, the
+    new samples are embedded into the fixed map and their coordinates are
+    returned (no_dims is then taken from the map)
+
     Parameters:
     ----------
     data: file or numpy.array
@@ -189,6 +213,10 @@ def run_bh_tsne(data, no_dims=2, perplexity=50, theta=0.5, randseed=-1, verbose=
     verbose: boolean
     use_pca: boolean
     max_iter: int
+    embedding: file or numpy.array
+        The map of data, one point per row
+    new_data: file or numpy.array
+        The samples to embed into the map, one sample per row
     '''
 
     # bh_tsne works with fixed input and output paths, give it a temporary
@@ -200,8 +228,13 @@ def run_bh_tsne(data, no_dims=2, perplexity=50, theta=0.5, randseed=-1, verbose=
     if child_pid == 0:
         if _is_filelike_object(data):
             data = load_data(data)
+        if _is_filelike_object(embedding):
+            embedding = load_data(embedding)
+        if _is_filelike_object(new_data):
+            new_data = load_data(new_data)
 
-        init_bh_tsne(data, tmp_dir_path, no_dims=no_dims, perplexity=perplexity, theta=theta, randseed=randseed,verbose=verbose, initial_dims=initial_dims, use_pca=use_pca, max_iter=max_iter)
+        init_bh_tsne(data, tmp_dir_path, no_dims=no_dims, perplexity=perplexity, theta=theta, randseed=randseed,verbose=verbose, initial_dims=initial_dims, use_pca=use_pca, max_iter=max_iter,
+                embedding=embedding, new_samples=new_data)
         sys.exit(0)
     else:
         try:
@@ -211,7 +244,7 @@ def run_bh_tsne(data, no_dims=2, perplexity=50, theta=0.5, randseed=-1, verbose=
             print("This is an issue due to asynchronous error handling.")
 
         res = []
-        for result in bh_tsne(tmp_dir_path, verbose):
+        for result in bh_tsne(tmp_dir_path, verbose, transform=new_data is not None):
             sample_res = []
             for r in result:
                 sample_res.append(r)
@@ -228,9 +261,12 @@ def main(args):
         return 
 
     argp = parser.parse_args(args[1:])
+    if (argp.map is None) != (argp.new is None):
+        parser.error('--map and --new must be given together')
     
     for result in run_bh_tsne(argp.input, no_dims=argp.no_dims, perplexity=argp.perplexity, theta=argp.theta, randseed=argp.randseed,
-            verbose=argp.verbose, initial_dims=argp.initial_dims, use_pca=argp.use_pca, max_iter=argp.max_iter):
+            verbose=argp.verbose, initial_dims=argp.initial_dims, use_pca=argp.use_pca, max_iter=argp.max_iter,
+            embedding=argp.map, new_data=argp.new):
         fmt = ''
         for i in range(1, len(result)):
             fmt = fmt + '{}\t'
@@ -1,7 +1,8 @@
-function mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg, max_iter)
+function mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg, max_iter, Y, X_new)
 %FAST_TSNE Runs the C++ implementation of Barnes-Hut t-SNE
 %
 %   mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg)
+%   mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg, max_iter, Y, X_new)
 %
 % Runs the C++ implementation of Barnes-Hut-SNE. The high-dimensional 
 % datapoints are specified in the NxD matrix X. The dimensionality of the 
@@ -15,6 +16,10 @@ function mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg, m
 % The variable alg determines the algorithm used for PCA. The default is set 
 % to 'svd'. Other options are 'eig' or 'als' (see 'doc pca' for more details).
 % The function returns the two-dimensional data points in mappedX.
+% If the map Y of X (e.g. computed by an earlier call) and new datapoints 
+% X_new are specified, the new datapoints are embedded into the fixed map Y
+% (using the PCA of X) and their coordinates are returned in mappedX. In 
+% that case, no_dims is taken from Y and max_iter defaults to 250.
 %
 % NOTE: The function is designed to run on large (N > 5000) data sets. It
 % may give poor performance on very small data sets (it is better to use a
@@ -65,31 +70,48 @@ function mappedX = fast_tsne(X, no_dims, initial_dims, perplexity, theta, alg, m
     if ~exist('alg', 'var') || isempty(alg)
         alg = 'svd';
     end
+    transform = exist('X_new', 'var') && ~isempty(X_new);
     if ~exist('max_iter', 'var') || isempty(max_iter)
        max_iter=750; 
+       if transform
+           max_iter = 250;
+       end
+    end
+    if transform
+        no_dims = size(Y, 2);
     end
     
     % Perform the initial dimensionality reduction using PCA
     X = double(X);
-    X = bsxfun(@minus, X, mean(X, 1));
+    mu = mean(X, 1);
+    X = bsxfun(@minus, X, mu);
     M = pca(X,'NumComponents',initial_dims,'Algorithm',alg);
     X = X * M;
+    if transform
+        X_new = bsxfun(@minus, double(X_new), mu) * M;
+    end
     
     tsne_path = which('fast_tsne');
     tsne_path = fileparts(tsne_path);
     
     % Compile t-SNE C code
     if(~exist(fullfile(tsne_path,'./bh_tsne'),'file') && isunix)
-        system(sprintf('g++ %s %s -o %s -O2',...
+        system(sprintf('g++ %s %s %s -o %s -O2',...
             fullfile(tsne_path,'./sptree.cpp'),...
             fullfile(tsne_path,'./tsne.cpp'),...
+            fullfile(tsne_path,'./tsne_main.cpp'),...
             fullfile(tsne_path,'./bh_tsne')));
     end
 
     % Run the fast diffusion SNE implementation
     write_data(X, no_dims, theta, perplexity, max_iter);
+    mode = '';
+    if transform
+        write_transform_data(Y, X_new);
+        mode = ' transform';
+    end
     tic
-    [flag, cmdout] = system(['"' fullfile(tsne_path,'./bh_tsne') '"']);
+    [flag, cmdout] = system(['"' fullfile(tsne_path,'./bh_tsne') '"' mode]);
     if(flag~=0)
         error(cmdout);
     end
@@ -116,6 +138,17 @@ function write_data(X, no_dims, theta, perplexity, max_iter)
 end
 
 
+% Appends the map of the data and the new datapoints to the datafile (for
+% the transform mode of the fast t-SNE implementation)
+function write_transform_data(Y, X_new)
+    h = fopen('data.dat', 'ab');
+    fwrite(h, double(Y)', 'double');
+    fwrite(h, size(X_new, 1), 'integer*4');
+    fwrite(h, X_new', 'double');
+    fclose(h);
+end
+
+
 % Reads the result file from the fast t-SNE implementation
 function [X, landmarks, costs] = read_data
     h = fopen('result.dat', 'rb');
@@ -374,6 +374,42 @@ void SPTree::computeNonEdgeForces(unsigned int point_index, double theta, double
 }
 
 
+// Compute non-edge forces for a point that is not stored in the tree (e.g., an out-of-sample point)
+void SPTree::computeNonEdgeForces(double* point, double theta, double neg_f[], double* sum_Q)
+{
+
+    // Make sure that we spend no time on empty nodes
+    if(cum_size == 0) return;
+
+    // Compute distance between point and center-of-mass
+    double D = .0;
+    for(unsigned int d = 0; d < dimension; d++) buff[d] = point[d] - center_of_mass[d];
+    for(unsigned int d = 0; d < dimension; d++) D += buff[d] * buff[d];
+
+    // Check whether we can use this node as a "summary"
+    double max_width = 0.0;
+    double cur_width;
+    for(unsigned int d = 0; d < dimension; d++) {
+        cur_width = boundary->getWidth(d);
+        max_width = (max_width > cur_width) ? max_width : cur_width;
+    }
+    if(is_leaf || max_width / sqrt(D) < theta) {
+
+        // Compute and add t-SNE force between point and current node
+        D = 1.0 / (1.0 + D);
+        double mult = cum_size * D;
+        *sum_Q += mult;
+        mult *= D;
+        for(unsigned int d = 0; d < dimension; d++) neg_f[d] += mult * buff[d];
+    }
+    else {
+
+        // Recursively apply Barnes-Hut to children
+        for(unsigned int i = 0; i < no_children; i++) children[i]->computeNonEdgeForces(point, theta, neg_f, sum_Q);
+    }
+}
+
+
 // Computes edge forces
 void SPTree::computeEdgeForces(unsigned int* row_P, unsigned int* col_P, double* val_P, int N, double* pos_f)
 {
@@ -102,6 +102,7 @@ public:
     void getAllIndices(unsigned int* indices);
     unsigned int getDepth();
     void computeNonEdgeForces(unsigned int point_index, double theta, double neg_f[], double* sum_Q);
+    void computeNonEdgeForces(double* point, double theta, double neg_f[], double* sum_Q);
     void computeEdgeForces(unsigned int* row_P, unsigned int* col_P, double* val_P, int N, double* pos_f);
     void print();
     
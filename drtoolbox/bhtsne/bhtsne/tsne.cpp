@@ -197,6 +197,109 @@ void TSNE::run(double* X, int N, int D, double* Y, int no_dims, double perplexit
 }
 
 
+// Embed new points into an existing t-SNE map (the reference map Y stays fixed)
+void TSNE::transform(double* X, int N, int D, double* Y, double* X_new, int N_new, double* Y_new, int no_dims, double perplexity, double theta,
+                     bool skip_init, int max_iter, int mom_switch_iter) {
+
+    // Determine whether the reference set is large enough
+    int K = (int) (3 * perplexity);
+    if(N < K) { printf("Perplexity too large for the number of reference points!\n"); exit(1); }
+    printf("Embedding %d new points into a map of %d points using perplexity = %f and theta = %f\n", N_new, N, perplexity, theta);
+
+    // Set learning parameters (the step size matches the one the reference points saw in run())
+    float total_time = .0;
+    clock_t start, end;
+    double momentum = .5, final_momentum = .8;
+    double eta = 200.0 / (double) N;
+
+    // Allocate some memory
+    double* dY    = (double*) malloc(N_new * no_dims * sizeof(double));
+    double* uY    = (double*) malloc(N_new * no_dims * sizeof(double));
+    double* gains = (double*) malloc(N_new * no_dims * sizeof(double));
+    double* mean  = (double*) calloc(D, sizeof(double));
+    if(dY == NULL || uY == NULL || gains == NULL || mean == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    for(int i = 0; i < N_new * no_dims; i++)    uY[i] =  .0;
+    for(int i = 0; i < N_new * no_dims; i++) gains[i] = 1.0;
+
+    // Normalize both data sets with the statistics of the reference set (as in run())
+    printf("Computing input similarities...\n");
+    start = clock();
+    for(int n = 0; n < N; n++) {
+        for(int d = 0; d < D; d++) mean[d] += X[n * D + d];
+    }
+    for(int d = 0; d < D; d++) mean[d] /= (double) N;
+    for(int n = 0; n < N; n++) {
+        for(int d = 0; d < D; d++) X[n * D + d] -= mean[d];
+    }
+    for(int n = 0; n < N_new; n++) {
+        for(int d = 0; d < D; d++) X_new[n * D + d] -= mean[d];
+    }
+    double max_X = .0;
+    for(int i = 0; i < N * D; i++) {
+        if(fabs(X[i]) > max_X) max_X = fabs(X[i]);
+    }
+    for(int i = 0; i < N * D; i++) X[i] /= max_X;
+    for(int i = 0; i < N_new * D; i++) X_new[i] /= max_X;
+
+    // Compute conditional similarities of the new points to the reference points
+    unsigned int* row_P; unsigned int* col_P; double* val_P;
+    computeGaussianPerplexity(X, N, D, X_new, N_new, &row_P, &col_P, &val_P, perplexity, K);
+    end = clock();
+
+    // Initialize solution at the similarity-weighted mean of the reference neighbors
+    if(skip_init != true) {
+        for(int i = 0; i < N_new * no_dims; i++) Y_new[i] = .0;
+        for(int n = 0; n < N_new; n++) {
+            for(unsigned int i = row_P[n]; i < row_P[n + 1]; i++) {
+                for(int d = 0; d < no_dims; d++) Y_new[n * no_dims + d] += val_P[i] * Y[col_P[i] * no_dims + d];
+            }
+        }
+    }
+
+    // Construct space-partitioning tree on the reference map once (it does not move)
+    printf("Input similarities computed in %4.2f seconds!\nLearning embedding...\n", (float) (end - start) / CLOCKS_PER_SEC);
+    start = clock();
+    SPTree* tree = new SPTree(no_dims, Y, N);
+
+    for(int iter = 0; iter < max_iter; iter++) {
+
+        // Compute (approximate) gradient
+        computeGradient(row_P, col_P, val_P, Y, tree, Y_new, N_new, no_dims, dY, theta);
+
+        // Update gains
+        for(int i = 0; i < N_new * no_dims; i++) gains[i] = (sign(dY[i]) != sign(uY[i])) ? (gains[i] + .2) : (gains[i] * .8);
+        for(int i = 0; i < N_new * no_dims; i++) if(gains[i] < .01) gains[i] = .01;
+
+        // Perform gradient update (with momentum and gains)
+        for(int i = 0; i < N_new * no_dims; i++)    uY[i] = momentum * uY[i] - eta * gains[i] * dY[i];
+        for(int i = 0; i < N_new * no_dims; i++) Y_new[i] = Y_new[i] + uY[i];
+
+        // Switch momentum after a while
+        if(iter == mom_switch_iter) momentum = final_momentum;
+
+        // Print out progress
+        if(iter > 0 && (iter % 50 == 0 || iter == max_iter - 1)) {
+            end = clock();
+            total_time += (float) (end - start) / CLOCKS_PER_SEC;
+            printf("Iteration %d: 50 iterations in %4.2f seconds\n", iter, (float) (end - start) / CLOCKS_PER_SEC);
+            start = clock();
+        }
+    }
+    end = clock(); total_time += (float) (end - start) / CLOCKS_PER_SEC;
+
+    // Clean up memory
+    delete tree;
+    free(dY);
+    free(uY);
+    free(gains);
+    free(mean);
+    free(row_P); row_P = NULL;
+    free(col_P); col_P = NULL;
+    free(val_P); val_P = NULL;
+    printf("Fitting performed in %4.2f seconds.\n", total_time);
+}
+
+
 // Compute gradient of the t-SNE cost function (using Barnes-Hut algorithm)
 void TSNE::computeGradient(double* P, unsigned int* inp_row_P, unsigned int* inp_col_P, double* inp_val_P, double* Y, int N, int D, double* dC, double theta)
 {
@@ -221,6 +324,40 @@ void TSNE::computeGradient(double* P, unsigned int* inp_row_P, unsigned int* inp
     delete tree;
 }
 
+// Compute gradient of the out-of-sample cost function for the new points (using Barnes-Hut algorithm)
+void TSNE::computeGradient(unsigned int* row_P, unsigned int* col_P, double* val_P, double* Y, SPTree* tree, double* Y_new, int N_new, int D, double* dC, double theta)
+{
+
+    // Compute all terms required for the gradient of each new point; as the reference
+    // map is fixed, every point has its own normalization term over the reference set
+    double* pos_f = (double*) calloc(D, sizeof(double));
+    double* neg_f = (double*) calloc(D, sizeof(double));
+    double* buff  = (double*) malloc(D * sizeof(double));
+    if(pos_f == NULL || neg_f == NULL || buff == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    for(int n = 0; n < N_new; n++) {
+        double* point = Y_new + n * D;
+        for(int d = 0; d < D; d++) pos_f[d] = .0;
+        for(int d = 0; d < D; d++) neg_f[d] = .0;
+
+        // Attractive forces towards the reference neighbors
+        for(unsigned int i = row_P[n]; i < row_P[n + 1]; i++) {
+            double Q = 1.0;
+            for(int d = 0; d < D; d++) buff[d] = point[d] - Y[col_P[i] * D + d];
+            for(int d = 0; d < D; d++) Q += buff[d] * buff[d];
+            Q = val_P[i] / Q;
+            for(int d = 0; d < D; d++) pos_f[d] += Q * buff[d];
+        }
+
+        // Repulsive forces from the complete reference map
+        double sum_Q = .0;
+        tree->computeNonEdgeForces(point, theta, neg_f, &sum_Q);
+        for(int d = 0; d < D; d++) dC[n * D + d] = pos_f[d] - (neg_f[d] / sum_Q);
+    }
+    free(pos_f);
+    free(neg_f);
+    free(buff);
+}
+
 // Compute gradient of the t-SNE cost function (exact)
 void TSNE::computeExactGradient(double* P, double* Y, int N, int D, double* dC) {
 
@@ -411,6 +548,62 @@ void TSNE::computeGaussianPerplexity(double* X, int N, int D, double* P, double
 }
 
 
+// Binary search for the precision of the Gaussian kernel that gives the desired perplexity over
+// the distances to the K nearest neighbors, the row-normalized kernel values are stored in cur_P
+static void computeGaussianRow(const double* distances, int K, double perplexity, double* cur_P) {
+
+    // Initialize some variables for binary search
+    bool found = false;
+    double beta = 1.0;
+    double min_beta = -DBL_MAX;
+    double max_beta =  DBL_MAX;
+    double tol = 1e-5;
+
+    // Iterate until we found a good perplexity
+    int iter = 0; double sum_P;
+    while(!found && iter < 200) {
+
+        // Compute Gaussian kernel row
+        for(int m = 0; m < K; m++) cur_P[m] = exp(-beta * distances[m] * distances[m]);
+
+        // Compute entropy of current row
+        sum_P = DBL_MIN;
+        for(int m = 0; m < K; m++) sum_P += cur_P[m];
+        double H = .0;
+        for(int m = 0; m < K; m++) H += beta * (distances[m] * distances[m] * cur_P[m]);
+        H = (H / sum_P) + log(sum_P);
+
+        // Evaluate whether the entropy is within the tolerance level
+        double Hdiff = H - log(perplexity);
+        if(Hdiff < tol && -Hdiff < tol) {
+            found = true;
+        }
+        else {
+            if(Hdiff > 0) {
+                min_beta = beta;
+                if(max_beta == DBL_MAX || max_beta == -DBL_MAX)
+                    beta *= 2.0;
+                else
+                    beta = (beta + max_beta) / 2.0;
+            }
+            else {
+                max_beta = beta;
+                if(min_beta == -DBL_MAX || min_beta == DBL_MAX)
+                    beta /= 2.0;
+                else
+                    beta = (beta + min_beta) / 2.0;
+            }
+        }
+
+        // Update iteration counter
+        iter++;
+    }
+
+    // Row-normalize current row of P
+    for(int m = 0; m < K; m++) cur_P[m] /= sum_P;
+}
+
+
 // Compute input similarities with a fixed perplexity using ball trees (this function allocates memory another function should free)
 void TSNE::computeGaussianPerplexity(double* X, int N, int D, unsigned int** _row_P, unsigned int** _col_P, double** _val_P, double perplexity, int K) {
 
@@ -448,57 +641,63 @@ void TSNE::computeGaussianPerplexity(double* X, int N, int D, unsigned int** _ro
         distances.clear();
         tree->search(obj_X[n], K + 1, &indices, &distances);
 
-        // Initialize some variables for binary search
-        bool found = false;
-        double beta = 1.0;
-        double min_beta = -DBL_MAX;
-        double max_beta =  DBL_MAX;
-        double tol = 1e-5;
-
-        // Iterate until we found a good perplexity
-        int iter = 0; double sum_P;
-        while(!found && iter < 200) {
-
-            // Compute Gaussian kernel row
-            for(int m = 0; m < K; m++) cur_P[m] = exp(-beta * distances[m + 1] * distances[m + 1]);
-
-            // Compute entropy of current row
-            sum_P = DBL_MIN;
-            for(int m = 0; m < K; m++) sum_P += cur_P[m];
-            double H = .0;
-            for(int m = 0; m < K; m++) H += beta * (distances[m + 1] * distances[m + 1] * cur_P[m]);
-            H = (H / sum_P) + log(sum_P);
-
-            // Evaluate whether the entropy is within the tolerance level
-            double Hdiff = H - log(perplexity);
-            if(Hdiff < tol && -Hdiff < tol) {
-                found = true;
-            }
-            else {
-                if(Hdiff > 0) {
-                    min_beta = beta;
-                    if(max_beta == DBL_MAX || max_beta == -DBL_MAX)
-                        beta *= 2.0;
-                    else
-                        beta = (beta + max_beta) / 2.0;
-                }
-                else {
-                    max_beta = beta;
-                    if(min_beta == -DBL_MAX || min_beta == DBL_MAX)
-                        beta /= 2.0;
-                    else
-                        beta = (beta + min_beta) / 2.0;
-                }
-            }
-
-            // Update iteration counter
-            iter++;
+        // Compute the normalized Gaussian kernel row (the nearest neighbor is the point itself)
+        computeGaussianRow(&distances[1], K, perplexity, cur_P);
+        for(int m = 0; m < K; m++) {
+            col_P[row_P[n] + m] = (unsigned int) indices[m + 1].index();
+            val_P[row_P[n] + m] = cur_P[m];
         }
+    }
 
-        // Row-normalize current row of P and store in matrix
-        for(unsigned int m = 0; m < K; m++) cur_P[m] /= sum_P;
-        for(unsigned int m = 0; m < K; m++) {
-            col_P[row_P[n] + m] = (unsigned int) indices[m + 1].index();
+    // Clean up memory
+    obj_X.clear();
+    free(cur_P);
+    delete tree;
+}
+
+
+// Compute conditional input similarities of new points to a reference set with a fixed perplexity using ball trees
+// (this function allocates memory another function should free)
+void TSNE::computeGaussianPerplexity(double* X, int N, int D, double* X_new, int N_new, unsigned int** _row_P, unsigned int** _col_P, double** _val_P, double perplexity, int K) {
+
+    if(perplexity > K) printf("Perplexity should be lower than K!\n");
+
+    // Allocate the memory we need
+    *_row_P = (unsigned int*)    malloc((N_new + 1) * sizeof(unsigned int));
+    *_col_P = (unsigned int*)    calloc(N_new * K, sizeof(unsigned int));
+    *_val_P = (double*) calloc(N_new * K, sizeof(double));
+    if(*_row_P == NULL || *_col_P == NULL || *_val_P == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    unsigned int* row_P = *_row_P;
+    unsigned int* col_P = *_col_P;
+    double* val_P = *_val_P;
+    double* cur_P = (double*) malloc(K * sizeof(double));
+    if(cur_P == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    row_P[0] = 0;
+    for(int n = 0; n < N_new; n++) row_P[n + 1] = row_P[n] + (unsigned int) K;
+
+    // Build ball tree on the reference set
+    VpTree<DataPoint, euclidean_distance>* tree = new VpTree<DataPoint, euclidean_distance>();
+    vector<DataPoint> obj_X(N, DataPoint(D, -1, X));
+    for(int n = 0; n < N; n++) obj_X[n] = DataPoint(D, n, X + n * D);
+    tree->create(obj_X);
+
+    // Loop over all new points to find their nearest reference neighbors (a new point is not its own neighbor)
+    printf("Building tree...\n");
+    vector<DataPoint> indices;
+    vector<double> distances;
+    for(int n = 0; n < N_new; n++) {
+
+        if(n % 10000 == 0) printf(" - point %d of %d\n", n, N_new);
+
+        // Find nearest neighbors
+        indices.clear();
+        distances.clear();
+        tree->search(DataPoint(D, -1, X_new + n * D), K, &indices, &distances);
+
+        // Compute the normalized Gaussian kernel row
+        computeGaussianRow(&distances[0], K, perplexity, cur_P);
+        for(int m = 0; m < K; m++) {
+            col_P[row_P[n] + m] = (unsigned int) indices[m].index();
             val_P[row_P[n] + m] = cur_P[m];
         }
     }
@@ -685,6 +884,41 @@ bool TSNE::load_data(double** data, int* n, int* d, int* no_dims, double* theta,
 	return true;
 }
 
+// Function that loads the data of an out-of-sample embedding: the header and the reference data are the same as in
+// load_data, followed by the reference map (n x no_dims), the number of new points and the new points (n_new x d)
+bool TSNE::load_transform_data(double** data, int* n, int* d, double** map, int* no_dims, double** data_new, int* n_new,
+                               double* theta, double* perplexity, int* max_iter) {
+
+	// Open file, read the header, allocate memory, and read the data
+    FILE *h;
+	if((h = fopen("data.dat", "r+b")) == NULL) {
+		printf("Error: could not open data file.\n");
+		return false;
+	}
+	fread(n, sizeof(int), 1, h);											// number of reference points
+	fread(d, sizeof(int), 1, h);											// original dimensionality
+    fread(theta, sizeof(double), 1, h);										// gradient accuracy
+	fread(perplexity, sizeof(double), 1, h);								// perplexity
+	fread(no_dims, sizeof(int), 1, h);                                      // output dimensionality
+    fread(max_iter, sizeof(int),1,h);                                       // maximum number of iterations
+	*data = (double*) malloc(*d * *n * sizeof(double));
+	*map = (double*) malloc(*no_dims * *n * sizeof(double));
+    if(*data == NULL || *map == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    fread(*data, sizeof(double), *n * *d, h);                               // the reference data
+    fread(*map, sizeof(double), *n * *no_dims, h);                          // the reference map
+    if(fread(n_new, sizeof(int), 1, h) != 1) {                              // number of new points
+        printf("Error: the data file does not contain new points.\n");
+        fclose(h); free(*data); free(*map);
+        return false;
+    }
+	*data_new = (double*) malloc(*d * *n_new * sizeof(double));
+    if(*data_new == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+    fread(*data_new, sizeof(double), *n_new * *d, h);                       // the new points
+	fclose(h);
+	printf("Read the %i x %i reference data and %i new points successfully!\n", *n, *d, *n_new);
+	return true;
+}
+
 // Function that saves map to a t-SNE file
 void TSNE::save_data(double* data, int* landmarks, double* costs, int n, int d) {
 
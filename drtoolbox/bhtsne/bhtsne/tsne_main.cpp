@@ -6,8 +6,37 @@
 #include <ctime>
 #include "tsne.h"
 
-// Function that runs the Barnes-Hut implementation of t-SNE
-int main() {
+// Embeds the new points of the data file into an existing map (bh_tsne transform)
+static void transform_main(TSNE* tsne) {
+
+    // Read the parameters, the reference data and map, and the new points
+    int N, D, no_dims, max_iter, N_new;
+    double perplexity, theta, *data, *map, *data_new;
+    if(tsne->load_transform_data(&data, &N, &D, &map, &no_dims, &data_new, &N_new, &theta, &perplexity, &max_iter)) {
+
+        // Make dummy landmarks
+        int* landmarks = (int*) malloc(N_new * sizeof(int));
+        if(landmarks == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+        for(int n = 0; n < N_new; n++) landmarks[n] = n;
+
+        // Optimize the coordinates of the new points only
+        double* Y_new = (double*) malloc(N_new * no_dims * sizeof(double));
+        double* costs = (double*) calloc(N_new, sizeof(double));
+        if(Y_new == NULL || costs == NULL) { printf("Memory allocation failed!\n"); exit(1); }
+        tsne->transform(data, N, D, map, data_new, N_new, Y_new, no_dims, perplexity, theta, false, max_iter);
+
+        // Save the results (the map of the new points)
+        tsne->save_data(Y_new, landmarks, costs, N_new, no_dims);
+
+        // Clean up the memory
+        free(data); free(map); free(data_new);
+        free(Y_new); free(costs); free(landmarks);
+    }
+}
+
+// Function that runs the Barnes-Hut implementation of t-SNE (or embeds new points into an existing map if the first
+// argument is "transform")
+int main(int argc, char** argv) {
 
     // Define some variables
 	int origN, N, D, no_dims, max_iter, *landmarks;
@@ -15,6 +44,11 @@ int main() {
 	double perplexity, theta, *data;
     int rand_seed = -1;
     TSNE* tsne = new TSNE();
+    if(argc > 1 && strcmp(argv[1], "transform") == 0) {
+        transform_main(tsne);
+        delete(tsne);
+        return 0;
+    }
 
     // Read the parameters and the dataset
 	if(tsne->load_data(&data, &origN, &D, &no_dims, &theta, &perplexity, &rand_seed, &max_iter)) {
@@ -23,22 +23,68 @@ function mexall
     catch
         warning('Compiling failed. FastMVU might not work properly.');
     end
+    if ispc
+        optsOmpC = {'-DUSEOMP', 'OPTIMFLAGS="$OPTIMFLAGS', '/openmp"'};
+    else
+        optsOmpC = {'-DUSEOMP', 'CFLAGS="\$CFLAGS', '-fopenmp"', 'LDFLAGS="\$LDFLAGS', '-fopenmp"'};
+    end
     try 
-        mex -O mexCCACollectData2.c
+        try
+            mex('-O', optsOmpC{:}, 'mexCCACollectData2.c');
+        catch
+            warning('Compiling with OpenMP failed. FastMVU will only use a single thread.');
+            mex -O mexCCACollectData2.c
+        end
     catch
         warning('Compiling failed. FastMVU might not work properly.');
     end
     try 
-        mex -O mexCCACollectData.c
+        try
+            mex('-O', optsOmpC{:}, 'mexCCACollectData.c');
+        catch
+            warning('Compiling with OpenMP failed. CCA will only use a single thread.');
+            mex -O mexCCACollectData.c
+        end
     catch
         warning('Compiling failed. CCA might not work properly.');
     end
+    try
+        try
+            mex('-O', optsOmpC{:}, 'find_nn.c', '-output', 'find_nn_mex');
+        catch
+            warning('Compiling with OpenMP failed. Nearest neighbor search will only use a single thread.');
+            mex -O find_nn.c -output find_nn_mex
+        end
+    catch
+        warning('Compiling failed. Nearest neighbor search will use the slower Matlab implementation.');
+    end
+    try
+        try
+            mex('-O', optsOmpC{:}, 'kernel_function.c');
+        catch
+            warning('Compiling with OpenMP failed. Kernel PCA will only use a single thread.');
+            mex -O kernel_function.c
+        end
+    catch
+        warning('Compiling failed. Kernel PCA will use the slower Matlab implementation.');
+    end
     try
         if any(strcmpi(computer, {'MACI64', 'PCWIN64', 'GLNXA64', 'SOL64'}))
-            mex -O -largeArrayDims dijkstra.cpp
+            opts = {'-O', '-largeArrayDims'};
+        else
+            opts = {'-O'};
+        end
+        if ispc
+            optsOmp = {'-DUSEOMP', 'OPTIMFLAGS="$OPTIMFLAGS', '/openmp"'};
         else
-            mex -O dijkstra.cpp
-        end            
+            optsOmp = {'-DUSEOMP', 'CXXFLAGS="\$CXXFLAGS', '-fopenmp"', 'LDFLAGS="\$LDFLAGS', '-fopenmp"'};
+        end
+        try
+            mex(opts{:}, optsOmp{:}, 'dijkstra.cpp');
+        catch
+            warning('Compiling with OpenMP failed. Isomap will only use a single thread.');
+            mex(opts{:}, 'dijkstra.cpp');
+        end
     catch
         warning('Compiling failed. Isomap and LandmarkIsomap might not work properly.');
         if ispc
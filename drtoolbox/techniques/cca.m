@@ -23,6 +23,11 @@ function [Z, ccaEigen, ccaDetails] = cca(X, Y, EDGES, OPTS)
 %
 %   OPTS:
 %     OPTS.method: 'CCA' 
+%     OPTS.blocksize: if set, the data needed for the SDP is collected in
+%     blocks of this many data points, so that only the columns of X needed
+%     for one block are accessed at a time (X may then be any object that
+%     supports size() and X(:, idx)). The result is identical to the
+%     in-memory collection.
 %
 % Outputs:
 %   Z: low dimensional embedding (d X N)
@@ -75,7 +80,11 @@ function [Z, ccaEigen, ccaDetails] = cca(X, Y, EDGES, OPTS)
 
     irow = int32(erow); icol = int32(ecol);
     ividx = int32(vidx); ivalue = int32(evalue);
-    [A,B, g] = mexCCACollectData(X,Y, irow, icol, int32(OPTS.relative), ivalue, ividx );
+    if OPTS.blocksize > 0
+        [A,B, g] = collectDataChunked(X,Y, irow, icol, int32(OPTS.relative), ivalue, ividx, OPTS.blocksize);
+    else
+        [A,B, g] = mexCCACollectData(X,Y, irow, icol, int32(OPTS.relative), ivalue, ividx );
+    end
     clear erow ecol irow icol tnn ividx ivalue evalue vidx;
     lst = find(g~=0);
     g = g(lst); B = B(:, lst);
@@ -323,6 +332,38 @@ function [A, b, c] = sdpToSeDuMi(F0, FI, cc)
         if isfield(OPTS, 'regularizer')==0
             OPTS.regularizer = 0;
         end
+
+        if isfield(OPTS, 'blocksize')==0
+            OPTS.blocksize = 0;
+        end
+    return
+
+
+    % Collect the data for the SDP formulation block by block
+    function [A, B, g] = collectDataChunked(X, Y, irow, icol, relative, nv, vidx, blocksize)
+        [d, N] = size(Y);
+        Ap = zeros(d^2*(d^2+1)/2, 1);
+        B = zeros(d^2, N);
+        g = zeros(N, 1);
+        vstart = [0; cumsum(double(nv(:)))];
+        for first=1:blocksize:N
+            last = min(first+blocksize-1, N);
+
+            % edges and vertex entries of the points first..last
+            e = double(icol(first))+1:double(icol(last+1));
+            v = vstart(double(icol(first))+1)+1:vstart(double(icol(last+1))+1);
+
+            % the points of the block come first, followed by their neighbors
+            nbr = double(irow(e(:)))+1;
+            pts = [first:last setdiff(nbr, first:last)'];
+            [dummy, loc] = ismember(nbr, pts);
+
+            % only the columns of B and g of the vertices of the block are passed
+            [u, dummy, iv] = unique(double(vidx(v)));
+            [Ap, B(:, u), g(u)] = mexCCACollectData(Ap, B(:, u), g(u), double(X(:, pts)), Y(:, pts), ...
+                      int32(loc-1), int32(icol(first:last+1)-icol(first)), relative, nv(e), int32(iv));
+        end
+        A = mexCCACollectData(Ap);
     return
 
 
@@ -1,5 +1,295 @@
+/*
+ * find_nn.c
+ *
+ * [D, ni] = find_nn_mex(X, k)
+ *
+ * Finds the k nearest neighbors of all datapoints in the NxD dataset X
+ * (rows are observations) and returns the same outputs as the MATLAB
+ * implementation in find_nn.m: the symmetric sparse NxN distance matrix D
+ * (distances of exactly zero are set to 1e-9) and the Nxk matrix ni with
+ * the neighbor indices, sorted by increasing distance.
+ *
+ * Low-dimensional data is searched with a kd-tree. For higher dimensions,
+ * where space partitioning no longer prunes, a blocked brute-force search
+ * is used that computes tiles of squared distances through the norm
+ * expansion |x|^2 + |y|^2 - 2<x,y>, with inner loops over contiguous
+ * memory so that the compiler vectorizes them. In both cases the query
+ * points are processed in parallel when compiled with OpenMP:
+ *
+ *   mex -O -DUSEOMP CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" find_nn.c -output find_nn_mex
+ *
+ * find_nn.m calls find_nn_mex automatically if it has been compiled.
+ */
+
 #include "mex.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+#define KD_MAX_DIM   16         /* use the kd-tree up to this dimensionality */
+#define KD_LEAF_SIZE 16         /* maximum number of points in a kd-tree leaf */
+#define BF_QUERIES   32         /* queries per block in the brute-force search */
+#define BF_REFS      128        /* reference points per tile in the brute-force search */
+#define BF_KQ        4          /* queries per register block in the brute-force search */
+#define BF_LANES     8          /* reference points per register block in the brute-force search */
+
+/* Bounded max-heap holding the k best (distance, index) pairs of one query */
+typedef struct {
+    double *d;
+    int    *ind;
+    int     size, k;
+} knn_heap;
+
+/* Pairs are ordered by distance and then by index, as MATLAB's sort would do */
+static int pair_less(double d1, int i1, double d2, int i2) {
+    return d1 < d2 || (d1 == d2 && i1 < i2);
+}
+
+static void heap_push(knn_heap *h, double d, int ind) {
+    int c, p;
+    if (h->size < h->k) c = h->size++;
+    else if (pair_less(d, ind, h->d[0], h->ind[0])) {
+        /* replace root and sift down */
+        c = 0;
+        for (;;) {
+            int l = 2 * c + 1, r = l + 1, m = c;
+            double md = d; int mi = ind;
+            if (l < h->k && pair_less(md, mi, h->d[l], h->ind[l])) { m = l; md = h->d[l]; mi = h->ind[l]; }
+            if (r < h->k && pair_less(md, mi, h->d[r], h->ind[r])) { m = r; }
+            if (m == c) break;
+            h->d[c] = h->d[m]; h->ind[c] = h->ind[m];
+            c = m;
+        }
+        h->d[c] = d; h->ind[c] = ind;
+        return;
+    }
+    else return;
+    /* sift up newly appended element */
+    while (c > 0) {
+        p = (c - 1) / 2;
+        if (!pair_less(h->d[p], h->ind[p], d, ind)) break;
+        h->d[c] = h->d[p]; h->ind[c] = h->ind[p];
+        c = p;
+    }
+    h->d[c] = d; h->ind[c] = ind;
+}
+
+/* Largest distance that can still enter the heap */
+static double heap_bound(const knn_heap *h) {
+    return (h->size < h->k) ? HUGE_VAL : h->d[0];
+}
+
+/* Sorts the heap contents in increasing order (heap is destroyed) */
+static void heap_sort(knn_heap *h) {
+    int n = h->size, c;
+    while (h->size > 1) {
+        double d = h->d[h->size - 1]; int ind = h->ind[h->size - 1];
+        h->d[h->size - 1] = h->d[0]; h->ind[h->size - 1] = h->ind[0];
+        h->size--;
+        c = 0;
+        for (;;) {
+            int l = 2 * c + 1, r = l + 1, m = c;
+            double md = d; int mi = ind;
+            if (l < h->size && pair_less(md, mi, h->d[l], h->ind[l])) { m = l; md = h->d[l]; mi = h->ind[l]; }
+            if (r < h->size && pair_less(md, mi, h->d[r], h->ind[r])) { m = r; }
+            if (m == c) break;
+            h->d[c] = h->d[m]; h->ind[c] = h->ind[m];
+            c = m;
+        }
+        h->d[c] = d; h->ind[c] = ind;
+    }
+    h->size = n;
+}
+
+/* kd-tree over a row-major copy of the data */
+typedef struct {
+    int    dim;                 /* split dimension, or -1 for a leaf */
+    double split;               /* split value */
+    int    left, right;         /* children (inner nodes) */
+    int    start, end;          /* range in the permutation (leaves) */
+} kd_node;
+
+typedef struct {
+    const double *x;            /* n x d, row-major */
+    int     d;
+    int    *perm;               /* point indices, leaves own contiguous ranges */
+    kd_node *nodes;
+    int     n_nodes;
+} kd_tree;
+
+/* Partially sorts perm[lo..hi) so that the m-th element is in place with respect to dimension dim */
+static void kd_select(const double *x, int d, int *perm, int lo, int hi, int m, int dim) {
+    while (hi - lo > 1) {
+        int i = lo, j = hi - 1, t;
+        double pivot = x[perm[(lo + hi) / 2] * d + dim];
+        while (i <= j) {
+            while (x[perm[i] * d + dim] < pivot) i++;
+            while (x[perm[j] * d + dim] > pivot) j--;
+            if (i <= j) { t = perm[i]; perm[i] = perm[j]; perm[j] = t; i++; j--; }
+        }
+        if (m <= j) hi = j + 1;
+        else if (m >= i) lo = i;
+        else break;
+    }
+}
+
+static int kd_build(kd_tree *t, int start, int end) {
+    int node = t->n_nodes++, l, dim = 0, mid;
+    double spread = -1.0;
+    kd_node *nd = &t->nodes[node];
+    nd->start = start; nd->end = end;
+    if (end - start <= KD_LEAF_SIZE) { nd->dim = -1; return node; }
+
+    /* split along the dimension with the largest spread */
+    for (l = 0; l < t->d; l++) {
+        double lo = HUGE_VAL, hi = -HUGE_VAL; int i;
+        for (i = start; i < end; i++) {
+            double v = t->x[t->perm[i] * t->d + l];
+            if (v < lo) lo = v;
+            if (v > hi) hi = v;
+        }
+        if (hi - lo > spread) { spread = hi - lo; dim = l; }
+    }
+    if (spread <= 0) { nd->dim = -1; return node; }
+    mid = (start + end) / 2;
+    kd_select(t->x, t->d, t->perm, start, end, mid, dim);
+    nd->dim = dim;
+    nd->split = t->x[t->perm[mid] * t->d + dim];
+    l = kd_build(t, start, mid);
+    t->nodes[node].left  = l;
+    l = kd_build(t, mid, end);
+    t->nodes[node].right = l;
+    return node;
+}
+
+static void kd_search(const kd_tree *t, int node, const double *q, int self, knn_heap *h) {
+    const kd_node *nd = &t->nodes[node];
+    if (nd->dim < 0) {
+        int i, l;
+        for (i = nd->start; i < nd->end; i++) {
+            int j = t->perm[i];
+            const double *y = t->x + (size_t) j * t->d;
+            double dist = 0;
+            if (j == self) continue;
+            for (l = 0; l < t->d; l++) dist += (q[l] - y[l]) * (q[l] - y[l]);
+            if (dist <= heap_bound(h)) heap_push(h, dist, j);
+        }
+    }
+    else {
+        double diff = q[nd->dim] - nd->split;
+        int near = (diff < 0) ? nd->left : nd->right;
+        int far  = (diff < 0) ? nd->right : nd->left;
+        kd_search(t, near, q, self, h);
+        if (diff * diff <= heap_bound(h)) kd_search(t, far, q, self, h);
+    }
+}
+
+/* Computes the k nearest neighbors of all points; X is n x d in column-major (MATLAB) order */
+static void find_nn(const double *X, int n, int d, int k, int *nn_ind, double *nn_d, int nThreads) {
+    int i;
+    if (d <= KD_MAX_DIM) {
+
+        /* Build kd-tree on row-major copy of the data */
+        kd_tree t;
+        double *xr = malloc((size_t) n * d * sizeof(double));
+        int l;
+        t.perm  = malloc(n * sizeof(int));
+        t.nodes = malloc((4 * (n / KD_LEAF_SIZE) + 4) * sizeof(kd_node));
+        if (xr == NULL || t.perm == NULL || t.nodes == NULL) mexErrMsgTxt("Memory allocation failed.");
+        for (i = 0; i < n; i++) for (l = 0; l < d; l++) xr[(size_t) i * d + l] = X[(size_t) l * n + i];
+        for (i = 0; i < n; i++) t.perm[i] = i;
+        t.x = xr; t.d = d; t.n_nodes = 0;
+        kd_build(&t, 0, n);
+
+        /* Query all points */
+        #ifdef USEOMP
+        #pragma omp parallel for num_threads(nThreads) schedule(dynamic, 256)
+        #endif
+        for (i = 0; i < n; i++) {
+            knn_heap h;
+            h.d = nn_d + (size_t) i * k; h.ind = nn_ind + (size_t) i * k; h.size = 0; h.k = k;
+            kd_search(&t, 0, xr + (size_t) i * d, i, &h);
+            heap_sort(&h);
+        }
+        free(xr); free(t.perm); free(t.nodes);
+    }
+    else {
+
+        /* Blocked brute-force search */
+        double *sq = malloc(n * sizeof(double));
+        int nb = (n + BF_QUERIES - 1) / BF_QUERIES, b;
+        if (sq == NULL) mexErrMsgTxt("Memory allocation failed.");
+        for (i = 0; i < n; i++) sq[i] = 0;
+        for (i = 0; i < d; i++) {
+            const double *col = X + (size_t) i * n; int j;
+            for (j = 0; j < n; j++) sq[j] += col[j] * col[j];
+        }
+
+        #ifdef USEOMP
+        #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+        #endif
+        for (b = 0; b < nb; b++) {
+            double dots[BF_QUERIES][BF_REFS], *qbuf;
+            knn_heap h[BF_QUERIES];
+            int q0 = b * BF_QUERIES, nq = (q0 + BF_QUERIES <= n) ? BF_QUERIES : n - q0, r0, a, l;
+
+            /* Interleave the query block (d x BF_QUERIES, zero padded) */
+            qbuf = calloc((size_t) d * BF_QUERIES, sizeof(double));
+            for (l = 0; l < d; l++) for (a = 0; a < nq; a++) qbuf[l * BF_QUERIES + a] = X[(size_t) l * n + q0 + a];
+            for (a = 0; a < nq; a++) {
+                h[a].d = nn_d + (size_t) (q0 + a) * k; h[a].ind = nn_ind + (size_t) (q0 + a) * k;
+                h[a].size = 0; h[a].k = k;
+            }
+            for (r0 = 0; r0 < n; r0 += BF_REFS) {
+                int nr = (r0 + BF_REFS <= n) ? BF_REFS : n - r0, j, j0, jj, a0;
+
+                /* Inner products of the query block with the reference tile; the tile
+                 * is reused from cache by all queries of the block, and every register
+                 * block of BF_KQ queries times BF_LANES reference points accumulates
+                 * over all dimensions before it is stored */
+                for (j0 = 0; j0 < nr; j0 += BF_LANES) {
+                    int nl = (j0 + BF_LANES <= nr) ? BF_LANES : nr - j0;
+                    for (a0 = 0; a0 < nq; a0 += BF_KQ) {
+                        double acc[BF_KQ][BF_LANES];
+                        for (a = 0; a < BF_KQ; a++) for (jj = 0; jj < BF_LANES; jj++) acc[a][jj] = 0;
+                        if (nl == BF_LANES) {
+                            for (l = 0; l < d; l++) {
+                                const double *ref = X + (size_t) l * n + r0 + j0, *ql = qbuf + l * BF_QUERIES + a0;
+                                for (a = 0; a < BF_KQ; a++) for (jj = 0; jj < BF_LANES; jj++) acc[a][jj] += ql[a] * ref[jj];
+                            }
+                        }
+                        else {
+                            for (l = 0; l < d; l++) {
+                                const double *ref = X + (size_t) l * n + r0 + j0, *ql = qbuf + l * BF_QUERIES + a0;
+                                for (a = 0; a < BF_KQ; a++) for (jj = 0; jj < nl; jj++) acc[a][jj] += ql[a] * ref[jj];
+                            }
+                        }
+                        for (a = 0; a < BF_KQ; a++) for (jj = 0; jj < nl; jj++) dots[a0 + a][j0 + jj] = acc[a][jj];
+                    }
+                }
+
+                /* Push candidates into the heaps */
+                for (a = 0; a < nq; a++) {
+                    for (j = 0; j < nr; j++) {
+                        double dist;
+                        if (r0 + j == q0 + a) continue;
+                        dist = fabs(sq[q0 + a] + sq[r0 + j] - 2 * dots[a][j]);
+                        if (dist <= heap_bound(&h[a])) heap_push(&h[a], dist, r0 + j);
+                    }
+                }
+            }
+            for (a = 0; a < nq; a++) heap_sort(&h[a]);
+            free(qbuf);
+        }
+        free(sq);
+    }
+
+    /* Squared distances to distances */
+    for (i = 0; i < n * k; i++) nn_d[i] = sqrt(nn_d[i]);
+}
 
 
 void mexFunction(
@@ -7,105 +297,111 @@ void mexFunction(
         int nrhs, const mxArray *prhs[]
         )
 {
-  
+
     /* Declare variables. */
-    int *irs, *jcs, *k_ind, i, j, k, l, m, n, p, cc, ck, nzmax, min_ind, *ind;
-    double *d, *k_d, *pr, *sr, dist, tmp, min_d;
-    mxArray *rhs[1], *lhs[2];
+    int n, d, k, i, l, nThreads, *nn_ind, *row_cnt, *order, *col_cnt, *e_row, *e_col, ne, nnz;
+    double *X, *nn_d, *ni, *sr, *e_val;
+    mwIndex *irs, *jcs;
 
-    /* Check for proper number of input and output arguments. */    
+    /* Check for proper number of input and output arguments. */
     if (nrhs < 1) {
         mexErrMsgTxt("At least one input argument required.");
-    } 
+    }
     if (nrhs > 2) {
         mexErrMsgTxt("No more than two input arguments allowed.");
-    } 
-    if (nlhs > 1) {
+    }
+    if (nlhs > 2) {
         mexErrMsgTxt("Too many output arguments.");
-    }  
-    if (!(mxIsDouble(prhs[0]))) {
-        mexErrMsgTxt("Input argument must be of type double.");
-    } 
+    }
+    if (!mxIsDouble(prhs[0]) || mxIsSparse(prhs[0]) || mxIsComplex(prhs[0])) {
+        mexErrMsgTxt("Input argument must be a full real matrix of type double.");
+    }
 
     /* Get all input data. */
-    m  = mxGetM(prhs[0]);                       // height
-    n  = mxGetN(prhs[0]);                       // width
-    pr = mxGetPr(prhs[0]);                      // pointer to data array (double)
-    if (nrhs > 1) {
-        k = (int)mxGetScalar(prhs[1]);          // number of neighbors
+    n = (int) mxGetM(prhs[0]);                  // number of datapoints
+    d = (int) mxGetN(prhs[0]);                  // dimensionality
+    X = mxGetPr(prhs[0]);
+    k = (nrhs > 1) ? (int) mxGetScalar(prhs[1]) : 12;
+    if (k < 1 || k >= n) {
+        mexErrMsgTxt("Number of neighbors should be between 1 and the number of datapoints minus one.");
     }
-    else {
-        k = 12;                                 // number of neighbors
-    }
-
-    /* Allocate space for sparse matrix (don't allow complex values). */
-    nzmax = m * k;
-    plhs[0] = mxCreateSparse(m, n, nzmax, 0);
-    sr  = mxGetPr(plhs[0]);                     // pointer to sparse values
-    irs = mxGetIr(plhs[0]);                     // pointer to sparse row indices
-    jcs = mxGetJc(plhs[0]);                     // pointer to sparse column indices
-    cc = 0;                                     // current row position in sparse matrix
-    ck = 0;                                     // current column position in sparse matrix
-
-    /* Allocate space for matrix containing the distances between one datapoint and all other datapoints. */
-    d     = malloc(m * sizeof(double));         // stores distances with n datapoints
-    k_d   = malloc(k * sizeof(double));         // stores distance values to k nearest neighbors
-    k_ind = malloc(k * sizeof(int));            // stores indices of k nearest neighbors
-    for (i = 0; i < m; i++) {
-        for (j = 0; j < m; j++) {
-            /* Compute Euclidean distance between datapoint i and j. */
-            dist = 0;
-            for (l = 0; l < n; l++) {
-                tmp = pr[i * n + l] - pr[j * n + l];
-                dist += (tmp * tmp);
-            }
-            d[j] = sqrt(dist);
-        }
-            
-        /* Find the k nearest neighbors. */
-/*        for (l = 0; l < k; l++) {
-            min_ind = 0;
-            min_d = 0xffffff;
-            for (p = 0; p < m; p++) {
-                if(d[p] < min_d) {
-                    min_d   = d[p];
-                    min_ind = p;
-                }
-            }
-            k_d[l]     = min_d;
-            k_ind[l]   = min_ind;
-            d[min_ind] = 0xffffff;
-        }     */
-        
-        /* Find the k nearest neighbors */
-        rhs[0] = (mxArray*)d;
-        mexCallMATLAB(2, lhs, 1, rhs, 'sort');
-        d   = lhs[0];
-        ind = lhs[1];
+    #ifdef USEOMP
+    nThreads = omp_get_max_threads();
+    #else
+    nThreads = 1;
+    #endif
+
+    /* Find the k nearest neighbors of every datapoint. */
+    nn_ind = malloc((size_t) n * k * sizeof(int));
+    nn_d   = malloc((size_t) n * k * sizeof(double));
+    if (nn_ind == NULL || nn_d == NULL) mexErrMsgTxt("Memory allocation failed.");
+    find_nn(X, n, d, k, nn_ind, nn_d, nThreads);
+    for (i = 0; i < n * k; i++) if (nn_d[i] == 0) nn_d[i] = 1e-9;
+
+    /* Neighbor indices (ni) */
+    plhs[1] = mxCreateDoubleMatrix(n, k, mxREAL);
+    ni = mxGetPr(plhs[1]);
+    for (i = 0; i < n; i++) for (l = 0; l < k; l++) ni[(size_t) l * n + i] = nn_ind[(size_t) i * k + l] + 1;
+
+    /* Symmetric sparse distance matrix: the union of the edges (i, ni(i,:))
+     * and (ni(i,:), i). The edges are bucketed by row first, so that
+     * scattering them into the columns leaves every column sorted by row. */
+    ne = 2 * n * k;
+    e_row = malloc(ne * sizeof(int)); e_col = malloc(ne * sizeof(int)); e_val = malloc(ne * sizeof(double));
+    row_cnt = calloc(n + 1, sizeof(int)); col_cnt = calloc(n + 1, sizeof(int)); order = malloc(ne * sizeof(int));
+    if (e_row == NULL || e_col == NULL || e_val == NULL || row_cnt == NULL || col_cnt == NULL || order == NULL) {
+        mexErrMsgTxt("Memory allocation failed.");
+    }
+    for (i = 0; i < n; i++) {
         for (l = 0; l < k; l++) {
-            k_d[l]   = d[l];
-            k_ind[l] = (int)ind[l];
+            int j = nn_ind[(size_t) i * k + l];
+            row_cnt[i + 1]++; row_cnt[j + 1]++;
         }
-               
-        /* Store the k nearest neighbors in the sparse dissimilarity matrix. */
+    }
+    for (i = 0; i < n; i++) row_cnt[i + 1] += row_cnt[i];
+    for (i = 0; i < n; i++) {
         for (l = 0; l < k; l++) {
-            if(cc < nzmax) {
-                sr[cc]  = k_d[l];           // store sparse value
-                irs[cc] = k_ind[l];         // store row index
-                cc++;
+            int j = nn_ind[(size_t) i * k + l], p;
+            double v = nn_d[(size_t) i * k + l];
+            p = row_cnt[i]++; e_row[p] = i; e_col[p] = j; e_val[p] = v;
+            p = row_cnt[j]++; e_row[p] = j; e_col[p] = i; e_val[p] = v;
+        }
+    }
+
+    /* Scatter into columns (order lists the edges of every column) */
+    for (i = 0; i < ne; i++) col_cnt[e_col[i] + 1]++;
+    for (i = 0; i < n; i++) col_cnt[i + 1] += col_cnt[i];
+    for (i = 0; i < ne; i++) order[col_cnt[e_col[i]]++] = i;
+    for (i = n; i > 0; i--) col_cnt[i] = col_cnt[i - 1];
+    col_cnt[0] = 0;
+
+    /* Count unique entries, then fill the sparse matrix */
+    nnz = 0;
+    for (i = 0; i < n; i++) {
+        int p, last = -1;
+        for (p = col_cnt[i]; p < col_cnt[i + 1]; p++) {
+            if (e_row[order[p]] != last) { nnz++; last = e_row[order[p]]; }
+        }
+    }
+    plhs[0] = mxCreateSparse(n, n, nnz, mxREAL);
+    sr  = mxGetPr(plhs[0]);
+    irs = mxGetIr(plhs[0]);
+    jcs = mxGetJc(plhs[0]);
+    nnz = 0;
+    for (i = 0; i < n; i++) {
+        int p, last = -1;
+        jcs[i] = nnz;
+        for (p = col_cnt[i]; p < col_cnt[i + 1]; p++) {
+            int e = order[p];
+            if (e_row[e] != last) {
+                irs[nnz] = e_row[e]; sr[nnz] = e_val[e]; nnz++; last = e_row[e];
             }
         }
-        jcs[i] = ck;                        // store column index
-        ck += k;        
     }
-    jcs[m] = ck;
+    jcs[n] = nnz;
 
     /* Clean up memory. */
-    free(d);
-    free(k_d);
-    free(k_ind);
-
-    return;
+    free(nn_ind); free(nn_d);
+    free(e_row); free(e_col); free(e_val);
+    free(row_cnt); free(col_cnt); free(order);
 }
-      
-      
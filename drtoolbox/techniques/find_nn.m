@@ -10,6 +10,8 @@ function [D, ni] = find_nn(X, k)
 % only the distances to the k nearest neighbors are stored. For
 % equal datapoints, the distance is set to a tolerance value.
 % The method is relatively slow, but has a memory requirement of O(nk).
+% If the MEX-file find_nn_mex has been compiled (see mexall), the
+% neighbors are found with a multi-threaded kd-tree or blocked search.
 %
 %
 
@@ -37,6 +39,10 @@ function [D, ni] = find_nn(X, k)
             ni(i,:) = tmp;
         end
     
+    % Perform normal neighborhood selection using the MEX-implementation
+    elseif exist('find_nn_mex', 'file') == 3
+        [D, ni] = find_nn_mex(full(double(X)), k);
+    
     % Perform normal neighborhood selection
     else
         
@@ -1,22 +1,64 @@
 #include "mex.h"
 #include "math.h"
 #include "string.h"
+#include "stdlib.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
+/*
+ * y = kernel_function(v, X, center, kernel, param1, param2, type, X2)
+ *
+ * X is a DxN matrix (one datapoint per column). Depending on type:
+ *   'Normal'      y = K * v (as row vector), used by EIGS in kernel PCA
+ *   'ColumnSums'  y = column sums of K
+ *   'Matrix'      y = K itself (NxN), or the NxM kernel matrix between X
+ *                 and the DxM points X2 if these are given (e.g., for the
+ *                 out-of-sample extension)
+ * If center is set, K is centered in feature space; for X2 the test
+ * centering K(i,j) - cs(i)/N - mean(K(:,j)) + sum(cs)/N^2 is used, where
+ * cs are the column sums of the kernel matrix of X.
+ *
+ * The kernel matrix is never formed row by row. It is computed in square
+ * tiles: the inner products of a tile come from a register-blocked matrix
+ * product, Gaussian distances follow from the norm expansion
+ * |x|^2 + |y|^2 - 2<x,y>, and the kernel function (selected once) and the
+ * centering are applied to the whole tile. Compiled with -DUSEOMP, tiles are
+ * processed in parallel.
+ */
+
+#define TILE 64                 /* tile size (in datapoints) */
+
+/* Parameters and function of the selected kernel */
+typedef struct {
+    double param1, param2;
+    double* nx;                 /* squared norms of the row points (Gaussian kernel) */
+    double* ny;                 /* squared norms of the column points (Gaussian kernel) */
+} kernelParams;
+
+typedef void (*kernelTransform)(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p);
 
-void computeKernelRow(double* X, int n, int d, int index, const char* function, int param1, int param2, double* row);
-void computeColumnSums(double* X, int n, int d, const char* function, int param1, int param2, double* column_sums, double *total_sum);
-void centerKernelRow(double* row, int index, int n, double* column_sums, double *total_sum);
+void computeGramTile(const double* X, const double* Y, int d, int i0, int ti, int j0, int tj, double* tile);
+void linearTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p);
+void polyTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p);
+void gaussTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p);
+void computeKernelTile(const double* X, const double* Y, int d, int i0, int ti, int j0, int tj, kernelTransform transform, const kernelParams* p, double* tile);
+void computeColumnSums(double* X, int n, int d, kernelTransform transform, const kernelParams* p, double* column_sums, double* total_sum);
+void computeKernelProduct(double* X, int n, int d, kernelTransform transform, const kernelParams* p, bool center, double* column_sums, double total_sum, double* v, double* res);
+void computeKernelMatrix(double* X, int n, double* Y, int m, int d, kernelTransform transform, const kernelParams* p, bool center, double* column_sums, double total_sum, double* K);
+double* computeSquaredNorms(const double* X, int n, int d);
 
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 
     // Initialize variables
-    int i, j, n, d;
-    double *v, *X, *column_sums, *total_sum, *row, *res;
+    int i, n, m, d;
+    double *v, *X, *X2 = NULL, *column_sums = NULL, total_sum = 0.0, *res;
     bool center;
-    char *function, *type;
-    double param1, param2;
-    
+    char function = 'k', type = 'N';
+    kernelParams params;
+    kernelTransform transform;
+
     // Check and process inputs
     if(nrhs < 2) {
         mexErrMsgTxt("Not enough inputs.");
@@ -38,10 +80,10 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     }
     else {
         if(mxIsClass(prhs[2], "logical")) {
-            center = *((bool*) mxGetPr(prhs[2]));
+            center = *((mxLogical*) mxGetData(prhs[2]));
         }
         else if(mxIsClass(prhs[2], "uint8")) {
-            if (*((char*) mxGetPr(prhs[2])) == 0) center = false;
+            if (*((unsigned char*) mxGetData(prhs[2])) == 0) center = false;
             else center = true;
         }
         else if(mxIsClass(prhs[2], "double")) {
@@ -52,202 +94,326 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
            mexErrMsgTxt("Third input should be of type logical, uint8, or double.");
         }
     }
-    if(nrhs < 4) {
-        function = "kernel";
-    }
-    else {
+    if(nrhs >= 4) {
         if(mxIsClass(prhs[3], "char")) {
-            function = (char*) mxGetPr(prhs[3]);
+            function = (char) *((mxChar*) mxGetData(prhs[3]));
         }
         else {
             mexErrMsgTxt("Fourth input should be of type char.");
         }
     }
     if(nrhs < 5) {
-        param1 = 1.0;
+        params.param1 = 1.0;
     }
     else {
         if(mxIsClass(prhs[4], "double")) {
-            param1 = *((double*) mxGetPr(prhs[4]));
+            params.param1 = *((double*) mxGetPr(prhs[4]));
         }
         else {
             mexErrMsgTxt("Fifth input should be of type double.");
         }
     }
     if(nrhs < 6) {
-        param2 = 3.0;
+        params.param2 = 3.0;
     }
     else {
         if(mxIsClass(prhs[5], "double")) {
-            param2 = *((double*) mxGetPr(prhs[5]));
+            params.param2 = *((double*) mxGetPr(prhs[5]));
         }
         else {
-            mexErrMsgTxt("Fifth input should be of type double.");
+            mexErrMsgTxt("Sixth input should be of type double.");
         }
     }
-    if(nrhs < 7) {
-        type = "Normal";
-    }
-    else {
+    if(nrhs >= 7) {
         if(mxIsClass(prhs[6], "char")) {
-            type = (char*) mxGetPr(prhs[6]);
+            type = (char) *((mxChar*) mxGetData(prhs[6]));
         }
         else {
-            mexErrMsgTxt("Sixth input should be of type char.");
+            mexErrMsgTxt("Seventh input should be of type char.");
         }
     }
-    if(mxGetN(prhs[1]) != mxGetM(prhs[0]) && mxGetM(prhs[0]) != 0) {
-        mexErrMsgTxt("Number of instances does not equal length of vector v.");
-    }
-        
-    // Allocate some memory and set some variables
     n = mxGetN(prhs[1]);
     d = mxGetM(prhs[1]);
-    plhs[0] = mxCreateDoubleMatrix(1, n, mxREAL);
+    m = n;
+    if(nrhs >= 8 && type == 'M') {
+        if(!mxIsClass(prhs[7], "double") || mxGetM(prhs[7]) != d) {
+            mexErrMsgTxt("Eighth input should be of type double and have the same dimensionality as the second.");
+        }
+        X2 = (double*) mxGetPr(prhs[7]);
+        m  = mxGetN(prhs[7]);
+    }
+    if(type == 'N' && mxGetN(prhs[1]) != mxGetM(prhs[0]) && mxGetM(prhs[0]) != 0) {
+        mexErrMsgTxt("Number of instances does not equal length of vector v.");
+    }
+
+    // Select the kernel function once
+    params.nx = params.ny = NULL;
+    if(function == 'l') {
+        transform = linearTransform;
+    }
+    else if(function == 'p') {
+        transform = polyTransform;
+    }
+    else if(function == 'g') {
+        transform = gaussTransform;
+        params.nx = params.ny = computeSquaredNorms(X, n, d);
+    }
+    else {
+        mexErrMsgTxt("Unknown kernel function.");
+    }
+
+    // Allocate output
+    if(type == 'M') plhs[0] = mxCreateDoubleMatrix(n, m, mxREAL);
+    else            plhs[0] = mxCreateDoubleMatrix(1, n, mxREAL);
     res = mxGetPr(plhs[0]);
-    
+
     // Compute column sums and total sum
-    if(center || strcmp(type, "C") == 0) {
+    if(center || type == 'C') {
         column_sums = (double*) malloc(n * sizeof(double));
-        total_sum   = (double*) malloc(sizeof(double));
-        for(i = 0; i < n; i++) *(column_sums + i) = 0.0;
-        *total_sum = 0.0;
-        computeColumnSums(X, n, d, function, param1, param2, column_sums, total_sum);
-        
+        computeColumnSums(X, n, d, transform, &params, column_sums, &total_sum);
+
         // Return only the column sums if type set to "ColumnSums"
-        if(strcmp(type, "C") == 0) {
+        if(type == 'C') {
             for(i = 0; i < n; i++) {
                 *(res + i) = *(column_sums + i);
             }
             free(column_sums);
-            free(total_sum);
+            free(params.nx);
             return;
         }
     }
-    
-    // Compute all rows and multiply by v
-    row = (double*) malloc(n * sizeof(double));
-    for(i = 0; i < n; i++) {
-        
-        // Compute rows
-        computeKernelRow(X, n, d, i, function, param1, param2, row);
-        if(center) {
-            centerKernelRow(row, i, n, column_sums, total_sum);
-        }
-        
-        // Multiply row by v
-        *(res + i) = 0.0;
-        for(j = 0; j < n; j++) {
-            *(res + i) += (*(row + j) * *(v + j));
-        }
+
+    // Compute the kernel matrix (or the product K*v) tile by tile
+    if(type == 'M') {
+        if(X2 != NULL && function == 'g') params.ny = computeSquaredNorms(X2, m, d);
+        computeKernelMatrix(X, n, X2 != NULL ? X2 : X, m, d, transform, &params, center, column_sums, total_sum, res);
+        if(params.ny != params.nx) free(params.ny);
     }
-    mexPrintf(".");
-    
+    else {
+        computeKernelProduct(X, n, d, transform, &params, center, column_sums, total_sum, v, res);
+        mexPrintf(".");
+    }
+
     // Clean up some memory
-    free(row);
+    free(params.nx);
     if(center) {
         free(column_sums);
-        free(total_sum);
     }
 }
 
 
 /**
- * 
- * Computes a single row of the kernel matrix, viz. row index.
+ *
+ * Computes the squared norms of all datapoints (columns of X).
  *
  */
-void computeKernelRow(double* X, int n, int d, int index, const char* function, int param1, int param2, double* row) {
+double* computeSquaredNorms(const double* X, int n, int d) {
+    int i, j;
+    double* norms = (double*) malloc(n * sizeof(double));
+    for(i = 0; i < n; i++) {
+        *(norms + i) = 0.0;
+        for(j = 0; j < d; j++) {
+            *(norms + i) += *(X + (i * d) + j) * *(X + (i * d) + j);
+        }
+    }
+    return norms;
+}
+
+
+/**
+ *
+ * Computes the inner products between the datapoints i0..i0+ti-1 of X and
+ * j0..j0+tj-1 of Y into tile (ti x tj, column-major). The products are
+ * accumulated in 4x4 register blocks.
+ *
+ */
+void computeGramTile(const double* X, const double* Y, int d, int i0, int ti, int j0, int tj, double* tile) {
 
     // Initialize variables
-    int i, j;
-    
-    // Compute linear kernel
-    if(strcmp(function, "l") == 0) {
-        for(i = 0; i < n; i++) {
-            *(row + i) = 0.0;
-            for(j = 0; j < d; j++) {
-                *(row + i) += *(X + (index * d) + j) * *(X + (i * d) + j);
-            }
-        }        
-    }
-    
-    // Compute polynomial kernel
-    else if(strcmp(function, "p") == 0) {
-        for(i = 0; i < n; i++) {
-            *(row + i) = 0.0;
-            for(j = 0; j < d; j++) {
-                *(row + i) += *(X + (index * d) + j) * *(X + (i * d) + j);
+    int i, j, k, a, b;
+
+    for(j = 0; j < tj; j += 4) {
+        for(i = 0; i < ti; i += 4) {
+            if(i + 4 <= ti && j + 4 <= tj) {
+                const double *x0 = X + (i0 + i) * d, *x1 = x0 + d, *x2 = x1 + d, *x3 = x2 + d;
+                const double *y0 = Y + (j0 + j) * d, *y1 = y0 + d, *y2 = y1 + d, *y3 = y2 + d;
+                double s00 = 0, s01 = 0, s02 = 0, s03 = 0, s10 = 0, s11 = 0, s12 = 0, s13 = 0;
+                double s20 = 0, s21 = 0, s22 = 0, s23 = 0, s30 = 0, s31 = 0, s32 = 0, s33 = 0;
+                for(k = 0; k < d; k++) {
+                    double a0 = x0[k], a1 = x1[k], a2 = x2[k], a3 = x3[k];
+                    double b0 = y0[k], b1 = y1[k], b2 = y2[k], b3 = y3[k];
+                    s00 += a0 * b0; s01 += a0 * b1; s02 += a0 * b2; s03 += a0 * b3;
+                    s10 += a1 * b0; s11 += a1 * b1; s12 += a1 * b2; s13 += a1 * b3;
+                    s20 += a2 * b0; s21 += a2 * b1; s22 += a2 * b2; s23 += a2 * b3;
+                    s30 += a3 * b0; s31 += a3 * b1; s32 += a3 * b2; s33 += a3 * b3;
+                }
+                double* t = tile + j * ti + i;
+                t[0]          = s00; t[1]          = s10; t[2]          = s20; t[3]          = s30;
+                t[ti]         = s01; t[ti + 1]     = s11; t[ti + 2]     = s21; t[ti + 3]     = s31;
+                t[2 * ti]     = s02; t[2 * ti + 1] = s12; t[2 * ti + 2] = s22; t[2 * ti + 3] = s32;
+                t[3 * ti]     = s03; t[3 * ti + 1] = s13; t[3 * ti + 2] = s23; t[3 * ti + 3] = s33;
             }
-            *(row + i) = pow(*(row + i) + param1, param2);
-        } 
-    }
-    
-    // Compute Gaussian kernel
-    else if(strcmp(function, "g") == 0) {
-        for(i = 0; i < n; i++) {
-            *(row + i) = 0.0;
-            for(j = 0; j < d; j++) {
-                *(row + i) += pow(*(X + (index * d) + j) - *(X + (i * d) + j), 2);
+            else {
+                for(b = j; b < j + 4 && b < tj; b++) {
+                    for(a = i; a < i + 4 && a < ti; a++) {
+                        const double *x = X + (i0 + a) * d, *y = Y + (j0 + b) * d;
+                        double s = 0.0;
+                        for(k = 0; k < d; k++) s += x[k] * y[k];
+                        tile[b * ti + a] = s;
+                    }
+                }
             }
-            *(row + i) = exp(-(*(row + i) / (2 * pow(param1, 2))));
-        } 
+        }
     }
-    
-    // Unknown kernel function
-    else {
-        mexErrMsgTxt("Unknown kernel function.");
+}
+
+
+/**
+ *
+ * Kernel functions, applied to a tile of inner products.
+ *
+ */
+void linearTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p) {
+}
+
+void polyTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p) {
+    int i;
+    for(i = 0; i < ti * tj; i++) {
+        *(tile + i) = pow(*(tile + i) + p->param1, p->param2);
+    }
+}
+
+void gaussTransform(double* tile, int ti, int tj, int i0, int j0, const kernelParams* p) {
+    int i, j;
+    double scale = -1.0 / (2 * pow(p->param1, 2));
+    for(j = 0; j < tj; j++) {
+        double ny = *(p->ny + j0 + j);
+        double* t = tile + j * ti;
+        for(i = 0; i < ti; i++) {
+            double dist = *(p->nx + i0 + i) + ny - 2 * t[i];
+            t[i] = exp((dist > 0.0 ? dist : 0.0) * scale);
+        }
     }
 }
 
 
 /**
  *
- * Compute all column sums and the total sum of a kernel matrix.
+ * Computes a tile of the kernel matrix between datapoints of X and Y.
  *
  */
-void computeColumnSums(double* X, int n, int d, const char* function, int param1, int param2, double* column_sums, double* total_sum) {
- 
+void computeKernelTile(const double* X, const double* Y, int d, int i0, int ti, int j0, int tj, kernelTransform transform, const kernelParams* p, double* tile) {
+    computeGramTile(X, Y, d, i0, ti, j0, tj, tile);
+    transform(tile, ti, tj, i0, j0, p);
+}
+
+
+/**
+ *
+ * Compute all column sums and the total sum of a kernel matrix. As the kernel
+ * matrix is symmetric, every thread sums the rows of its own block of rows.
+ *
+ */
+void computeColumnSums(double* X, int n, int d, kernelTransform transform, const kernelParams* p, double* column_sums, double* total_sum) {
+
     // Initialize variables
-    int i, j;
-    double *row;
-    
-    // Preallocate memory
-    row = (double*) malloc(n * sizeof(double));
-    for(i = 0; i < n; i++) *(row + i) = 0.0;
-    *total_sum = 0.0;
-    
-    // Compute column sums and total sum
-    for(i = 0; i < n; i++) {
-        
-        // Compute kernel row
-        computeKernelRow(X, n, d, i, function, param1, param2, row);
-        
-        // Update sums
-        for(j = 0; j < n; j++) {
-            *(column_sums + j) += *(row + j);
-            *total_sum += *(row + j);
-        }
-    }
-    *total_sum = *total_sum / pow(n, 2);
-    
-    // Clean up memory
-    free(row);
+    int ib, nb = (n + TILE - 1) / TILE;
+    double sum = 0.0;
+
+    #ifdef USEOMP
+    #pragma omp parallel for schedule(dynamic) reduction(+:sum)
+    #endif
+    for(ib = 0; ib < nb; ib++) {
+        double tile[TILE * TILE];
+        int i0 = ib * TILE, ti = (i0 + TILE <= n) ? TILE : n - i0, j0, a, b;
+        for(a = 0; a < ti; a++) *(column_sums + i0 + a) = 0.0;
+        for(j0 = 0; j0 < n; j0 += TILE) {
+            int tj = (j0 + TILE <= n) ? TILE : n - j0;
+            computeKernelTile(X, X, d, i0, ti, j0, tj, transform, p, tile);
+            for(b = 0; b < tj; b++) {
+                for(a = 0; a < ti; a++) *(column_sums + i0 + a) += tile[b * ti + a];
+            }
+        }
+        for(a = 0; a < ti; a++) sum += *(column_sums + i0 + a);
+    }
+    *total_sum = sum / pow(n, 2);
 }
 
 
 /**
  *
- * Centers a kernel row as computed by computeKernelRow() using precomputed sums (e.g., sums as given by computeColumnSums(...)).
+ * Computes K * v (with K centered on the fly using precomputed sums, e.g.,
+ * sums as given by computeColumnSums(...)). Threads own blocks of rows.
  *
  */
-void centerKernelRow(double* row, int index, int n, double* column_sums, double* total_sum) {
-    
+void computeKernelProduct(double* X, int n, int d, kernelTransform transform, const kernelParams* p, bool center, double* column_sums, double total_sum, double* v, double* res) {
+
     // Initialize variables
-    int i;
-    
-    // Update kernel row
-    for(i = 0; i < n; i++) {
-        *(row + i) = *(row + i) - (*(column_sums + i) / (double) n) - (*(column_sums + index) / (double) n) + *total_sum;
+    int ib, nb = (n + TILE - 1) / TILE;
+
+    #ifdef USEOMP
+    #pragma omp parallel for schedule(dynamic)
+    #endif
+    for(ib = 0; ib < nb; ib++) {
+        double tile[TILE * TILE];
+        int i0 = ib * TILE, ti = (i0 + TILE <= n) ? TILE : n - i0, j0, a, b;
+        for(a = 0; a < ti; a++) *(res + i0 + a) = 0.0;
+        for(j0 = 0; j0 < n; j0 += TILE) {
+            int tj = (j0 + TILE <= n) ? TILE : n - j0;
+            computeKernelTile(X, X, d, i0, ti, j0, tj, transform, p, tile);
+            for(b = 0; b < tj; b++) {
+                double vb = *(v + j0 + b);
+                double cb = center ? *(column_sums + j0 + b) / (double) n - total_sum : 0.0;
+                for(a = 0; a < ti; a++) {
+                    double k = tile[b * ti + a];
+                    if(center) k -= cb + *(column_sums + i0 + a) / (double) n;
+                    *(res + i0 + a) += k * vb;
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ *
+ * Computes the (optionally centered) NxM kernel matrix between X and Y.
+ * Threads own blocks of columns of K.
+ *
+ */
+void computeKernelMatrix(double* X, int n, double* Y, int m, int d, kernelTransform transform, const kernelParams* p, bool center, double* column_sums, double total_sum, double* K) {
+
+    // Initialize variables
+    int jb, nb = (m + TILE - 1) / TILE;
+
+    #ifdef USEOMP
+    #pragma omp parallel for schedule(dynamic)
+    #endif
+    for(jb = 0; jb < nb; jb++) {
+        double tile[TILE * TILE], mean[TILE];
+        int j0 = jb * TILE, tj = (j0 + TILE <= m) ? TILE : m - j0, i0, a, b;
+        for(b = 0; b < tj; b++) mean[b] = 0.0;
+        for(i0 = 0; i0 < n; i0 += TILE) {
+            int ti = (i0 + TILE <= n) ? TILE : n - i0;
+            computeKernelTile(X, Y, d, i0, ti, j0, tj, transform, p, tile);
+            for(b = 0; b < tj; b++) {
+                double* col = K + (size_t) (j0 + b) * n + i0;
+                for(a = 0; a < ti; a++) {
+                    col[a] = tile[b * ti + a];
+                    mean[b] += col[a];
+                }
+            }
+        }
+
+        // Center the columns of this block
+        if(center) {
+            for(b = 0; b < tj; b++) {
+                double* col = K + (size_t) (j0 + b) * n;
+                double cb = mean[b] / (double) n - total_sum;
+                for(a = 0; a < n; a++) {
+                    col[a] -= cb + *(column_sums + a) / (double) n;
+                }
+            }
+        }
     }
 }
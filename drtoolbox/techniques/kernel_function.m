@@ -1,4 +1,4 @@
-function y = kernel_function(v, X, center, kernel, param1, param2, type)
+function y = kernel_function(v, X, center, kernel, param1, param2, type, X2)
 %KERNEL_FUNCTION Computes sum of (K * X) where X is a possible eigenvector
 %
 %   y = kernel_function(v, X, center, kernel, param1, param2)
@@ -8,6 +8,10 @@ function y = kernel_function(v, X, center, kernel, param1, param2, type)
 % EIGS in Kernel PCA. The other parameters of the function are the dataset 
 % X, the name of the kernel function (default = 'gauss'), and its 
 % corresponding parameters in param1 and param2.
+% If type is 'ColumnSums', the column sums of K are returned. If type is
+% 'Matrix', the (centered) kernel matrix itself is returned, or the kernel
+% matrix between X and the points X2 if these are specified. The compiled
+% MEX-version of this function computes K in parallel tiles.
 %
 %
 
@@ -26,12 +30,34 @@ function y = kernel_function(v, X, center, kernel, param1, param2, type)
     if ~exist('type', 'var')
         type = 'Normal';
     end
-    if ~strcmp(type, 'ColumnSums'), fprintf('.'); end    
+    if ~any(strcmp(type, {'ColumnSums', 'Matrix'})), fprintf('.'); end    
         
     % If no kernel function is specified
     if nargin == 2 || strcmp(kernel, 'none')
         kernel = 'linear';
     end
+    if ~exist('param1', 'var'), param1 = 1; end
+    if ~exist('param2', 'var'), param2 = 3; end
+    
+    % Compute (centered) kernel matrix
+    if strcmp(type, 'Matrix')
+        same = ~exist('X2', 'var') || isequal(X2, X);
+        if ~exist('X2', 'var'), X2 = X; end
+        y = gram(X', X2', kernel, param1, param2);
+        if center
+            % Kernel is evaluated once (twice if X2 differs from X)
+            column_mean = mean(y, 1);
+            if same
+                column_sum = sum(y, 1);
+            else
+                column_sum = sum(gram(X', X', kernel, param1, param2), 1);
+            end
+            n = size(X, 2);
+            y = bsxfun(@minus, y, column_sum' ./ n);
+            y = bsxfun(@minus, y, column_mean) + sum(column_sum) / n^2;
+        end
+        return
+    end
     
     % Construct result vector
     y = zeros(1, size(X, 1));
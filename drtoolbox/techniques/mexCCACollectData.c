@@ -3,87 +3,154 @@
  * mexCCACollectdata.c
  *      prepare data for cca.m to form SDP
  *
+ * In-memory use (whole data set at once):
+ *
+ *   [A, B, g] = mexCCACollectData(X, Y, irow, icol, relative, nv, vidx)
+ *
+ * Chunked use (data blocks fed incrementally, see cca.m):
+ *
+ *   [Ap, Bu, gu] = mexCCACollectData(Ap, Bu, gu, Xb, Yb, irow, icol, relative, nv, vidx)
+ *   A = mexCCACollectData(Ap)
+ *
+ * Ap is the packed upper triangle of A, a (d^2)(d^2+1)/2 vector initialized
+ * to zeros. Bu = B(:,u) and gu = g(u) are the columns of B and g touched by
+ * the block (u = unique vertex indices of the block), which the caller
+ * scatters back. For a block, the first numel(icol)-1 columns of Xb and Yb
+ * are the points whose neighborhoods are processed, irow holds (0-based)
+ * column indices into Xb and Yb, nv the edge multiplicities of the block
+ * and vidx the (1-based) vertex indices into Bu and gu. Only the
+ * sufficient statistics (A, B, g) are kept between calls, so X never has
+ * to be in memory as a whole. Feeding the blocks in order yields exactly
+ * the same A, B and g as the in-memory call: both go through the same
+ * engine and every entry is accumulated over the edges in the same order.
+ * A block call copies Ap and the numel(u) touched columns in and out, so
+ * its cost is O(d^4 + d^2 numel(u)) on top of the edges, independent of n.
+ *
+ * Edges are processed in batches: the outer products of a batch are formed
+ * in parallel and A is then updated with the rows of its packed triangle
+ * distributed over threads (when compiled with -DUSEOMP), which keeps the
+ * summation order, and thus the result, independent of the thread count.
+ *
  * by feisha@cis.upenn.edu
  */
- 
+
  #include "mex.h"
  #include "matrix.h"
 #include <stdlib.h>
 #include <float.h>
-#include <string.h> 
+#include <string.h>
 #include <math.h>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+#define EDGE_BATCH 256          /* number of edges whose outer products are buffered */
 
  /* the computation engine */
-void collectdata(double *x, double *y, int* edgerow, int *edgecol, int *relative, 
-int *nv, int *vidx, int D, int d, int n, int ks, double *a, double *b, double *g);
+void collectdata(double *x, double *y, int* edgerow, int *edgecol, int relflg,
+int *nv, int *vidx, int D, int d, int n, double *tempA, double *b, double *g, int nb);
 
 /* auxiliary functions */
-void sanity_check(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+void recoverA(int D, double *A, double *tempA);
+int packed_dim(const mxArray *a);
+void check_accumulator(const mxArray *A, const mxArray *B, const mxArray *g, int d, int n);
 
-/* the gateway */ 
+/* the gateway */
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
-    int n, ks=1, D, d;
-    double *x, *y, *a, *b, *g;
-    int *neighbors;
-    
-    /* sanity_check(nlhs, plhs, nrhs, prhs); */
-    
+    int n, D, d, dd, nb;
+    double *tempA;
+
+    /* finalize a chunked collection: expand the packed A */
+    if (nrhs == 1) {
+        dd = packed_dim(prhs[0]);
+        plhs[0] = mxCreateDoubleMatrix(dd, dd, mxREAL);
+        recoverA(dd, mxGetPr(plhs[0]), mxGetPr(prhs[0]));
+        return;
+    }
+
+    /* add one block to the packed A and to the touched columns of B and g */
+    if (nrhs == 10) {
+        D = mxGetM(prhs[3]);
+        d = mxGetM(prhs[4]);
+        if (mxGetN(prhs[3]) != mxGetN(prhs[4]))
+            mexErrMsgTxt("Data blocks of X and Y must have the same number of columns.");
+        nb = mxGetNumberOfElements(prhs[6]) - 1;
+        if (nb < 0 || nb > (int)mxGetN(prhs[3]))
+            mexErrMsgTxt("Edge index of the block does not match the data block.");
+        n = mxGetN(prhs[1]);
+        check_accumulator(prhs[0], prhs[1], prhs[2], d, n);
+        plhs[0] = mxDuplicateArray(prhs[0]);
+        plhs[1] = mxDuplicateArray(prhs[1]);
+        plhs[2] = mxDuplicateArray(prhs[2]);
+        collectdata( (double*)mxGetData(prhs[3]),
+                     (double*)mxGetData(prhs[4]),
+                     (int*)mxGetData(prhs[5]),
+                     (int*)mxGetData(prhs[6]),
+                     *(int*)mxGetData(prhs[7]),
+                     (int*)mxGetData(prhs[8]),
+                     (int*)mxGetData(prhs[9]),
+                     D, d, n,
+                     mxGetPr(plhs[0]), mxGetPr(plhs[1]), mxGetPr(plhs[2]), nb);
+        return;
+    }
+
+    if (nrhs != 7)
+        mexErrMsgTxt("Seven input arguments required.");
+
     n = mxGetN(prhs[0]);
     D = mxGetM(prhs[0]);
     d = mxGetM(prhs[1]);
+    dd = d*d;
     /*printf("%d data points, reducing from dimension %d ---> dimension %d, using \
 %d nearest neighbors\n", n, D, d, ks); */
-    
+
     plhs[0] = mxCreateDoubleMatrix(d*d, d*d, mxREAL);
     plhs[1] = mxCreateDoubleMatrix(d*d, n, mxREAL);
     plhs[2] = mxCreateDoubleMatrix(n,1, mxREAL);
-    
+
+    /* mxCalloc: released by MATLAB if collectdata raises an error */
+    tempA = (double*)mxCalloc((size_t)dd*(dd+1)/2, sizeof(double));
     collectdata( (double*)mxGetData(prhs[0]),
                  (double*)mxGetData(prhs[1]),
                  (int*)mxGetData(prhs[2]),
                  (int*)mxGetData(prhs[3]),
-                 (int*)mxGetData(prhs[4]),
+                 *(int*)mxGetData(prhs[4]),
                  (int*)mxGetData(prhs[5]),
                  (int*)mxGetData(prhs[6]),
-                 D, d, n, ks, 
-                 (double*)mxGetData(plhs[0]),
+                 D, d, n, tempA,
                  (double*)mxGetData(plhs[1]),
-                 (double*)mxGetData(plhs[2]));
+                 (double*)mxGetData(plhs[2]), n);
+
+    /* make A symmetric */
+    recoverA(dd, (double*)mxGetData(plhs[0]), tempA);
+    mxFree(tempA);
     return;
 }
 
 
-/* check input arguments */
-void sanity_check(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) 
+/* side of the matrix whose upper triangle is packed in a */
+int packed_dim(const mxArray *a)
 {
-    int n1, n2, n3;
-    /* Check for proper number of input and output arguments. */    
-    if (nrhs != 4) {
-        mexErrMsgTxt("Four input argument required.");
-    } 
-    if (nlhs != 3) {
-        mexErrMsgTxt("Three output arguments required.");
-    }
+    int dd;
+    if (!mxIsDouble(a) || mxIsComplex(a))
+        mexErrMsgTxt("Packed A must be a real double vector.");
+    dd = (int)((sqrt(8.0*mxGetNumberOfElements(a) + 1) - 1)/2 + 0.5);
+    if ((size_t)dd*(dd+1)/2 != mxGetNumberOfElements(a))
+        mexErrMsgTxt("Packed A must have (d^2)(d^2+1)/2 elements.");
+    return dd;
+}
 
-    /* Check data type of input argument. */
-    /*if (!(mxIsDouble(prhs[0])) || !(mxIsDouble(prhs[1])) || !(mxIsDouble(prhs[2]))) {
-        mexErrMsgTxt("Input array must be of type double.");
-    }*/
-    
-    /* Check dimensions */
-    if(mxGetNumberOfDimensions(prhs[0])!=2 || mxGetNumberOfDimensions(prhs[1])!=2 || mxGetNumberOfDimensions(prhs[2])!=2) {
-        mexErrMsgTxt("Input arrays must be two-dimension arrays");
-    }
+/* check the packed A and the columns of B and g of a block */
+void check_accumulator(const mxArray *A, const mxArray *B, const mxArray *g, int d, int n)
+{
+    int dd = d*d;
 
-    /* matching dimensions */
-    n1 = mxGetN(prhs[0]);
-    n2 = mxGetN(prhs[1]);
-    n3 = mxGetN(prhs[2]);
-    if (n1 != n2 || n1 !=n3) {
-        mexErrMsgTxt("Input arrays must have same number of columns!");
-    }
-    return;
+    if (!mxIsDouble(A) || !mxIsDouble(B) || !mxIsDouble(g))
+        mexErrMsgTxt("Packed A, B and g must be double arrays.");
+    if ((int)mxGetNumberOfElements(A) != dd*(dd+1)/2 || (int)mxGetM(B) != dd ||
+        (int)mxGetNumberOfElements(g) != n)
+        mexErrMsgTxt("Packed A, B and g do not match the dimensions of the data.");
 }
 
 /* computing */
@@ -96,186 +163,147 @@ double vecdot(double* v1, int n) {  /* v1'*v2 */
     return x;
 }
 void vecsub(double* v1,double* v2, double* v3, int n) { /* v3=v1-v2 */
-    int incx=1;
-    double none = -1;
-    /*       dcopy_(&n, v1, &incx,v3, &incx);
-	     daxpy_(&n, &none, v2, &incx, v3, &incx);*/
     int i;
-     for(i=0;i<n;i++) v3[i]=v1[i]-v2[i]; 
-    
+     for(i=0;i<n;i++) v3[i]=v1[i]-v2[i];
+
 }
 void vecout(double* v1, double* v3, int d) { /* v3 = v1*v2' */
-  double temp,one = 1.0;
-    int inca = 1;
+  double temp;
     int i,j,c;
- 
-    /*   dger_(&d , &d, &one, v1, &inca,v1, &inca, v3, &d); */
+
     c=0;
-    for(i=0;i<d;i++){ 
+    for(i=0;i<d;i++){
       temp=v1[i];
       for(j=0;j<d;j++){
    	v3[c]=temp*v1[j];
       c++;
-	}    
-    }
-}
-void makevecsym(double *v, int d) { /* assume V is a dxd matrix, return (V+V')/2 */
-    int row, col, i;
-    double temp;
-    for(col=0; col < d; col++) {
-        for(row=col; row < d; row++) {
-            temp = (v[row*d+col] + v[col*d+row])/2;
-            v[row*d+col] = v[col*d+row] = temp;
-        }
+	}
     }
 }
-void updateA(double *a, double *v, double alpha, int d) {  /* update A */
-    int inca = 1;
-    char *uplo= "U";
-    double temp;
-    int i,j,c;
+/* update A with a batch of ne outer products v (d x ne), weighted by alpha:
+   every row of the packed triangle sees the edges in order, so the rows can
+   be updated in parallel without changing the result */
+void updateA(double *a, double *v, double *alpha, int ne, int d) {
+    int i;
 
-    /*            dspr_(uplo, &d , &alpha, v, &inca, a);*/
- 
-    if(alpha==1.0){ /*optimize the common case */
-     c=0;
-     for(i=0;i<d;i++){
-      temp=v[i];
-      for(j=0;j<=i;j++)  {
-	a[c]+=temp*v[j];
-       c++;
-      }
-      }
-    } else{
-     c=0;
-     for(i=0;i<d;i++){
-      temp=v[i]*alpha;
-      for(j=0;j<=i;j++)  {
-	a[c]+=temp*v[j];
-       c++;
-      }
+    #ifdef USEOMP
+    #pragma omp parallel for schedule(dynamic, 16)
+    #endif
+    for(i=0;i<d;i++){
+      double *ai = a + (size_t)i*(i+1)/2, *ve, temp;
+      int e, j;
+      for(e=0;e<ne;e++){
+        ve = v + (size_t)e*d;
+        temp=ve[i]*alpha[e];
+        for(j=0;j<=i;j++)
+          ai[j]+=temp*ve[j];
       }
     }
 }
 void updateB(double * b, double alpha, double *v, int d) { /* update B(:,i) */
     int i;
-    int incx = 1;
-    /*   daxpy_(&d, &alpha, v, &incx, b, &incx);*/
     for(i=0;i<d;i++) b[i]+=alpha*v[i];
 }
 /* transform upper triangular matrix stored in A as full matrix */
 void recoverA(int D, double *A, double *tempA)
 {
-  int l = 0, idx, jdx,s, incx=1, incy=1;
-  int n = D*(D+1)/2;
+  int l = 0, idx, jdx;
   for(jdx=0; jdx <D; jdx++) {
      for(idx=0; idx <=jdx; idx++) {
     	A[jdx*D+idx] = tempA[l];
-        l++;    
+        l++;
       }
   }
-  for(jdx=0; jdx <D; jdx++) 
+  for(jdx=0; jdx <D; jdx++)
     for(idx=jdx; idx <D; idx++) {
         A[jdx*D+idx] = A[idx*D+jdx];
     }
- 
+
 
 }
 
 
 
-void collectdata(double *x, double *y, int* edgesrow, int *edgescol, int *relative, int *nv, 
-int *vidx, int D, int d, int n, int ks, double *a, double *b, double *g) 
+/* accumulates the edges of the first nb points of x and y into tempA (packed
+   upper triangle), b and g; n is the number of columns of b and g */
+void collectdata(double *x, double *y, int* edgesrow, int *edgescol, int relflg, int *nv,
+int *vidx, int D, int d, int n, double *tempA, double *b, double *g, int nb)
 {
-    double *diffx, *diffy, *yij, *nid;
-    double gij;
-    int i, j, k, iEdge, iVertex,itemp, ii;
-    int nn_start, nn_end, nn;
-    double *diffxjk, *diffyjk;
-    double gjk, *yjk, *tempA;
-    int relflg = *relative;
-    /* clear data area */
-    memset(a, 0, sizeof(double)*d*d*d*d);
-    memset(b, 0, sizeof(double)*d*d*n);
-    memset(g, 0, sizeof(double)*n);
+    double *yij, *gij, *alpha;
+    int *src, *dst;
+    int i, nn, e, ne, itemp, ii, dd = d*d;
+    int nn_start, nn_end, iEdge, iVertex;
 
     /* temporary working space */
-    diffx = (double*)calloc(D, sizeof(double));
-    diffy = (double*)calloc(d, sizeof(double));
-    yij = (double*)calloc(d*d, sizeof(double));
-    
-    
-    tempA = (double*)calloc((d*d)*(d*d+1)/2, sizeof(double));
-    
-    if(!diffx || !diffy || !yij || !tempA) {
+    yij   = (double*)malloc((size_t)EDGE_BATCH*dd*sizeof(double));
+    gij   = (double*)malloc(EDGE_BATCH*sizeof(double));
+    alpha = (double*)malloc(EDGE_BATCH*sizeof(double));
+    src   = (int*)malloc(EDGE_BATCH*sizeof(int));
+    dst   = (int*)malloc(EDGE_BATCH*sizeof(int));
+
+    if(!yij || !gij || !alpha || !src || !dst) {
+        free(yij); free(gij); free(alpha); free(src); free(dst);
         mexErrMsgTxt("Out of memory..cannot allocate working space..");
         return;
     }
     iEdge = 0;
     iVertex = 0;
-    if(relflg==0) {
-    
-        for(i=0; i <n ; i++) { 
-            /* figure out the nearest neighbors */
+    i = 0; nn = edgescol[0];
+    while(i < nb) {
+        /* gather the next batch of edges */
+        ne = 0;
+        for(; i < nb && ne < EDGE_BATCH; i++) {
             nn_start = edgescol[i]; nn_end = edgescol[i+1]-1;
-            if (nn_end >= nn_start) {
-                for(nn=nn_start; nn<=nn_end; nn++) {
-                    j = edgesrow[nn];
-                    
-                    /* compute diffx and diffy */
-                    vecsub(x+i*D, x+j*D, diffx, D);
-                    gij = vecdot(diffx, D);
-                
-                    vecsub(y+i*d, y+j*d, diffy, d);
-                    vecout(diffy,  yij, d);
-            
-                    /* update A, b */
-                    updateA(tempA, yij, 1.0*nv[iEdge],d*d);
-                    for(itemp=0; itemp < nv[iEdge]; itemp++) {
-                        ii = vidx[iVertex]-1;
-                        updateB(b+ii*d*d, gij, yij, d*d);
-                        g[ii] = g[ii]+gij*gij;
-                        iVertex++;
-                    }
-                    
-                    iEdge++;
-                }   
+            if(nn < nn_start) nn = nn_start;
+            for(; nn <= nn_end && ne < EDGE_BATCH; nn++, ne++) {
+                src[ne] = i; dst[ne] = edgesrow[nn];
             }
+            if(nn <= nn_end) break;     /* batch full inside column i */
         }
-        printf("Iedge :%d, ivertex: %d\n", iEdge, iVertex);
-    } else {
-        /* reproducing the code above to some degree so that we don't have to 
-         do if statement inside cache-intensive loop */
-        for(i=0; i <n ; i++) { 
-            /* figure out the nearest neighbors */
-            nn_start = edgescol[i]; nn_end = edgescol[i+1]-1;
-            if (nn_end >= nn_start) {
-                for(nn=nn_start; nn<=nn_end; nn++) {
-                    j = edgesrow[nn];
-            
-                    /* compute diffx and diffy */
-                    vecsub(x+i*D, x+j*D, diffx, D);
-                    gij = vecdot(diffx, D);
-                
-                    vecsub(y+i*d, y+j*d, diffy, d);
-                    vecout(diffy,  yij, d);
-            
-                    /* update A, b */
-                    updateA(tempA, yij, 1*nv[iEdge]/(gij*gij), d*d);
-                    for(itemp=0; itemp < nv[iEdge]; itemp++) {
-                        ii = vidx[iVertex]-1;
-                        updateB(b+ii*d*d, 1/gij, yij, d*d);
-                        g[ii] = g[ii]+1;
-                        iVertex++;
-                    }
-                    iEdge++;
-                }   
+
+        /* compute diffx and diffy */
+        #ifdef USEOMP
+        #pragma omp parallel
+        #endif
+        {
+            double *diffx = (double*)malloc(D*sizeof(double));
+            double *diffy = (double*)malloc(d*sizeof(double));
+            int k;
+            #ifdef USEOMP
+            #pragma omp for
+            #endif
+            for(k=0; k<ne; k++) {
+                vecsub(x+(size_t)src[k]*D, x+(size_t)dst[k]*D, diffx, D);
+                gij[k] = vecdot(diffx, D);
+                vecsub(y+(size_t)src[k]*d, y+(size_t)dst[k]*d, diffy, d);
+                vecout(diffy, yij+(size_t)k*dd, d);
             }
+            free(diffx); free(diffy);
         }
-    }
-    /* make A symmetric */
-    recoverA(d*d, a, tempA); 
-}   
 
+        /* update A */
+        for(e=0; e<ne; e++)
+            alpha[e] = relflg==0 ? 1.0*nv[iEdge+e] : 1*nv[iEdge+e]/(gij[e]*gij[e]);
+        updateA(tempA, yij, alpha, ne, dd);
 
-  
\ No newline at end of file
+        /* update b */
+        for(e=0; e<ne; e++, iEdge++) {
+            for(itemp=0; itemp < nv[iEdge]; itemp++) {
+                ii = vidx[iVertex]-1;
+                if(ii < 0 || ii >= n) {
+                    free(yij); free(gij); free(alpha); free(src); free(dst);
+                    mexErrMsgTxt("Vertex index out of range.");
+                }
+                if(relflg==0) {
+                    updateB(b+(size_t)ii*dd, gij[e], yij+(size_t)e*dd, dd);
+                    g[ii] = g[ii]+gij[e]*gij[e];
+                } else {
+                    updateB(b+(size_t)ii*dd, 1/gij[e], yij+(size_t)e*dd, dd);
+                    g[ii] = g[ii]+1;
+                }
+                iVertex++;
+            }
+        }
+    }
+    free(yij); free(gij); free(alpha); free(src); free(dst);
+}
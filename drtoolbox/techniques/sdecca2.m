@@ -1,4 +1,4 @@
-function  [P, newY, L, newV, idx]= sdecca2(Y, snn, regularizer, relative)
+function  [P, newY, L, newV, idx]= sdecca2(Y, snn, regularizer, relative, blocksize)
 % doing semidefinitve embedding/MVU with output being parameterized by graph
 % laplacian's eigenfunctions.. 
 %
@@ -16,6 +16,8 @@ function  [P, newY, L, newV, idx]= sdecca2(Y, snn, regularizer, relative)
 %   Y: matrix of d'xN, with each column is a point in R^d'
 %   NEIGHBORS: matrix of KxN, each column is a list of indices (between 1
 %   and N) to the nearest-neighbor of the corresponding column in X
+%   BLOCKSIZE: if specified, the data for the SDP is collected in blocks of
+%   this many points (the result is identical)
 % Output:
 %   P: square of the linear map L, i.e., P = L'*L
 %   newY: transformed data points, i.e., newY = L*Y;
@@ -41,7 +43,11 @@ function  [P, newY, L, newV, idx]= sdecca2(Y, snn, regularizer, relative)
     [erow, ecol, edist] = sparse_nn(snn);
     irow = int32(erow); 
     icol = int32(ecol);
-    [A, B, g] = mexCCACollectData2(Y, irow, icol, edist, int32(relative));
+    if nargin > 4 && blocksize > 0
+        [A, B, g] = collectDataChunked(Y, irow, icol, edist, int32(relative), blocksize);
+    else
+        [A, B, g] = mexCCACollectData2(Y, irow, icol, edist, int32(relative));
+    end
     BG = 2 * sum(B, 2);
     Q = A ;
     [V, E] = eig(Q + eye(size(Q)));
@@ -98,6 +104,27 @@ function  [P, newY, L, newV, idx]= sdecca2(Y, snn, regularizer, relative)
 return
 
 
+% Function that collects the data for the SDP block by block
+function [A, B, g] = collectDataChunked(Y, irow, icol, edist, relative, blocksize)
+    [d, N] = size(Y);
+    Ap = zeros(d^2 * (d^2 + 1) / 2, 1);
+    B = zeros(d^2, N);
+    g = zeros(N, 1);
+    for first=1:blocksize:N
+        last = min(first + blocksize - 1, N);
+        
+        % The points of the block come first, followed by their neighbors
+        e = double(icol(first))+1:double(icol(last + 1));
+        nbr = double(irow(e(:))) + 1;
+        pts = [first:last setdiff(nbr, first:last)'];
+        [dummy, loc] = ismember(nbr, pts);
+        [Ap, B(:,first:last), g(first:last)] = mexCCACollectData2(Ap, Y(:,pts), int32(loc - 1), ...
+                  int32(icol(first:last + 1) - icol(first)), edist(e), relative);
+    end
+    A = mexCCACollectData2(Ap);
+return
+
+
 % Function that formulates the SDP problem
 function [A, b, c]=formulateSDP(S, D, bb)
     [F0, FI, c] = localformulateSDP(S, D, bb);
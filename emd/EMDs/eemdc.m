@@ -0,0 +1,73 @@
+%EEMDC  computes Ensemble Empirical Mode Decomposition (EEMD or CEEMDAN)
+%
+%
+%   Syntax
+%
+%
+% [IMF,NB_ITERATIONS]=EEMDC(T,X,NOISE_STD,NE,MAX_IMFS,NB_ITERATIONS,CEEMDAN,SEED,NTHREADS);
+%
+%
+%   Description
+%
+%
+% computes the ensemble EMD of [1] (CEEMDAN=0) or the complete ensemble
+% EMD with adaptive noise of [2] (CEEMDAN=1) with the sifting of EMDC.
+%
+% EEMD: the IMFs are the means of the IMFs of the EMDs of NE copies of X
+% with added white noise.
+% CEEMDAN: the k-th IMF is the mean of the first IMFs of NE copies of the 
+% current residual with added (normalized) k-th IMFs of white noises
+% (the noises themselves for the first IMF). 
+%
+% inputs:	
+%       - T: sampling times. If T=[], the signal is assumed uniformly sampled.
+%       - X: analyzed signal
+%       - NOISE_STD: standard deviation of the added noise relative to the
+%         standard deviation of X (CEEMDAN: of the current residual).
+%         Default: 0.2
+%       - NE: ensemble size. Default: 100
+%       - MAX_IMFS: number of IMFs to be extracted. If MAX_IMFS is zero,
+%         empty or unspecified, EEMD extracts fix(log2(N))-1 IMFs and
+%         CEEMDAN extracts IMFs until the residual has not enough extrema.
+%       - NB_ITERATIONS: if nonzero, NB_ITERATIONS sifting iterations are
+%         performed for each IMF (see EMDC_FIX), otherwise the default
+%         stopping criterion of EMDC is used.
+%       - CEEMDAN: 0 (EEMD, default) or 1 (CEEMDAN)
+%       - SEED: seed of the noise (nonnegative integer, default 0). The results
+%         are reproducible for given SEED and NTHREADS.
+%       - NTHREADS: maximum number of threads (default: as many as available)
+%         
+% outputs: 
+%		- IMF: intrinsic mode functions (IMFs) (last line = residual). With
+%		  EEMD, modes that some members do not have are averaged as zeros.
+%		- NB_ITERATIONS: mean number of sifting iterations for each mode
+%
+%
+%   Examples
+%
+%
+% workspace: 
+%  T: 1xN time instants
+%  X: 1xN signal data 
+%
+%>>IMF = EEMDC(T,X);
+%>>IMF = EEMDC([],X,0.1,200);
+%>>IMF = EEMDC([],X,0.2,100,8,10);
+%>>[IMF,NB_IT] = EEMDC([],X,0.2,100,[],[],1);
+%
+%
+%   References
+%
+%
+% [1] Z. Wu and N. E. Huang, "Ensemble empirical mode decomposition: a
+% noise-assisted data analysis method", Advances in Adaptive Data Analysis,
+% Vol. 1, pp. 1-41, 2009
+%
+% [2] M. E. Torres, M. A. Colominas, G. Schlotthauer and P. Flandrin,
+% "A complete ensemble empirical mode decomposition with adaptive noise",
+% IEEE ICASSP 2011, pp. 4144-4147
+%
+%
+% See also
+%  emdc (fast implementation of EMD)
+%  emdc_batch (EMD of several signals)
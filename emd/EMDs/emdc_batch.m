@@ -0,0 +1,59 @@
+%EMDC_BATCH  computes Empirical Mode Decomposition of several signals
+%
+%
+%   Syntax
+%
+%
+% [IMF,NB_ITERATIONS]=EMDC_BATCH(T,X,STOP_PARAMETERS,MAX_IMFS,NB_ITERATIONS,NTHREADS);
+%
+%
+%   Description
+%
+%
+% computes the EMD of every column of X, either with the stopping
+% criterion of EMDC or with a fixed number of sifting iterations as in
+% EMDC_FIX. Each signal gives exactly the same result as EMDC (resp. EMDC_FIX)
+% applied to that signal alone. The signals are processed in parallel if
+% the code was compiled with OpenMP (see make_emdc).
+%
+% inputs:	
+%       - T: sampling times (common to all signals). If T=[], the signals 
+%         are assumed uniformly sampled.
+%       - X: analyzed signals, one signal per column (a row vector is
+%         analyzed as a single signal)
+%       - STOP_PARAMETERS: parameters for the stopping criterion (see EMDC).
+%         if STOP_PARAMETERS is unspecified or empty, default values are used: [0.05,0.05]
+%       - MAX_IMFS: maximum number of IMFs to be extracted. If MAX_IMFS is
+%         zero, empty or unspecified, the default behavior is to extract as
+%         many IMFs as possible.
+%       - NB_ITERATIONS: if nonzero, the stopping criterion is ignored and
+%         NB_ITERATIONS sifting iterations are performed for each IMF (see EMDC_FIX).
+%       - NTHREADS: maximum number of threads (default: as many as available)
+%         
+% outputs: 
+%		- IMF: MxNxK array, IMF(:,:,k) holds the IMFs of the k-th signal in
+%		  its first rows and its residual in the last row. The signals
+%		  with less than M-1 IMFs are padded with rows of zeros before
+%		  the residual, so that sum(IMF(:,:,k),1) is always the k-th signal.
+%		- NB_ITERATIONS: (M-1)xK effective number of sifting iterations
+%		  for each mode (zero for the padding)
+%
+%
+%   Examples
+%
+%
+% workspace: 
+%  T: 1xN time instants
+%  X: NxK signals 
+%
+%>>IMF = EMDC_BATCH(T,X);
+%>>[IMF,NB_IT] = EMDC_BATCH([],X);
+%>>IMF = EMDC_BATCH(T,X,[0.1,0.1]);
+%>>IMF = EMDC_BATCH([],X,[],4);
+%>>IMF = EMDC_BATCH([],X,[],[],10);
+%>>IMF = EMDC_BATCH([],X,[],[],[],2);
+%
+%
+% See also
+%  emdc (fast implementation of EMD for one signal)
+%  emdc_fix (fast implementation of EMD with a fixed number of iterations)
@@ -0,0 +1,59 @@
+%EMDC_STREAM  computes Empirical Mode Decomposition of long signals by windows
+%
+%
+%   Syntax
+%
+%
+% EMDC_STREAM(X,DEST,WINDOW,OVERLAP,NB_IMFS,STOP_PARAMETERS,NB_ITERATIONS);
+% IMF = EMDC_STREAM(X,[],WINDOW,OVERLAP,NB_IMFS,STOP_PARAMETERS,NB_ITERATIONS);
+%
+%
+%   Description
+%
+%
+% computes EMD (see EMDC) on windows of WINDOW samples that overlap by
+% OVERLAP samples. The decompositions of consecutive windows are blended
+% over the middle half of their overlap (the samples closest to the edges
+% of a window are taken from the neighboring window only). The signal is
+% read and the IMFs are written by segments, so that the memory only
+% depends on WINDOW and not on the length of the signal.
+%
+% The modes whose periods are not small compared to OVERLAP (and WINDOW)
+% are not consistent from one window to the next, WINDOW should be at
+% least a few times the period of the slowest mode of interest.
+%
+% inputs:	
+%       - X: analyzed signal (uniformly sampled), either a vector or the
+%         name of a file of raw double precision samples (native byte order)
+%         (an error is raised if its size is not a multiple of 8 bytes)
+%       - DEST: destination of the IMFs:
+%         function handle: called as DEST(IMF,FIRST) for every segment where 
+%           IMF(:,k) are the IMFs (last line = residual) of sample FIRST+k-1
+%         file name: the segments are appended to the file, which can
+%           then be read with fread(fid,[NB_IMFS+1,Inf],'double')
+%         empty: the IMFs are returned as IMF
+%       - WINDOW: window size (default: 65536)
+%       - OVERLAP: overlap between consecutive windows, at most WINDOW/2
+%         (default: WINDOW/4)
+%       - NB_IMFS: number of IMFs extracted from each window (missing IMFs are
+%         zero). Default: fix(log2(WINDOW))-1
+%       - STOP_PARAMETERS: parameters for the stopping criterion (see EMDC).
+%         if STOP_PARAMETERS is unspecified or empty, default values are used: [0.05,0.05]
+%       - NB_ITERATIONS: if nonzero, the stopping criterion is ignored and
+%         NB_ITERATIONS sifting iterations are performed for each IMF (see EMDC_FIX).
+%         
+% outputs: 
+%		- IMF: (NB_IMFS+1)xN intrinsic mode functions (last line = residual)
+%
+%
+%   Examples
+%
+%
+%>>IMF = EMDC_STREAM(X,[],4096,1024,6);
+%>>EMDC_STREAM('signal.bin','imfs.bin',65536,16384,8);
+%>>EMDC_STREAM(X,@(imf,first) plot(first:first+size(imf,2)-1,imf(1,:)),8192);
+%
+%
+% See also
+%  emdc (fast implementation of EMD)
+%  emd_online (on-line EMD demonstration)
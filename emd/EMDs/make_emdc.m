@@ -15,7 +15,15 @@ if ispc
   cd('src')
 end
 
-filelist = {'emdc.c','emdc_fix.c','cemdc.c','cemdc_fix.c','cemdc2.c','cemdc2_fix.c'};
+filelist = {'emdc.c','emdc_fix.c','emdc_batch.c','eemdc.c','emdc_stream.c','cemdc.c','cemdc_fix.c','cemdc2.c','cemdc2_fix.c'};
+
+% emdc_batch and eemdc process the signals (ensemble members) in parallel
+% if OpenMP is available
+if ispc
+  ompflags = {'-DUSEOMP','OPTIMFLAGS=$OPTIMFLAGS /openmp'};
+else
+  ompflags = {'-DUSEOMP','CFLAGS=$CFLAGS -fopenmp','LDFLAGS=$LDFLAGS -fopenmp'};
+end
 
 for k = 1:length(filelist)
   file = filelist{k};
@@ -24,6 +32,15 @@ for k = 1:length(filelist)
   else
     args = {['src/',file]};
   end
+  if any(strcmp(file,{'emdc_batch.c','eemdc.c'}))
+    try
+      mex('-DC99_OK',ompflags{:},args{:})
+      status(k) = 0;
+      continue
+    catch
+      warning([file(1:end-2),' could not be compiled with OpenMP, it will run sequentially'])
+    end
+  end
   try
     mex('-DC99_OK',args{:})
     status(k) = 0;
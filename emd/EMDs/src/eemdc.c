@@ -0,0 +1,406 @@
+/*
+* ensemble EMD (EEMD [1]) and complete ensemble EMD with adaptive noise
+* (CEEMDAN [2]) built on the sifting core of emdc (sift.c). The ensemble
+* members are sifted in parallel if compiled with -DUSEOMP and OpenMP
+* enabled. Every member draws its noise from its own random stream (seeded
+* from SEED and the index of the member) so that the noise does not depend
+* on the thread that runs the member, and every thread adds the modes of
+* its members to a private accumulator. The accumulators are summed in
+* thread order at the end, so that the memory does not grow with the
+* ensemble size (except for the noise kept by CEEMDAN, see below).
+*
+* [1] Z. Wu and N. E. Huang, "Ensemble empirical mode decomposition: a
+* noise-assisted data analysis method", Advances in Adaptive Data Analysis,
+* Vol. 1, pp. 1-41, 2009
+*
+* [2] M. E. Torres, M. A. Colominas, G. Schlotthauer and P. Flandrin,
+* "A complete ensemble empirical mode decomposition with adaptive noise",
+* IEEE ICASSP 2011, pp. 4144-4147
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "mex.h"
+#include "io.h"
+#include "extr.h"
+#include "interpolation.h"
+#include "sift.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+#define DEFAULT_THRESHOLD 0.05
+#define DEFAULT_TOLERANCE 0.05
+#define MAX_ITERATIONS 1000
+#define NBSYM 2
+#define DEFAULT_NOISE_STD 0.2
+#define DEFAULT_ENSEMBLE_SIZE 100
+
+/* CEEMDAN needs the k-th mode of the noise of every member at stage k.  */
+/* The noise (minus its first modes) is kept between stages for as many */
+/* members as fit in NOISE_CACHE_SIZE bytes, the noise of the other     */
+/* members is generated and decomposed again at every stage             */
+#ifndef NOISE_CACHE_SIZE
+#define NOISE_CACHE_SIZE 268435456
+#endif
+
+#include "io.c"
+#include "extr.c"
+#include "interpolation.c"
+#include "sift.c"
+
+/* structure used to store the input data of eemdc */
+typedef struct {
+  int n;
+  int ensemble_size;
+  int max_imfs;
+  int nb_iterations;
+  int ceemdan;
+  int seed;
+  int nb_threads;
+  int allocated_x;
+  double noise_std;
+  double *x;
+  double *y;
+} eemd_input_t;
+
+/************************************************************************/
+/*                                                                      */
+/* GET INPUT DATA                                                       */
+/*                                                                      */
+/************************************************************************/
+
+eemd_input_t get_eemd_input(int nlhs,int nrhs,const mxArray *prhs[]) {
+  eemd_input_t input;
+  int n;
+
+  input.noise_std=DEFAULT_NOISE_STD;
+  input.ensemble_size=DEFAULT_ENSEMBLE_SIZE;
+  input.max_imfs=0;
+  input.nb_iterations=0;
+  input.ceemdan=0;
+  input.seed=0;
+  input.nb_threads=100000;
+
+  /* argument checking*/
+  if (nrhs>9)
+    mexErrMsgTxt("Too many arguments");
+  if (nrhs<2)
+    mexErrMsgTxt("Not enough arguments");
+  if (nlhs>2)
+    mexErrMsgTxt("Too many output arguments");
+  if (!mxIsNumeric(prhs[1]) || mxIsComplex(prhs[1]) ||
+  mxIsSparse(prhs[1]) || !mxIsDouble(prhs[1])  ||
+  (mxGetNumberOfDimensions(prhs[1]) > 2) ||
+  SMALLER(mxGetN(prhs[1]),mxGetM(prhs[1]))!=1)
+    mexErrMsgTxt("X must be a double precision real vector.");
+  n=GREATER(mxGetN(prhs[1]),mxGetM(prhs[1]));
+  input.y=mxGetPr(prhs[1]);
+
+  /* noise amplitude (relative to the standard deviation of X) */
+  if (nrhs>=3 && !mxIsEmpty(prhs[2])) {
+    if (!mxIsNumeric(prhs[2]) || mxIsComplex(prhs[2]) || mxIsSparse(prhs[2])
+    || !mxIsDouble(prhs[2]) || mxGetNumberOfElements(prhs[2])!=1)
+      mexErrMsgTxt("NOISE_STD must be a real scalar");
+    input.noise_std=*mxGetPr(prhs[2]);
+    if (!(input.noise_std >= 0))
+      mexErrMsgTxt("NOISE_STD must be a nonnegative number");
+  }
+
+  /* integer arguments */
+  if (nrhs>=4)
+    input.ensemble_size=get_integer(prhs[3],DEFAULT_ENSEMBLE_SIZE,"NE must be a positive integer");
+  if (input.ensemble_size<1)
+    mexErrMsgTxt("NE must be a positive integer");
+  if (nrhs>=5)
+    input.max_imfs=get_integer(prhs[4],0,"MAX_IMFS must be a positive integer");
+  if (nrhs>=6)
+    input.nb_iterations=get_integer(prhs[5],0,"NB_ITERATIONS must be a positive integer");
+  if (nrhs>=7)
+    input.ceemdan=get_integer(prhs[6],0,"CEEMDAN must be 0 or 1");
+  if (input.ceemdan>1)
+    mexErrMsgTxt("CEEMDAN must be 0 or 1");
+  if (nrhs>=8)
+    input.seed=get_integer(prhs[7],0,"SEED must be a positive integer");
+  if (nrhs>=9)
+    input.nb_threads=get_integer(prhs[8],100000,"NTHREADS must be a positive integer");
+
+  /* sampling times (uniform sampling if T is empty) */
+  input.x=get_times(prhs[0],n,&input.allocated_x);
+  input.n=n;
+  return input;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* WHITE GAUSSIAN NOISE OF ENSEMBLE MEMBER j                            */
+/*                                                                      */
+/* xoroshiro128+ generator (rotations 55 and 36, shift 14) seeded from  */
+/* (seed,j) with the splitmix64 finalizer, normal samples by the        */
+/* Box-Muller transform                                                 */
+/*                                                                      */
+/************************************************************************/
+
+unsigned long long mix64(unsigned long long z) {
+  z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+  z=(z^(z>>27))*0x94D049BB133111EBULL;
+  return z^(z>>31);
+}
+
+void white_noise(int seed,int j,double *w,int n) {
+  unsigned long long s0,s1,r;
+  double u[2],a,b;
+  int i,k;
+  s0=mix64((unsigned long long)seed*0x9E3779B97F4A7C15ULL^mix64(2*(unsigned long long)j+1));
+  s1=mix64(s0+0x9E3779B97F4A7C15ULL)|1;
+  for (i=0;i<n;i+=2) {
+    for (k=0;k<2;k++) {
+      r=s0+s1;
+      s1^=s0;
+      s0=((s0<<55)|(s0>>9))^s1^(s1<<14);
+      s1=(s1<<36)|(s1>>28);
+      u[k]=(double)(r>>11)*(1.0/9007199254740992.0);
+    }
+    a=sqrt(-2*log(1-u[0]));
+    b=6.283185307179586*u[1];
+    w[i]=a*cos(b);
+    if (i+1<n) w[i+1]=a*sin(b);
+  }
+}
+
+/************************************************************************/
+/* STANDARD DEVIATION (normalized by n-1 as in MATLAB)                  */
+/************************************************************************/
+
+double emd_std(double *y,int n) {
+  int i;
+  double mean=0,s=0;
+  if (n<2) return 0;
+  for (i=0;i<n;i++) mean+=y[i];
+  mean/=n;
+  for (i=0;i<n;i++) s+=(y[i]-mean)*(y[i]-mean);
+  return sqrt(s/(n-1));
+}
+
+/************************************************************************/
+/*                                                                      */
+/* EMD OF ONE EEMD MEMBER                                               */
+/*                                                                      */
+/* adds the (at most K) IMFs of y to the first K rows of acc (n samples */
+/* per row) and the residual to row K, the number of iterations of      */
+/* mode k is added to it[k]                                             */
+/*                                                                      */
+/************************************************************************/
+
+void eemd_member(double *x,double *y,int n,int K,sift_t *w,double *acc,double *it) {
+  int i,k,iteration_counter;
+  for (k=0;k<K;k++) {
+    iteration_counter=sift(x,y,n,w);
+    if (!iteration_counter)
+      break;
+    for (i=0;i<n;i++) {
+      acc[(size_t)k*n+i]+=w->z[i];
+      y[i]-=w->z[i];
+    }
+    it[k]+=iteration_counter;
+  }
+  for (i=0;i<n;i++) acc[(size_t)K*n+i]+=y[i];
+}
+
+/************************************************************************/
+/*                                                                      */
+/* k-TH MODE OF THE NOISE OF A CEEMDAN MEMBER (k>=1)                    */
+/*                                                                      */
+/* if cached, nr holds the noise of member j minus its first k-1 modes  */
+/* and is updated, otherwise the noise is generated in nr and its first */
+/* k modes are extracted again (both give the same result). The mode    */
+/* is left in w->z, returns 0 if the noise has no k-th mode             */
+/*                                                                      */
+/************************************************************************/
+
+int noise_mode(double *x,double *nr,int n,int k,int cached,int seed,int j,sift_t *w) {
+  int i,l;
+  if (!cached) {
+    white_noise(seed,j,nr,n);
+    for (l=1;l<k;l++) {
+      if (!sift(x,nr,n,w))
+        return 0;
+      for (i=0;i<n;i++) nr[i]-=w->z[i];
+    }
+  }
+  if (!sift(x,nr,n,w))
+    return 0;
+  if (cached)
+    for (i=0;i<n;i++) nr[i]-=w->z[i];
+  return 1;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* MAIN FUNCTION                                                        */
+/*                                                                      */
+/************************************************************************/
+
+void mexFunction(int nlhs,mxArray *plhs[],int nrhs,const mxArray *prhs[]) {
+
+    /* declarations */
+  int i,t,k,n,ne,K,nb_threads,nb_cached,nb_imfs;
+  double *x,*r,*mode,*y,*nr,*cache,*accs,*its,eps;
+  eemd_input_t input;
+  imf_list_t list;
+  sift_t *w;
+
+    /* get input data */
+  input=get_eemd_input(nlhs,nrhs,prhs);
+  n=input.n;
+  ne=input.ensemble_size;
+  x=input.x;
+  list=init_imf_list(n);
+
+    /* number of threads */
+  nb_threads=input.nb_threads;
+  #ifdef USEOMP
+  if (nb_threads>omp_get_max_threads()) nb_threads=omp_get_max_threads();
+  #else
+  nb_threads=1;
+  #endif
+  if (nb_threads>ne) nb_threads=ne;
+  if (nb_threads<1) nb_threads=1;
+
+    /* number of modes of the EEMD members (at most log2(n)-1 by default) */
+    /* a CEEMDAN stops when the residual has not enough extrema           */
+  K=input.max_imfs;
+  if (!K && !input.ceemdan)
+    for (K=-1,i=n;i>1;i/=2) K++;
+  if (K<1 && !input.ceemdan) K=1;
+
+    /* sifting workspaces and accumulators (one per thread) */
+  w=(sift_t *)malloc(nb_threads*sizeof(sift_t));
+  for (t=0;t<nb_threads;t++) {
+    w[t]=init_sift(n);
+    if (input.nb_iterations) {
+      w[t].criterion=0;
+      w[t].max_iterations=input.nb_iterations;
+    }
+  }
+  y=(double *)malloc((size_t)nb_threads*n*sizeof(double));
+  nr=(double *)malloc((size_t)nb_threads*n*sizeof(double));
+  r=(double *)malloc(n*sizeof(double));
+  mode=(double *)malloc(n*sizeof(double));
+  for (i=0;i<n;i++) r[i]=input.y[i];
+  eps=input.noise_std*emd_std(r,n);
+
+  if (!input.ceemdan) {
+
+      /* EEMD: EMD of every member with its own noise */
+    accs=(double *)calloc((size_t)nb_threads*(K+1)*n,sizeof(double));
+    its=(double *)calloc((size_t)nb_threads*K,sizeof(double));
+    #ifdef USEOMP
+    #pragma omp parallel for num_threads(nb_threads) schedule(static) private(i)
+    #endif
+    for (k=0;k<ne;k++) {
+      int tid=0;
+      double *yt;
+      #ifdef USEOMP
+      tid=omp_get_thread_num();
+      #endif
+      yt=y+(size_t)tid*n;
+      white_noise(input.seed,k,yt,n);
+      for (i=0;i<n;i++) yt[i]=r[i]+eps*yt[i];
+      eemd_member(x,yt,n,K,&w[tid],accs+(size_t)tid*(K+1)*n,its+(size_t)tid*K);
+    }
+    for (t=1;t<nb_threads;t++) {
+      for (i=0;i<(K+1)*n;i++) accs[i]+=accs[(size_t)t*(K+1)*n+i];
+      for (i=0;i<K;i++) its[i]+=its[(size_t)t*K+i];
+    }
+    for (k=0;k<K;k++) {
+      for (i=0;i<n;i++) mode[i]=accs[(size_t)k*n+i]/ne;
+      add_imf(&list,mode,(int)(its[k]/ne+0.5));
+    }
+    for (i=0;i<n;i++) r[i]=accs[(size_t)K*n+i]/ne;
+    free(accs);
+    free(its);
+
+  } else {
+
+      /* CEEMDAN: the k-th mode is the mean of the first modes of the     */
+      /* residual plus the (normalized) k-th mode of the noise of every   */
+      /* member (the noise itself for the first mode)                     */
+    nb_cached=(int)SMALLER((double)ne,(double)NOISE_CACHE_SIZE/((double)n*sizeof(double)));
+    cache=(double *)malloc(((size_t)nb_cached*n+1)*sizeof(double));
+    accs=(double *)malloc((size_t)nb_threads*n*sizeof(double));
+    its=(double *)malloc(nb_threads*sizeof(double));
+    nb_imfs=0;
+    while (!input.max_imfs || nb_imfs<input.max_imfs) {
+
+        /* stop when the residual has not enough extrema */
+      if (nb_imfs) {
+        sift_extr(x,r,NULL,n,&w[0].ex);
+        if (w[0].ex.n_min+w[0].ex.n_max <7)
+          break;
+      }
+      eps=input.noise_std*emd_std(r,n);
+      for (i=0;i<nb_threads*n;i++) accs[i]=0;
+      for (t=0;t<nb_threads;t++) its[t]=0;
+
+      #ifdef USEOMP
+      #pragma omp parallel for num_threads(nb_threads) schedule(static) private(i)
+      #endif
+      for (k=0;k<ne;k++) {
+        int tid=0,cached=(k<nb_cached);
+        double *yt,*nt,*acc,s;
+        sift_t *wt;
+        #ifdef USEOMP
+        tid=omp_get_thread_num();
+        #endif
+        wt=&w[tid];
+        yt=y+(size_t)tid*n;
+        nt=cached ? cache+(size_t)k*n : nr+(size_t)tid*n;
+        acc=accs+(size_t)tid*n;
+        if (!nb_imfs) {
+          white_noise(input.seed,k,nt,n);
+          for (i=0;i<n;i++) yt[i]=r[i]+eps*nt[i];
+        } else if (noise_mode(x,nt,n,nb_imfs,cached,input.seed,k,wt)
+        && (s=emd_std(wt->z,n))>0) {
+          for (i=0;i<n;i++) yt[i]=r[i]+eps/s*wt->z[i];
+        } else {
+          for (i=0;i<n;i++) yt[i]=r[i];
+        }
+        its[tid]+=sift(x,yt,n,wt);
+        for (i=0;i<n;i++) acc[i]+=wt->z[i];
+      }
+      for (t=1;t<nb_threads;t++) {
+        for (i=0;i<n;i++) accs[i]+=accs[(size_t)t*n+i];
+        its[0]+=its[t];
+      }
+      for (i=0;i<n;i++) {
+        mode[i]=accs[i]/ne;
+        r[i]-=mode[i];
+      }
+      add_imf(&list,mode,(int)(its[0]/ne+0.5));
+      nb_imfs++;
+    }
+    free(cache);
+    free(accs);
+    free(its);
+  }
+
+    /* save the residual into list */
+  add_imf(&list,r,0);
+
+    /* output into a MATLAB array */
+  write_output(list,plhs);
+
+    /* free allocated memory */
+  if (input.allocated_x)
+    free(input.x);
+  for (t=0;t<nb_threads;t++) free_sift(w[t]);
+  free(w);
+  free(y);
+  free(nr);
+  free(r);
+  free(mode);
+  free_imf_list(list);
+
+}
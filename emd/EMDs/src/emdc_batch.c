@@ -0,0 +1,204 @@
+/*
+* batch version of emdc and emdc_fix: decomposes every column of a matrix
+* with the sifting core of emdc (sift.c). Compile with -DUSEOMP and OpenMP
+* enabled to process the columns in parallel.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "mex.h"
+#include "io.h"
+#include "extr.h"
+#include "interpolation.h"
+#include "sift.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+#define DEFAULT_THRESHOLD 0.05
+#define DEFAULT_TOLERANCE 0.05
+#define MAX_ITERATIONS 1000
+#define NBSYM 2
+
+#include "io.c"
+#include "extr.c"
+#include "interpolation.c"
+#include "sift.c"
+
+/* structure used to store the input data of the batch version */
+typedef struct {
+  int n;
+  int nb_signals;
+  int max_imfs;
+  int nb_iterations;
+  int nb_threads;
+  int allocated_x;
+  double *x;
+  double *y;
+  stop_t stop_params;
+} batch_input_t;
+
+/************************************************************************/
+/*                                                                      */
+/* GET INPUT DATA                                                       */
+/*                                                                      */
+/************************************************************************/
+
+batch_input_t get_batch_input(int nlhs,int nrhs,const mxArray *prhs[]) {
+  batch_input_t input;
+  int n;
+
+  input.stop_params.threshold = DEFAULT_THRESHOLD;
+  input.stop_params.tolerance = DEFAULT_TOLERANCE;
+  input.max_imfs=0;
+  input.nb_iterations=0;
+  input.nb_threads=100000;
+
+  /* argument checking*/
+  if (nrhs>6)
+    mexErrMsgTxt("Too many arguments");
+  if (nrhs<2)
+    mexErrMsgTxt("Not enough arguments");
+  if (nlhs>2)
+    mexErrMsgTxt("Too many output arguments");
+  if (!mxIsNumeric(prhs[1]) || mxIsComplex(prhs[1]) ||
+  mxIsSparse(prhs[1]) || !mxIsDouble(prhs[1])  ||
+  (mxGetNumberOfDimensions(prhs[1]) > 2))
+    mexErrMsgTxt("X must be a double precision real matrix.");
+
+  /* one signal per column (a row vector is a single signal) */
+  if (mxGetM(prhs[1])==1) {
+    n=mxGetN(prhs[1]);
+    input.nb_signals=1;
+  } else {
+    n=mxGetM(prhs[1]);
+    input.nb_signals=mxGetN(prhs[1]);
+  }
+  input.y=mxGetPr(prhs[1]);
+
+  /* stopping criterion */
+  if (nrhs>=3)
+    input.stop_params=get_stop(prhs[2]);
+
+  /* integer arguments */
+  if (nrhs>=4)
+    input.max_imfs=get_integer(prhs[3],0,"MAX_IMFS must be a positive integer");
+  if (nrhs>=5)
+    input.nb_iterations=get_integer(prhs[4],0,"NB_ITERATIONS must be a positive integer");
+  if (nrhs>=6)
+    input.nb_threads=get_integer(prhs[5],100000,"NTHREADS must be a positive integer");
+
+  /* sampling times (uniform sampling if T is empty) */
+  input.x=get_times(prhs[0],n,&input.allocated_x);
+  input.n=n;
+  return input;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* OUTPUT INTO MATLAB ARRAYS                                            */
+/*                                                                      */
+/* IMF is m x n x k, the IMFs of each signal are in the first rows and  */
+/* its residual in the last row (padded with zeros in between, so that  */
+/* sum(IMF(:,:,k),1) is still the signal). NB_ITERATIONS is (m-1) x k   */
+/* with zeros for the padding                                           */
+/*                                                                      */
+/************************************************************************/
+
+void write_batch_output(imf_list_t *lists,int k,mxArray *plhs[]) {
+  double *out1,*out2;
+  imf_t *current;
+  int i,j,s,m=1,n=lists[0].n;
+  mwSize dims[3];
+  for (s=0;s<k;s++) if (lists[s].m>m) m=lists[s].m;
+  dims[0]=m;
+  dims[1]=n;
+  dims[2]=k;
+  plhs[0]=mxCreateNumericArray(3,dims,mxDOUBLE_CLASS,mxREAL);
+  out1=mxGetPr(plhs[0]);
+  plhs[1]=mxCreateDoubleMatrix(m-1,k,mxREAL);
+  out2=mxGetPr(plhs[1]);
+  for (s=0;s<k;s++) {
+    i=0;
+    for (current=lists[s].first;current;current=current->next) {
+      if (!current->next) i=m-1; /* residual */
+      for (j=0;j<n;j++) out1[(size_t)s*m*n+(size_t)j*m+i]=current->pointer[j];
+      if (i<m-1) out2[(size_t)s*(m-1)+i]=current->nb_iterations;
+      i++;
+    }
+  }
+}
+
+/************************************************************************/
+/*                                                                      */
+/* MAIN FUNCTION                                                        */
+/*                                                                      */
+/************************************************************************/
+
+void mexFunction(int nlhs,mxArray *plhs[],int nrhs,const mxArray *prhs[]) {
+
+    /* declarations */
+  int s,n,k,nb_threads;
+  batch_input_t input;
+  imf_list_t *lists;
+
+    /* get input data */
+  input=get_batch_input(nlhs,nrhs,prhs);
+  n=input.n;
+  k=input.nb_signals;
+  lists=(imf_list_t *)malloc((k>0 ? k : 1)*sizeof(imf_list_t));
+  for (s=0;s<k;s++) lists[s]=init_imf_list(n);
+
+    /* number of threads */
+  nb_threads=input.nb_threads;
+  #ifdef USEOMP
+  if (nb_threads>omp_get_max_threads()) nb_threads=omp_get_max_threads();
+  #else
+  nb_threads=1;
+  #endif
+  if (nb_threads>k) nb_threads=k;
+  if (nb_threads<1) nb_threads=1;
+
+    /* MAIN LOOP (one sifting workspace per thread) */
+  #ifdef USEOMP
+  #pragma omp parallel num_threads(nb_threads)
+  #endif
+  {
+    int i,t;
+    sift_t w=init_sift(n);
+    double *y=(double *)malloc(n*sizeof(double));
+    if (input.nb_iterations) {
+      w.criterion=0;
+      w.max_iterations=input.nb_iterations;
+    } else {
+      w.threshold=input.stop_params.threshold;
+      w.tolerance=input.stop_params.tolerance;
+    }
+    #ifdef USEOMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (t=0;t<k;t++) {
+      for (i=0;i<n;i++) y[i]=input.y[(size_t)t*n+i];
+      emd_core(input.x,y,n,input.max_imfs,&w,&lists[t]);
+          /* save the residual into list */
+      add_imf(&lists[t],y,0);
+    }
+    free(y);
+    free_sift(w);
+  }
+
+    /* output into MATLAB arrays */
+  if (k>0)
+    write_batch_output(lists,k,plhs);
+  else {
+    plhs[0]=mxCreateDoubleMatrix(0,0,mxREAL);
+    plhs[1]=mxCreateDoubleMatrix(0,0,mxREAL);
+  }
+
+    /* free allocated memory */
+  if (input.allocated_x)
+    free(input.x);
+  for (s=0;s<k;s++) free_imf_list(lists[s]);
+  free(lists);
+
+}
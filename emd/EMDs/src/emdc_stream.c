@@ -0,0 +1,280 @@
+/*
+* streaming version of emdc: the signal is read by chunks (from a vector
+* or from a file of raw doubles) and decomposed by overlapping windows
+* (stream.c), the IMFs are passed segment by segment to a MATLAB function
+* or appended to a file, so that the memory only depends on the window
+* size.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "mex.h"
+#include "io.h"
+#include "extr.h"
+#include "interpolation.h"
+#include "sift.h"
+#include "stream.h"
+
+#define DEFAULT_THRESHOLD 0.05
+#define DEFAULT_TOLERANCE 0.05
+#define MAX_ITERATIONS 1000
+#define NBSYM 2
+#define DEFAULT_WINDOW 65536
+
+#include "io.c"
+#include "extr.c"
+#include "interpolation.c"
+#include "sift.c"
+#include "stream.c"
+
+/* structure used to store the input data of the streaming version */
+typedef struct {
+  int window;
+  int overlap;
+  int max_imfs;
+  int nb_iterations;
+  char *source;      /* file name (NULL if the signal is a vector) */
+  char *dest;        /* file name */
+  const mxArray *callback;
+  stop_t stop_params;
+} stream_input_t;
+
+/* destination of the IMF segments */
+typedef struct {
+  FILE *file;
+  const mxArray *callback;
+  mxArray *exception;
+  int error;
+  double *imf;       /* whole decomposition if no file nor callback */
+                     /* (allocated with mxMalloc) */
+  long long n;
+  long long size;
+} dest_t;
+
+/************************************************************************/
+/*                                                                      */
+/* GET INPUT DATA                                                       */
+/*                                                                      */
+/************************************************************************/
+
+char *get_file_name(const mxArray *p,const char *msg) {
+  char *name;
+  if (mxGetM(p)!=1)
+    mexErrMsgTxt(msg);
+  name=mxArrayToString(p);
+  if (!name)
+    mexErrMsgTxt(msg);
+  return name;
+}
+
+stream_input_t get_stream_input(int nlhs,int nrhs,const mxArray *prhs[]) {
+  stream_input_t input;
+  int i;
+
+  input.source=NULL;
+  input.dest=NULL;
+  input.callback=NULL;
+  input.stop_params.threshold = DEFAULT_THRESHOLD;
+  input.stop_params.tolerance = DEFAULT_TOLERANCE;
+  input.window=DEFAULT_WINDOW;
+  input.max_imfs=0;
+  input.nb_iterations=0;
+
+  /* argument checking*/
+  if (nrhs>7)
+    mexErrMsgTxt("Too many arguments");
+  if (nrhs<1)
+    mexErrMsgTxt("Not enough arguments");
+  if (nlhs>1)
+    mexErrMsgTxt("Too many output arguments");
+  if (!mxIsChar(prhs[0]) && (!mxIsNumeric(prhs[0]) || mxIsComplex(prhs[0]) ||
+  mxIsSparse(prhs[0]) || !mxIsDouble(prhs[0]) ||
+  (mxGetNumberOfDimensions(prhs[0]) > 2) ||
+  SMALLER(mxGetN(prhs[0]),mxGetM(prhs[0]))>1))
+    mexErrMsgTxt("X must be a double precision real vector or a file name.");
+
+  /* window, overlap and number of IMFs */
+  if (nrhs>=3)
+    input.window=get_integer(prhs[2],DEFAULT_WINDOW,"WINDOW must be a positive integer");
+  if (input.window<2)
+    mexErrMsgTxt("WINDOW must be at least 2");
+  input.overlap=input.window/4;
+  if (nrhs>=4)
+    input.overlap=get_integer(prhs[3],input.window/4,"OVERLAP must be a positive integer");
+  if (input.overlap>input.window/2)
+    mexErrMsgTxt("OVERLAP must not exceed WINDOW/2");
+  if (nrhs>=5)
+    input.max_imfs=get_integer(prhs[4],0,"NB_IMFS must be a positive integer");
+  if (!input.max_imfs) {
+    for (input.max_imfs=-1,i=input.window;i>1;i/=2) input.max_imfs++;
+    if (input.max_imfs<1) input.max_imfs=1;
+  }
+
+  /* stopping criterion */
+  if (nrhs>=6)
+    input.stop_params=get_stop(prhs[5]);
+  if (nrhs>=7)
+    input.nb_iterations=get_integer(prhs[6],0,"NB_ITERATIONS must be a positive integer");
+
+  /* destination of the IMFs */
+  if (nrhs>=2 && !mxIsEmpty(prhs[1])) {
+    if (nlhs>0)
+      mexErrMsgTxt("IMF is only returned if DEST is empty");
+    if (mxIsClass(prhs[1],"function_handle"))
+      input.callback=prhs[1];
+    else if (mxIsChar(prhs[1]))
+      input.dest=get_file_name(prhs[1],"DEST must be a file name or a function handle");
+    else
+      mexErrMsgTxt("DEST must be a file name or a function handle");
+  }
+  if (mxIsChar(prhs[0]))
+    input.source=get_file_name(prhs[0],"X must be a double precision real vector or a file name.");
+  return input;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* OUTPUT OF ONE SEGMENT                                                */
+/*                                                                      */
+/* appended to the file, passed to the callback as (IMF,FIRST) where    */
+/* FIRST is the index of the first sample, or stored                    */
+/*                                                                      */
+/************************************************************************/
+
+void emit_segment(double *seg,int m,int len,long long first,void *ctx) {
+  dest_t *d=(dest_t *)ctx;
+  mxArray *rhs[3];
+  if (d->error)
+    return;
+  if (d->file) {
+    if (fwrite(seg,sizeof(double),(size_t)m*len,d->file)!=(size_t)m*len)
+      d->error=1;
+  } else if (d->callback) {
+    rhs[0]=(mxArray *)d->callback;
+    rhs[1]=mxCreateDoubleMatrix(m,len,mxREAL);
+    memcpy(mxGetPr(rhs[1]),seg,(size_t)m*len*sizeof(double));
+    rhs[2]=mxCreateDoubleScalar((double)first+1);
+    d->exception=mexCallMATLABWithTrap(0,NULL,3,rhs,"feval");
+    mxDestroyArray(rhs[1]);
+    mxDestroyArray(rhs[2]);
+    if (d->exception)
+      d->error=1;
+  } else {
+    if (d->n+len>d->size) {
+      d->size=GREATER(2*d->size,d->n+len);
+      d->imf=(double *)mxRealloc(d->imf,(size_t)m*d->size*sizeof(double));
+    }
+    memcpy(d->imf+(size_t)m*d->n,seg,(size_t)m*len*sizeof(double));
+  }
+  d->n+=len;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* MAIN FUNCTION                                                        */
+/*                                                                      */
+/************************************************************************/
+
+void mexFunction(int nlhs,mxArray *plhs[],int nrhs,const mxArray *prhs[]) {
+
+    /* declarations */
+  int m,c,in_error=0;
+  size_t b;
+  long long i,n;
+  double *y,*chunk;
+  FILE *source=NULL;
+  stream_input_t input;
+  stream_t s;
+  dest_t d;
+
+    /* get input data */
+  input=get_stream_input(nlhs,nrhs,prhs);
+  m=input.max_imfs+1;
+  d.file=NULL;
+  d.callback=input.callback;
+  d.exception=NULL;
+  d.error=0;
+  d.imf=NULL;
+  d.n=0;
+  d.size=0;
+  if (input.source) {
+    source=fopen(input.source,"rb");
+    mxFree(input.source);
+    if (!source) {
+      if (input.dest) mxFree(input.dest);
+      mexErrMsgTxt("Cannot open the input file");
+    }
+  }
+  if (input.dest) {
+    d.file=fopen(input.dest,"wb");
+    mxFree(input.dest);
+    if (!d.file) {
+      if (source) fclose(source);
+      mexErrMsgTxt("Cannot open the output file");
+    }
+  }
+
+    /* init the stream */
+  s=init_stream(input.window,input.overlap,input.max_imfs,emit_segment,&d);
+  if (input.nb_iterations) {
+    s.w.criterion=0;
+    s.w.max_iterations=input.nb_iterations;
+  } else {
+    s.w.threshold=input.stop_params.threshold;
+    s.w.tolerance=input.stop_params.tolerance;
+  }
+
+    /* MAIN LOOP: the signal is pushed one window at a time */
+  /* (the file is read by bytes so that a truncated last sample is detected) */
+  if (source) {
+    chunk=(double *)mxMalloc(input.window*sizeof(double));
+    while (!d.error && (b=fread(chunk,1,input.window*sizeof(double),source))>0) {
+      if (b%sizeof(double)) {
+        in_error=1;
+        break;
+      }
+      stream_push(&s,chunk,(int)(b/sizeof(double)));
+    }
+    if (!in_error && ferror(source))
+      in_error=2;
+    mxFree(chunk);
+    fclose(source);
+  } else {
+    y=mxGetPr(prhs[0]);
+    n=mxGetNumberOfElements(prhs[0]);
+    if (!d.file && !d.callback) {
+      d.size=n;
+      d.imf=(double *)mxMalloc(((size_t)m*n+1)*sizeof(double));
+    }
+    for (i=0;i<n && !d.error;i+=c) {
+      c=(int)SMALLER(n-i,(long long)input.window);
+      stream_push(&s,y+i,c);
+    }
+  }
+  if (!d.error && !in_error)
+    stream_flush(&s);
+  free_stream(s);
+  if (d.file && fclose(d.file))
+    d.error=1;
+
+    /* errors (the error of the callback is rethrown) */
+  if (in_error==1)
+    mexErrMsgTxt("Truncated input file (its size is not a multiple of 8 bytes)");
+  if (in_error==2)
+    mexErrMsgTxt("Cannot read the input file");
+  if (d.exception)
+    mexCallMATLAB(0,NULL,1,&d.exception,"throw");
+  if (d.error)
+    mexErrMsgTxt("Cannot write the output file");
+
+    /* output into a MATLAB array (without copy) */
+  if (!d.file && !d.callback) {
+    plhs[0]=mxCreateDoubleMatrix(0,0,mxREAL);
+    if (d.imf) {
+      mxSetM(plhs[0],m);
+      mxSetN(plhs[0],(mwSize)d.n);
+      mxSetPr(plhs[0],d.imf);
+    }
+  }
+}
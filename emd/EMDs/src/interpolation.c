@@ -9,56 +9,141 @@
 
 /*************************************************************************/
 /*                                                                       */
-/* INTERPOLATION                                                         */
+/* SECOND DERIVATIVES OF THE NATURAL CUBIC SPLINE                        */
 /*                                                                       */
-/* interpolates the sequence (xs,ys) at instants in x using cubic spline */
+/* solves the tridiagonal system of the spline through the n knots       */
+/* (xs,ys) in O(n), temp is a work array of n elements                   */
 /*                                                                       */
 /*************************************************************************/
 
-void interpolation(double y[],double xs[],double ys[],int n,double x[], int nx,double *ys2, double *temp) {
-  int i,j,jfin,cur,prev;
-  double p,sig,a,b,c,d,e,f,g,a0,a1,a2,a3,xc;
+void spline_second_derivatives(double xs[],double ys[],int n,double *ys2,double *temp) {
+  int i;
+  double p,sig,h0,h1,s0,s1;
 
-  /* Compute second derivatives at the knots */
   ys2[0]=temp[0]=0.0;
+  h0=xs[1]-xs[0];
+  s0=(ys[1]-ys[0])/h0;
   for (i=1;i<n-1;i++) {
-    sig=(xs[i]-xs[i-1])/(xs[i+1]-xs[i-1]);
+    h1=xs[i+1]-xs[i];
+    s1=(ys[i+1]-ys[i])/h1;
+    sig=h0/(h0+h1);
     p=sig*ys2[i-1]+2.0;
     ys2[i]=(sig-1.0)/p;
-    temp[i]=(ys[i+1]-ys[i])/(xs[i+1]-xs[i])-(ys[i]-ys[i-1])/(xs[i]-xs[i-1]);
-    temp[i]=(6.0*temp[i]/(xs[i+1]-xs[i-1])-sig*temp[i-1])/p;
+    temp[i]=(6.0*(s1-s0)/(h0+h1)-sig*temp[i-1])/p;
+    h0=h1;
+    s0=s1;
   }
   ys2[n-1]=0.0;
-  for (j=n-2;j>=0;j--) ys2[j]=ys2[j]*ys2[j+1]+temp[j];
+  for (i=n-2;i>=0;i--) ys2[i]=ys2[i]*ys2[i+1]+temp[i];
+}
+
+/*************************************************************************/
+/*                                                                       */
+/* COEFFICIENTS OF THE NATURAL CUBIC SPLINE IN LOCAL COORDINATES         */
+/*                                                                       */
+/* on [xs[j],xs[j+1]] the spline through the n knots (xs,ys) is          */
+/* c[4j]+t*(c[4j+1]+t*(c[4j+2]+t*c[4j+3])) with t=x-xs[j] (c has 4*n     */
+/* elements, the coefficients of one interval are contiguous). The       */
+/* forward elimination is written as a linear recurrence on numerators   */
+/* and denominators (rescaled every 32 knots) so that the divisions are  */
+/* not chained from one knot to the next                                 */
+/*                                                                       */
+/*************************************************************************/
+
+void spline_coefficients(double xs[],double ys[],int n,double *c) {
+  int i;
+  double sig,h0,h1,s0,s1,ih,ihh,num,den,den0,u,r,m0,m1;
+
+  /* forward elimination: c[4i+2] and c[4i+1] store the factors of      */
+  /* ys2[i]=c[4i+2]*ys2[i+1]+c[4i+1], c[4i+3] stores 1/(xs[i+1]-xs[i])  */
+  c[1]=c[2]=0.0;
+  num=0.0;
+  den=1.0;
+  u=0.0;
+  h0=xs[1]-xs[0];
+  c[3]=ih=1.0/h0;
+  s0=(ys[1]-ys[0])*ih;
+  for (i=1;i<n-1;i++) {
+    h1=xs[i+1]-xs[i];
+    c[4*i+3]=ih=1.0/h1;
+    s1=(ys[i+1]-ys[i])*ih;
+    ihh=1.0/(h0+h1);
+    sig=h0*ihh;
+    den0=den;
+    den=sig*num+2.0*den;
+    num=(sig-1.0)*den0;
+    u=6.0*(s1-s0)*ihh*den0-sig*u;
+    r=1.0/den;
+    if ((i&31)==0) {
+      num*=r;
+      u*=r;
+      den=1.0;
+      c[4*i+2]=num;
+      c[4*i+1]=u;
+    } else {
+      c[4*i+2]=num*r;
+      c[4*i+1]=u*r;
+    }
+    h0=h1;
+    s0=s1;
+  }
 
-  /* Compute the spline coefficients */
+  /* back substitution and coefficients of the polynomials */
+  m1=0.0;
+  c[4*n-4]=ys[n-1];
+  c[4*n-3]=c[4*n-2]=c[4*n-1]=0.0;
+  for (i=n-2;i>=0;i--) {
+    m0=c[4*i+2]*m1+c[4*i+1];
+    ih=c[4*i+3];
+    c[4*i]=ys[i];
+    c[4*i+1]=(ys[i+1]-ys[i])*ih-(2*m0+m1)/(6*ih);
+    c[4*i+2]=m0/2;
+    c[4*i+3]=(m1-m0)*ih/6;
+    m1=m0;
+  }
+}
+
+/*************************************************************************/
+/*                                                                       */
+/* INTERPOLATION                                                         */
+/*                                                                       */
+/* interpolates the sequence (xs,ys) at instants in x using cubic spline */
+/* the polynomial of each interval is evaluated in local coordinates     */
+/* t=x-xs[j] (Horner scheme), which is both cheaper and much more        */
+/* accurate than the expansion in x for long signals                     */
+/*                                                                       */
+/*************************************************************************/
+
+void interpolation(double y[],double xs[],double ys[],int n,double x[], int nx,double *ys2, double *temp) {
+  int i,j,jfin,cur,prev;
+  double a,h,c0,c1,c2,c3,t;
+
+  /* Compute second derivatives at the knots */
+  spline_second_derivatives(xs,ys,n,ys2,temp);
+
+  /* Find the first and last intervals covering the sampling times */
   cur=0;
   j=0;
-  jfin=n-1;
-  while (xs[j+2]<x[0]) j++;
-  while (xs[jfin]>x[nx-1]) jfin--;
+  jfin=n-2;
+  while (j<n-2 && xs[j+1]<x[0]) j++;
+  while (jfin>j && xs[jfin]>x[nx-1]) jfin--;
   for (;j<=jfin;j++) {
     /* Compute the coefficients of the polynomial between two knots */
     a=xs[j];
-    b=xs[j+1];
-    c=b-a;
-    d=ys[j];
-    e=ys[j+1];
-    f=ys2[j];
-    g=ys2[j+1];
-    a0=(b*d-a*e+CUBE(b)*f/6-CUBE(a)*g/6)/c+c*(a*g-b*f)/6;
-    a1=(e-d-SQUARE(b)*f/2+SQUARE(a)*g/2)/c+c*(f-g)/6;
-    a2=(b*f-a*g)/(2*c);
-    a3=(g-f)/(6*c);
-
+    h=xs[j+1]-a;
+    c0=ys[j];
+    c1=(ys[j+1]-ys[j])/h-h*(2*ys2[j]+ys2[j+1])/6;
+    c2=ys2[j]/2;
+    c3=(ys2[j+1]-ys2[j])/(6*h);
 
     prev=cur;
-    while ((cur<nx) && ((j==jfin) || (x[cur]<xs[j+1]))) cur++;
+    if (j==jfin) cur=nx;
+    else while (cur<nx && x[cur]<xs[j+1]) cur++;
 
     /* Compute the value of the spline at the sampling times x[i] */
     for (i=prev;i<cur;i++) {
-      xc=x[i];
-      y[i]=a0+a1*xc+a2*SQUARE(xc)+a3*CUBE(xc);
+      t=x[i]-a;
+      y[i]=c0+t*(c1+t*(c2+t*c3));
     }
   }
 }
@@ -10,9 +10,8 @@
 #ifndef INTERPOLATION_H
 #define INTERPOLATION_H
 
-#define SQUARE(A) (A*A)
-#define CUBE(A) (A*A*A)
-
+void spline_second_derivatives(double *,double *,int,double *,double *);
+void spline_coefficients(double *,double *,int,double *);
 void interpolation(double *,double *,double *,int,double *,int,double *, double *);
 
 #endif
@@ -73,6 +73,7 @@ input_t get_input(int nlhs,int nrhs,const mxArray *prhs[]) {
           else {/* third argument is input.stop_params.threshold */
             input.stop_params.threshold=*third;
           }
+          break;
         }
         case 2 : {
           input.stop_params.threshold=third[0];
@@ -124,6 +125,88 @@ input_t get_input(int nlhs,int nrhs,const mxArray *prhs[]) {
 }
 
 
+/************************************************************************/
+/*                                                                      */
+/* NONNEGATIVE INTEGER ARGUMENT (def if empty)                          */
+/*                                                                      */
+/************************************************************************/
+
+int get_integer(const mxArray *p,int def,const char *msg) {
+  double v;
+  if (mxIsEmpty(p))
+    return def;
+  if (!mxIsNumeric(p) || mxIsComplex(p) || mxIsSparse(p) || !mxIsDouble(p)
+  || mxGetNumberOfElements(p)!=1)
+    mexErrMsgTxt(msg);
+  v=*mxGetPr(p);
+  if (v<0 || (int)v != v)
+    mexErrMsgTxt(msg);
+  return (int)v;
+}
+
+
+/************************************************************************/
+/*                                                                      */
+/* STOPPING CRITERION [THRESHOLD,TOLERANCE] (defaults if empty)         */
+/*                                                                      */
+/************************************************************************/
+
+stop_t get_stop(const mxArray *p) {
+  stop_t stop_params;
+  double *stop;
+  stop_params.threshold = DEFAULT_THRESHOLD;
+  stop_params.tolerance = DEFAULT_TOLERANCE;
+  if (mxIsEmpty(p))
+    return stop_params;
+  if (!mxIsNumeric(p) || mxIsComplex(p) || mxIsSparse(p)
+  || !mxIsDouble(p) || mxGetNumberOfElements(p)>2)
+    mexErrMsgTxt("STOP must be a real vector of 1 or 2 elements");
+  stop=mxGetPr(p);
+  stop_params.threshold=stop[0];
+  if (mxGetNumberOfElements(p)==2)
+    stop_params.tolerance=stop[1];
+  if (stop_params.threshold <= 0)
+    mexErrMsgTxt("threshold must be a positive number");
+  if (stop_params.threshold >= 1)
+    mexWarnMsgTxt("threshold should be lower than 1");
+  if (stop_params.tolerance < 0 || stop_params.tolerance >= 1)
+    mexErrMsgTxt("tolerance must be a real number in [O,1]");
+  return stop_params;
+}
+
+
+/************************************************************************/
+/*                                                                      */
+/* SAMPLING TIMES OF SIGNALS WITH n SAMPLES                             */
+/*                                                                      */
+/* if t is empty, x=0..n-1 is allocated (*allocated is then set). Must  */
+/* be called after all other inputs are checked                         */
+/*                                                                      */
+/************************************************************************/
+
+double *get_times(const mxArray *t,int n,int *allocated) {
+  int i;
+  double *x;
+  *allocated=0;
+  if (mxIsEmpty(t)) {
+    *allocated=1;
+    x=(double *)malloc(n*sizeof(double));
+    for(i=0;i<n;i++) x[i]=i;
+    return x;
+  }
+  if (!mxIsNumeric(t) || mxIsComplex(t) || mxIsSparse(t) || !mxIsDouble(t) ||
+  SMALLER(mxGetN(t),mxGetM(t))!=1)
+    mexErrMsgTxt("T must be either empty or a double precision real vector.");
+  if (mxGetNumberOfElements(t)!=(size_t)n)
+    mexErrMsgTxt("T must have as many elements as the signals in X");
+  x=mxGetPr(t);
+  i=1;
+  while (i<n && x[i]>x[i-1]) i++;
+  if (i<n) mexErrMsgTxt("Values in T must be non decreasing");
+  return x;
+}
+
+
 /************************************************************************/
 /*                                                                      */
 /* INITIALIZATION OF THE LIST                                           */
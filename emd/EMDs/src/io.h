@@ -48,6 +48,9 @@ typedef struct {
 } imf_list_t;
 
 input_t get_input(int,int,const mxArray **);
+int get_integer(const mxArray *,int,const char *);
+stop_t get_stop(const mxArray *);
+double *get_times(const mxArray *,int,int *);
 imf_list_t init_imf_list(int);
 void add_imf(imf_list_t *,double *,int);
 void free_imf_list(imf_list_t);
@@ -0,0 +1,229 @@
+/*
+* G. Rilling, last modification: 3.2007
+* gabriel.rilling@ens-lyon.fr
+*
+* code based on a student project by T. Boustane and G. Quellec, 11.03.2004
+* supervised by P. Chainais (ISIMA - LIMOS - Universite Blaise Pascal - Clermont II
+* email : pchainai@isima.fr).
+*/
+
+/************************************************************************/
+/*                                                                      */
+/* ALLOCATE MEMORY FOR THE SIFTING OF SIGNALS WITH n SAMPLES            */
+/*                                                                      */
+/************************************************************************/
+
+sift_t init_sift(int n) {
+  sift_t w;
+  w.n=n;
+  w.criterion=1;
+  w.max_iterations=MAX_ITERATIONS;
+  w.threshold=0.05;
+  w.tolerance=0.05;
+  w.ex=init_extr(n+2*NBSYM);
+  w.c_min=(double *)malloc(4*(n+2*NBSYM)*sizeof(double));
+  w.c_max=(double *)malloc(4*(n+2*NBSYM)*sizeof(double));
+  w.z=(double *)malloc(n*sizeof(double));
+  w.m=(double *)malloc(n*sizeof(double));
+  return w;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* FREE ALLOCATED MEMORY                                                */
+/*                                                                      */
+/************************************************************************/
+
+void free_sift(sift_t w) {
+  free_extr(w.ex);
+  free(w.c_min);
+  free(w.c_max);
+  free(w.z);
+  free(w.m);
+}
+
+/************************************************************************/
+/* ABSOLUTE VALUE                                                       */
+/************************************************************************/
+
+double emd_fabs(double x) {
+  if (x <0) return -x;
+  else return x;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* SUBTRACTION OF THE LOCAL MEAN AND DETECTION OF LOCAL EXTREMA         */
+/*                                                                      */
+/* same as extr() but z[i] is replaced by z[i]-m[i] (if m is not NULL)  */
+/* in the same pass over the signal                                     */
+/*                                                                      */
+/************************************************************************/
+
+void sift_extr(double x[],double z[],double m[],int n,extrema_t *ex) {
+  int cour,n_min,n_max;
+  double zp,zc,zn;
+  if (m) {
+    if (n>0) z[0]=z[0]-m[0];
+    if (n>1) z[1]=z[1]-m[1];
+  }
+  n_min=NBSYM;
+  n_max=NBSYM;
+  /* the current sample is always written and kept only if it is an */
+  /* extremum (no unpredictable branches for noisy signals) */
+  if (n>1) {
+    zp=z[0];
+    zc=z[1];
+    for(cour=1;cour<(n-1);cour++) {
+      if (m) z[cour+1]=z[cour+1]-m[cour+1];
+      zn=z[cour+1];
+      ex->x_min[n_min]=x[cour];
+      ex->y_min[n_min]=zc;
+      n_min+=(zc<=zp) & (zc<=zn);
+      ex->x_max[n_max]=x[cour];
+      ex->y_max[n_max]=zc;
+      n_max+=(zc>=zp) & (zc>=zn);
+      zp=zc;
+      zc=zn;
+    }
+  }
+  ex->n_min=n_min-NBSYM;
+  ex->n_max=n_max-NBSYM;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* FIRST INTERVAL OF THE KNOTS xs COVERING THE INSTANT x0               */
+/*                                                                      */
+/************************************************************************/
+
+int first_interval(double *xs,int n,double x0) {
+  int j=0;
+  while (j<n-2 && xs[j+1]<x0) j++;
+  return j;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* ONE SIFTING ITERATION                                                */
+/*                                                                      */
+/* subtracts the local mean w->m from w->z (if sub is set), then        */
+/* replaces w->m by the mean of the envelopes of w->z. Returns 1 if z   */
+/* has not enough extrema. Otherwise *stop is set if the stopping       */
+/* criterion is met: all minima (maxima) are negative (positive) and    */
+/* the mean is larger than threshold times the amplitude on at most     */
+/* tolerance*n samples. Both envelopes are evaluated in the same pass   */
+/* as the mean, so that neither the envelopes nor the amplitude are     */
+/* stored                                                               */
+/*                                                                      */
+/************************************************************************/
+
+int sift_step(double *x,int n,int sub,sift_t *w,int *stop) {
+  int i,count,j_min,j_max,l_min,l_max;
+  double eps,xi,t,e_min,e_max,mi,*c,*x_min,*x_max;
+  extrema_t *ex=&w->ex;
+
+  /* subtract the previous mean and detect maxima and minima */
+  sift_extr(x,w->z,sub ? w->m : NULL,n,ex);
+  /* if not enough extrema -> stop */
+  if (ex->n_min+ex->n_max <7)
+    return 1;
+  /* add extra points at the edges */
+  boundary_conditions(x,w->z,n,ex);
+  /* spline coefficients of the upper and lower envelopes */
+  spline_coefficients(ex->x_max,ex->y_max,ex->n_max,w->c_max);
+  spline_coefficients(ex->x_min,ex->y_min,ex->n_min,w->c_min);
+
+  /* mean of the envelopes and stopping criterion: the intervals of the */
+  /* two splines are tracked along the signal (the knots are extrema of */
+  /* the signal so there is at most one new knot per sample, except     */
+  /* near the edges) and each sample is computed without branching      */
+  eps=w->threshold;
+  count=0;
+  x_min=ex->x_min;
+  x_max=ex->x_max;
+  l_min=ex->n_min-2;
+  l_max=ex->n_max-2;
+  j_min=first_interval(x_min,ex->n_min,x[0]);
+  j_max=first_interval(x_max,ex->n_max,x[0]);
+  for (i=0;i<n;i++) {
+    xi=x[i];
+    j_min+=(j_min<l_min) & (xi>=x_min[j_min+1]);
+    j_max+=(j_max<l_max) & (xi>=x_max[j_max+1]);
+    if ((j_min<l_min && xi>=x_min[j_min+1]) || (j_max<l_max && xi>=x_max[j_max+1])) {
+      while (j_min<l_min && xi>=x_min[j_min+1]) j_min++;
+      while (j_max<l_max && xi>=x_max[j_max+1]) j_max++;
+    }
+    c=w->c_min+4*j_min;
+    t=xi-x_min[j_min];
+    e_min=c[0]+t*(c[1]+t*(c[2]+t*c[3]));
+    c=w->c_max+4*j_max;
+    t=xi-x_max[j_max];
+    e_max=c[0]+t*(c[1]+t*(c[2]+t*c[3]));
+    mi=(e_max+e_min)/2;
+    w->m[i]=mi;
+    count+=(emd_fabs(mi) > eps*emd_fabs((e_max-e_min)/2));
+  }
+
+  /* sign of the extrema */
+  *stop=(count <= w->tolerance*n);
+  for (i=0;i<ex->n_min;i++) if (ex->y_min[i] > 0) *stop=0;
+  for (i=0;i<ex->n_max;i++) if (ex->y_max[i] < 0) *stop=0;
+  return 0;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* EXTRACTION OF ONE IMF                                                */
+/*                                                                      */
+/* sifts y until the stopping criterion is met (or for max_iterations   */
+/* iterations), the IMF is left in w->z. Returns the number of          */
+/* iterations (0 if y has not enough extrema)                           */
+/*                                                                      */
+/************************************************************************/
+
+int sift(double *x,double *y,int n,sift_t *w) {
+  int i,iteration_counter,stop;
+
+  for (i=0;i<n;i++) w->z[i]=y[i];
+  iteration_counter=0;
+  if (sift_step(x,n,0,w,&stop))
+    return 0;
+
+  /* SIFTING LOOP */
+  while (!(w->criterion && stop) && iteration_counter < w->max_iterations) {
+    iteration_counter++;
+    if (sift_step(x,n,1,w,&stop))
+      break;
+  }
+  return iteration_counter;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* EMPIRICAL MODE DECOMPOSITION                                         */
+/*                                                                      */
+/* extracts IMFs from y (at most max_imfs if max_imfs>0) and appends    */
+/* them to list, y is replaced by the residual. Returns the number of   */
+/* IMFs                                                                 */
+/*                                                                      */
+/************************************************************************/
+
+int emd_core(double *x,double *y,int n,int max_imfs,sift_t *w,imf_list_t *list) {
+  int i,nb_imfs,iteration_counter;
+
+  nb_imfs=0;
+  while (!max_imfs || (nb_imfs < max_imfs)) {
+
+    iteration_counter = sift(x,y,n,w);
+
+        /* save current IMF into list if at least     */
+        /* one sifting iteration has been performed */
+    if (!iteration_counter)
+      break;
+    add_imf(list,w->z,iteration_counter);
+    nb_imfs++;
+    for (i=0;i<n;i++) y[i]=y[i]-w->z[i];
+  }
+  return nb_imfs;
+}
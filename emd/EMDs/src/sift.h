@@ -0,0 +1,35 @@
+/*
+* G. Rilling, last modification: 3.2007
+* gabriel.rilling@ens-lyon.fr
+*
+* code based on a student project by T. Boustane and G. Quellec, 11.03.2004
+* supervised by P. Chainais (ISIMA - LIMOS - Universite Blaise Pascal - Clermont II
+* email : pchainai@isima.fr).
+*/
+
+#ifndef SIFT_H
+#define SIFT_H
+
+/* workspace and parameters of the sifting loop (allocated once, reused */
+/* for every IMF). Sifting stops when the stopping criterion of emdc is */
+/* met (if criterion is set) or after max_iterations iterations         */
+typedef struct {
+  int n;
+  int criterion;
+  int max_iterations;
+  double threshold;
+  double tolerance;
+  extrema_t ex;
+  double *c_min; /* spline coefficients of the lower envelope */
+  double *c_max; /* spline coefficients of the upper envelope */
+  double *z;     /* current mode */
+  double *m;     /* local mean */
+} sift_t;
+
+sift_t init_sift(int);
+void free_sift(sift_t);
+int sift_step(double *,int,int,sift_t *,int *);
+int sift(double *,double *,int,sift_t *);
+int emd_core(double *,double *,int,int,sift_t *,imf_list_t *);
+
+#endif
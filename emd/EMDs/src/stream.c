@@ -0,0 +1,152 @@
+/************************************************************************/
+/*                                                                      */
+/* ALLOCATE MEMORY FOR A STREAM                                         */
+/*                                                                      */
+/* windows of window samples overlapping by overlap samples (at most    */
+/* window/2), nb_imfs IMFs are extracted from each window. The sifting  */
+/* parameters can be changed in the field w of the stream               */
+/*                                                                      */
+/************************************************************************/
+
+stream_t init_stream(int window,int overlap,int nb_imfs,emit_t emit,void *ctx) {
+  stream_t s;
+  int i,m=nb_imfs+1;
+  s.window=window;
+  s.overlap=overlap;
+  s.nb_imfs=nb_imfs;
+  s.has_tail=0;
+  s.fill=0;
+  s.pos=0;
+  s.x=(double *)malloc(window*sizeof(double));
+  for (i=0;i<window;i++) s.x[i]=i;
+  s.buf=(double *)malloc(window*sizeof(double));
+  s.y=(double *)malloc(window*sizeof(double));
+  s.dec=(double *)malloc((size_t)m*window*sizeof(double));
+  s.tail=(double *)malloc(((size_t)m*overlap+1)*sizeof(double));
+  s.seg=(double *)malloc((size_t)m*window*sizeof(double));
+  s.w=init_sift(window);
+  s.emit=emit;
+  s.ctx=ctx;
+  return s;
+}
+
+/************************************************************************/
+/*                                                                      */
+/* FREE ALLOCATED MEMORY                                                */
+/*                                                                      */
+/************************************************************************/
+
+void free_stream(stream_t s) {
+  free(s.x);
+  free(s.buf);
+  free(s.y);
+  free(s.dec);
+  free(s.tail);
+  free(s.seg);
+  free_sift(s.w);
+}
+
+/************************************************************************/
+/*                                                                      */
+/* DECOMPOSITION OF THE WINDOW [pos,pos+len)                            */
+/*                                                                      */
+/* the first samples are blended with the previous window: the weight   */
+/* of the current window grows linearly over the middle half of the     */
+/* overlap, so that the first and last quarters (nearest to the edges   */
+/* of the windows) only come from the window where they are inner       */
+/* samples. Emits the IMFs up to the overlap with the next window (up   */
+/* to the end if last is set) and keeps the overlap as the new tail     */
+/*                                                                      */
+/************************************************************************/
+
+void stream_window(stream_t *s,int len,int last) {
+  int i,k,q,b,o,end,m=s->nb_imfs+1,W=s->window,O=s->overlap;
+  double a,*d,*seg=s->seg;
+
+  /* EMD of the window (at most nb_imfs IMFs, the others are zero) */
+  for (i=0;i<len;i++) s->y[i]=s->buf[i];
+  for (k=0;k<s->nb_imfs;k++) {
+    d=s->dec+(size_t)k*W;
+    if (!sift(s->x,s->y,len,&s->w))
+      break;
+    for (i=0;i<len;i++) {
+      d[i]=s->w.z[i];
+      s->y[i]-=d[i];
+    }
+  }
+  for (;k<s->nb_imfs;k++)
+    for (i=0;i<len;i++) s->dec[(size_t)k*W+i]=0;
+  for (i=0;i<len;i++) s->dec[(size_t)s->nb_imfs*W+i]=s->y[i];
+
+  /* output segment (blended with the tail of the previous window) */
+  end=last ? len : len-O;
+  o=s->has_tail ? SMALLER(O,len) : 0;
+  q=O/4;
+  b=O-2*q;
+  for (i=0;i<end;i++)
+    for (k=0;k<m;k++) seg[(size_t)i*m+k]=s->dec[(size_t)k*W+i];
+  for (i=0;i<o;i++) {
+    a=(i<q) ? 0 : ((i>=q+b) ? 1 : (i-q+0.5)/b);
+    for (k=0;k<m;k++)
+      seg[(size_t)i*m+k]=a*s->dec[(size_t)k*W+i]+(1-a)*s->tail[(size_t)k*O+i];
+  }
+  if (end>0)
+    s->emit(seg,m,end,s->pos,s->ctx);
+
+  /* keep the overlap with the next window */
+  if (!last) {
+    for (k=0;k<m;k++)
+      for (i=0;i<O;i++) s->tail[(size_t)k*O+i]=s->dec[(size_t)k*W+len-O+i];
+    s->has_tail=1;
+  }
+}
+
+/************************************************************************/
+/*                                                                      */
+/* APPEND n SAMPLES TO THE STREAM                                       */
+/*                                                                      */
+/* every full window is decomposed (and its IMFs emitted) right away    */
+/*                                                                      */
+/************************************************************************/
+
+void stream_push(stream_t *s,double *y,int n) {
+  int i,c,h=s->window-s->overlap;
+  while (n>0) {
+    c=SMALLER(n,s->window-s->fill);
+    for (i=0;i<c;i++) s->buf[s->fill+i]=y[i];
+    s->fill+=c;
+    y+=c;
+    n-=c;
+    if (s->fill==s->window) {
+      stream_window(s,s->window,0);
+      for (i=0;i<s->overlap;i++) s->buf[i]=s->buf[h+i];
+      s->pos+=h;
+      s->fill=s->overlap;
+    }
+  }
+}
+
+/************************************************************************/
+/*                                                                      */
+/* END OF THE STREAM                                                    */
+/*                                                                      */
+/* decomposes the remaining samples as a last (shorter) window and      */
+/* emits the IMFs up to the end of the stream                           */
+/*                                                                      */
+/************************************************************************/
+
+void stream_flush(stream_t *s) {
+  int i,k,m=s->nb_imfs+1,O=s->overlap;
+  if (s->has_tail && s->fill==O) {
+    /* no new sample since the last window */
+    for (i=0;i<O;i++)
+      for (k=0;k<m;k++) s->seg[(size_t)i*m+k]=s->tail[(size_t)k*O+i];
+    if (O>0)
+      s->emit(s->seg,m,O,s->pos,s->ctx);
+  } else if (s->fill>0) {
+    stream_window(s,s->fill,1);
+  }
+  s->pos+=s->fill;
+  s->fill=0;
+  s->has_tail=0;
+}
@@ -0,0 +1,41 @@
+/*
+* streaming EMD: the signal is pushed by chunks of any size and decomposed
+* by overlapping windows with the sifting core of emdc (sift.c). The
+* decompositions of two consecutive windows are blended over their
+* overlap and the IMFs are emitted by segments as soon as they are final,
+* so that the memory only depends on the window size.
+*/
+
+#ifndef EMD_STREAM_H
+#define EMD_STREAM_H
+
+/* called with the IMFs of samples [first,first+len) of the stream: seg  */
+/* is m x len (column major, one sample per column), the last row is     */
+/* the residual                                                          */
+typedef void (*emit_t)(double *seg,int m,int len,long long first,void *ctx);
+
+typedef struct {
+  int window;         /* samples per window */
+  int overlap;        /* samples shared by consecutive windows */
+  int nb_imfs;        /* IMFs per window (missing IMFs are zero) */
+  int has_tail;       /* set once a window has been decomposed */
+  int fill;           /* number of samples in buf */
+  long long pos;      /* index of the first sample in buf */
+  double *x;          /* sampling times of a window (0..window-1) */
+  double *buf;        /* samples [pos,pos+fill) */
+  double *y;          /* residual of the current window */
+  double *dec;        /* IMFs and residual of the current window */
+  double *tail;       /* IMFs and residual of the previous window on */
+                      /* [pos,pos+overlap) */
+  double *seg;        /* output segment */
+  sift_t w;
+  emit_t emit;
+  void *ctx;
+} stream_t;
+
+stream_t init_stream(int,int,int,emit_t,void *);
+void free_stream(stream_t);
+void stream_push(stream_t *,double *,int);
+void stream_flush(stream_t *);
+
+#endif
@@ -67,6 +67,11 @@ function pyramid = chnsPyramid( I, varargin )
 % optimization. Computing the full set of (approximated) *multi-scale*
 % channels on a 480x640 image runs over *30 fps* on a single core of a
 % machine from 2011 (although runtime depends on input parameters).
+% When the compiled chnsPyramidMex is available (and no custom channels are
+% enabled) the whole pyramid is computed natively: the real scales are
+% computed in parallel without creating intermediate arrays, and the
+% approximated scales are resampled, smoothed and padded in a second call.
+% The result is identical to calling chnsCompute() on every real scale.
 %
 % USAGE
 %  pPyramid = chnsPyramid()
@@ -139,15 +144,24 @@ isR=isR:nApprox+1:nScales; isA=1:nScales; isA(isR)=[];
 j=[0 floor((isR(1:end-1)+isR(2:end))/2) nScales];
 isN=1:nScales; for i=1:length(isR), isN(j(i)+1:j(i+1))=isR(i); end
 nTypes=0; data=cell(nScales,nTypes); info=struct([]);
+hws=round(scales(:)*sz/shrink); useMex=useChnsMex(I,pChns,hws,isR,smooth);
 
-% compute image pyramid [real scales]
-for i=isR
-  s=scales(i); sz1=round(sz*s/shrink)*shrink;
-  if(all(sz==sz1)), I1=I; else I1=imResampleMex(I,sz1(1),sz1(2),1); end
-  if(s==.5 && (nApprox>0 || nPerOct==1)), I=I1; end
-  chns=chnsCompute(I1,pChns); info=chns.info;
-  if(i==isR(1)), nTypes=chns.nTypes; data=cell(nScales,nTypes); end
-  data(i,:) = chns.data;
+% compute image pyramid [real scales] (natively in a single call if possible)
+if( useMex )
+  iHalf=find(scales(isR)==.5,1); if(~(nApprox>0 || nPerOct==1)), iHalf=[]; end
+  if(isempty(iHalf)), iHalf=0; end
+  d=chnsPyramidMex('real',I,hws(isR,:)*shrink,iHalf,pChns);
+  info=chnsInfo(pChns,size(I,3)); nTypes=length(info);
+  data=cell(nScales,nTypes); data(isR,:)=d;
+else
+  for i=isR
+    s=scales(i); sz1=round(sz*s/shrink)*shrink;
+    if(all(sz==sz1)), I1=I; else I1=imResampleMex(I,sz1(1),sz1(2),1); end
+    if(s==.5 && (nApprox>0 || nPerOct==1)), I=I1; end
+    chns=chnsCompute(I1,pChns); info=chns.info;
+    if(i==isR(1)), nTypes=chns.nTypes; data=cell(nScales,nTypes); end
+    data(i,:) = chns.data;
+  end
 end
 
 % if lambdas not specified compute image specific lambdas
@@ -160,20 +174,27 @@ if( nScales>0 && nApprox>0 && isempty(lambdas) )
   lambdas = - log2(f0./f1) / log2(scales(is(1))/scales(is(2)));
 end
 
-% compute image pyramid [approximated scales]
-for i=isA
-  iR=isN(i); sz1=round(sz*scales(i)/shrink);
-  for j=1:nTypes, ratio=(scales(i)/scales(iR)).^-lambdas(j);
-    data{i,j}=imResampleMex(data{iR,j},sz1(1),sz1(2),ratio); end
+% compute image pyramid [approximated scales], smooth, pad and concatenate
+if( useMex )
+  ratios=zeros(nScales,nTypes);
+  for i=isA, ratios(i,:)=(scales(i)/scales(isN(i))).^-lambdas(:)'; end
+  data=chnsPyramidMex('approx',data,isN,hws,ratios,smooth,pad/shrink,...
+    {info.padWith},concat);
+else
+  % compute image pyramid [approximated scales]
+  for i=isA
+    iR=isN(i); sz1=round(sz*scales(i)/shrink);
+    for j=1:nTypes, ratio=(scales(i)/scales(iR)).^-lambdas(j);
+      data{i,j}=imResampleMex(data{iR,j},sz1(1),sz1(2),ratio); end
+  end
+  % smooth channels, optionally pad and concatenate channels
+  for i=1:nScales*nTypes, data{i}=convTri(data{i},smooth); end
+  if(any(pad)), for i=1:nScales, for j=1:nTypes
+        data{i,j}=imPad(data{i,j},pad/shrink,info(j).padWith); end; end; end
+  if(concat && nTypes), data0=data; data=cell(nScales,1); end
+  if(concat && nTypes), for i=1:nScales, data{i}=cat(3,data0{i,:}); end; end
 end
 
-% smooth channels, optionally pad and concatenate channels
-for i=1:nScales*nTypes, data{i}=convTri(data{i},smooth); end
-if(any(pad)), for i=1:nScales, for j=1:nTypes
-      data{i,j}=imPad(data{i,j},pad/shrink,info(j).padWith); end; end; end
-if(concat && nTypes), data0=data; data=cell(nScales,1); end
-if(concat && nTypes), for i=1:nScales, data{i}=cat(3,data0{i,:}); end; end
-
 % create output struct
 j=info; if(~isempty(j)), j=find(strcmp('color channels',{j.name})); end
 if(~isempty(j)), info(j).pChn.colorSpace=cs; end
@@ -183,6 +204,29 @@ pyramid = struct( 'pPyramid',pPyramid, 'nTypes',nTypes, ...
 
 end
 
+function useMex = useChnsMex( I, pChns, hws, isR, smooth )
+% Check if chnsPyramidMex applies (it implements the mex code paths only).
+p=pChns.pCustom; useMex=~isempty(isR) && isa(I,'single') && ndims(I)<=3 ...
+  && ~any([p.enabled]) && exist('chnsPyramidMex','file')==3 && ...
+  (pChns.pColor.enabled || pChns.pGradMag.enabled || pChns.pGradHist.enabled);
+if(~useMex), return; end
+% convTri() must not fall back to its nomex code (see convTri.m)
+m=min(min(hws(isR,:)))*pChns.shrink; m1=min(hws(:));
+r=[pChns.pColor.smooth pChns.pGradMag.normRad];
+useMex = m>=4 && all(r==0 | 2*r+1<m) && ...
+  (smooth==0 || (m1>=4 && 2*smooth+1<m1));
+end
+
+function info = chnsInfo( pChns, nColor )
+% Channel info as created by chnsCompute() (see addChn there).
+p=pChns.pGradHist; o=p.nOrients;
+if(p.useHog==0), n=o; elseif(p.useHog==1), n=o*4; else n=o*3+5; end
+info=struct('name',{'color channels','gradient magnitude',...
+  'gradient histogram'},'pChn',{pChns.pColor,pChns.pGradMag,p},...
+  'nChns',{nColor,1,n},'padWith',{'replicate',0,0});
+info=info([pChns.pColor.enabled pChns.pGradMag.enabled p.enabled]~=0);
+end
+
 function [scales,scaleshw] = getScales(nPerOct,nOctUp,minDs,shrink,sz)
 % set each scale s such that max(abs(round(sz*s/shrink)*shrink-sz*s)) is
 % minimized without changing the smaller dim of sz (tricky algebra)
@@ -1,4 +1,4 @@
-function J = convBox( I, r, s, nomex )
+function J = convBox( I, r, s, nomex, nThreads )
 % Extremely fast 2D image convolution with a box filter.
 %
 % Convolves an image by a F=ones(2*r+1,2*r+1)/(2*r+1)^2 filter. The
@@ -15,7 +15,7 @@ function J = convBox( I, r, s, nomex )
 %  f = ones(1,2*r+1); f=f/sum(f);
 %  J = padarray(I,[r r],'symmetric','both');
 %  J = convn(convn(J,f,'valid'),f','valid');
-%  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:); end
+%  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:,:); end
 % The computation, however, is an order of magnitude faster than the above.
 %
 % When used as a smoothing filter, the standard deviation (sigma) of a box
@@ -27,20 +27,24 @@ function J = convBox( I, r, s, nomex )
 % The related function convTri performs convolution with a triangle filter,
 % which has nicer properties if used for smoothing, but is slightly slower.
 %
+% Channels (and bands of columns) are processed in parallel if compiled with
+% OpenMP, an [hxwxkxn] stack of n images can be convolved in a single call.
+%
 % This code requires SSE2 to compile and run (most modern Intel and AMD
 % processors support SSE2). Please see: http://en.wikipedia.org/wiki/SSE2.
 %
 % USAGE
-%  J = convBox( I, r, [s], [nomex] )
+%  J = convBox( I, r, [s], [nomex], [nThreads] )
 %
 % INPUTS
-%  I      - [hxwxk] input k channel single image
+%  I      - [hxwxk] input k channel single image (or [hxwxkxn] stack)
 %  r      - integer filter radius
 %  s      - [1] integer downsampling amount after convolving
 %  nomex  - [0] if true perform computation in matlab (for testing/timing)
+%  nThreads - [inf] max number of computational threads to use
 %
 % OUTPUTS
-%  J      - [hxwxk] smoothed image
+%  J      - [hxwxk] smoothed image (or [hxwxkxn] stack)
 %
 % EXAMPLE
 %  I = single(imResample(imread('cameraman.tif'),[480 640]))/255;
@@ -58,18 +62,19 @@ function J = convBox( I, r, s, nomex )
 assert( r>=0 );
 if( nargin<3 ), s=1; end
 if( nargin<4 ), nomex=0; end
+if( nargin<5 ), nThreads=1e5; end
 if( isempty(I) || (r==0 && s==1) ), J = I; return; end
 m=min(size(I,1),size(I,2)); if( m<4 || 2*r+1>=m ), nomex=1; end
 
 if( nomex==0 )
   if( r==1 && s<=2 )
-    J = convConst('convTri1',I,1,s);
+    J = convConst('convTri1',I,1,s,nThreads);
   else
-    J = convConst('convBox',I,r,s);
+    J = convConst('convBox',I,r,s,nThreads);
   end
 else
   f = ones(1,2*r+1); f=f/sum(f);
   J = padarray(I,[r r],'symmetric','both');
   J = convn(convn(J,f,'valid'),f','valid');
-  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:); end
+  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:,:); end
 end
@@ -1,4 +1,4 @@
-function J = convMax( I, r, nomex )
+function J = convMax( I, r, nomex, nThreads )
 % Extremely fast 2D image convolution with a max filter.
 %
 % For each location computes J(y,x) = max(max(I(y-r:y+r,x-r:x+r))). The
@@ -17,15 +17,16 @@ function J = convMax( I, r, nomex )
 % The computation, however, is an order of magnitude faster than the above.
 %
 % USAGE
-%  J = convMax( I, r, [nomex] )
+%  J = convMax( I, r, [nomex], [nThreads] )
 %
 % INPUTS
-%  I      - [hxwxk] input k channel single image
+%  I      - [hxwxk] input k channel single image (or [hxwxkxn] stack)
 %  r      - integer filter radius or radii along y and x
 %  nomex  - [0] if true perform computation in matlab (for testing/timing)
+%  nThreads - [inf] max number of computational threads to use
 %
 % OUTPUTS
-%  J      - [hxwxk] max image
+%  J      - [hxwxk] max image (or [hxwxkxn] stack)
 %
 % EXAMPLE
 %  I = single(imResample(imread('cameraman.tif'),[480 640]))/255;
@@ -42,20 +43,18 @@ function J = convMax( I, r, nomex )
 
 assert( all(r>=0) );
 if( nargin<3 ), nomex=0; end
+if( nargin<4 ), nThreads=1e5; end
 if( all(r==0) ), J = I; return; end
 if( numel(r)==1 ), ry=r; rx=r; else ry=r(1); rx=r(2); end
 
 if( nomex==0 )
-  d=size(I,3);
-  if(d==1), J=convConst('convMax',convConst('convMax',I,ry,1)',rx,1)'; else
-    J=I; for z=1:d, J(:,:,z) = ...
-        convConst('convMax',convConst('convMax',J(:,:,z),ry,1)',rx,1)'; end
-  end
+  J=permute(convConst('convMax',I,ry,1,nThreads),[2 1 3 4]);
+  J=permute(convConst('convMax',J,rx,1,nThreads),[2 1 3 4]);
 else
   I=padarray(I,[ry rx],'replicate','both'); [h,w,d]=size(I); J=I;
   for z=1:d, for x=rx+1:w-rx, for y=ry+1:h-ry
         J(y,x,z) = max(max(I(y-ry:y+ry,x-rx:x+rx,z))); end; end; end
-  J=J(ry+1:h-ry,rx+1:w-rx,:);
+  J=J(ry+1:h-ry,rx+1:w-rx,:,:);
 end
 
 end
@@ -1,4 +1,4 @@
-function J = convTri( I, r, s, nomex )
+function J = convTri( I, r, s, nomex, nThreads )
 % Extremely fast 2D image convolution with a triangle filter.
 %
 % Convolves an image by a 2D triangle filter (the 1D triangle filter f is
@@ -16,7 +16,7 @@ function J = convTri( I, r, s, nomex )
 %  f = [1:r r+1 r:-1:1]/(r+1)^2;
 %  J = padarray(I,[r r],'symmetric','both');
 %  J = convn(convn(J,f,'valid'),f','valid');
-%  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:); end
+%  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:,:); end
 % The computation, however, is an order of magnitude faster than the above.
 %
 % When used as a smoothing filter, the standard deviation (sigma) of a tri
@@ -39,21 +39,25 @@ function J = convTri( I, r, s, nomex )
 % The related function convBox performs convolution with a box filter,
 % which is slightly faster but has worse properties if used for smoothing.
 %
+% Channels (and bands of columns) are processed in parallel if compiled with
+% OpenMP, an [hxwxkxn] stack of n images can be convolved in a single call.
+%
 % This code requires SSE2 to compile and run (most modern Intel and AMD
 % processors support SSE2). Please see: http://en.wikipedia.org/wiki/SSE2.
 %
 % USAGE
-%  J = convTri( I, r, [s], [nomex] )
+%  J = convTri( I, r, [s], [nomex], [nThreads] )
 %
 % INPUTS
-%  I      - [hxwxk] input k channel single image
+%  I      - [hxwxk] input k channel single image (or [hxwxkxn] stack)
 %  r      - integer filter radius (or any value between 0 and 1)
 %           filter standard deviation is: sigma=sqrt(r*(r+2)/6)
 %  s      - [1] integer downsampling amount after convolving
 %  nomex  - [0] if true perform computation in matlab (for testing/timing)
+%  nThreads - [inf] max number of computational threads to use
 %
 % OUTPUTS
-%  J      - [hxwxk] smoothed image
+%  J      - [hxwxk] smoothed image (or [hxwxkxn] stack)
 %
 % EXAMPLE - matlab versus mex
 %  I = single(imResample(imread('cameraman.tif'),[480 640]))/255;
@@ -77,19 +81,20 @@ function J = convTri( I, r, s, nomex )
 
 if( nargin<3 ), s=1; end
 if( nargin<4 ), nomex=0; end
+if( nargin<5 ), nThreads=1e5; end
 if( isempty(I) || (r==0 && s==1) ), J = I; return; end
 m=min(size(I,1),size(I,2)); if( m<4 || 2*r+1>=m ), nomex=1; end
 
 if( nomex==0 )
   if( r>0 && r<=1 && s<=2 )
-    J = convConst('convTri1',I,12/r/(r+2)-2,s);
+    J = convConst('convTri1',I,12/r/(r+2)-2,s,nThreads);
   else
-    J = convConst('convTri',I,r,s);
+    J = convConst('convTri',I,r,s,nThreads);
   end
 else
   if(r<=1), p=12/r/(r+2)-2; f=[1 p 1]/(2+p); r=1;
   else f=[1:r r+1 r:-1:1]/(r+1)^2; end
   J = padarray(I,[r r],'symmetric','both');
   J = convn(convn(J,f,'valid'),f','valid');
-  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:); end
+  if(s>1), t=floor(s/2)+1; J=J(t:s:end-s+t,t:s:end-s+t,:,:); end
 end
@@ -1,4 +1,4 @@
-function H = fhog( I, binSize, nOrients, clip, crop )
+function H = fhog( I, binSize, nOrients, clip, crop, scales, nThreads )
 % Efficiently compute Felzenszwalb's HOG (FHOG) features.
 %
 % A fast implementation of the HOG variant used by Felzenszwalb et al.
@@ -22,27 +22,45 @@ function H = fhog( I, binSize, nOrients, clip, crop )
 %  H = gradientHist(M,O,binSize,nOrients,softBin,useHog,clip);
 % See gradientHist() for more general usage.
 %
+% Features for a whole stack of K images (e.g. the frames of a video) can
+% be computed in a single call by passing I as a [hxwxdxK] array (use d=1
+% for grayscale frames). Optionally scales gives a list of scales at which
+% to compute the features of every image (the stack is resampled with
+% imResample), in which case H is a cell array with one entry per scale.
+% Stacks are processed by gradientMex in parallel (over images, or over
+% bands of columns of each image if there are fewer images than threads)
+% and the results are identical to calling fhog() on each image.
+%
 % This code requires SSE2 to compile and run (most modern Intel and AMD
 % processors support SSE2). Please see: http://en.wikipedia.org/wiki/SSE2.
 %
 % USAGE
-%  H = fhog( I, [binSize], [nOrients], [clip], [crop] )
+%  H = fhog( I, [binSize], [nOrients], [clip], [crop], [scales], [nThreads] )
 %
 % INPUTS
 %  I        - [hxw] color or grayscale input image (must have type single)
+%             or [hxwxdxK] stack of K images with d channels each
 %  binSize  - [8] spatial bin size
 %  nOrients - [9] number of orientation bins
 %  clip     - [.2] value at which to clip histogram bins
 %  crop     - [0] if true crop boundaries
+%  scales   - [] optional list of scales (result is a cell array)
+%  nThreads - [inf] max number of computational threads to use
 %
 % OUTPUTS
 %  H        - [h/binSize w/binSize nOrients*3+5] computed hog features
+%             (with a 4th dimension of size K if I is a stack)
 %
 % EXAMPLE
 %  I=imResample(single(imread('peppers.png'))/255,[480 640]);
 %  tic, for i=1:100, H=fhog(I,8,9); end; disp(100/toc) % >125 fps
 %  figure(1); im(I); V=hogDraw(H,25,1); figure(2); im(V)
 %
+% EXAMPLE - stack of frames at multiple scales
+%  I=imResample(single(imread('peppers.png'))/255,[240 320]);
+%  I=repmat(I,[1 1 1 20]); tic, Hs=fhog(I,8,9,.2,0,[1 .5]); toc
+%  H=fhog(I(:,:,:,1)); isequal(H,Hs{1}(:,:,:,1))
+%
 % EXAMPLE
 %  % comparison to features.cc (requires DPM code release version 5)
 %  I=imResample(single(imread('peppers.png'))/255,[480 640]); Id=double(I);
@@ -61,10 +79,28 @@ if( nargin<2 ), binSize=8; end
 if( nargin<3 ), nOrients=9; end
 if( nargin<4 ), clip=.2; end
 if( nargin<5 ), crop=0; end
+if( nargin<6 ), scales=[]; end
+if( nargin<7 ), nThreads=1e5; end
 
 softBin = -1; useHog = 2; b = binSize;
-[M,O] = gradientMag( I,0,0,0,1 );
-H = gradientHist(M,O,binSize,nOrients,softBin,useHog,clip);
-if( crop ), e=mod(size(I),b)<b/2; H=H(2:end-e(1),2:end-e(2),:); end
+if( ndims(I)<=3 && isempty(scales) )
+  [M,O] = gradientMag( I,0,0,0,1 );
+  H = gradientHist(M,O,binSize,nOrients,softBin,useHog,clip);
+  if( crop ), e=mod(size(I),b)<b/2; H=H(2:end-e(1),2:end-e(2),:); end
+  return;
+end
+
+% compute features of the whole stack at each scale
+siz=size(I); siz(end+1:4)=1; if(isempty(scales)), scales=1; end
+nScales=numel(scales); Hs=cell(1,nScales);
+for i=1:nScales
+  sz=round(siz(1:2)*scales(i)); Is=I;
+  if(any(sz~=siz(1:2))), Is=reshape(imResample(reshape(I,...
+      siz(1),siz(2),[]),sz),[sz siz(3:4)]); end
+  H=gradientMex('fhog',Is,binSize,nOrients,clip,nThreads);
+  if( crop ), e=mod(sz,b)<b/2; H=H(2:end-e(1),2:end-e(2),:,:); end
+  Hs{i}=H;
+end
+if( nScales==1 ), H=Hs{1}; else H=Hs; end
 
 end
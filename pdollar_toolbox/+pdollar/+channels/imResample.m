@@ -1,4 +1,4 @@
-function B = imResample( A, scale, method, norm )
+function B = imResample( A, scale, method, norm, nThreads )
 % Fast bilinear image downsampling/upsampling.
 %
 % Gives similar results to imresize with the bilinear option and
@@ -6,17 +6,23 @@ function B = imResample( A, scale, method, norm )
 % dims are off by 1 pixel. For very small values of the scale imresize is
 % faster but only looks at subset of values of original image.
 %
+% Bilinear resampling processes the columns of all channels in parallel (if
+% compiled with OpenMP). Interpolation coefficients are cached by source and
+% target size, so repeatedly resampling images of the same dimensions (for
+% example in chnsPyramid) does not recompute them.
+%
 % This code requires SSE2 to compile and run (most modern Intel and AMD
 % processors support SSE2). Please see: http://en.wikipedia.org/wiki/SSE2.
 %
 % USAGE
-%  B = imResample( A, scale, [method], [norm] )
+%  B = imResample( A, scale, [method], [norm], [nThreads] )
 %
 % INPUT
 %  A        - input image (2D or 3D single, double or uint8 array)
 %  scale    - scalar resize factor [s] of target height and width [h w]
 %  method   - ['bilinear'] either 'bilinear' or 'nearest'
 %  norm     - [1] optionally multiply every output pixel by norm
+%  nThreads - [inf] max number of computational threads to use (bilinear)
 %
 % OUPUT
 %   B       - resampled image
@@ -39,6 +45,7 @@ if( nargin<3 || isempty(method) ), bilinear=1; else
   bilinear = ~strcmpi(method,'nearest');
 end
 if( nargin<4 || isempty(norm) ), norm=1; end
+if( nargin<5 || isempty(nThreads) ), nThreads=1e5; end
 [m,n,~]=size(A); k=numel(scale);
 same = (k==1 && scale==1) | (k==2 && m==scale(1) && n==scale(2));
 if( same && norm==1 ); B=A; return; end
@@ -47,7 +54,7 @@ if( bilinear )
   % use bilinear interpolation
   if(k==1), m1=round(scale*m); n1=round(scale*n);
   else m1=scale(1); n1=scale(2); end
-  B=imResampleMex(A,m1,n1,norm);
+  B=imResampleMex(A,m1,n1,norm,nThreads);
 else
   % use nearest neighbor interpolation
   if(k==1), sy=scale; sx=sy; m1=ceil(m*sy); n1=ceil(n*sx);
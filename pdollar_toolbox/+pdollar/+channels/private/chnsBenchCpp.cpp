@@ -0,0 +1,57 @@
+/*******************************************************************************
+* Piotr's Computer Vision Matlab Toolbox      Version 3.00
+* Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rgbConvertMex.cpp"
+#include "imPadMex.cpp"
+#include "convConst.cpp"
+#include "imResampleMex.cpp"
+#include "gradientMex.cpp"
+
+// time nReps calls of stmt and print the average time per call in ms
+#define BENCH(name,stmt) { clock_t t0=clock(); \
+  for( int r=0; r<nReps; r++ ) { stmt; } \
+  double ms=1000.0*(clock()-t0)/CLOCKS_PER_SEC/nReps; \
+  printf("%-12s %4dx%4d %9.2f ms\n",name,h,w,ms); }
+
+// time the channel kernels on a single color image of size h x w
+void bench( int h, int w, int nReps )
+{
+  const int n=h*w, d=3, h2=h/2, w2=w/2, bin=4, nOrients=6;
+  float *I, *J, *T, *L, *R, *M, *O, *S, *H;
+  I = (float*) alMalloc(n*d*sizeof(float),64);
+  for( int i=0; i<n*d; i++ ) I[i]=float(rand())/RAND_MAX;
+  T = (float*) alMalloc(n*d*sizeof(float),64);
+  R = (float*) alMalloc(h2*w2*d*sizeof(float),64);
+  M = (float*) alMalloc(n*sizeof(float),64);
+  O = (float*) alMalloc(n*sizeof(float),64);
+  S = (float*) alMalloc(n*sizeof(float),64);
+  H = (float*) wrCalloc((h/bin)*(w/bin)*nOrients,sizeof(float));
+  L = rgbConvert(I,n,d,2,1.0f); wrFree(L);
+  BENCH("rgb2luv",  J=rgbConvert(I,n,d,2,1.0f); wrFree(J));
+  BENCH("convTri",  convTri(I,T,h,w,d,5,1));
+  BENCH("convTri1", convTri1(I,T,h,w,d,2.0f,1));
+  BENCH("convBox",  convBox(I,T,h,w,d,5,1));
+  BENCH("resample", resample(I,R,h,h2,w,w2,d,1.0f));
+  BENCH("gradMag",  gradMag(I,M,O,h,w,d,false));
+  convTri(M,S,h,w,1,5,1);
+  BENCH("gradNorm", memcpy(T,M,n*sizeof(float)); gradMagNorm(T,S,h,w,.005f));
+  BENCH("gradHist", memset(H,0,(h/bin)*(w/bin)*nOrients*sizeof(float));
+    gradHist(M,O,H,h,w,bin,nOrients,0,false));
+  alFree(I); alFree(T); alFree(R); alFree(M); alFree(O); alFree(S); wrFree(H);
+}
+
+// benchmark standalone channels source code at 1080p and 4K, compile with
+// -O2 (SSE), -O2 -mavx2 -DUSEAVX2 or -O2 -mavx512f -DUSEAVX512 (see sse.hpp)
+int main(int argc, const char* argv[])
+{
+  const int nReps = argc>1 ? atoi(argv[1]) : 10;
+  printf("vector width: %d floats\n",VW);
+  bench(1080,1920,nReps);
+  bench(2160,3840,nReps);
+  return 0;
+}
@@ -0,0 +1,319 @@
+/*******************************************************************************
+* Piotr's Computer Vision Matlab Toolbox      Version 3.30
+* Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#include "mex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+// The channel sources are compiled in without their mex gateways. This also
+// makes wrappers.hpp use the C allocators, which (unlike mxMalloc) may be
+// called from multiple threads.
+#undef MATLAB_MEX_FILE
+#include "convConst.cpp"
+#include "imResampleMex.cpp"
+#include "imPadMex.cpp"
+#include "gradientMex.cpp"
+using namespace std;
+
+// parameters of chnsCompute() (see chnsCompute.m)
+struct ChnsPrm {
+  int shrink, colorEn, gradMagEn, colorChn, full, gradHistEn;
+  int binSize, nOrients, softBin, useHog; double colorSmooth, normRad;
+  float normConst, clipHog;
+};
+
+// per thread scratch memory, reused across scales (see scratch())
+struct Scratch { float *A, *B, *M, *O, *S, *H; };
+
+// B=convTri(A,r) for r>0 (see convTri.m, caller checks that the mex is used)
+void convTriM( float *A, float *B, int h, int w, int d, double r ) {
+  if( r<=1 ) convTri1(A,B,h,w,d,float(12/r/(r+2)-2),1);
+  else convTri(A,B,h,w,d,int(r),1);
+}
+
+// B=imResampleMex(A,hb,wb,r) with B a scratch or zero initialized array
+void resampleM( float *A, float *B, int ha, int hb, int wa, int wb, int d,
+  float r, bool zero )
+{
+  if( zero ) memset(B,0,hb*wb*d*sizeof(float));
+  resample(A,B,ha,hb,wa,wb,d,r);
+}
+
+// allocate n floats of 16 byte aligned scratch memory (aligned like mxArrays)
+float* scratch( size_t n ) { return (float*) alMalloc(n*sizeof(float),16); }
+
+// allocate n elements of bookkeeping memory with mxMalloc (main thread only),
+// so that it is released by MATLAB if mexErrMsgTxt() is called before mxFree()
+template<class T> T* mxNew( size_t n ) { return (T*) mxMalloc(n*sizeof(T)); }
+
+// number of channels of the gradient histogram (see gradientHist.m)
+int histChns( const ChnsPrm &p ) {
+  const int o=p.nOrients; if( !p.gradHistEn ) return 0;
+  return p.useHog==0 ? o : (p.useHog==1 ? o*4 : o*3+5);
+}
+
+// compute chnsCompute(I,pChns) for an image I whose size is divisible by
+// shrink, writing each enabled channel type to the (zeroed) arrays C[]
+void chnsScale( float *I, int h, int w, int d, const ChnsPrm &p,
+  Scratch &s, float **C )
+{
+  const int hc=h/p.shrink, wc=w/p.shrink; int t=0;
+  // color channels (smoothed image)
+  float *Is=I;
+  if( p.colorSmooth!=0 ) { Is=s.A; convTriM(I,Is,h,w,d,p.colorSmooth); }
+  if( p.colorEn ) {
+    if( hc==h && wc==w ) memcpy(C[t],Is,h*w*d*sizeof(float));
+    else resampleM(Is,C[t],h,hc,w,wc,d,1.0f,false);
+    t++;
+  }
+  if( !p.gradMagEn && !p.gradHistEn ) return;
+  // gradient magnitude (normalized) and orientation
+  float *Ig=Is; int dg=d;
+  if( p.colorChn>0 && p.colorChn<=d ) { Ig+=h*w*(p.colorChn-1); dg=1; }
+  gradMag(Ig,s.M,p.gradHistEn ? s.O : 0,h,w,dg,p.full>0);
+  if( p.normRad!=0 ) {
+    convTriM(s.M,s.S,h,w,1,p.normRad); gradMagNorm(s.M,s.S,h,w,p.normConst);
+  }
+  if( p.gradMagEn ) {
+    if( hc==h && wc==w ) memcpy(C[t],s.M,h*w*sizeof(float));
+    else resampleM(s.M,C[t],h,hc,w,wc,1,1.0f,false);
+    t++;
+  }
+  if( !p.gradHistEn || p.nOrients==0 ) return;
+  // gradient histogram (computed in place if it has the channel size)
+  const int hb=h/p.binSize, wb=w/p.binSize, nChns=histChns(p);
+  float *H=(hb==hc && wb==wc) ? C[t] : s.H;
+  if( H==s.H ) memset(H,0,hb*wb*nChns*sizeof(float));
+  if( p.useHog==0 )
+    gradHist(s.M,s.O,H,h,w,p.binSize,p.nOrients,p.softBin,p.full>0);
+  else if( p.useHog==1 )
+    hog(s.M,s.O,H,h,w,p.binSize,p.nOrients,p.softBin,p.full>0,p.clipHog);
+  else
+    fhog(s.M,s.O,H,h,w,p.binSize,p.nOrients,p.softBin,p.clipHog);
+  if( H==s.H ) resampleM(H,C[t],hb,hc,wb,wc,nChns,1.0f,false);
+}
+
+// get scalar field of a struct (with default value if missing)
+double getField( const mxArray *S, const char *name, double dflt ) {
+  mxArray *f=mxGetField(S,0,name);
+  return (f==NULL || mxIsEmpty(f)) ? dflt : mxGetScalar(f);
+}
+
+// extract the parameters of chnsCompute() from the pChns struct
+ChnsPrm getChnsPrm( const mxArray *pChns ) {
+  ChnsPrm p; mxArray *pc, *pm, *ph;
+  pc=mxGetField(pChns,0,"pColor"); pm=mxGetField(pChns,0,"pGradMag");
+  ph=mxGetField(pChns,0,"pGradHist");
+  if( !pc || !pm || !ph ) mexErrMsgTxt("pChns is incomplete.");
+  p.shrink=(int) getField(pChns,"shrink",4);
+  p.colorEn=(int) getField(pc,"enabled",1);
+  p.colorSmooth=getField(pc,"smooth",1);
+  p.gradMagEn=(int) getField(pm,"enabled",1);
+  p.colorChn=(int) getField(pm,"colorChn",0);
+  p.normRad=getField(pm,"normRad",5);
+  p.normConst=(float) getField(pm,"normConst",.005);
+  p.full=(int) getField(pm,"full",0);
+  p.gradHistEn=(int) getField(ph,"enabled",1);
+  p.binSize=(int) getField(ph,"binSize",p.shrink);
+  p.nOrients=(int) getField(ph,"nOrients",6);
+  p.softBin=(int) getField(ph,"softBin",0);
+  p.useHog=(int) getField(ph,"useHog",0);
+  p.clipHog=(float) getField(ph,"clipHog",.2);
+  if( p.shrink<1 || p.binSize<1 ) mexErrMsgTxt("Invalid shrink or binSize.");
+  return p;
+}
+
+// data = chnsPyramidMex('real',I,sz1s,iHalf,pChns,[nThreads])
+// computes chnsCompute(I1,pChns).data for every real scale of chnsPyramid,
+// where I1 is I resampled to sz1s(k,:); if iHalf>0 the image of scale iHalf
+// replaces I as the source of all later scales (as done in chnsPyramid.m)
+void mReal( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
+  if( nr<4 || nr>5 ) mexErrMsgTxt("Incorrect number of inputs.");
+  if( nl>1 ) mexErrMsgTxt("One output expected.");
+  const mwSize *dims=mxGetDimensions(pr[0]); int nDims, h0, w0, d, nR, iHalf;
+  nDims=(int) mxGetNumberOfDimensions(pr[0]);
+  if( mxGetClassID(pr[0])!=mxSINGLE_CLASS || nDims>3 )
+    mexErrMsgTxt("I must be a 2D or 3D single array.");
+  h0=(int) dims[0]; w0=(int) dims[1]; d=(nDims==2) ? 1 : (int) dims[2];
+  float *I=(float*) mxGetData(pr[0]);
+  nR=(int) mxGetM(pr[1]); double *sz1s=mxGetPr(pr[1]);
+  if( !mxIsDouble(pr[1]) || (nR>0 && mxGetN(pr[1])!=2) )
+    mexErrMsgTxt("sz1s must be a nx2 double array.");
+  iHalf=(int) mxGetScalar(pr[2]); const ChnsPrm p=getChnsPrm(pr[3]);
+  int nThreads = (nr<5) ? 100000 : (int) mxGetScalar(pr[4]);
+
+  // sizes of every scale and of its channels, create all outputs
+  const int nTypes=(p.colorEn>0)+(p.gradMagEn>0)+(p.gradHistEn>0);
+  const int nChns[3]={d,1,histChns(p)};
+  int *hs=mxNew<int>(nR), *ws=mxNew<int>(nR); size_t nMax=0, nHMax=0;
+  float **C=mxNew<float*>(nR*3); pl[0]=mxCreateCellMatrix(nR,nTypes);
+  for( int k=0; k<nR; k++ ) {
+    int h=hs[k]=(int) sz1s[k], w=ws[k]=(int) sz1s[k+nR], t=0;
+    if( h<2 || w<2 || h%p.shrink || w%p.shrink )
+      mexErrMsgTxt("Invalid scale size.");
+    size_t n=size_t(h)*w; if(n>nMax) nMax=n;
+    size_t nH=size_t(h/p.binSize)*(w/p.binSize)*nChns[2]; if(nH>nHMax) nHMax=nH;
+    mwSize ms[3]={mwSize(h/p.shrink),mwSize(w/p.shrink),0};
+    for( int j=0; j<3; j++ ) {
+      if( (j==0 && !p.colorEn) || (j==1 && !p.gradMagEn) ) continue;
+      if( j==2 && !p.gradHistEn ) continue;
+      ms[2]=nChns[j]; mxArray *c=mxCreateNumericArray(3,ms,mxSINGLE_CLASS,mxREAL);
+      C[k*3+t]=(float*) mxGetData(c); mxSetCell(pl[0],k+t*nR,c); t++;
+    }
+  }
+
+  // resample the half scale image first, later scales are computed from it
+  float *Ih=0; if( iHalf<0 || iHalf>nR ) mexErrMsgTxt("Invalid iHalf.");
+  if( iHalf>0 && (hs[iHalf-1]!=h0 || ws[iHalf-1]!=w0) ) {
+    Ih=scratch(size_t(hs[iHalf-1])*ws[iHalf-1]*d);
+    resampleM(I,Ih,h0,hs[iHalf-1],w0,ws[iHalf-1],d,1.0f,true);
+  }
+
+  // compute the channels of every scale in parallel (scales are ordered
+  // from largest to smallest, hence the dynamic schedule)
+  acosTable();
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel num_threads(nThreads)
+  #endif
+  {
+    Scratch s; s.A=scratch(nMax*d); s.B=scratch(nMax*d); s.M=scratch(nMax);
+    s.O=scratch(nMax); s.S=scratch(nMax); s.H=scratch(nHMax);
+    #ifdef USEOMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for( int k=0; k<nR; k++ ) {
+      float *Is=I; int h=h0, w=w0;
+      if( iHalf>0 && k+1>=iHalf && Ih ) {
+        Is=Ih; h=hs[iHalf-1]; w=ws[iHalf-1];
+      }
+      if( hs[k]!=h || ws[k]!=w ) {
+        resampleM(Is,s.B,h,hs[k],w,ws[k],d,1.0f,true); Is=s.B;
+      }
+      chnsScale(Is,hs[k],ws[k],d,p,s,C+k*3);
+    }
+    alFree(s.A); alFree(s.B); alFree(s.M); alFree(s.O); alFree(s.S); alFree(s.H);
+  }
+  if( Ih ) alFree(Ih);
+  mxFree(hs); mxFree(ws); mxFree(C);
+}
+
+// data = chnsPyramidMex('approx',data,isN,sz1s,ratios,smooth,pad,padWith,
+//   concat,[nThreads])
+// given the channels of the real scales in data, computes the approximated
+// scales (i with isN(i)~=i) by resampling data{isN(i),j} to sz1s(i,:) with
+// normalization ratios(i,j), then smooths, pads and concatenates the channels
+// of every scale exactly as done in chnsPyramid.m
+void mApprox( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
+  if( nr<8 || nr>9 ) mexErrMsgTxt("Incorrect number of inputs.");
+  if( nl>1 ) mexErrMsgTxt("One output expected.");
+  const mxArray *D=pr[0]; const int nS=(int) mxGetM(D), nT=(int) mxGetN(D);
+  if( !mxIsCell(D) ) mexErrMsgTxt("data must be a cell array.");
+  if( mxGetNumberOfElements(pr[1])!=(mwSize) nS
+    || mxGetNumberOfElements(pr[3])!=(mwSize) nS*nT
+    || mxGetM(pr[2])!=(mwSize) nS || !mxIsDouble(pr[1]) || !mxIsDouble(pr[2])
+    || !mxIsDouble(pr[3]) ) mexErrMsgTxt("isN, sz1s or ratios is bad.");
+  double *isN=mxGetPr(pr[1]), *sz1s=mxGetPr(pr[2]), *ratios=mxGetPr(pr[3]);
+  const double smooth=mxGetScalar(pr[4]); double *pad=mxGetPr(pr[5]);
+  const int pt=(int) pad[0], pl0=(int) pad[mxGetNumberOfElements(pr[5])>1];
+  const bool doPad=(pt!=0 || pl0!=0), concat=mxGetScalar(pr[7])>0;
+  int nThreads = (nr<9) ? 100000 : (int) mxGetScalar(pr[8]);
+  if( pt<0 || pl0<0 ) mexErrMsgTxt("pad must be nonnegative.");
+
+  // padding type of every channel type (see imPadMex.cpp)
+  int *flags=mxNew<int>(nT); float *vals=mxNew<float>(nT); char type[1024];
+  if( !mxIsCell(pr[6]) || mxGetNumberOfElements(pr[6])!=(mwSize) nT )
+    mexErrMsgTxt("padWith must be a cell with one entry per type.");
+  for( int j=0; j<nT; j++ ) {
+    const mxArray *pw=mxGetCell(pr[6],j); vals[j]=0;
+    if( pw==NULL ) mexErrMsgTxt("padWith is bad.");
+    if( !mxGetString(pw,type,1024) ) {
+      if(!strcmp(type,"replicate")) flags[j]=1;
+      else if(!strcmp(type,"symmetric")) flags[j]=2;
+      else if(!strcmp(type,"circular")) flags[j]=3;
+      else mexErrMsgTxt("Invalid pad value.");
+    } else {
+      flags[j]=0; vals[j]=(float) mxGetScalar(pw);
+    }
+  }
+
+  // sources, sizes and outputs of every channel type at every scale
+  float **A=mxNew<float*>(nS*nT), **B=mxNew<float*>(nS*nT);
+  int *ha=mxNew<int>(nS*nT), *wa=mxNew<int>(nS*nT), *hb=mxNew<int>(nS);
+  int *wb=mxNew<int>(nS), *nc=mxNew<int>(nT); size_t nMax=0;
+  pl[0]=mxCreateCellMatrix(nS,concat ? 1 : nT);
+  for( int j=0; j<nT; j++ ) {
+    const mxArray *c=mxGetCell(D,int(isN[0])-1+j*nS);
+    nc[j]=(c && mxGetNumberOfDimensions(c)==3) ? (int) mxGetDimensions(c)[2] : 1;
+  }
+  for( int i=0; i<nS; i++ ) {
+    int iR=int(isN[i])-1, nChns=0;
+    if( iR<0 || iR>=nS ) mexErrMsgTxt("isN is bad.");
+    for( int j=0; j<nT; j++ ) {
+      const mxArray *c=mxGetCell(D,iR+j*nS);
+      if( c==NULL || mxGetClassID(c)!=mxSINGLE_CLASS )
+        mexErrMsgTxt("data of the real scales must be single arrays.");
+      const mwSize *ds=mxGetDimensions(c);
+      int nd=(int) mxGetNumberOfDimensions(c), d1=nd==2 ? 1 : (int) ds[2];
+      if( d1!=nc[j] || nd>3 ) mexErrMsgTxt("data has inconsistent channels.");
+      A[i*nT+j]=(float*) mxGetData(c); ha[i*nT+j]=(int) ds[0];
+      wa[i*nT+j]=(int) ds[1]; nChns+=nc[j];
+    }
+    hb[i]=(iR==i) ? ha[i*nT] : (int) sz1s[i]; wb[i]=(iR==i) ? wa[i*nT] : (int) sz1s[i+nS];
+    if( hb[i]<=0 || wb[i]<=0 ) mexErrMsgTxt("downsampling factor too small.");
+    size_t n=size_t(hb[i])*wb[i]*nChns; if(n>nMax) nMax=n;
+    mwSize ms[3]={mwSize(hb[i]+2*pt),mwSize(wb[i]+2*pl0),0};
+    for( int j=0, o=0; j<nT; j++ ) {
+      if( concat && j==0 ) {
+        ms[2]=nChns; mxArray *c=mxCreateNumericArray(3,ms,mxSINGLE_CLASS,mxREAL);
+        mxSetCell(pl[0],i,c); B[i*nT]=(float*) mxGetData(c);
+      } else if( concat ) {
+        B[i*nT+j]=B[i*nT]+size_t(ms[0])*ms[1]*o;
+      } else {
+        ms[2]=nc[j]; mxArray *c=mxCreateNumericArray(3,ms,mxSINGLE_CLASS,mxREAL);
+        mxSetCell(pl[0],i+j*nS,c); B[i*nT+j]=(float*) mxGetData(c);
+      }
+      o+=nc[j];
+    }
+  }
+
+  // resample (approximated scales only), smooth and pad each scale in turn
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel num_threads(nThreads)
+  #endif
+  {
+    float *T0=scratch(nMax), *T1=scratch(nMax);
+    #ifdef USEOMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for( int i=0; i<nS; i++ ) for( int j=0; j<nT; j++ ) {
+      const int k=i*nT+j, h=hb[i], w=wb[i], n=h*w*nc[j]; float *C=A[k];
+      if( int(isN[i])-1!=i ) {
+        resampleM(C,T0,ha[k],h,wa[k],w,nc[j],float(ratios[i+j*nS]),true);
+        C=T0;
+      }
+      if( smooth!=0 && n>0 ) { convTriM(C,T1,h,w,nc[j],smooth); C=T1; }
+      if( !doPad ) memcpy(B[k],C,n*sizeof(float));
+      else if( n>0 ) imPad(C,B[k],h,w,nc[j],pt,pt,pl0,pl0,flags[j],vals[j]);
+    }
+    alFree(T0); alFree(T1);
+  }
+  mxFree(flags); mxFree(vals); mxFree(A); mxFree(B);
+  mxFree(ha); mxFree(wa); mxFree(hb); mxFree(wb); mxFree(nc);
+}
+
+// interface to the fused pyramid computation (see chnsPyramid.m)
+void mexFunction( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
+  int f; char action[1024]; f=mxGetString(pr[0],action,1024); nr--; pr++;
+  if(f) mexErrMsgTxt("Failed to get action.");
+  else if(!strcmp(action,"real")) mReal(nl,pl,nr,pr);
+  else if(!strcmp(action,"approx")) mApprox(nl,pl,nr,pr);
+  else mexErrMsgTxt("Invalid action.");
+}
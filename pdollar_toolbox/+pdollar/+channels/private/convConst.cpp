@@ -6,6 +6,35 @@
 #include "wrappers.hpp"
 #include <string.h>
 #include "sse.hpp"
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+// Every function below takes a stack of d channels and an optional number of
+// threads. Work is split into units (a channel or a band of columns of a
+// channel) that are processed in parallel with per thread scratch memory.
+int convThreads( int nUnits, int nThreads ) {
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #else
+  nThreads=1;
+  #endif
+  if( nThreads>nUnits ) nThreads=nUnits;
+  return nThreads<1 ? 1 : nThreads;
+}
+
+// convTri and convBox keep running sums along x. Columns are processed in
+// bands of at least 64 columns (a multiple of s) whose running sums are
+// initialized directly, bands do not depend on nThreads and so neither does
+// the output. Column x of the (symmetrically padded) image is convReflect(x).
+void convBands( int w, int r, int s, int &nBands, int &bw ) {
+  const int w0=(w/s)*s; bw=(r>16 ? 4*r : 64); bw=((bw+s-1)/s)*s;
+  nBands=(w0+bw-1)/bw;
+}
+
+inline int convReflect( int x, int w ) {
+  return x<0 ? -1-x : (x>=w ? 2*w-1-x : x);
+}
 
 // convolve one column of I by a 2rx1 ones filter
 void convBoxY( float *I, float *O, int h, int r, int s ) {
@@ -23,28 +52,60 @@ void convBoxY( float *I, float *O, int h, int r, int s ) {
   }
 }
 
-// convolve I by a 2r+1 x 2r+1 ones filter (uses SSE)
-void convBox( float *I, float *O, int h, int w, int d, int r, int s ) {
-  float nrm = 1.0f/((2*r+1)*(2*r+1)); int i, j, k=(s-1)/2, h0, h1, w0;
-  if(h%4==0) h0=h1=h; else { h0=h-(h%4); h1=h0+4; } w0=(w/s)*s;
-  float *T=(float*) alMalloc(h1*sizeof(float),16);
-  while(d-- > 0) {
+// convolve columns [x0,x1) of a single channel I by a 2r+1 x 2r+1 ones
+// filter, writing output column x/s for every x with x%s==s/2 (x0 must be a
+// multiple of s and T must hold h rounded up to a multiple of VW floats)
+void convBoxBand( float *I, float *O, float *T, int h, int w, int r, int s,
+  int x0, int x1 )
+{
+  float nrm = 1.0f/((2*r+1)*(2*r+1)); int i, j, h0, h1, ho=h/s;
+  if(h%VW==0) h0=h1=h; else { h0=h-(h%VW); h1=h0+VW; }
+  memset( T, 0, h1*sizeof(float) );
+  if( x0==0 ) {
     // initialize T
-    memset( T, 0, h1*sizeof(float) );
-    for(i=0; i<=r; i++) for(j=0; j<h0; j+=4) INC(T[j],LDu(I[j+i*h]));
-    for(j=0; j<h0; j+=4) STR(T[j],MUL(nrm,SUB(MUL(2,LD(T[j])),LDu(I[j+r*h]))));
+    for(i=0; i<=r; i++) for(j=0; j<h0; j+=VW) INC(T[j],LDuv(I[j+i*h]));
+    for(j=0; j<h0; j+=VW) STR(T[j],MUL(nrm,SUB(MUL(2,LDv(T[j])),LDuv(I[j+r*h]))));
     for(i=0; i<=r; i++) for(j=h0; j<h; j++ ) T[j]+=I[j+i*h];
     for(j=h0; j<h; j++ ) T[j]=nrm*(2*T[j]-I[j+r*h]);
-    // prepare and convolve each column in turn
-    k++; if(k==s) { k=0; convBoxY(T,O,h,r,s); O+=h/s; }
-    for( i=1; i<w0; i++ ) {
-      float *Il=I+(i-1-r)*h; if(i<=r) Il=I+(r-i)*h;
-      float *Ir=I+(i+r)*h; if(i>=w-r) Ir=I+(2*w-r-i-1)*h;
-      for(j=0; j<h0; j+=4) DEC(T[j],MUL(nrm,SUB(LDu(Il[j]),LDu(Ir[j]))));
-      for(j=h0; j<h; j++ ) T[j]-=nrm*(Il[j]-Ir[j]);
-      k++; if(k==s) { k=0; convBoxY(T,O,h,r,s); O+=h/s; }
+  } else {
+    // initialize T directly from the columns x0-r..x0+r
+    for(i=x0-r; i<=x0+r; i++) {
+      float *Ii=I+convReflect(i,w)*h;
+      for(j=0; j<h0; j+=VW) INC(T[j],LDuv(Ii[j]));
+      for(j=h0; j<h; j++ ) T[j]+=Ii[j];
     }
-    I+=w*h;
+    for(j=0; j<h0; j+=VW) STR(T[j],MUL(nrm,LDv(T[j])));
+    for(j=h0; j<h; j++ ) T[j]*=nrm;
+  }
+  // prepare and convolve each column in turn
+  if(x0%s==s/2) convBoxY(T,O+(x0/s)*ho,h,r,s);
+  for( i=x0+1; i<x1; i++ ) {
+    float *Il=I+(i-1-r)*h; if(i<=r) Il=I+(r-i)*h;
+    float *Ir=I+(i+r)*h; if(i>=w-r) Ir=I+(2*w-r-i-1)*h;
+    for(j=0; j<h0; j+=VW) DEC(T[j],MUL(nrm,SUB(LDuv(Il[j]),LDuv(Ir[j]))));
+    for(j=h0; j<h; j++ ) T[j]-=nrm*(Il[j]-Ir[j]);
+    if(i%s==s/2) convBoxY(T,O+(i/s)*ho,h,r,s);
+  }
+}
+
+// convolve I by a 2r+1 x 2r+1 ones filter (uses SSE/AVX)
+void convBox( float *I, float *O, int h, int w, int d, int r, int s,
+  int nThreads=1 )
+{
+  int nBands, bw, h1=((h+VW-1)/VW)*VW; convBands(w,r,s,nBands,bw);
+  nThreads=convThreads(d*nBands,nThreads);
+  float *T=(float*) alMalloc(h1*nThreads*sizeof(float),VW*4);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+  #endif
+  for( int u=0; u<d*nBands; u++ ) {
+    int t=0;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    const int z=u/nBands, x0=(u%nBands)*bw, w0=(w/s)*s;
+    convBoxBand(I+size_t(z)*h*w,O+size_t(z)*(h/s)*(w/s),T+h1*t,h,w,r,s,
+      x0,x0+bw<w0 ? x0+bw : w0);
   }
   alFree(T);
 }
@@ -55,12 +116,13 @@ void conv11Y( float *I, float *O, int h, int side, int s ) {
   int j=0, k=((~((size_t) O) + 1) & 15)/4;
   const int d = (side % 4 >= 2) ? 1 : 0, h2=(h-d)/2;
   if( s==2 ) {
+    if( k>h2 ) k=h2; // never write past the end of the column
     for( ; j<k; j++ ) O[j]=I[2*j+d]+I[2*j+d+1];
     for( ; j<h2-4; j+=4 ) STR(O[j],_mm_shuffle_ps(C4(2,d+1),C4(2,d+5),136));
     for( ; j<h2; j++ ) O[j]=I[2*j+d]+I[2*j+d+1];
     if(d==1 && h%2==0) O[j]=2*I[2*j+d];
   } else {
-    if(d==0) { O[0]=2*I[0]; j++; if(k==0) k=4; }
+    if(d==0) { O[0]=2*I[0]; j++; if(k==0) k=4; } if( k>h-d ) k=h-d;
     for( ; j<k; j++ ) O[j]=I[j-1+d]+I[j+d];
     for( ; j<h-4-d; j+=4 ) STR(O[j],C4(1,d) );
     for( ; j<h-d; j++ ) O[j]=I[j-1+d]+I[j+d];
@@ -69,17 +131,29 @@ void conv11Y( float *I, float *O, int h, int side, int s ) {
   #undef C4
 }
 
-// convolve I by a [1 1; 1 1] filter (uses SSE)
-void conv11( float *I, float *O, int h, int w, int d, int side, int s ) {
-  const float nrm = 0.25f; int i, j;
-  float *I0, *I1, *T = (float*) alMalloc(h*sizeof(float),16);
-  for( int d0=0; d0<d; d0++ ) for( i=s/2; i<w; i+=s ) {
-    I0=I1=I+i*h+d0*h*w; if(side%2) { if(i<w-1) I1+=h; } else { if(i) I0-=h; }
-    for( j=0; j<h-4; j+=4 ) STR( T[j], MUL(nrm,ADD(LDu(I0[j]),LDu(I1[j]))) );
+// convolve I by a [1 1; 1 1] filter (uses SSE/AVX)
+void conv11( float *I, float *O, int h, int w, int d, int side, int s,
+  int nThreads=1 )
+{
+  const float nrm = 0.25f; const int wo=(w-s/2+s-1)/s, h1=((h+VW-1)/VW)*VW;
+  nThreads=convThreads(d*wo,nThreads);
+  float *Ts = (float*) alMalloc(h1*nThreads*sizeof(float),VW*4);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(static)
+  #endif
+  for( int u=0; u<d*wo; u++ ) {
+    int t=0, j;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    const int d0=u/wo, i=s/2+(u%wo)*s; float *I0, *I1, *T=Ts+h1*t;
+    I0=I1=I+i*h+size_t(d0)*h*w; if(side%2) { if(i<w-1) I1+=h; }
+    else { if(i) I0-=h; }
+    for( j=0; j<h-VW; j+=VW ) STR( T[j], MUL(nrm,ADD(LDuv(I0[j]),LDuv(I1[j]))) );
     for( ; j<h; j++ ) T[j]=nrm*(I0[j]+I1[j]);
-    conv11Y(T,O,h,side,s); O+=h/s;
+    conv11Y(T,O+size_t(u)*(h/s),h,side,s);
   }
-  alFree(T);
+  alFree(Ts);
 }
 
 // convolve one column of I by a 2rx1 triangle filter
@@ -100,33 +174,70 @@ void convTriY( float *I, float *O, int h, int r, int s ) {
   }
 }
 
-// convolve I by a 2rx1 triangle filter (uses SSE)
-void convTri( float *I, float *O, int h, int w, int d, int r, int s ) {
-  r++; float nrm = 1.0f/(r*r*r*r); int i, j, k=(s-1)/2, h0, h1, w0;
-  if(h%4==0) h0=h1=h; else { h0=h-(h%4); h1=h0+4; } w0=(w/s)*s;
-  float *T=(float*) alMalloc(2*h1*sizeof(float),16), *U=T+h1;
-  while(d-- > 0) {
+// convolve columns [x0,x1) of a single channel I by a 2rx1 triangle filter,
+// writing output column x/s for every x with x%s==s/2 (x0 must be a multiple
+// of s and T must hold twice h rounded up to a multiple of VW floats)
+void convTriBand( float *I, float *O, float *T, int h, int w, int r, int s,
+  int x0, int x1 )
+{
+  r++; float nrm = 1.0f/(r*r*r*r); int i, j, h0, h1, ho=h/s;
+  if(h%VW==0) h0=h1=h; else { h0=h-(h%VW); h1=h0+VW; } float *U=T+h1;
+  if( x0==0 ) {
     // initialize T and U
-    for(j=0; j<h0; j+=4) STR(U[j], STR(T[j], LDu(I[j])));
-    for(i=1; i<r; i++) for(j=0; j<h0; j+=4) INC(U[j],INC(T[j],LDu(I[j+i*h])));
-    for(j=0; j<h0; j+=4) STR(U[j],MUL(nrm,(SUB(MUL(2,LD(U[j])),LD(T[j])))));
-    for(j=0; j<h0; j+=4) STR(T[j],0);
+    for(j=0; j<h0; j+=VW) STR(U[j], STR(T[j], LDuv(I[j])));
+    for(i=1; i<r; i++) for(j=0; j<h0; j+=VW) INC(U[j],INC(T[j],LDuv(I[j+i*h])));
+    for(j=0; j<h0; j+=VW) STR(U[j],MUL(nrm,(SUB(MUL(2,LDv(U[j])),LDv(T[j])))));
+    for(j=0; j<h0; j+=VW) STR(T[j],SETv(0.f));
     for(j=h0; j<h; j++ ) U[j]=T[j]=I[j];
     for(i=1; i<r; i++) for(j=h0; j<h; j++ ) U[j]+=T[j]+=I[j+i*h];
     for(j=h0; j<h; j++ ) { U[j] = nrm * (2*U[j]-T[j]); T[j]=0; }
-    // prepare and convolve each column in turn
-    k++; if(k==s) { k=0; convTriY(U,O,h,r-1,s); O+=h/s; }
-    for( i=1; i<w0; i++ ) {
-      float *Il=I+(i-1-r)*h; if(i<=r) Il=I+(r-i)*h; float *Im=I+(i-1)*h;
-      float *Ir=I+(i-1+r)*h; if(i>w-r) Ir=I+(2*w-r-i)*h;
-      for( j=0; j<h0; j+=4 ) {
-        INC(T[j],ADD(LDu(Il[j]),LDu(Ir[j]),MUL(-2,LDu(Im[j]))));
-        INC(U[j],MUL(nrm,LD(T[j])));
-      }
-      for( j=h0; j<h; j++ ) U[j]+=nrm*(T[j]+=Il[j]+Ir[j]-2*Im[j]);
-      k++; if(k==s) { k=0; convTriY(U,O,h,r-1,s); O+=h/s; }
+  } else {
+    // initialize U and T directly from the columns x0-r..x0+r-1 (U is the
+    // smoothed column x0 and T the sum of columns x0..x0+r-1 minus the sum
+    // of columns x0-r..x0-1, the difference of U at x0 and x0-1 up to nrm)
+    memset( T, 0, 2*h1*sizeof(float) );
+    for(i=-r; i<r; i++) {
+      float *Ii=I+convReflect(x0+i,w)*h; const float wt=float(r-(i<0?-i:i));
+      for(j=0; j<h0; j+=VW) INC(U[j],MUL(LDuv(Ii[j]),SETv(wt)));
+      if(i<0) for(j=0; j<h0; j+=VW) DEC(T[j],LDuv(Ii[j]));
+      else for(j=0; j<h0; j+=VW) INC(T[j],LDuv(Ii[j]));
+      for(j=h0; j<h; j++ ) { U[j]+=Ii[j]*wt; T[j]+=(i<0) ? -Ii[j] : Ii[j]; }
+    }
+    for(j=0; j<h0; j+=VW) STR(U[j],MUL(nrm,LDv(U[j])));
+    for(j=h0; j<h; j++ ) U[j]*=nrm;
+  }
+  // prepare and convolve each column in turn
+  if(x0%s==s/2) convTriY(U,O+(x0/s)*ho,h,r-1,s);
+  for( i=x0+1; i<x1; i++ ) {
+    float *Il=I+(i-1-r)*h; if(i<=r) Il=I+(r-i)*h; float *Im=I+(i-1)*h;
+    float *Ir=I+(i-1+r)*h; if(i>w-r) Ir=I+(2*w-r-i)*h;
+    for( j=0; j<h0; j+=VW ) {
+      INC(T[j],ADD(LDuv(Il[j]),LDuv(Ir[j]),MUL(-2,LDuv(Im[j]))));
+      INC(U[j],MUL(nrm,LDv(T[j])));
     }
-    I+=w*h;
+    for( j=h0; j<h; j++ ) U[j]+=nrm*(T[j]+=Il[j]+Ir[j]-2*Im[j]);
+    if(i%s==s/2) convTriY(U,O+(i/s)*ho,h,r-1,s);
+  }
+}
+
+// convolve I by a 2rx1 triangle filter (uses SSE/AVX)
+void convTri( float *I, float *O, int h, int w, int d, int r, int s,
+  int nThreads=1 )
+{
+  int nBands, bw, h1=((h+VW-1)/VW)*VW; convBands(w,r,s,nBands,bw);
+  nThreads=convThreads(d*nBands,nThreads);
+  float *T=(float*) alMalloc(2*h1*nThreads*sizeof(float),VW*4);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+  #endif
+  for( int u=0; u<d*nBands; u++ ) {
+    int t=0;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    const int z=u/nBands, x0=(u%nBands)*bw, w0=(w/s)*s;
+    convTriBand(I+size_t(z)*h*w,O+size_t(z)*(h/s)*(w/s),T+2*h1*t,h,w,r,s,
+      x0,x0+bw<w0 ? x0+bw : w0);
   }
   alFree(T);
 }
@@ -136,6 +247,7 @@ void convTri1Y( float *I, float *O, int h, float p, int s ) {
   #define C4(m,o) ADD(ADD(LDu(I[m*j-1+o]),MUL(p,LDu(I[m*j+o]))),LDu(I[m*j+1+o]))
   int j=0, k=((~((size_t) O) + 1) & 15)/4, h2=(h-1)/2;
   if( s==2 ) {
+    if( k>h2 ) k=h2; // never write past the end of the column
     for( ; j<k; j++ ) O[j]=I[2*j]+p*I[2*j+1]+I[2*j+2];
     for( ; j<h2-4; j+=4 ) STR(O[j],_mm_shuffle_ps(C4(2,1),C4(2,5),136));
     for( ; j<h2; j++ ) O[j]=I[2*j]+p*I[2*j+1]+I[2*j+2];
@@ -150,18 +262,30 @@ void convTri1Y( float *I, float *O, int h, float p, int s ) {
   #undef C4
 }
 
-// convolve I by a [1 p 1] filter (uses SSE)
-void convTri1( float *I, float *O, int h, int w, int d, float p, int s ) {
-  const float nrm = 1.0f/((p+2)*(p+2)); int i, j, h0=h-(h%4);
-  float *Il, *Im, *Ir, *T=(float*) alMalloc(h*sizeof(float),16);
-  for( int d0=0; d0<d; d0++ ) for( i=s/2; i<w; i+=s ) {
-    Il=Im=Ir=I+i*h+d0*h*w; if(i>0) Il-=h; if(i<w-1) Ir+=h;
-    for( j=0; j<h0; j+=4 )
-      STR(T[j],MUL(nrm,ADD(ADD(LDu(Il[j]),MUL(p,LDu(Im[j]))),LDu(Ir[j]))));
+// convolve I by a [1 p 1] filter (uses SSE/AVX)
+void convTri1( float *I, float *O, int h, int w, int d, float p, int s,
+  int nThreads=1 )
+{
+  const float nrm = 1.0f/((p+2)*(p+2)); const int h0=h-(h%VW);
+  const int wo=(w-s/2+s-1)/s, h1=((h+VW-1)/VW)*VW;
+  nThreads=convThreads(d*wo,nThreads);
+  float *Ts=(float*) alMalloc(h1*nThreads*sizeof(float),VW*4);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(static)
+  #endif
+  for( int u=0; u<d*wo; u++ ) {
+    int t=0, j;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    const int d0=u/wo, i=s/2+(u%wo)*s; float *Il, *Im, *Ir, *T=Ts+h1*t;
+    Il=Im=Ir=I+i*h+size_t(d0)*h*w; if(i>0) Il-=h; if(i<w-1) Ir+=h;
+    for( j=0; j<h0; j+=VW )
+      STR(T[j],MUL(nrm,ADD(ADD(LDuv(Il[j]),MUL(p,LDuv(Im[j]))),LDuv(Ir[j]))));
     for( j=h0; j<h; j++ ) T[j]=nrm*(Il[j]+p*Im[j]+Ir[j]);
-    convTri1Y(T,O,h,p,s); O+=h/s;
+    convTri1Y(T,O+size_t(u)*(h/s),h,p,s);
   }
-  alFree(T);
+  alFree(Ts);
 }
 
 // convolve one column of I by a 2rx1 max filter
@@ -184,32 +308,43 @@ void convMaxY( float *I, float *O, float *T, int h, int r ) {
 }
 
 // convolve I by a 2rx1 max filter
-void convMax( float *I, float *O, int h, int w, int d, int r ) {
+void convMax( float *I, float *O, int h, int w, int d, int r,
+  int nThreads=1 )
+{
   if( r>w-1 ) r=w-1; if( r>h-1 ) r=h-1; int m=2*r+1;
-  float *T=(float*) alMalloc(m*2*sizeof(float),16);
-  for( int d0=0; d0<d; d0++ ) for( int x=0; x<w; x++ ) {
-    float *Oc=O+d0*h*w+h*x, *Ic=I+d0*h*w+h*x;
-    convMaxY(Ic,Oc,T,h,r);
+  nThreads=convThreads(d*w,nThreads);
+  float *Ts=(float*) alMalloc(m*2*nThreads*sizeof(float),16);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(static)
+  #endif
+  for( int u=0; u<d*w; u++ ) {
+    int t=0;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    float *Oc=O+size_t(u)*h, *Ic=I+size_t(u)*h;
+    convMaxY(Ic,Oc,Ts+m*2*t,h,r);
   }
-  alFree(T);
+  alFree(Ts);
 }
 
-// B=convConst(type,A,r,s); fast 2D convolutions (see convTri.m and convBox.m)
+// B=convConst(type,A,r,s,[nThreads]); fast 2D convolutions (see convTri.m
+// and convBox.m), A may be a [h x w x d x n] stack of images
 #ifdef MATLAB_MEX_FILE
 void mexFunction( int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[] ) {
-  int *ns, ms[3], nDims, d, m, r, s; float *A, *B, p;
-  mxClassID id; char type[1024];
+  int h, w, nDims, d, m, r, s, nThreads; float *A, *B, p;
+  mxClassID id; char type[1024]; const mwSize *ns; mwSize ms[4];
 
   // error checking on arguments
-  if(nrhs!=4) mexErrMsgTxt("Four inputs required.");
+  if(nrhs<4 || nrhs>5) mexErrMsgTxt("Four or five inputs required.");
   if(nlhs > 1) mexErrMsgTxt("One output expected.");
   nDims = mxGetNumberOfDimensions(prhs[1]);
   id = mxGetClassID(prhs[1]);
-  ns = (int*) mxGetDimensions(prhs[1]);
-  d = (nDims == 3) ? ns[2] : 1;
-  m = (ns[0] < ns[1]) ? ns[0] : ns[1];
-  if( (nDims!=2 && nDims!=3) || id!=mxSINGLE_CLASS || m<4 )
-    mexErrMsgTxt("A must be a 4x4 or bigger 2D or 3D float array.");
+  ns = mxGetDimensions(prhs[1]); h=(int) ns[0]; w=(int) ns[1];
+  d = 1; for( int i=2; i<nDims && i<4; i++ ) d*=(int) ns[i];
+  m = (h < w) ? h : w;
+  if( (nDims<2 || nDims>4) || id!=mxSINGLE_CLASS || m<4 )
+    mexErrMsgTxt("A must be a 4x4 or bigger 2D, 3D or 4D float array.");
 
   // extract inputs
   if(mxGetString(prhs[0],type,1024))
@@ -218,31 +353,32 @@ void mexFunction( int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[] ) {
   p = (float) mxGetScalar(prhs[2]);
   r = (int) mxGetScalar(prhs[2]);
   s = (int) mxGetScalar(prhs[3]);
+  nThreads = (nrhs<5) ? 100000 : (int) mxGetScalar(prhs[4]);
   if( s<1 ) mexErrMsgTxt("Invalid sampling value s");
   if( r<0 ) mexErrMsgTxt("Invalid radius r");
 
   // create output array (w/o initializing to 0)
-  ms[0]=ns[0]/s; ms[1]=ns[1]/s; ms[2]=d;
+  ms[0]=h/s; ms[1]=w/s; for( int i=2; i<nDims; i++ ) ms[i]=ns[i];
   B = (float*) mxMalloc(ms[0]*ms[1]*d*sizeof(float));
   plhs[0] = mxCreateNumericMatrix(0, 0, mxSINGLE_CLASS, mxREAL);
-  mxSetData(plhs[0], B); mxSetDimensions(plhs[0],(mwSize*)ms,nDims);
+  mxSetData(plhs[0], B); mxSetDimensions(plhs[0],ms,nDims);
 
   // perform appropriate type of convolution
   if(!strcmp(type,"convBox")) {
     if(r>=m/2) mexErrMsgTxt("mask larger than image (r too large)");
-    convBox( A, B, ns[0], ns[1], d, r, s );
+    convBox( A, B, h, w, d, r, s, nThreads );
   } else if(!strcmp(type,"convTri")) {
     if(r>=m/2) mexErrMsgTxt("mask larger than image (r too large)");
-    convTri( A, B, ns[0], ns[1], d, r, s );
+    convTri( A, B, h, w, d, r, s, nThreads );
   } else if(!strcmp(type,"conv11")) {
     if( s>2 ) mexErrMsgTxt("conv11 can sample by at most s=2");
-    conv11( A, B, ns[0], ns[1], d, r, s );
+    conv11( A, B, h, w, d, r, s, nThreads );
   } else if(!strcmp(type,"convTri1")) {
     if( s>2 ) mexErrMsgTxt("convTri1 can sample by at most s=2");
-    convTri1( A, B, ns[0], ns[1], d, p, s );
+    convTri1( A, B, h, w, d, p, s, nThreads );
   } else if(!strcmp(type,"convMax")) {
     if( s>1 ) mexErrMsgTxt("convMax cannot sample");
-    convMax( A, B, ns[0], ns[1], d, r );
+    convMax( A, B, h, w, d, r, nThreads );
   } else {
     mexErrMsgTxt("Invalid type.");
   }
@@ -6,7 +6,11 @@
 #include "wrappers.hpp"
 #include <math.h>
 #include "string.h"
+#include <algorithm>
 #include "sse.hpp"
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
 #define PI 3.14159265f
 
@@ -54,22 +58,24 @@ float* acosTable() {
   init=true; return a1;
 }
 
-// compute gradient magnitude and orientation at each location (uses sse)
-void gradMag( float *I, float *M, float *O, int h, int w, int d, bool full ) {
-  int x, y, y1, c, h4, s; float *Gx, *Gy, *M2; __m128 *_Gx, *_Gy, *_M2, _m;
+// height of one column of gradMag() scratch (padded so h4%VW==0)
+inline int gradMagH4( int h ) { return (h%VW==0) ? h : h-(h%VW)+VW; }
+
+// compute gradient magnitude and orientation for columns [x0,x1) given
+// scratch M2, Gx and Gy for one column (d*gradMagH4(h) aligned floats each)
+void gradMagCols( float *I, float *M, float *O, int h, int w, int d,
+  bool full, int x0, int x1, float *M2, float *Gx, float *Gy )
+{
+  int x, y, y1, c, h4=gradMagH4(h); VEC *_Gx, *_Gy, *_M2, _m;
   float *acost = acosTable(), acMult=10000.0f;
-  // allocate memory for storing one column of output (padded so h4%4==0)
-  h4=(h%4==0) ? h : h-(h%4)+4; s=d*h4*sizeof(float);
-  M2=(float*) alMalloc(s,16); _M2=(__m128*) M2;
-  Gx=(float*) alMalloc(s,16); _Gx=(__m128*) Gx;
-  Gy=(float*) alMalloc(s,16); _Gy=(__m128*) Gy;
+  _M2=(VEC*) M2; _Gx=(VEC*) Gx; _Gy=(VEC*) Gy;
   // compute gradient magnitude and orientation for each column
-  for( x=0; x<w; x++ ) {
+  for( x=x0; x<x1; x++ ) {
     // compute gradients (Gx, Gy) with maximum squared magnitude (M2)
     for(c=0; c<d; c++) {
       grad1( I+x*h+c*w*h, Gx+c*h4, Gy+c*h4, h, w, x );
-      for( y=0; y<h4/4; y++ ) {
-        y1=h4/4*c+y;
+      for( y=0; y<h4/VW; y++ ) {
+        y1=h4/VW*c+y;
         _M2[y1]=ADD(MUL(_Gx[y1],_Gx[y1]),MUL(_Gy[y1],_Gy[y1]));
         if( c==0 ) continue; _m = CMPGT( _M2[y1], _M2[y] );
         _M2[y] = OR( AND(_m,_M2[y1]), ANDNOT(_m,_M2[y]) );
@@ -78,11 +84,11 @@ void gradMag( float *I, float *M, float *O, int h, int w, int d, bool full ) {
       }
     }
     // compute gradient mangitude (M) and normalize Gx
-    for( y=0; y<h4/4; y++ ) {
-      _m = MIN( RCPSQRT(_M2[y]), SET(1e10f) );
+    for( y=0; y<h4/VW; y++ ) {
+      _m = MIN( RCPSQRT(_M2[y]), SETv(1e10f) );
       _M2[y] = RCP(_m);
-      if(O) _Gx[y] = MUL( MUL(_Gx[y],_m), SET(acMult) );
-      if(O) _Gx[y] = XOR( _Gx[y], AND(_Gy[y], SET(-0.f)) );
+      if(O) _Gx[y] = MUL( MUL(_Gx[y],_m), SETv(acMult) );
+      if(O) _Gx[y] = XOR( _Gx[y], AND(_Gy[y], SETv(-0.f)) );
     };
     memcpy( M+x*h, M2, h*sizeof(float) );
     // compute and store gradient orientation (O) via table lookup
@@ -95,14 +101,24 @@ void gradMag( float *I, float *M, float *O, int h, int w, int d, bool full ) {
       for( ; y<h; y++ ) O[y+x*h]+=(Gy[y]<0)*PI;
     }
   }
+}
+
+// compute gradient magnitude and orientation at each location (uses sse/avx)
+void gradMag( float *I, float *M, float *O, int h, int w, int d, bool full ) {
+  float *Gx, *Gy, *M2; int s=d*gradMagH4(h)*sizeof(float);
+  M2=(float*) alMalloc(s,VW*4); Gx=(float*) alMalloc(s,VW*4);
+  Gy=(float*) alMalloc(s,VW*4);
+  gradMagCols(I,M,O,h,w,d,full,0,w,M2,Gx,Gy);
   alFree(Gx); alFree(Gy); alFree(M2);
 }
 
-// normalize gradient magnitude at each location (uses sse)
+// normalize gradient magnitude at each location (uses sse/avx)
 void gradMagNorm( float *M, float *S, int h, int w, float norm ) {
   __m128 *_M, *_S, _norm; int i=0, n=h*w, n4=n/4;
-  _S = (__m128*) S; _M = (__m128*) M; _norm = SET(norm);
   bool sse = !(size_t(M)&15) && !(size_t(S)&15);
+  if(sse) for(; i<=n-VW; i+=VW)
+    STRu(M[i],MUL(LDuv(M[i]),RCP(ADD(LDuv(S[i]),SETv(norm)))));
+  _S = (__m128*) (S+i); _M = (__m128*) (M+i); _norm = SET(norm); i/=4;
   if(sse) for(; i<n4; i++) { *_M=MUL(*_M,RCP(ADD(*_S++,_norm))); _M++; }
   if(sse) i*=4; for(; i<n; i++) M[i] /= (S[i] + norm);
 }
@@ -111,26 +127,25 @@ void gradMagNorm( float *M, float *S, int h, int w, float norm ) {
 void gradQuantize( float *O, float *M, int *O0, int *O1, float *M0, float *M1,
   int nb, int n, float norm, int nOrients, bool full, bool interpolate )
 {
-  // assumes all *OUTPUT* matrices are 4-byte aligned
   int i, o0, o1; float o, od, m;
-  __m128i _o0, _o1, *_O0, *_O1; __m128 _o, _od, _m, *_M0, *_M1;
+  VECi _o0, _o1; VEC _o, _od, _m, _m1;
   // define useful constants
   const float oMult=(float)nOrients/(full?2*PI:PI); const int oMax=nOrients*nb;
-  const __m128 _norm=SET(norm), _oMult=SET(oMult), _nbf=SET((float)nb);
-  const __m128i _oMax=SET(oMax), _nb=SET(nb);
-  // perform the majority of the work with sse
-  _O0=(__m128i*) O0; _O1=(__m128i*) O1; _M0=(__m128*) M0; _M1=(__m128*) M1;
-  if( interpolate ) for( i=0; i<=n-4; i+=4 ) {
-    _o=MUL(LDu(O[i]),_oMult); _o0=CVT(_o); _od=SUB(_o,CVT(_o0));
-    _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); *_O0++=_o0;
-    _o1=ADD(_o0,_nb); _o1=AND(CMPGT(_oMax,_o1),_o1); *_O1++=_o1;
-    _m=MUL(LDu(M[i]),_norm); *_M1=MUL(_od,_m); *_M0++=SUB(_m,*_M1); _M1++;
-  } else for( i=0; i<=n-4; i+=4 ) {
-    _o=MUL(LDu(O[i]),_oMult); _o0=CVT(ADD(_o,SET(.5f)));
-    _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); *_O0++=_o0;
-    *_M0++=MUL(LDu(M[i]),_norm); *_M1++=SET(0.f); *_O1++=SET(0);
+  const VEC _norm=SETv(norm), _oMult=SETv(oMult), _nbf=SETv((float)nb);
+  const VECi _oMax=SETv(oMax), _nb=SETv(nb);
+  // perform the majority of the work with sse/avx (VW values at a time)
+  if( interpolate ) for( i=0; i<=n-VW; i+=VW ) {
+    _o=MUL(LDuv(O[i]),_oMult); _o0=CVT(_o); _od=SUB(_o,CVT(_o0));
+    _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); STRu(O0[i],_o0);
+    _o1=ADD(_o0,_nb); _o1=AND(CMPGT(_oMax,_o1),_o1); STRu(O1[i],_o1);
+    _m=MUL(LDuv(M[i]),_norm); _m1=MUL(_od,_m); STRu(M1[i],_m1);
+    STRu(M0[i],SUB(_m,_m1));
+  } else for( i=0; i<=n-VW; i+=VW ) {
+    _o=MUL(LDuv(O[i]),_oMult); _o0=CVT(ADD(_o,SETv(.5f)));
+    _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); STRu(O0[i],_o0);
+    STRu(M0[i],MUL(LDuv(M[i]),_norm)); STRu(M1[i],SETv(0.f)); STRu(O1[i],SETv(0));
   }
-  // compute trailing locations without sse
+  // compute trailing locations without sse/avx
   if( interpolate ) for(; i<n; i++ ) {
     o=O[i]*oMult; o0=(int) o; od=o-o0;
     o0*=nb; if(o0>=oMax) o0=0; O0[i]=o0;
@@ -143,17 +158,22 @@ void gradQuantize( float *O, float *M, int *O0, int *O1, float *M0, float *M1,
   }
 }
 
-// compute nOrients gradient histograms per bin x bin block of pixels
-void gradHist( float *M, float *O, float *H, int h, int w,
-  int bin, int nOrients, int softBin, bool full )
+// compute nOrients gradient histograms per bin x bin block of pixels for the
+// columns [x0,x1) of M and O given scratch O0, O1, M0 and M1 (h values each,
+// 16 byte aligned). Used to split gradHist() into bands (see gradHistBands):
+// with trilinear interpolation pixels whose left bin is below lfSkip do not
+// add to it and if lfOnly is set pixels only add to their left bin.
+void gradHistCols( float *M, float *O, float *H, int h, int w,
+  int bin, int nOrients, int softBin, bool full, int x0, int x1,
+  int lfSkip, bool lfOnly, int *O0, int *O1, float *M0, float *M1 )
 {
-  const int hb=h/bin, wb=w/bin, h0=hb*bin, w0=wb*bin, nb=wb*hb;
+  const int hb=h/bin, wb=w/bin, h0=hb*bin, nb=wb*hb;
   const float s=(float)bin, sInv=1/s, sInv2=1/s/s;
-  float *H0, *H1, *M0, *M1; int x, y; int *O0, *O1; float xb, init;
-  O0=(int*)alMalloc(h*sizeof(int),16); M0=(float*) alMalloc(h*sizeof(float),16);
-  O1=(int*)alMalloc(h*sizeof(int),16); M1=(float*) alMalloc(h*sizeof(float),16);
+  float *H0, *H1; int x, y; float xb, init;
+  // spatial bin of the first column (accumulated exactly as for x0=0)
+  init=(0+.5f)*sInv-0.5f; xb=init; for( x=0; x<x0; x++ ) xb+=sInv;
   // main loop
-  for( x=0; x<w0; x++ ) {
+  for( x=x0; x<x1; x++ ) {
     // compute target orientation bins for entire column - very fast
     gradQuantize(O+x*h,M+x*h,O0,O1,M0,M1,nb,h0,sInv2,nOrients,full,softBin>=0);
 
@@ -183,8 +203,9 @@ void gradHist( float *M, float *O, float *H, int h, int w,
       // interpolate using trilinear interpolation
       float ms[4], xyd, yb, xd, yd; __m128 _m, _m0, _m1;
       bool hasLf, hasRt; int xb0, yb0;
-      if( x==0 ) { init=(0+.5f)*sInv-0.5f; xb=init; }
       hasLf = xb>=0; xb0 = hasLf?(int)xb:-1; hasRt = xb0 < wb-1;
+      if( xb0<lfSkip ) hasLf=false;
+      if( lfOnly ) hasRt=false;
       xd=xb-xb0; xb+=sInv; yb=init; y=0;
       // macros for code conciseness
       #define GHinit yd=yb-yb0; yb+=sInv; H0=H+xb0*hb+yb0; xyd=xd*yd; \
@@ -196,19 +217,28 @@ void gradHist( float *M, float *O, float *H, int h, int w,
         if(hasLf) { H0[O0[y]+1]+=ms[1]*M0[y]; H0[O1[y]+1]+=ms[1]*M1[y]; }
         if(hasRt) { H0[O0[y]+hb+1]+=ms[3]*M0[y]; H0[O1[y]+hb+1]+=ms[3]*M1[y]; }
       }
-      // main rows, has top and bottom bins, use SSE for minor speedup
+      // main rows, has top and bottom bins, use SSE for minor speedup (the
+      // SSE updates touch 4 bins, the last two bin rows are done without so
+      // that no bins of other columns are touched, see gradHistBands)
       if( softBin<0 ) for( ; ; y++ ) {
-        yb0 = (int) yb; if(yb0>=hb-1) break; GHinit; _m0=SET(M0[y]);
+        yb0 = (int) yb; if(yb0>=hb-3) break; GHinit; _m0=SET(M0[y]);
         if(hasLf) { _m=SET(0,0,ms[1],ms[0]); GH(H0+O0[y],_m,_m0); }
         if(hasRt) { _m=SET(0,0,ms[3],ms[2]); GH(H0+O0[y]+hb,_m,_m0); }
       } else for( ; ; y++ ) {
-        yb0 = (int) yb; if(yb0>=hb-1) break; GHinit;
+        yb0 = (int) yb; if(yb0>=hb-3) break; GHinit;
         _m0=SET(M0[y]); _m1=SET(M1[y]);
         if(hasLf) { _m=SET(0,0,ms[1],ms[0]);
           GH(H0+O0[y],_m,_m0); GH(H0+O1[y],_m,_m1); }
         if(hasRt) { _m=SET(0,0,ms[3],ms[2]);
           GH(H0+O0[y]+hb,_m,_m0); GH(H0+O1[y]+hb,_m,_m1); }
       }
+      for( ; ; y++ ) {
+        yb0 = (int) yb; if(yb0>=hb-1) break; GHinit;
+        if(hasLf) { H0[O0[y]]+=ms[0]*M0[y]; H0[O0[y]+1]+=ms[1]*M0[y];
+          if(softBin>=0) { H0[O1[y]]+=ms[0]*M1[y]; H0[O1[y]+1]+=ms[1]*M1[y]; } }
+        if(hasRt) { H0[O0[y]+hb]+=ms[2]*M0[y]; H0[O0[y]+hb+1]+=ms[3]*M0[y];
+          if(softBin>=0) { H0[O1[y]+hb]+=ms[2]*M1[y]; H0[O1[y]+hb+1]+=ms[3]*M1[y]; } }
+      }
       // final rows, no bottom bin
       for( ; y<h0; y++ ) {
         yb0 = (int) yb; GHinit;
@@ -219,8 +249,11 @@ void gradHist( float *M, float *O, float *H, int h, int w,
       #undef GH
     }
   }
-  alFree(O0); alFree(O1); alFree(M0); alFree(M1);
-  // normalize boundary bins which only get 7/8 of weight of interior bins
+}
+
+// normalize boundary bins which only get 7/8 of weight of interior bins
+void gradHistNorm( float *H, int hb, int wb, int nOrients, int softBin ) {
+  const int nb=wb*hb; int x, y;
   if( softBin%2!=0 ) for( int o=0; o<nOrients; o++ ) {
     x=0; for( y=0; y<hb; y++ ) H[o*nb+x*hb+y]*=8.f/7.f;
     y=0; for( x=0; x<wb; x++ ) H[o*nb+x*hb+y]*=8.f/7.f;
@@ -229,13 +262,26 @@ void gradHist( float *M, float *O, float *H, int h, int w,
   }
 }
 
+// compute nOrients gradient histograms per bin x bin block of pixels
+void gradHist( float *M, float *O, float *H, int h, int w,
+  int bin, int nOrients, int softBin, bool full )
+{
+  const int hb=h/bin, wb=w/bin, w0=wb*bin; float *M0, *M1; int *O0, *O1;
+  O0=(int*)alMalloc(h*sizeof(int),16); M0=(float*) alMalloc(h*sizeof(float),16);
+  O1=(int*)alMalloc(h*sizeof(int),16); M1=(float*) alMalloc(h*sizeof(float),16);
+  gradHistCols(M,O,H,h,w,bin,nOrients,softBin,full,0,w0,0,false,O0,O1,M0,M1);
+  alFree(O0); alFree(O1); alFree(M0); alFree(M1);
+  gradHistNorm(H,hb,wb,nOrients,softBin);
+}
+
 /******************************************************************************/
 
 // HOG helper: compute 2x2 block normalization values (padded by 1 pixel)
-float* hogNormMatrix( float *H, int nOrients, int hb, int wb, int bin ) {
-  float *N, *N1, *n; int o, x, y, dx, dy, hb1=hb+1, wb1=wb+1;
+// into N which must hold (hb+1)*(wb+1) zeros
+void hogNormMatrix( float *H, float *N, int nOrients, int hb, int wb, int bin ) {
+  float *N1, *n; int o, x, y, dx, dy, hb1=hb+1, wb1=wb+1;
   float eps = 1e-4f/4/bin/bin/bin/bin; // precise backward equality
-  N = (float*) wrCalloc(hb1*wb1,sizeof(float)); N1=N+hb1+1;
+  N1=N+hb1+1;
   for( o=0; o<nOrients; o++ ) for( x=0; x<wb; x++ ) for( y=0; y<hb; y++ )
     N1[x*hb1+y] += H[o*wb*hb+x*hb+y]*H[o*wb*hb+x*hb+y];
   for( x=0; x<wb-1; x++ ) for( y=0; y<hb-1; y++ ) {
@@ -248,17 +294,22 @@ float* hogNormMatrix( float *H, int nOrients, int hb, int wb, int bin ) {
   x=wb1-1; dx=-1; dy=-1; y=hb1-1;              N[x*hb1+y]=N[(x+dx)*hb1+y+dy];
   y=0;     dx= 0; dy= 1; for(x=0; x<wb1; x++)  N[x*hb1+y]=N[(x+dx)*hb1+y+dy];
   y=hb1-1; dx= 0; dy=-1; for(x=0; x<wb1; x++)  N[x*hb1+y]=N[(x+dx)*hb1+y+dy];
-  return N;
 }
 
-// HOG helper: compute HOG or FHOG channels
+// HOG helper: allocate and compute 2x2 block normalization values
+float* hogNormMatrix( float *H, int nOrients, int hb, int wb, int bin ) {
+  float *N = (float*) wrCalloc((hb+1)*(wb+1),sizeof(float));
+  hogNormMatrix(H,N,nOrients,hb,wb,bin); return N;
+}
+
+// HOG helper: compute HOG or FHOG channels (for columns [x0,x1) if given)
 void hogChannels( float *H, const float *R, const float *N,
-  int hb, int wb, int nOrients, float clip, int type )
+  int hb, int wb, int nOrients, float clip, int type, int x0=0, int x1=-1 )
 {
   #define GETT(blk) t=R1[y]*N1[y-(blk)]; if(t>clip) t=clip; c++;
   const float r=.2357f; int o, x, y, c; float t;
-  const int nb=wb*hb, nbo=nOrients*nb, hb1=hb+1;
-  for( o=0; o<nOrients; o++ ) for( x=0; x<wb; x++ ) {
+  const int nb=wb*hb, nbo=nOrients*nb, hb1=hb+1; if( x1<0 ) x1=wb;
+  for( o=0; o<nOrients; o++ ) for( x=x0; x<x1; x++ ) {
     const float *R1=R+o*nb+x*hb, *N1=N+x*hb1+hb1+1;
     float *H1 = (type<=1) ? (H+o*nb+x*hb) : (H+x*hb);
     if( type==0) for( y=0; y<hb; y++ ) {
@@ -312,7 +363,156 @@ void fhog( float *M, float *O, float *H, int h, int w, int binSize,
   hogChannels( H+nbo*0, R1, N, hb, wb, nOrients*2, clip, 1 );
   hogChannels( H+nbo*2, R2, N, hb, wb, nOrients*1, clip, 1 );
   hogChannels( H+nbo*3, R1, N, hb, wb, nOrients*2, clip, 2 );
-  wrFree(N); mxFree(R1); wrFree(R2);
+  wrFree(N); wrFree(R1); wrFree(R2);
+}
+
+/******************************************************************************/
+
+// per band scratch of fhogStack() (see gradMagCols and gradHistCols)
+struct FhogBuf { float *M2, *Gx, *Gy, *M0, *M1; int *O0, *O1; };
+
+// per image scratch of fhogStack() (gradients and histograms)
+struct FhogImg { float *M, *O, *R1, *R2, *N; };
+
+void fhogAlloc( FhogBuf &b, int h, int d ) {
+  const size_t s=d*gradMagH4(h)*sizeof(float);
+  b.M2=(float*) alMalloc(s,VW*4); b.Gx=(float*) alMalloc(s,VW*4);
+  b.Gy=(float*) alMalloc(s,VW*4);
+  b.O0=(int*) alMalloc(h*sizeof(int),16); b.M0=(float*) alMalloc(h*sizeof(float),16);
+  b.O1=(int*) alMalloc(h*sizeof(int),16); b.M1=(float*) alMalloc(h*sizeof(float),16);
+}
+
+void fhogFree( FhogBuf &b ) {
+  alFree(b.M2); alFree(b.Gx); alFree(b.Gy);
+  alFree(b.O0); alFree(b.M0); alFree(b.O1); alFree(b.M1);
+}
+
+void fhogAlloc( FhogImg &m, int h, int w, int binSize, int nOrients ) {
+  const int hb=h/binSize, wb=w/binSize; const size_t nb=hb*wb;
+  m.M=(float*) alMalloc(size_t(h)*w*sizeof(float),16);
+  m.O=(float*) alMalloc(size_t(h)*w*sizeof(float),16);
+  m.R1=(float*) alMalloc(nb*nOrients*2*sizeof(float)+1,16);
+  m.R2=(float*) alMalloc(nb*nOrients*sizeof(float)+1,16);
+  m.N=(float*) alMalloc((hb+1)*(wb+1)*sizeof(float),16);
+}
+
+void fhogFree( FhogImg &m ) {
+  alFree(m.M); alFree(m.O); alFree(m.R1); alFree(m.R2); alFree(m.N);
+}
+
+// gradHist() split into nBands bands of bin columns computed in parallel
+// (each with its own scratch bufs[b]). Neighboring bands only share a bin
+// column under trilinear interpolation, in which case the right band adds
+// its part after the left band is done. As every bin is then accumulated in
+// the same order as in gradHist() the results are identical.
+void gradHistBands( float *M, float *O, float *H, int h, int w, int bin,
+  int nOrients, int softBin, bool full, int nBands, FhogBuf *bufs )
+{
+  const int hb=h/bin, wb=w/bin, w0=wb*bin; const float sInv=1/(float)bin;
+  const bool tri = softBin%2!=0 && bin!=1; int b, x, xb0, js[257], xs[257],
+    xe[257]; float xb=(0+.5f)*sInv-0.5f;
+  nBands=std::max(1,std::min(std::min(nBands,wb),256));
+  // bin columns [js[b],js[b+1]) and pixel columns [xs[b],xs[b+1]) of band b,
+  // with trilinear interpolation pixels are assigned by their left bin (xb0
+  // computed as in gradHistCols) and [xs[b],xe[b]) have left bin js[b]
+  for( b=0; b<=nBands; b++ ) js[b]=int(size_t(wb)*b/nBands);
+  for( b=0; b<=nBands; b++ ) xs[b]=xe[b]=(b==nBands) ? w0 : js[b]*bin;
+  if( tri ) for( x=0, b=1; x<w0; x++, xb+=sInv ) {
+    xb0 = xb>=0 ? (int) xb : -1;
+    for( ; b<nBands && xb0>=js[b]; b++ ) xs[b]=x;
+    for( int b1=1; b1<nBands; b1++ ) if( xb0==js[b1] ) xe[b1]=x+1;
+  }
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nBands) if(nBands>1)
+  #endif
+  for( b=0; b<nBands; b++ ) { FhogBuf &f=bufs[b];
+    gradHistCols(M,O,H,h,w,bin,nOrients,softBin,full,xs[b],xs[b+1],
+      (tri && b>0) ? js[b]+1 : 0,false,f.O0,f.O1,f.M0,f.M1); }
+  if( tri ) {
+    #ifdef USEOMP
+    #pragma omp parallel for num_threads(nBands) if(nBands>1)
+    #endif
+    for( b=1; b<nBands; b++ ) { FhogBuf &f=bufs[b];
+      gradHistCols(M,O,H,h,w,bin,nOrients,softBin,full,xs[b],
+        std::max(xs[b],xe[b]),0,true,f.O0,f.O1,f.M0,f.M1); }
+  }
+  gradHistNorm(H,hb,wb,nOrients,softBin);
+}
+
+// compute FHOG features H (zero initialized) of image I exactly as gradMag()
+// followed by fhog() would, in parallel over nBands bands of columns (the
+// caller must have built acosTable() before any threads are started)
+void fhogImage( float *I, float *H, int h, int w, int d, int binSize,
+  int nOrients, int softBin, float clip, FhogImg &m, FhogBuf *bufs,
+  int nBands )
+{
+  const int hb=h/binSize, wb=w/binSize, nb=hb*wb, nbo=nb*nOrients; int b;
+  // compute gradient magnitude and orientation
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nBands) if(nBands>1)
+  #endif
+  for( b=0; b<nBands; b++ ) { FhogBuf &f=bufs[b];
+    gradMagCols(I,m.M,m.O,h,w,d,true,int(size_t(w)*b/nBands),
+      int(size_t(w)*(b+1)/nBands),f.M2,f.Gx,f.Gy); }
+  // compute contrast sensitive and insensitive histograms
+  memset(m.R1,0,nbo*2*sizeof(float));
+  gradHistBands(m.M,m.O,m.R1,h,w,binSize,nOrients*2,softBin,true,nBands,bufs);
+  for( int o=0; o<nOrients; o++ ) for( int x=0; x<nb; x++ )
+    m.R2[o*nb+x] = m.R1[o*nb+x]+m.R1[(o+nOrients)*nb+x];
+  // compute block normalization values
+  memset(m.N,0,(hb+1)*(wb+1)*sizeof(float));
+  hogNormMatrix(m.R2,m.N,nOrients,hb,wb,binSize);
+  // normalized histograms and texture channels
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nBands) if(nBands>1)
+  #endif
+  for( b=0; b<nBands; b++ ) {
+    const int x0=int(size_t(wb)*b/nBands), x1=int(size_t(wb)*(b+1)/nBands);
+    hogChannels( H+nbo*0, m.R1, m.N, hb, wb, nOrients*2, clip, 1, x0, x1 );
+    hogChannels( H+nbo*2, m.R2, m.N, hb, wb, nOrients*1, clip, 1, x0, x1 );
+    hogChannels( H+nbo*3, m.R1, m.N, hb, wb, nOrients*2, clip, 2, x0, x1 );
+  }
+}
+
+// compute FHOG features of each image of the stack I [h x w x d x K] into H
+// [hb x wb x nOrients*3+5 x K] (zero initialized), see fhog.m. If there are
+// at least as many images as threads the images are processed in parallel,
+// otherwise one by one each split into bands of columns. Scratch memory is
+// allocated once (before any threads are started) and reused for all images.
+void fhogStack( float *I, float *H, int h, int w, int d, int K, int binSize,
+  int nOrients, int softBin, float clip, int nThreads )
+{
+  const int hb=h/binSize, wb=w/binSize, nChns=nOrients*3+5;
+  const size_t nI=size_t(h)*w*d, nH=size_t(hb)*wb*nChns;
+  int k, nImg, nBands; FhogImg *imgs; FhogBuf *bufs;
+  if( hb==0 || wb==0 || K==0 ) return;
+  #ifdef USEOMP
+  nThreads = std::min(nThreads,omp_get_max_threads());
+  #else
+  nThreads = 1;
+  #endif
+  nThreads=std::max(nThreads,1);
+  if( K>=nThreads ) { nImg=nThreads; nBands=1; }
+  else { nImg=1; nBands=std::max(1,std::min(std::min(nThreads,wb),256)); }
+  imgs=(FhogImg*) wrMalloc(nImg*sizeof(FhogImg));
+  bufs=(FhogBuf*) wrMalloc(std::max(nImg,nBands)*sizeof(FhogBuf));
+  for( k=0; k<nImg; k++ ) fhogAlloc(imgs[k],h,w,binSize,nOrients);
+  for( k=0; k<std::max(nImg,nBands); k++ ) fhogAlloc(bufs[k],h,d);
+  acosTable(); // build the (lazily initialized) table before any threads
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nImg) schedule(dynamic) if(nImg>1)
+  #endif
+  for( k=0; k<K; k++ ) {
+    int t=0;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    fhogImage(I+nI*k,H+nH*k,h,w,d,binSize,nOrients,softBin,clip,
+      imgs[t],bufs+t,nBands);
+  }
+  for( k=0; k<nImg; k++ ) fhogFree(imgs[k]);
+  for( k=0; k<std::max(nImg,nBands); k++ ) fhogFree(bufs[k]);
+  wrFree(imgs); wrFree(bufs);
 }
 
 /******************************************************************************/
@@ -401,6 +601,29 @@ void mGradHist( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
   }
 }
 
+// H=fhog(I,[binSize],[nOrients],[clip],[nThreads]) - I is [hxwxdxK], see fhog.m
+void mFhog( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
+  int h, w, d, K, binSize, nOrients, nThreads, nDims; float *I, *H, clip;
+  const mwSize *dims; mwSize ds[4];
+  if( nl>1 ) mexErrMsgTxt("Incorrect number of outputs.");
+  if( nr<1 || nr>5 ) mexErrMsgTxt("Incorrect number of inputs.");
+  if( mxGetClassID(pr[0])!=mxSINGLE_CLASS ) mexErrMsgTxt("I has incorrect type.");
+  nDims=mxGetNumberOfDimensions(pr[0]); dims=mxGetDimensions(pr[0]);
+  if( nDims>4 ) mexErrMsgTxt("I must be a 2D, 3D or 4D array.");
+  h=(int) dims[0]; w=(int) dims[1]; I=(float*) mxGetData(pr[0]);
+  d=(nDims>2) ? (int) dims[2] : 1; K=(nDims>3) ? (int) dims[3] : 1;
+  if(h<2 || w<2) mexErrMsgTxt("I must be at least 2x2.");
+  binSize  = (nr>=2) ? (int)   mxGetScalar(pr[1]) : 8;
+  nOrients = (nr>=3) ? (int)   mxGetScalar(pr[2]) : 9;
+  clip     = (nr>=4) ? (float) mxGetScalar(pr[3]) : 0.2f;
+  nThreads = (nr>=5) ? (int)   mxGetScalar(pr[4]) : 100000;
+  if( binSize<1 || nOrients<0 ) mexErrMsgTxt("Invalid binSize or nOrients.");
+  ds[0]=h/binSize; ds[1]=w/binSize; ds[2]=nOrients*3+5; ds[3]=K;
+  pl[0] = mxCreateNumericArray(4,ds,mxSINGLE_CLASS,mxREAL);
+  H = (float*) mxGetData(pl[0]); if( nOrients==0 || d==0 ) return;
+  fhogStack(I,H,h,w,d,K,binSize,nOrients,-1,clip,nThreads);
+}
+
 // inteface to various gradient functions (see corresponding Matlab functions)
 void mexFunction( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
   int f; char action[1024]; f=mxGetString(pr[0],action,1024); nr--; pr++;
@@ -409,6 +632,7 @@ void mexFunction( int nl, mxArray *pl[], int nr, const mxArray *pr[] ) {
   else if(!strcmp(action,"gradientMag")) mGradMag(nl,pl,nr,pr);
   else if(!strcmp(action,"gradientMagNorm")) mGradMagNorm(nl,pl,nr,pr);
   else if(!strcmp(action,"gradientHist")) mGradHist(nl,pl,nr,pr);
+  else if(!strcmp(action,"fhog")) mFhog(nl,pl,nr,pr);
   else mexErrMsgTxt("Invalid action.");
 }
 #endif
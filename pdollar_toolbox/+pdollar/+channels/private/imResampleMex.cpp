@@ -7,20 +7,28 @@
 #include "string.h"
 #include <math.h>
 #include <typeinfo>
+#include <vector>
 #include "sse.hpp"
+#ifdef USEOMP
+#include <omp.h>
+#endif
 typedef unsigned char uchar;
 
+// interpolation coefficients along one dimension (see resampleCoef)
+template<class T> struct RsCoef {
+  int ha, hb, pad, n, bd[2], refs; size_t used;
+  std::vector<int> as, bs; std::vector<T> wts;
+};
+
 // compute interpolation values for single column for resapling
-template<class T> void resampleCoef( int ha, int hb, int &n, int *&yas,
-  int *&ybs, T *&wts, int bd[2], int pad=0 )
+template<class T> void resampleCoef( int ha, int hb, int pad, RsCoef<T> &c )
 {
   const T s = T(hb)/T(ha), sInv = 1/s; T wt, wt0=T(1e-3)*s;
-  bool ds=ha>hb; int nMax; bd[0]=bd[1]=0;
+  bool ds=ha>hb; int nMax, n, *bd=c.bd; bd[0]=bd[1]=0;
   if(ds) { n=0; nMax=ha+(pad>2 ? pad : 2)*hb; } else { n=nMax=hb; }
   // initialize memory
-  wts = (T*)alMalloc(nMax*sizeof(T),16);
-  yas = (int*)alMalloc(nMax*sizeof(int),16);
-  ybs = (int*)alMalloc(nMax*sizeof(int),16);
+  c.ha=ha; c.hb=hb; c.pad=pad; c.wts.resize(nMax); c.as.resize(nMax);
+  c.bs.resize(nMax); T *wts=&c.wts[0]; int *yas=&c.as[0], *ybs=&c.bs[0];
   if( ds ) for( int yb=0; yb<hb; yb++ ) {
     // create coefficients for downsampling
     T ya0f=yb*sInv, ya1f=ya0f+sInv, W=0;
@@ -39,130 +47,222 @@ template<class T> void resampleCoef( int ha, int hb, int &n, int *&yas,
     if(ya<0) { ya=0; bd[0]++; } if(ya>=ha-1) { ya=ha-1; bd[1]++; }
     ybs[yb]=yb; yas[yb]=ya; wts[yb]=wt;
   }
+  c.n=n;
+}
+
+// Coefficients are cached by (ha,hb,pad) as resampling the same sizes over
+// and over is common (e.g. in chnsPyramid). The cache is shared by all calls
+// and threads, entries in use are never evicted (if all are in use a private
+// table is computed instead). Release the coefficients with putCoef().
+template<class T> struct RsCache {
+  enum { N=32 }; static RsCoef<T> c[N]; static size_t used;
+};
+template<class T> RsCoef<T> RsCache<T>::c[RsCache<T>::N];
+template<class T> size_t RsCache<T>::used=0;
+
+template<class T> RsCoef<T>* getCoef( int ha, int hb, int pad ) {
+  typedef RsCache<T> C; RsCoef<T> *c=0;
+  #ifdef USEOMP
+  #pragma omp critical(rsCoefCache)
+  #endif
+  {
+    for( int i=0; i<C::N && !c; i++ ) if( C::c[i].ha==ha && C::c[i].hb==hb
+      && C::c[i].pad==pad && C::c[i].used>0 ) c=C::c+i;
+    if( !c ) {
+      for( int i=0; i<C::N; i++ ) if( C::c[i].refs==0 &&
+        (!c || C::c[i].used<c->used) ) c=C::c+i;
+      if( c ) resampleCoef(ha,hb,pad,*c);
+    }
+    if( c ) { c->refs++; c->used=++C::used; }
+  }
+  if( !c ) { c=new RsCoef<T>(); resampleCoef(ha,hb,pad,*c); c->refs=-1; }
+  return c;
+}
+
+template<class T> void putCoef( RsCoef<T> *c ) {
+  if( c->refs<0 ) { delete c; return; }
+  #ifdef USEOMP
+  #pragma omp critical(rsCoefCache)
+  #endif
+  c->refs--;
+}
+
+// resample column x of a single channel A along x direction (A -> C)
+template<class T> inline void resampleX( T *A, T *C, int ha, int wa, int wb,
+  int x, int x1, const RsCoef<T> &cx, bool sse )
+{
+  const int wn=cx.n, *xas=&cx.as[0], *xbs=&cx.bs[0], *xbd=cx.bd;
+  const T *xwts=&cx.wts[0]; int xa=xas[x1], xb=xbs[x1], y=0;
+  T wt=xwts[x1], wt1=1-wt, *A0=A+xa*ha, *A1=A0+ha, *A2=A1+ha, *A3=A2+ha;
+  // variables for SSE (simple casts to float)
+  float *Af0, *Af1, *Af2, *Af3, *Cf, wtf, wt1f;
+  Af0=(float*) A0; Af1=(float*) A1; Af2=(float*) A2; Af3=(float*) A3;
+  Cf=(float*) C; wtf=(float) wt; wt1f=(float) wt1;
+  // resample along x direction (A -> C), VW values at a time (see sse.hpp)
+  #define FORs(X) if(sse) for(; y<ha-VW; y+=VW) STR(Cf[y],X);
+  #define FORr(X) for(; y<ha; y++) C[y] = X;
+  if( wa==2*wb ) {
+    FORs( ADD(LDuv(Af0[y]),LDuv(Af1[y])) );
+    FORr( A0[y]+A1[y] );
+  } else if( wa==3*wb ) {
+    FORs( ADD(LDuv(Af0[y]),LDuv(Af1[y]),LDuv(Af2[y])) );
+    FORr( A0[y]+A1[y]+A2[y] );
+  } else if( wa==4*wb ) {
+    FORs( ADD(LDuv(Af0[y]),LDuv(Af1[y]),LDuv(Af2[y]),LDuv(Af3[y])) );
+    FORr( A0[y]+A1[y]+A2[y]+A3[y] );
+  } else if( wa>wb ) {
+    int m=1; while( x1+m<wn && xb==xbs[x1+m] ) m++; float wtsf[4];
+    for( int x0=0; x0<(m<4?m:4); x0++ ) wtsf[x0]=float(xwts[x1+x0]);
+    #define U(x) MUL( LDuv(*(Af ## x + y)), SETv(wtsf[x]) )
+    #define V(x) *(A ## x + y) * xwts[x1+x]
+    if(m==1) { FORs(U(0));                     FORr(V(0)); }
+    if(m==2) { FORs(ADD(U(0),U(1)));           FORr(V(0)+V(1)); }
+    if(m==3) { FORs(ADD(U(0),U(1),U(2)));      FORr(V(0)+V(1)+V(2)); }
+    if(m>=4) { FORs(ADD(U(0),U(1),U(2),U(3))); FORr(V(0)+V(1)+V(2)+V(3)); }
+    #undef U
+    #undef V
+    for( int x0=4; x0<m; x0++ ) {
+      A1=A0+x0*ha; wt1=xwts[x1+x0]; Af1=(float*) A1; wt1f=float(wt1); y=0;
+      FORs(ADD(LDv(Cf[y]),MUL(LDuv(Af1[y]),SETv(wt1f)))); FORr(C[y]+A1[y]*wt1);
+    }
+  } else {
+    bool xBd = x<xbd[0] || x>=wb-xbd[1];
+    if(xBd) memcpy(C,A0,ha*sizeof(T));
+    if(!xBd) FORs(ADD(MUL(LDuv(Af0[y]),SETv(wtf)),
+      MUL(LDuv(Af1[y]),SETv(wt1f))));
+    if(!xBd) FORr( A0[y]*wt + A1[y]*wt1 );
+  }
+  #undef FORs
+  #undef FORr
+}
+
+// resample a single column along y direction (C -> B0), ywts are the
+// coefficients of cy multiplied by the normalization r
+template<class T> inline void resampleY( T *C, T *B0, int ha, int hb,
+  const RsCoef<T> &cy, const T *ywts, T r, bool sse )
+{
+  const int hn=cy.n, *yas=&cy.as[0], *ybs=&cy.bs[0], *ybd=cy.bd;
+  float *Bf0=(float*) B0, *Cf=(float*) C; int y, ya;
+  if( ha==hb*2 ) {
+    T r2 = r/2; int k=((~((size_t) B0) + 1) & 15)/4; y=0;
+    for( ; y<k; y++ )  B0[y]=(C[2*y]+C[2*y+1])*r2;
+    if(sse) for(; y<hb-4; y+=4) STR(Bf0[y],MUL((float)r2,_mm_shuffle_ps(ADD(
+      LDu(Cf[2*y]),LDu(Cf[2*y+1])),ADD(LDu(Cf[2*y+4]),LDu(Cf[2*y+5])),136)));
+    for( ; y<hb; y++ ) B0[y]=(C[2*y]+C[2*y+1])*r2;
+  } else if( ha==hb*3 ) {
+    for(y=0; y<hb; y++) B0[y]=(C[3*y]+C[3*y+1]+C[3*y+2])*(r/3);
+  } else if( ha==hb*4 ) {
+    for(y=0; y<hb; y++) B0[y]=(C[4*y]+C[4*y+1]+C[4*y+2]+C[4*y+3])*(r/4);
+  } else if( ha>hb ) {
+    y=0; const float *ywtsf=(const float*) ywts;
+    // 4 outputs at a time: products of rows with their (zero padded) weights
+    // are transposed so term o of all 4 outputs is in Vo, and are summed in
+    // the same order as below (C must be zero for ha<=y<ha+4)
+    if( sse && ybd[0]>=2 && ybd[0]<=4 ) for(; y<=hb-4; y+=4) {
+      const int *ya4=yas+y*4; const float *w4=ywtsf+y*4;
+      __m128 V0=MUL(LDu(Cf[ya4[0]]),LD(w4[0]));
+      __m128 V1=MUL(LDu(Cf[ya4[4]]),LD(w4[4]));
+      __m128 V2=MUL(LDu(Cf[ya4[8]]),LD(w4[8]));
+      __m128 V3=MUL(LDu(Cf[ya4[12]]),LD(w4[12]));
+      _MM_TRANSPOSE4_PS(V0,V1,V2,V3);
+      if(ybd[0]==2) STRu(Bf0[y],ADD(V0,V1));
+      if(ybd[0]==3) STRu(Bf0[y],ADD(V0,V1,V2));
+      if(ybd[0]==4) STRu(Bf0[y],ADD(V0,V1,V2,V3));
+    }
+    #define U(o) C[ya+o]*ywts[y*4+o]
+    if(ybd[0]==2) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1); }
+    if(ybd[0]==3) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1)+U(2); }
+    if(ybd[0]==4) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1)+U(2)+U(3); }
+    if(ybd[0]>4)  for(; y<hn; y++) { B0[ybs[y]] += C[yas[y]] * ywts[y]; }
+    #undef U
+  } else {
+    for(y=0; y<ybd[0]; y++) B0[y] = C[yas[y]]*ywts[y];
+    for(; y<hb-ybd[1]; y++) B0[y] = C[yas[y]]*ywts[y]+C[yas[y]+1]*(r-ywts[y]);
+    for(; y<hb; y++)        B0[y] = C[yas[y]]*ywts[y];
+  }
 }
 
-// resample A using bilinear interpolation and and store result in B
-template<class T>
-void resample( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r ) {
-  int hn, wn, x, x1, y, z, xa, xb, ya; T *A0, *A1, *A2, *A3, *B0, wt, wt1;
-  T *C = (T*) alMalloc((ha+4)*sizeof(T),16); for(y=ha; y<ha+4; y++) C[y]=0;
+// resample A using bilinear interpolation and and store result in B (B must
+// be zero initialized), columns of all channels are processed in parallel
+template<class T> void resample( T *A, T *B, int ha, int hb, int wa, int wb,
+  int d, T r, int nThreads=1 )
+{
+  int x, y;
   bool sse = (typeid(T)==typeid(float)) && !(size_t(A)&15) && !(size_t(B)&15);
   // get coefficients for resampling along w and h
-  int *xas, *xbs, *yas, *ybs; T *xwts, *ywts; int xbd[2], ybd[2];
-  resampleCoef<T>( wa, wb, wn, xas, xbs, xwts, xbd, 0 );
-  resampleCoef<T>( ha, hb, hn, yas, ybs, ywts, ybd, 4 );
+  RsCoef<T> *cx=getCoef<T>(wa,wb,0), *cy=getCoef<T>(ha,hb,4);
   if( wa==2*wb ) r/=2; if( wa==3*wb ) r/=3; if( wa==4*wb ) r/=4;
-  r/=T(1+1e-6); for( y=0; y<hn; y++ ) ywts[y] *= r;
-  // resample each channel in turn
-  for( z=0; z<d; z++ ) for( x=0; x<wb; x++ ) {
-    if(x==0) x1=0; xa=xas[x1]; xb=xbs[x1]; wt=xwts[x1]; wt1=1-wt; y=0;
-    A0=A+z*ha*wa+xa*ha; A1=A0+ha, A2=A1+ha, A3=A2+ha; B0=B+z*hb*wb+xb*hb;
-    // variables for SSE (simple casts to float)
-    float *Af0, *Af1, *Af2, *Af3, *Bf0, *Cf, *ywtsf, wtf, wt1f;
-    Af0=(float*) A0; Af1=(float*) A1; Af2=(float*) A2; Af3=(float*) A3;
-    Bf0=(float*) B0; Cf=(float*) C;
-    ywtsf=(float*) ywts; wtf=(float) wt; wt1f=(float) wt1;
-    // resample along x direction (A -> C)
-    #define FORs(X) if(sse) for(; y<ha-4; y+=4) STR(Cf[y],X);
-    #define FORr(X) for(; y<ha; y++) C[y] = X;
-    if( wa==2*wb ) {
-      FORs( ADD(LDu(Af0[y]),LDu(Af1[y])) );
-      FORr( A0[y]+A1[y] ); x1+=2;
-    } else if( wa==3*wb ) {
-      FORs( ADD(LDu(Af0[y]),LDu(Af1[y]),LDu(Af2[y])) );
-      FORr( A0[y]+A1[y]+A2[y] ); x1+=3;
-    } else if( wa==4*wb ) {
-      FORs( ADD(LDu(Af0[y]),LDu(Af1[y]),LDu(Af2[y]),LDu(Af3[y])) );
-      FORr( A0[y]+A1[y]+A2[y]+A3[y] ); x1+=4;
-    } else if( wa>wb ) {
-      int m=1; while( x1+m<wn && xb==xbs[x1+m] ) m++; float wtsf[4];
-      for( int x0=0; x0<(m<4?m:4); x0++ ) wtsf[x0]=float(xwts[x1+x0]);
-      #define U(x) MUL( LDu(*(Af ## x + y)), SET(wtsf[x]) )
-      #define V(x) *(A ## x + y) * xwts[x1+x]
-      if(m==1) { FORs(U(0));                     FORr(V(0)); }
-      if(m==2) { FORs(ADD(U(0),U(1)));           FORr(V(0)+V(1)); }
-      if(m==3) { FORs(ADD(U(0),U(1),U(2)));      FORr(V(0)+V(1)+V(2)); }
-      if(m>=4) { FORs(ADD(U(0),U(1),U(2),U(3))); FORr(V(0)+V(1)+V(2)+V(3)); }
-      #undef U
-      #undef V
-      for( int x0=4; x0<m; x0++ ) {
-        A1=A0+x0*ha; wt1=xwts[x1+x0]; Af1=(float*) A1; wt1f=float(wt1); y=0;
-        FORs(ADD(LD(Cf[y]),MUL(LDu(Af1[y]),SET(wt1f)))); FORr(C[y]+A1[y]*wt1);
-      }
-      x1+=m;
-    } else {
-      bool xBd = x<xbd[0] || x>=wb-xbd[1]; x1++;
-      if(xBd) memcpy(C,A0,ha*sizeof(T));
-      if(!xBd) FORs(ADD(MUL(LDu(Af0[y]),SET(wtf)),MUL(LDu(Af1[y]),SET(wt1f))));
-      if(!xBd) FORr( A0[y]*wt + A1[y]*wt1 );
-    }
-    #undef FORs
-    #undef FORr
-    // resample along y direction (B -> C)
-    if( ha==hb*2 ) {
-      T r2 = r/2; int k=((~((size_t) B0) + 1) & 15)/4; y=0;
-      for( ; y<k; y++ )  B0[y]=(C[2*y]+C[2*y+1])*r2;
-      if(sse) for(; y<hb-4; y+=4) STR(Bf0[y],MUL((float)r2,_mm_shuffle_ps(ADD(
-        LDu(Cf[2*y]),LDu(Cf[2*y+1])),ADD(LDu(Cf[2*y+4]),LDu(Cf[2*y+5])),136)));
-      for( ; y<hb; y++ ) B0[y]=(C[2*y]+C[2*y+1])*r2;
-    } else if( ha==hb*3 ) {
-      for(y=0; y<hb; y++) B0[y]=(C[3*y]+C[3*y+1]+C[3*y+2])*(r/3);
-    } else if( ha==hb*4 ) {
-      for(y=0; y<hb; y++) B0[y]=(C[4*y]+C[4*y+1]+C[4*y+2]+C[4*y+3])*(r/4);
-    } else if( ha>hb ) {
-      y=0;
-      //if( sse && ybd[0]<=4 ) for(; y<hb; y++) // Requires SSE4
-      //  STR1(Bf0[y],_mm_dp_ps(LDu(Cf[yas[y*4]]),LDu(ywtsf[y*4]),0xF1));
-      #define U(o) C[ya+o]*ywts[y*4+o]
-      if(ybd[0]==2) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1); }
-      if(ybd[0]==3) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1)+U(2); }
-      if(ybd[0]==4) for(; y<hb; y++) { ya=yas[y*4]; B0[y]=U(0)+U(1)+U(2)+U(3); }
-      if(ybd[0]>4)  for(; y<hn; y++) { B0[ybs[y]] += C[yas[y]] * ywts[y]; }
-      #undef U
-    } else {
-      for(y=0; y<ybd[0]; y++) B0[y] = C[yas[y]]*ywts[y];
-      for(; y<hb-ybd[1]; y++) B0[y] = C[yas[y]]*ywts[y]+C[yas[y]+1]*(r-ywts[y]);
-      for(; y<hb; y++)        B0[y] = C[yas[y]]*ywts[y];
-    }
+  r/=T(1+1e-6); T *ywts=(T*) alMalloc(cy->n*sizeof(T),16);
+  for( y=0; y<cy->n; y++ ) ywts[y]=cy->wts[y]*r;
+  // first coefficient of each column along x
+  int *x1s=(int*) alMalloc(wb*sizeof(int),16);
+  for( x=0; x<wb; x++ ) x1s[x]=x;
+  if( wa==2*wb || wa==3*wb || wa==4*wb ) for( x=0; x<wb; x++ ) x1s[x]=x*wa/wb;
+  else if( wa>wb ) for( x=cx->n-1; x>=0; x-- ) x1s[cx->bs[x]]=x;
+  // per thread scratch memory for the intermediate columns C
+  #ifdef USEOMP
+  nThreads = nThreads<omp_get_max_threads() ? nThreads : omp_get_max_threads();
+  if( nThreads>d*wb ) nThreads=d*wb;
+  #else
+  nThreads=1;
+  #endif
+  if( nThreads<1 ) nThreads=1;
+  const int hc=(ha+4+15)&~15;
+  T *Cs = (T*) alMalloc(size_t(hc)*nThreads*sizeof(T),VW*4);
+  memset(Cs,0,size_t(hc)*nThreads*sizeof(T));
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads) schedule(static)
+  #endif
+  for( int i=0; i<d*wb; i++ ) {
+    int t=0;
+    #ifdef USEOMP
+    t=omp_get_thread_num();
+    #endif
+    const int x=i%wb, z=i/wb; T *C=Cs+size_t(hc)*t;
+    resampleX(A+size_t(z)*ha*wa,C,ha,wa,wb,x,x1s[x],*cx,sse);
+    resampleY(C,B+size_t(z)*hb*wb+size_t(x)*hb,ha,hb,*cy,ywts,r,sse);
   }
-  alFree(xas); alFree(xbs); alFree(xwts); alFree(C);
-  alFree(yas); alFree(ybs); alFree(ywts);
+  putCoef(cx); putCoef(cy); alFree(x1s); alFree(ywts); alFree(Cs);
 }
 
-// B = imResampleMex(A,hb,wb,nrm); see imResample.m for usage details
+// B = imResampleMex(A,hb,wb,nrm,[nThreads]); see imResample.m for usage details
 #ifdef MATLAB_MEX_FILE
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  int *ns, ms[3], n, m, nCh, nDims;
+  int ns[3], nCh, nDims, nThreads; mwSize ms[3]; size_t n, m;
   void *A, *B; mxClassID id; double nrm;
 
   // Error checking on arguments
-  if( nrhs!=4) mexErrMsgTxt("Four inputs expected.");
+  if( nrhs<4 || nrhs>5 ) mexErrMsgTxt("Four or five inputs expected.");
   if( nlhs>1 ) mexErrMsgTxt("One output expected.");
   nDims=mxGetNumberOfDimensions(prhs[0]); id=mxGetClassID(prhs[0]);
-  ns = (int*) mxGetDimensions(prhs[0]); nCh=(nDims==2) ? 1 : ns[2];
+  const mwSize *dims = mxGetDimensions(prhs[0]);
+  ns[0]=(int) dims[0]; ns[1]=(int) dims[1]; nCh=(nDims==2) ? 1 : (int) dims[2];
   if( (nDims!=2 && nDims!=3) ||
     (id!=mxSINGLE_CLASS && id!=mxDOUBLE_CLASS && id!=mxUINT8_CLASS) )
     mexErrMsgTxt("A should be 2D or 3D single, double or uint8 array.");
-  ms[0]=(int)mxGetScalar(prhs[1]); ms[1]=(int)mxGetScalar(prhs[2]); ms[2]=nCh;
-  if( ms[0]<=0 || ms[1]<=0 ) mexErrMsgTxt("downsampling factor too small.");
-  nrm=(double)mxGetScalar(prhs[3]);
+  int hb=(int)mxGetScalar(prhs[1]), wb=(int)mxGetScalar(prhs[2]);
+  if( hb<=0 || wb<=0 ) mexErrMsgTxt("downsampling factor too small.");
+  ms[0]=hb; ms[1]=wb; ms[2]=nCh; nrm=(double)mxGetScalar(prhs[3]);
+  nThreads = (nrhs<5) ? 100000 : (int) mxGetScalar(prhs[4]);
 
   // create output array
-  plhs[0] = mxCreateNumericArray(3, (const mwSize*) ms, id, mxREAL);
-  n=ns[0]*ns[1]*nCh; m=ms[0]*ms[1]*nCh;
+  plhs[0] = mxCreateNumericArray(3, ms, id, mxREAL);
+  n=size_t(ns[0])*ns[1]*nCh; m=size_t(hb)*wb*nCh;
 
   // perform resampling (w appropriate type)
   A=mxGetData(prhs[0]); B=mxGetData(plhs[0]);
   if( id==mxDOUBLE_CLASS ) {
-    resample((double*)A, (double*)B, ns[0], ms[0], ns[1], ms[1], nCh, nrm);
+    resample((double*)A, (double*)B, ns[0], hb, ns[1], wb, nCh, nrm,
+      nThreads);
   } else if( id==mxSINGLE_CLASS ) {
-    resample((float*)A, (float*)B, ns[0], ms[0], ns[1], ms[1], nCh, float(nrm));
+    resample((float*)A, (float*)B, ns[0], hb, ns[1], wb, nCh, float(nrm),
+      nThreads);
   } else if( id==mxUINT8_CLASS ) {
     float *A1 = (float*) mxMalloc(n*sizeof(float));
     float *B1 = (float*) mxCalloc(m,sizeof(float));
-    for(int i=0; i<n; i++) A1[i]=(float) ((uchar*)A)[i];
-    resample(A1, B1, ns[0], ms[0], ns[1], ms[1], nCh, float(nrm));
-    for(int i=0; i<m; i++) ((uchar*)B)[i]=(uchar) (B1[i]+.5);
+    for(size_t i=0; i<n; i++) A1[i]=(float) ((uchar*)A)[i];
+    resample(A1, B1, ns[0], hb, ns[1], wb, nCh, float(nrm), nThreads);
+    for(size_t i=0; i<m; i++) ((uchar*)B)[i]=(uchar) (B1[i]+.5);
   } else {
     mexErrMsgTxt("Unsupported type.");
   }
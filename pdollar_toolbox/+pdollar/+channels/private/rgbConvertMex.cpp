@@ -50,58 +50,52 @@ template<class iT, class oT> void rgb2luv( iT *I, oT *J, int n, oT nrm ) {
   }
 }
 
-// Convert from rgb to luv using sse
+// Convert from rgb to luv using sse/avx (VW values at a time, see sse.hpp)
 template<class iT> void rgb2luv_sse( iT *I, float *J, int n, float nrm ) {
   const int k=256; float R[k], G[k], B[k];
   if( (size_t(R)&15||size_t(G)&15||size_t(B)&15||size_t(I)&15||size_t(J)&15)
     || n%4>0 ) { rgb2luv(I,J,n,nrm); return; }
-  int i=0, i1, n1; float minu, minv, un, vn, mr[3], mg[3], mb[3];
+  int i=0, i1, m, n1; float minu, minv, un, vn, mr[3], mg[3], mb[3];
   float *lTable = rgb2luv_setup(nrm,mr,mg,mb,minu,minv,un,vn);
+  // the last (m%VW)/4 vectors of a block are processed with __m128
+  #define FORv(e) for( i1=0; i1<=m-VW; i1+=VW ) e(VEC,LDuv,STRu,SETv); \
+    for( ; i1<m; i1+=4 ) e(__m128,LD,STR,SET);
   while( i<n ) {
-    n1 = i+k; if(n1>n) n1=n; float *J1=J+i; float *R1, *G1, *B1;
+    n1 = i+k; if(n1>n) n1=n; m=n1-i; float *J1=J+i; float *R1, *G1, *B1;
+    float *X=J1, *Y=J1+n, *Z=J1+2*n;
     // convert to floats (and load input into cache)
     if( typeid(iT) != typeid(float) ) {
       R1=R; G1=G; B1=B; iT *Ri=I+i, *Gi=Ri+n, *Bi=Gi+n;
-      for( i1=0; i1<(n1-i); i1++ ) {
+      for( i1=0; i1<m; i1++ ) {
         R1[i1] = (float) *Ri++; G1[i1] = (float) *Gi++; B1[i1] = (float) *Bi++;
       }
     } else { R1=((float*)I)+i; G1=R1+n; B1=G1+n; }
     // compute RGB -> XYZ
     for( int j=0; j<3; j++ ) {
-      __m128 _mr, _mg, _mb, *_J=(__m128*) (J1+j*n);
-      __m128 *_R=(__m128*) R1, *_G=(__m128*) G1, *_B=(__m128*) B1;
-      _mr=SET(mr[j]); _mg=SET(mg[j]); _mb=SET(mb[j]);
-      for( i1=i; i1<n1; i1+=4 ) *(_J++) = ADD( ADD(MUL(*(_R++),_mr),
-        MUL(*(_G++),_mg)),MUL(*(_B++),_mb));
-    }
-    { // compute XZY -> LUV (without doing L lookup/normalization)
-      __m128 _c15, _c3, _cEps, _c52, _c117, _c1024, _cun, _cvn;
-      _c15=SET(15.0f); _c3=SET(3.0f); _cEps=SET(1e-35f);
-      _c52=SET(52.0f); _c117=SET(117.0f), _c1024=SET(1024.0f);
-      _cun=SET(13*un); _cvn=SET(13*vn);
-      __m128 *_X, *_Y, *_Z, _x, _y, _z;
-      _X=(__m128*) J1; _Y=(__m128*) (J1+n); _Z=(__m128*) (J1+2*n);
-      for( i1=i; i1<n1; i1+=4 ) {
-        _x = *_X; _y=*_Y; _z=*_Z;
-        _z = RCP(ADD(_x,ADD(_cEps,ADD(MUL(_c15,_y),MUL(_c3,_z)))));
-        *(_X++) = MUL(_c1024,_y);
-        *(_Y++) = SUB(MUL(MUL(_c52,_x),_z),_cun);
-        *(_Z++) = SUB(MUL(MUL(_c117,_y),_z),_cvn);
-      }
-    }
-    { // perform lookup for L and finalize computation of U and V
-      for( i1=i; i1<n1; i1++ ) J[i1] = lTable[(int)J[i1]];
-      __m128 *_L, *_U, *_V, _l, _cminu, _cminv;
-      _L=(__m128*) J1; _U=(__m128*) (J1+n); _V=(__m128*) (J1+2*n);
-      _cminu=SET(minu); _cminv=SET(minv);
-      for( i1=i; i1<n1; i1+=4 ) {
-        _l = *(_L++);
-        *_U = SUB(MUL(_l,*_U),_cminu); _U++;
-        *_V = SUB(MUL(_l,*_V),_cminv); _V++;
-      }
+      float *J2=J1+j*n;
+      #define XYZ(T,LD,ST,S) ST(J2[i1],ADD(ADD(MUL(LD(R1[i1]),S(mr[j])), \
+        MUL(LD(G1[i1]),S(mg[j]))),MUL(LD(B1[i1]),S(mb[j]))));
+      FORv(XYZ);
     }
+    // compute XZY -> LUV (without doing L lookup/normalization)
+    #define LUV(T,LD,ST,S) { T _x=LD(X[i1]), _y=LD(Y[i1]), _z=LD(Z[i1]); \
+      _z = RCP(ADD(_x,ADD(S(1e-35f),ADD(MUL(S(15.0f),_y),MUL(S(3.0f),_z))))); \
+      ST(X[i1],MUL(S(1024.0f),_y)); \
+      ST(Y[i1],SUB(MUL(MUL(S(52.0f),_x),_z),S(13*un))); \
+      ST(Z[i1],SUB(MUL(MUL(S(117.0f),_y),_z),S(13*vn))); }
+    FORv(LUV);
+    // perform lookup for L and finalize computation of U and V
+    for( i1=i; i1<n1; i1++ ) J[i1] = lTable[(int)J[i1]];
+    #define UV(T,LD,ST,S) { T _l=LD(X[i1]); \
+      ST(Y[i1],SUB(MUL(_l,LD(Y[i1])),S(minu))); \
+      ST(Z[i1],SUB(MUL(_l,LD(Z[i1])),S(minv))); }
+    FORv(UV);
     i = n1;
   }
+  #undef FORv
+  #undef XYZ
+  #undef LUV
+  #undef UV
 }
 
 // Convert from rgb to hsv
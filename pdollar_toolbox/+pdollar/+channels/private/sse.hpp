@@ -57,6 +57,159 @@ RETi CMPLT( const __m128i x, const __m128i y ) { return _mm_cmplt_epi32(x,y); }
 RETf CVT( const __m128i x ) { return _mm_cvtepi32_ps(x); }
 RETi CVT( const __m128 x ) { return _mm_cvttps_epi32(x); }
 
+// store integer values
+RETi STRu( int &x, const __m128i y ) { _mm_storeu_si128((__m128i*)&x,y); return y; }
+
 #undef RETf
 #undef RETi
+
+/*******************************************************************************
+* Width generic wrappers. VEC (VECi) holds VW floats (ints) and is __m128 by
+* default, __m256 if compiled with -mavx2 -DUSEAVX2 and __m512 if compiled
+* with -mavx512f -DUSEAVX512. Kernels written against VEC use SETv, LDv and
+* LDuv to create vectors (all other operators above are overloaded for every
+* width) and process VW values per instruction. RCP and RCPSQRT return the
+* same estimates at every width, so results do not depend on the build (as
+* long as scalar code is not contracted to fma, compile with -ffp-contract=off).
+*******************************************************************************/
+#if defined(USEAVX512) && defined(__AVX512F__)
+#include <immintrin.h>
+#define VW 16
+typedef __m512 VEC; typedef __m512i VECi;
+#elif (defined(USEAVX2) || defined(USEAVX512)) && defined(__AVX2__)
+#include <immintrin.h>
+#define VW 8
+typedef __m256 VEC; typedef __m256i VECi;
+#else
+#define VW 4
+typedef __m128 VEC; typedef __m128i VECi;
+#endif
+
+#if VW==4
+inline VEC SETv( const float &x ) { return SET(x); }
+inline VECi SETv( const int &x ) { return SET(x); }
+inline VEC LDv( const float &x ) { return LD(x); }
+inline VEC LDuv( const float &x ) { return LDu(x); }
+#endif
+
+#if VW>=8
+#define RETf inline __m256
+#define RETi inline __m256i
+#if VW==8
+RETf SETv( const float &x ) { return _mm256_set1_ps(x); }
+RETi SETv( const int &x ) { return _mm256_set1_epi32(x); }
+RETf LDv( const float &x ) { return _mm256_load_ps(&x); }
+RETf LDuv( const float &x ) { return _mm256_loadu_ps(&x); }
+#endif
+RETf STR( float &x, const __m256 y ) { _mm256_store_ps(&x,y); return y; }
+RETf STRu( float &x, const __m256 y ) { _mm256_storeu_ps(&x,y); return y; }
+RETi STRu( int &x, const __m256i y ) {
+  _mm256_storeu_si256((__m256i*)&x,y); return y; }
+RETi ADD( const __m256i x, const __m256i y ) { return _mm256_add_epi32(x,y); }
+RETf ADD( const __m256 x, const __m256 y ) { return _mm256_add_ps(x,y); }
+RETf ADD( const __m256 x, const __m256 y, const __m256 z ) {
+  return ADD(ADD(x,y),z); }
+RETf ADD( const __m256 a, const __m256 b, const __m256 c, const __m256 &d ) {
+  return ADD(ADD(ADD(a,b),c),d); }
+RETf SUB( const __m256 x, const __m256 y ) { return _mm256_sub_ps(x,y); }
+RETf MUL( const __m256 x, const __m256 y ) { return _mm256_mul_ps(x,y); }
+RETf MUL( const __m256 x, const float y ) { return MUL(x,_mm256_set1_ps(y)); }
+RETf MUL( const float x, const __m256 y ) { return MUL(_mm256_set1_ps(x),y); }
+RETf INC( __m256 &x, const __m256 y ) { return x = ADD(x,y); }
+RETf INC( float &x, const __m256 y ) {
+  __m256 t=ADD(_mm256_load_ps(&x),y); return STR(x,t); }
+RETf DEC( __m256 &x, const __m256 y ) { return x = SUB(x,y); }
+RETf DEC( float &x, const __m256 y ) {
+  __m256 t=SUB(_mm256_load_ps(&x),y); return STR(x,t); }
+RETf MIN( const __m256 x, const __m256 y ) { return _mm256_min_ps(x,y); }
+RETf RCP( const __m256 x ) { return _mm256_rcp_ps(x); }
+RETf RCPSQRT( const __m256 x ) { return _mm256_rsqrt_ps(x); }
+RETf AND( const __m256 x, const __m256 y ) { return _mm256_and_ps(x,y); }
+RETi AND( const __m256i x, const __m256i y ) { return _mm256_and_si256(x,y); }
+RETf ANDNOT( const __m256 x, const __m256 y ) { return _mm256_andnot_ps(x,y); }
+RETf OR( const __m256 x, const __m256 y ) { return _mm256_or_ps(x,y); }
+RETf XOR( const __m256 x, const __m256 y ) { return _mm256_xor_ps(x,y); }
+RETf CMPGT( const __m256 x, const __m256 y ) {
+  return _mm256_cmp_ps(x,y,_CMP_GT_OQ); }
+RETf CMPLT( const __m256 x, const __m256 y ) {
+  return _mm256_cmp_ps(x,y,_CMP_LT_OQ); }
+RETi CMPGT( const __m256i x, const __m256i y ) {
+  return _mm256_cmpgt_epi32(x,y); }
+RETi CMPLT( const __m256i x, const __m256i y ) {
+  return _mm256_cmpgt_epi32(y,x); }
+RETf CVT( const __m256i x ) { return _mm256_cvtepi32_ps(x); }
+RETi CVT( const __m256 x ) { return _mm256_cvttps_epi32(x); }
+#undef RETf
+#undef RETi
+#endif
+
+#if VW==16
+#define RETf inline __m512
+#define RETi inline __m512i
+#define CASTf _mm512_castsi512_ps
+#define CASTi _mm512_castps_si512
+// comparisons return masks in AVX-512, expand them to all ones lanes
+#define MASKf(m) CASTf(_mm512_maskz_set1_epi32(m,-1))
+// estimates are computed on 256 bit halves to match the SSE/AVX estimates
+#define LO(x) _mm512_castps512_ps256(x)
+#define HI(x) _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x),1))
+#define JOIN(l,h) _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512( \
+  _mm256_castps_pd(l)),_mm256_castps_pd(h),1))
+RETf SETv( const float &x ) { return _mm512_set1_ps(x); }
+RETi SETv( const int &x ) { return _mm512_set1_epi32(x); }
+RETf LDv( const float &x ) { return _mm512_load_ps(&x); }
+RETf LDuv( const float &x ) { return _mm512_loadu_ps(&x); }
+RETf STR( float &x, const __m512 y ) { _mm512_store_ps(&x,y); return y; }
+RETf STRu( float &x, const __m512 y ) { _mm512_storeu_ps(&x,y); return y; }
+RETi STRu( int &x, const __m512i y ) { _mm512_storeu_si512(&x,y); return y; }
+RETi ADD( const __m512i x, const __m512i y ) { return _mm512_add_epi32(x,y); }
+RETf ADD( const __m512 x, const __m512 y ) { return _mm512_add_ps(x,y); }
+RETf ADD( const __m512 x, const __m512 y, const __m512 z ) {
+  return ADD(ADD(x,y),z); }
+RETf ADD( const __m512 a, const __m512 b, const __m512 c, const __m512 &d ) {
+  return ADD(ADD(ADD(a,b),c),d); }
+RETf SUB( const __m512 x, const __m512 y ) { return _mm512_sub_ps(x,y); }
+RETf MUL( const __m512 x, const __m512 y ) { return _mm512_mul_ps(x,y); }
+RETf MUL( const __m512 x, const float y ) { return MUL(x,_mm512_set1_ps(y)); }
+RETf MUL( const float x, const __m512 y ) { return MUL(_mm512_set1_ps(x),y); }
+RETf INC( __m512 &x, const __m512 y ) { return x = ADD(x,y); }
+RETf INC( float &x, const __m512 y ) {
+  __m512 t=ADD(_mm512_load_ps(&x),y); return STR(x,t); }
+RETf DEC( __m512 &x, const __m512 y ) { return x = SUB(x,y); }
+RETf DEC( float &x, const __m512 y ) {
+  __m512 t=SUB(_mm512_load_ps(&x),y); return STR(x,t); }
+RETf MIN( const __m512 x, const __m512 y ) { return _mm512_min_ps(x,y); }
+RETf RCP( const __m512 x ) {
+  return JOIN(_mm256_rcp_ps(LO(x)),_mm256_rcp_ps(HI(x))); }
+RETf RCPSQRT( const __m512 x ) {
+  return JOIN(_mm256_rsqrt_ps(LO(x)),_mm256_rsqrt_ps(HI(x))); }
+RETf AND( const __m512 x, const __m512 y ) {
+  return CASTf(_mm512_and_si512(CASTi(x),CASTi(y))); }
+RETi AND( const __m512i x, const __m512i y ) { return _mm512_and_si512(x,y); }
+RETf ANDNOT( const __m512 x, const __m512 y ) {
+  return CASTf(_mm512_andnot_si512(CASTi(x),CASTi(y))); }
+RETf OR( const __m512 x, const __m512 y ) {
+  return CASTf(_mm512_or_si512(CASTi(x),CASTi(y))); }
+RETf XOR( const __m512 x, const __m512 y ) {
+  return CASTf(_mm512_xor_si512(CASTi(x),CASTi(y))); }
+RETf CMPGT( const __m512 x, const __m512 y ) {
+  return MASKf(_mm512_cmp_ps_mask(x,y,_CMP_GT_OQ)); }
+RETf CMPLT( const __m512 x, const __m512 y ) {
+  return MASKf(_mm512_cmp_ps_mask(x,y,_CMP_LT_OQ)); }
+RETi CMPGT( const __m512i x, const __m512i y ) {
+  return _mm512_maskz_set1_epi32(_mm512_cmpgt_epi32_mask(x,y),-1); }
+RETi CMPLT( const __m512i x, const __m512i y ) {
+  return _mm512_maskz_set1_epi32(_mm512_cmpgt_epi32_mask(y,x),-1); }
+RETf CVT( const __m512i x ) { return _mm512_cvtepi32_ps(x); }
+RETi CVT( const __m512 x ) { return _mm512_cvttps_epi32(x); }
+#undef RETf
+#undef RETi
+#undef CASTf
+#undef CASTi
+#undef MASKf
+#undef LO
+#undef HI
+#undef JOIN
+#endif
+
 #endif
@@ -40,6 +40,8 @@ function [tree,data,err] = binaryTreeTrain( data, varargin )
 %   .minWeight  - [.01] minimum sample weigth to allow split
 %   .fracFtrs   - [1] fraction of features to sample for each node split
 %   .nThreads   - [16] max number of computational threads to use
+%   .histSub    - [1] if true derive child histograms by subtraction
+%                 (histogram only the smaller child, faster if maxDepth>1)
 %
 % OUTPUTS
 %  tree       - learned decision tree model struct w the following fields
@@ -61,8 +63,10 @@ function [tree,data,err] = binaryTreeTrain( data, varargin )
 % Licensed under the Simplified BSD License [see external/bsd.txt]
 
 % get parameters
-dfs={'nBins',256,'maxDepth',1,'minWeight',.01,'fracFtrs',1,'nThreads',16};
-[nBins,maxDepth,minWeight,fracFtrs,nThreads]=getPrmDflt(varargin,dfs,1);
+dfs={'nBins',256,'maxDepth',1,'minWeight',.01,'fracFtrs',1,'nThreads',16,...
+  'histSub',1};
+[nBins,maxDepth,minWeight,fracFtrs,nThreads,histSub]=...
+  getPrmDflt(varargin,dfs,1);
 assert(nBins<=256);
 
 % get data and normalize weights
@@ -91,7 +95,7 @@ K=2*(N0+N1); thrs=zeros(K,1,xType);
 hs=zeros(K,1,'single'); weights=hs; errs=hs;
 fids=zeros(K,1,'uint32'); child=fids; depth=fids;
 wtsAll0=cell(K,1); wtsAll0{1}=wts0;
-wtsAll1=cell(K,1); wtsAll1{1}=wts1; k=1; K=2;
+wtsAll1=cell(K,1); wtsAll1{1}=wts1; hsts=cell(K,1); k=1; K=2;
 while( k < K )
   % get node weights and prior
   wts0=wtsAll0{k}; wtsAll0{k}=[]; w0=sum(wts0);
@@ -101,10 +105,20 @@ while( k < K )
   % if nearly pure node or insufficient data don't train split
   if( prior<1e-3||prior>1-1e-3||depth(k)>=maxDepth||w<minWeight )
     k=k+1; continue; end
-  % train best stump
+  % train best stump (histograms of all features are kept if needed later)
   fidsSt=1:F; if(fracFtrs<1), fidsSt=randperm(F,floor(F*fracFtrs)); end
-  [errsSt,thrsSt] = binaryTreeTrain1(X0,X1,single(wts0/w),...
-    single(wts1/w),nBins,prior,uint32(fidsSt-1),nThreads);
+  hst=hsts{k}; hsts{k}=[]; keep=histSub && depth(k)+1<maxDepth;
+  if( ~isempty(hst) )
+    [errsSt,thrsSt] = binaryTreeTrain1(X0,X1,[],[],nBins,prior,...
+      uint32(fidsSt-1),nThreads,[],[],hst/w);
+  elseif( keep )
+    [errsSt,thrsSt,hst] = binaryTreeTrain1(X0,X1,single(wts0/w),...
+      single(wts1/w),nBins,prior,uint32(0:F-1),nThreads);
+    errsSt=errsSt(fidsSt); thrsSt=thrsSt(fidsSt); hst=hst*w;
+  else
+    [errsSt,thrsSt] = binaryTreeTrain1(X0,X1,single(wts0/w),...
+      single(wts1/w),nBins,prior,uint32(fidsSt-1),nThreads);
+  end
   [~,fid]=min(errsSt); thr=single(thrsSt(fid))+.5; fid=fidsSt(fid);
   % split data and continue
   left0=X0(:,fid)<thr; left1=X1(:,fid)<thr;
@@ -113,7 +127,9 @@ while( k < K )
     child(k)=K; fids(k)=fid-1; thrs(k)=thr;
     wtsAll0{K}=wts0.*left0; wtsAll0{K+1}=wts0.*~left0;
     wtsAll1{K}=wts1.*left1; wtsAll1{K+1}=wts1.*~left1;
-    depth(K:K+1)=depth(k)+1; K=K+2;
+    depth(K:K+1)=depth(k)+1;
+    if( keep ), hsts(K:K+1)=childHists(X0,X1,wts0,wts1,left0,left1,...
+        hst,nBins,F,nThreads); end; K=K+2;
   end; k=k+1;
 end; K=K-1;
 
@@ -123,3 +139,14 @@ tree=struct('fids',fids(1:K),'thrs',thrs(1:K),'child',child(1:K),...
 if(nargout>=3), err=sum(errs(1:K).*tree.weights.*(tree.child==0)); end
 
 end
+
+function hsts = childHists( X0, X1, wts0, wts1, left0, left1, hst, ...
+  nBins, F, nThreads )
+% Histograms of both children, only the smaller child is computed directly.
+in0=wts0>0; in1=wts1>0; nLeft=nnz(left0&in0)+nnz(left1&in1);
+sml=nLeft<=(nnz(in0)+nnz(in1))/2; if(~sml), left0=~left0; left1=~left1; end
+i0=find(left0&in0); i1=find(left1&in1);
+[~,~,hst1] = binaryTreeTrain1(X0,X1,single(wts0(i0)),single(wts1(i1)),...
+  nBins,0,uint32(0:F-1),nThreads,uint32(i0-1),uint32(i1-1));
+hsts={hst1,hst-hst1}; if(~sml), hsts=hsts([2 1]); end
+end
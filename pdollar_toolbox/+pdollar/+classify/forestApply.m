@@ -1,8 +1,9 @@
-function [hs,ps] = forestApply( data, forest, maxDepth, minCount, best )
+function [hs,ps] = forestApply( data, forest, maxDepth, minCount, best, nThreads )
 % Apply learned forest classifier.
 %
 % USAGE
-%  [hs,ps] = forestApply( data, forest, [maxDepth], [minCount], [best] )
+%  [hs,ps] = forestApply( data, forest, [maxDepth], [minCount], [best], ...
+%    [nThreads] )
 %
 % INPUTS
 %  data     - [NxF] N length F feature vectors
@@ -10,6 +11,7 @@ function [hs,ps] = forestApply( data, forest, maxDepth, minCount, best )
 %  maxDepth - [] maximum depth of tree
 %  minCount - [] minimum number of data points to allow split
 %  best     - [0] if true use single best prediction per tree
+%  nThreads - [inf] max number of computational threads to use
 %
 % OUTPUTS
 %  hs       - [Nx1] predicted output labels
@@ -25,14 +27,19 @@ function [hs,ps] = forestApply( data, forest, maxDepth, minCount, best )
 if(nargin<3 || isempty(maxDepth)), maxDepth=0; end
 if(nargin<4 || isempty(minCount)), minCount=0; end
 if(nargin<5 || isempty(best)), best=0; end
+if(nargin<6 || isempty(nThreads)), nThreads=1e5; end
 assert(isa(data,'single')); M=length(forest);
 H=size(forest(1).distr,2); N=size(data,1);
 if(best), hs=zeros(N,M); else ps=zeros(N,H); end
 discr=iscell(forest(1).hs); if(discr), best=1; hs=cell(N,M); end
+if(~discr && exist('forestApply1','file')==3)
+  % apply all trees natively (identical output, see forestApply1.cpp)
+  [hs,ps]=forestApply1(data,forest,maxDepth,minCount,best,nThreads); return;
+end
 for i=1:M, tree=forest(i);
   if(maxDepth>0), tree.child(tree.depth>=maxDepth) = 0; end
   if(minCount>0), tree.child(tree.count<=minCount) = 0; end
-  ids = forestInds(data,tree.thrs,tree.fids,tree.child);
+  ids = forestInds(data,tree.thrs,tree.fids,tree.child,nThreads);
   if(best), hs(:,i)=tree.hs(ids); else ps=ps+tree.distr(ids,:); end
 end
 if(discr), ps=[]; return; end % output is actually {NxM} in this case
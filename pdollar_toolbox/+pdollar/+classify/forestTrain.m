@@ -26,6 +26,8 @@ function forest = forestTrain( data, hs, varargin )
 %   .fWts       - [] weights used for sampling features
 %   .discretize - [] optional function mapping structured to class labels
 %                    format: [hsClass,hBest] = discretize(hsStructured,H);
+%   .nBins      - [0] if >0 search thresholds over nBins quantized values
+%                    per feature (faster, avoids sorting data at each node)
 %
 % OUTPUTS
 %  forest   - learned forest model struct array w the following fields
@@ -42,6 +44,7 @@ function forest = forestTrain( data, hs, varargin )
 %  xs0=single(xs0); xs1=single(xs1);
 %  pTrain={'maxDepth',50,'F1',2,'M',150,'minChild',5};
 %  tic, forest=forestTrain(xs0,hs0,pTrain{:}); toc
+%  tic, forestQ=forestTrain(xs0,hs0,pTrain{:},'nBins',256); toc
 %  hsPr0 = forestApply(xs0,forest);
 %  hsPr1 = forestApply(xs1,forest);
 %  e0=mean(hsPr0~=hs0); e1=mean(hsPr1~=hs1);
@@ -59,8 +62,9 @@ function forest = forestTrain( data, hs, varargin )
 
 % get additional parameters and fill in remaining parameters
 dfs={ 'M',1, 'H',[], 'N1',[], 'F1',[], 'split','gini', 'minCount',1, ...
-  'minChild',1, 'maxDepth',64, 'dWts',[], 'fWts',[], 'discretize','' };
-[M,H,N1,F1,splitStr,minCount,minChild,maxDepth,dWts,fWts,discretize] = ...
+  'minChild',1, 'maxDepth',64, 'dWts',[], 'fWts',[], 'discretize','', ...
+  'nBins',0 };
+[M,H,N1,F1,splitStr,minCount,minChild,maxDepth,dWts,fWts,discretize,nBins]=...
   getPrmDflt(varargin,dfs,1);
 [N,F]=size(data); assert(length(hs)==N); discr=~isempty(discretize);
 minChild=max(1,minChild); minCount=max([1 minCount minChild]);
@@ -79,7 +83,7 @@ if(~isa(fWts,'single')), fWts=single(fWts); end
 if(~isa(dWts,'single')), dWts=single(dWts); end
 
 % train M random trees on different subsets of data
-prmTree = {H,F1,minCount,minChild,maxDepth,fWts,split,discretize};
+prmTree = {H,F1,minCount,minChild,maxDepth,fWts,split,discretize,nBins};
 for i=1:M
   if(N==N1), data1=data; hs1=hs; dWts1=dWts; else
     d=wswor(dWts,N1,4); data1=data(d,:); hs1=hs(d);
@@ -93,7 +97,7 @@ end
 
 function tree = treeTrain( data, hs, dWts, prmTree )
 % Train single random tree.
-[H,F1,minCount,minChild,maxDepth,fWts,split,discretize]=deal(prmTree{:});
+[H,F1,minCount,minChild,maxDepth,fWts,split,discretize,nBins]=deal(prmTree{:});
 N=size(data,1); K=2*N-1; discr=~isempty(discretize);
 thrs=zeros(K,1,'single'); distr=zeros(K,H,'single');
 fids=zeros(K,1,'uint32'); child=fids; count=fids; depth=fids;
@@ -109,8 +113,9 @@ while( k < K )
   if( pure || n1<=minCount || depth(k)>maxDepth ), k=k+1; continue; end
   % train split and continue
   fids1=wswor(fWts,F1,4); data1=data(dids1,fids1);
-  [~,order1]=sort(data1); order1=uint32(order1-1);
-  [fid,thr,gain]=forestFindThr(data1,hs1,dWts(dids1),order1,H,split);
+  if(nBins>0), order1=[]; else
+    [~,order1]=sort(data1); order1=uint32(order1-1); end
+  [fid,thr,gain]=forestFindThr(data1,hs1,dWts(dids1),order1,H,split,nBins);
   fid=fids1(fid); left=data(dids1,fid)<thr; count0=nnz(left);
   if( gain>1e-10 && count0>=minChild && (n1-count0)>=minChild )
     child(k)=K; fids(k)=fid-1; thrs(k)=thr;
@@ -4,6 +4,7 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include <mex.h>
+#include <string.h>
 #ifdef USEOMP
 #include <omp.h>
 #endif
@@ -12,23 +13,54 @@ typedef unsigned char uint8;
 typedef unsigned int uint32;
 #define min(x,y) ((x) < (y) ? (x) : (y))
 
-// construct cdf given data vector and wts
-void constructCdf( uint8* data, float *wts, int nBins,
-                  int N, int M, uint32 *ord, float *cdf )
+// features and samples are processed in blocks of FB features and SB samples
+// (the histograms of a block of features and the weights and indices of a
+// block of samples fit into L1/L2, so the weights are read once per block)
+static const int FB=16, SB=2048;
+
+// accumulate 256 bin histograms hs[f*256+...] of data for nf features with
+// columns cols[f] given wts, samples are added in order (if M>=0 only the M
+// samples ord[i] with weights wts[i] are used)
+void constructHists( uint8* data, float *wts, int N, int M, uint32 *ord,
+  const uint32 *cols, int nf, float *hs )
 {
-  int i; for( i=0; i<nBins; i++) cdf[i]=0;
-  if(M) for( i=0; i<M; i++) cdf[data[ord[i]]] += wts[i];
-  else for( i=0; i<N; i++) cdf[data[i]] += wts[i];
-  for(i=1; i<nBins; i++) cdf[i]+=cdf[i-1];
+  memset(hs,0,nf*256*sizeof(float)); int n=M<0 ? N : M;
+  for( int i0=0; i0<n; i0+=SB ) {
+    int i1=min(i0+SB,n);
+    for( int f=0; f<nf; f++ ) {
+      uint8 *data1=data+N*size_t(cols[f]); float *hs1=hs+f*256;
+      if(M>=0) for( int i=i0; i<i1; i++ ) hs1[data1[ord[i]]] += wts[i];
+      else for( int i=i0; i<i1; i++ ) hs1[data1[i]] += wts[i];
+    }
+  }
 }
 
-// [errs,thrs] = mexFunction( data0, data1, wts0, wts1,
-//  nBins, prior, fids, nThreads, [ord0], [ord1] )
+// find lowest error threshold given histograms of both classes
+void bestThr( const float *hs0, const float *hs1, int nBins, float prior,
+  float &err, uint8 &thr )
+{
+  float cdf0[256], cdf1[256], e0=1, e1=0, e; int t=0;
+  cdf0[0]=hs0[0]; cdf1[0]=hs1[0];
+  for( int i=1; i<nBins; i++ ) {
+    cdf0[i]=hs0[i]+cdf0[i-1]; cdf1[i]=hs1[i]+cdf1[i-1]; }
+  for( int i=0; i<nBins; i++) {
+    e = prior - cdf1[i] + cdf0[i];
+    if(e<e0) { e0=e; e1=1-e; t=i; } else if(e>e1) { e0=1-e; e1=e; t=i; }
+  }
+  err=e0; thr=(uint8) t;
+}
+
+// [errs,thrs,hists] = mexFunction( data0, data1, wts0, wts1,
+//  nBins, prior, fids, nThreads, [ord0], [ord1], [hists] )
+// hists is [2*nBins x nFtrs] with the (weighted) histograms of each feature
+// for both classes. If given as input the histograms are used instead of
+// the data (columns are indexed by fids), as output column f holds feature
+// fids(f). Child histograms can be derived from a parent by subtraction.
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
   // get inputs
   int nBins, nThreads, N0, N1, M0, M1, F; float prior, *wts0, *wts1;
-  uint8 *data0, *data1; uint32 *fids, *ord0, *ord1;
+  uint8 *data0, *data1; uint32 *fids, *ord0=0, *ord1=0; float *hsIn=0;
   data0 = (uint8*) mxGetData(prhs[0]);
   data1 = (uint8*) mxGetData(prhs[1]);
   wts0 = (float*) mxGetData(prhs[2]);
@@ -40,34 +72,56 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   N0 = (int) mxGetM(prhs[0]);
   N1 = (int) mxGetM(prhs[1]);
   F = (int) mxGetNumberOfElements(prhs[6]);
+  if( nBins<1 || nBins>256 ) mexErrMsgTxt("nBins must be in [1,256].");
 
   // ord0 and ord1 are optional
-  if( nrhs<10 ) M0=M1=0; else {
+  if( nrhs<10 ) M0=M1=-1; else {
     ord0 = (uint32*) mxGetData(prhs[8]);
     ord1 = (uint32*) mxGetData(prhs[9]);
     M0 = (int) mxGetNumberOfElements(prhs[8]);
     M1 = (int) mxGetNumberOfElements(prhs[9]);
   }
 
+  // input histograms are optional
+  if( nrhs>=11 && !mxIsEmpty(prhs[10]) ) {
+    if( mxGetClassID(prhs[10])!=mxSINGLE_CLASS || int(mxGetM(prhs[10]))!=2*nBins )
+      mexErrMsgTxt("hists must be a single matrix with 2*nBins rows.");
+    hsIn = (float*) mxGetData(prhs[10]);
+    for( int f=0; f<F; f++ ) if( fids[f]>=mxGetN(prhs[10]) )
+      mexErrMsgTxt("fids out of range of hists.");
+  }
+
   // create outpu structure
   plhs[0] = mxCreateNumericMatrix(1,F,mxSINGLE_CLASS,mxREAL);
   plhs[1] = mxCreateNumericMatrix(1,F,mxUINT8_CLASS,mxREAL);
   float *errs = (float*) mxGetData(plhs[0]);
   uint8 *thrs = (uint8*) mxGetData(plhs[1]);
+  float *hsOut = 0; if( nlhs>2 ) {
+    plhs[2] = mxCreateNumericMatrix(2*nBins,F,mxSINGLE_CLASS,mxREAL);
+    hsOut = (float*) mxGetData(plhs[2]);
+  }
 
-  // find lowest error for each feature
+  // find lowest error for each feature (in parallel over blocks of features)
+  const int nBlocks=(F+FB-1)/FB;
   #ifdef USEOMP
   nThreads = min(nThreads,omp_get_max_threads());
-  #pragma omp parallel for num_threads(nThreads)
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
   #endif
-  for( int f=0; f<F; f++ ) {
-    float cdf0[256], cdf1[256], e0=1, e1=0, e; int thr;
-    constructCdf(data0+N0*size_t(fids[f]),wts0,nBins,N0,M0,ord0,cdf0);
-    constructCdf(data1+N1*size_t(fids[f]),wts1,nBins,N1,M1,ord1,cdf1);
-    for( int i=0; i<nBins; i++) {
-      e = prior - cdf1[i] + cdf0[i];
-      if(e<e0) { e0=e; e1=1-e; thr=i; } else if(e>e1) { e0=1-e; e1=e; thr=i; }
+  for( int b=0; b<nBlocks; b++ ) {
+    const int f0=b*FB, nf=min(FB,F-f0); float hs0[FB*256], hs1[FB*256];
+    if( hsIn ) for( int f=0; f<nf; f++ ) {
+      const float *h=hsIn+size_t(fids[f0+f])*2*nBins;
+      memcpy(hs0+f*256,h,nBins*sizeof(float));
+      memcpy(hs1+f*256,h+nBins,nBins*sizeof(float));
+    } else {
+      constructHists(data0,wts0,N0,M0,ord0,fids+f0,nf,hs0);
+      constructHists(data1,wts1,N1,M1,ord1,fids+f0,nf,hs1);
+    }
+    for( int f=0; f<nf; f++ ) {
+      bestThr(hs0+f*256,hs1+f*256,nBins,prior,errs[f0+f],thrs[f0+f]);
+      if( hsOut ) { float *h=hsOut+size_t(f0+f)*2*nBins;
+        memcpy(h,hs0+f*256,nBins*sizeof(float));
+        memcpy(h+nBins,hs1+f*256,nBins*sizeof(float)); }
     }
-    errs[f]=e0; thrs[f]=(uint8) thr;
   }
 }
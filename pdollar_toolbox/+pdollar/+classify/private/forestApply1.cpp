@@ -0,0 +1,196 @@
+/*******************************************************************************
+* Piotr's Computer Vision Matlab Toolbox      Version 3.24
+* Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#include <mex.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+using namespace std;
+
+typedef unsigned int uint32;
+
+// packed tree node (child==0 at leaves, see forestInds)
+struct Node { uint32 fid; float thr; uint32 child; };
+
+// single tree: packed nodes plus per node either the class distribution
+// (stored node major, H values per node) or a single vote (class index)
+struct Tree { vector<Node> nodes; vector<float> distr; vector<int> vote; };
+
+// value i of a numeric array as a double
+double getVal( const mxArray *A, size_t i )
+{
+  void *p=mxGetData(A);
+  switch( mxGetClassID(A) ) {
+    case mxDOUBLE_CLASS: return ((double*)p)[i];
+    case mxSINGLE_CLASS: return ((float*)p)[i];
+    case mxUINT32_CLASS: return ((uint32*)p)[i];
+    case mxINT32_CLASS: return ((int*)p)[i];
+    default: mexErrMsgTxt("Unsupported type for forest.hs.");
+  }
+  return 0;
+}
+
+// get field of forest(t) and check its class
+const mxArray* getField( const mxArray *forest, int t, const char *name,
+  mxClassID id )
+{
+  const mxArray *A=mxGetField(forest,t,name);
+  if( A==NULL ) mexErrMsgTxt("Missing forest field.");
+  if( id!=mxUNKNOWN_CLASS && mxGetClassID(A)!=id )
+    mexErrMsgTxt("Forest field has unexpected type.");
+  return A;
+}
+
+// pack forest(t), nodes at depth>=maxDepth or with count<=minCount are
+// turned into leaves (as in forestApply.m)
+void getTree( const mxArray *forest, int t, int H, double maxDepth,
+  double minCount, bool best, Tree &tree )
+{
+  const mxArray *A=getField(forest,t,"fids",mxUINT32_CLASS);
+  size_t K=mxGetNumberOfElements(A); uint32 *fids=(uint32*) mxGetData(A);
+  float *thrs=(float*) mxGetData(getField(forest,t,"thrs",mxSINGLE_CLASS));
+  uint32 *child=(uint32*) mxGetData(getField(forest,t,"child",mxUINT32_CLASS));
+  uint32 *depth=0, *count=0;
+  if(maxDepth>0) depth=(uint32*) mxGetData(getField(forest,t,"depth",mxUINT32_CLASS));
+  if(minCount>0) count=(uint32*) mxGetData(getField(forest,t,"count",mxUINT32_CLASS));
+  tree.nodes.resize(K);
+  for( size_t k=0; k<K; k++ ) {
+    Node &n=tree.nodes[k]; n.fid=fids[k]; n.thr=thrs[k]; n.child=child[k];
+    if( depth && depth[k]>=maxDepth ) n.child=0;
+    if( count && count[k]<=minCount ) n.child=0;
+  }
+  if( best ) {
+    // vote for class hs(k) (values outside [1,H] are ignored as by histc)
+    A=getField(forest,t,"hs",mxUNKNOWN_CLASS); tree.vote.resize(K);
+    if( mxGetNumberOfElements(A)!=K ) mexErrMsgTxt("Invalid forest.hs.");
+    for( size_t k=0; k<K; k++ ) {
+      double v=getVal(A,k); int h=v==H ? H-1 : int(floor(v))-1;
+      tree.vote[k] = (v>=1 && v<=H) ? h : -1;
+    }
+  } else {
+    A=getField(forest,t,"distr",mxSINGLE_CLASS);
+    if( mxGetM(A)!=K || int(mxGetN(A))!=H ) mexErrMsgTxt("Invalid forest.distr.");
+    float *distr=(float*) mxGetData(A); tree.distr.resize(K*H);
+    for( size_t k=0; k<K; k++ ) for( int h=0; h<H; h++ )
+      tree.distr[k*H+h]=distr[k+h*K];
+  }
+}
+
+// route n samples (data is column major with N rows) through the tree,
+// eight samples at a time so that their node fetches overlap
+inline void route( const float *data, int N, int n, const Node *nodes,
+  uint32 *ks )
+{
+  int i=0;
+  for( ; i+8<=n; i+=8 ) {
+    uint32 k[8]={0,0,0,0,0,0,0,0}; bool more=true;
+    while( more ) {
+      more=false;
+      for( int j=0; j<8; j++ ) {
+        const Node &nd=nodes[k[j]]; if(!nd.child) continue;
+        k[j] = nd.child - (data[i+j+nd.fid*size_t(N)] < nd.thr); more=true;
+      }
+    }
+    for( int j=0; j<8; j++ ) ks[i+j]=k[j];
+  }
+  for( ; i<n; i++ ) {
+    uint32 k=0;
+    while( nodes[k].child ) k = nodes[k].child -
+      (data[i+nodes[k].fid*size_t(N)] < nodes[k].thr);
+    ks[i]=k;
+  }
+}
+
+// apply all trees to the data in blocks of B samples: every tree routes the
+// whole block before moving on to the next tree (so its nodes stay in cache)
+// and the outputs of the block are accumulated in a small row major buffer.
+// Per sample the trees are summed in order, so ps is identical to summing
+// the outputs of the trees one at a time. ps is NxH (column major).
+template<class T> void forestApply( const float *data, int N, int H,
+  const vector<Tree> &trees, bool best, T *ps, int nThreads )
+{
+  const int B=1024, nBlocks=(N+B-1)/B, M=int(trees.size());
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+  #endif
+  for( int b=0; b<nBlocks; b++ ) {
+    const int i0=b*B, n=min(B,N-i0); uint32 ks[B];
+    vector<T> acc(size_t(n)*H,T(0));
+    for( int t=0; t<M; t++ ) {
+      const Node *nodes=&trees[t].nodes[0];
+      route(data+i0,N,n,nodes,ks);
+      if( best ) {
+        const int *vote=&trees[t].vote[0];
+        for( int i=0; i<n; i++ ) if(vote[ks[i]]>=0) acc[i*H+vote[ks[i]]]+=1;
+      } else {
+        const float *distr=&trees[t].distr[0];
+        for( int i=0; i<n; i++ ) {
+          const float *d=distr+ks[i]*size_t(H); T *a=&acc[i*H];
+          for( int h=0; h<H; h++ ) a[h]+=d[h];
+        }
+      }
+    }
+    for( int i=0; i<n; i++ ) for( int h=0; h<H; h++ )
+      ps[i0+i+h*size_t(N)]=acc[i*H+h];
+  }
+}
+
+// most likely label of each sample (first maximum) and normalized ps
+template<class T> void forestLabels( T *ps, int N, int H, int M, double *hs )
+{
+  for( int i=0; i<N; i++ ) {
+    int h1=0; T p=ps[i];
+    for( int h=1; h<H; h++ ) if( ps[i+h*size_t(N)]>p ) { p=ps[i+h*size_t(N)]; h1=h; }
+    hs[i]=h1+1;
+  }
+  for( size_t i=0; i<size_t(N)*H; i++ ) ps[i]/=T(M);
+}
+
+// [hs,ps] = mexFunction(data,forest,maxDepth,minCount,best,[nThreads])
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+  int N, H, M, nThreads; double maxDepth, minCount; bool best;
+  const float *data;
+  if( nrhs<5 || nrhs>6 ) mexErrMsgTxt("Incorrect number of inputs.");
+  if( mxGetClassID(prhs[0])!=mxSINGLE_CLASS ) mexErrMsgTxt("data must be single.");
+  if( !mxIsStruct(prhs[1]) ) mexErrMsgTxt("forest must be a struct array.");
+  data = (float*) mxGetData(prhs[0]);
+  N = (int) mxGetM(prhs[0]);
+  M = (int) mxGetNumberOfElements(prhs[1]);
+  maxDepth = mxGetScalar(prhs[2]);
+  minCount = mxGetScalar(prhs[3]);
+  best = mxGetScalar(prhs[4])!=0;
+  nThreads = (nrhs<6) ? 100000 : (int) mxGetScalar(prhs[5]);
+  if( M<1 ) mexErrMsgTxt("forest must contain at least one tree.");
+  H = (int) mxGetN(getField(prhs[1],0,"distr",mxUNKNOWN_CLASS));
+
+  // pack trees and check that every feature id lies within data
+  vector<Tree> trees(M); uint32 F=uint32(mxGetN(prhs[0]));
+  for( int t=0; t<M; t++ ) {
+    getTree(prhs[1],t,H,maxDepth,minCount,best,trees[t]);
+    uint32 K=uint32(trees[t].nodes.size());
+    if( K==0 ) mexErrMsgTxt("Empty tree.");
+    for( uint32 k=0; k<K; k++ ) { const Node &n=trees[t].nodes[k];
+      if( n.child && (n.child>=K || n.fid>=F) ) mexErrMsgTxt("Invalid tree."); }
+  }
+
+  // apply forest (ps is single unless best is set, as in forestApply.m)
+  plhs[0] = mxCreateNumericMatrix(N,1,mxDOUBLE_CLASS,mxREAL);
+  double *hs = (double*) mxGetData(plhs[0]);
+  if( best ) {
+    plhs[1] = mxCreateNumericMatrix(N,H,mxDOUBLE_CLASS,mxREAL);
+    double *ps = (double*) mxGetData(plhs[1]);
+    forestApply(data,N,H,trees,best,ps,nThreads);
+    forestLabels(ps,N,H,M,hs);
+  } else {
+    plhs[1] = mxCreateNumericMatrix(N,H,mxSINGLE_CLASS,mxREAL);
+    float *ps = (float*) mxGetData(plhs[1]);
+    forestApply(data,N,H,trees,best,ps,nThreads);
+    forestLabels(ps,N,H,M,hs);
+  }
+}
@@ -7,6 +7,12 @@
 #include <stdint.h>
 #include <math.h>
 #include <mex.h>
+#include <vector>
+#include <algorithm>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+using namespace std;
 
 typedef unsigned int uint32;
 #define gini(p) p*p
@@ -21,55 +27,137 @@ inline float flog2( float x ) {
     - 1.72587999f / (0.3520887068f + mx.f);
 }
 
-// perform actual computation
-void forestFindThr( int H, int N, int F, const float *data,
-  const uint32 *hs, const float *ws, const uint32 *order, const int split,
-  uint32 &fid, float &thr, double &gain )
+// initial impurity of the node and the total weights of each class W
+double nodeImpurity( int H, int N, const uint32 *hs, const float *ws,
+  const int split, double *W, double &w, double &g )
 {
-  double *Wl, *Wr, *W; float *data1; uint32 *order1;
-  int i, j, j1, j2, h; double vBst, vInit, v, w, wl, wr, g, gl, gr;
-  Wl=new double[H]; Wr=new double[H]; W=new double[H];
-  // perform initialization
-  vBst = vInit = 0; g = 0; w = 0; fid = 1; thr = 0;
+  int i, j; g=0; w=0;
   for( i=0; i<H; i++ ) W[i] = 0;
   for( j=0; j<N; j++ ) { w+=ws[j]; W[hs[j]-1]+=ws[j]; }
-  if( split==0 ) { for( i=0; i<H; i++ ) g+=gini(W[i]); vBst=vInit=(1-g/w/w); }
-  if( split==1 ) { for( i=0; i<H; i++ ) g+=entropy(W[i]); vBst=vInit=g/w; }
-  // loop over features, then thresholds (data is sorted by feature value)
-  for( i=0; i<F; i++ ) {
-    order1=(uint32*) order+i*N; data1=(float*) data+i*size_t(N);
-    for( j=0; j<H; j++ ) { Wl[j]=0; Wr[j]=W[j]; } gl=wl=0; gr=g; wr=w;
-    for( j=0; j<N-1; j++ ) {
-      j1=order1[j]; j2=order1[j+1]; h=hs[j1]-1;
+  if( split==0 ) { for( i=0; i<H; i++ ) g+=gini(W[i]); return 1-g/w/w; }
+  if( split==1 ) { for( i=0; i<H; i++ ) g+=entropy(W[i]); return g/w; }
+  return 0;
+}
+
+// best threshold for a single feature (data is sorted by feature value),
+// only thresholds with v<vBst are considered, returns true if one was found
+bool featureThr( int H, int N, const float *data1, const uint32 *hs,
+  const float *ws, const uint32 *order1, const int split, const double *W,
+  double w, double g, double *Wl, double *Wr, double &vBst, float &thr )
+{
+  int j, j1, j2, h; double v, wl, wr, gl, gr; bool found=false;
+  for( j=0; j<H; j++ ) { Wl[j]=0; Wr[j]=W[j]; } gl=wl=0; gr=g; wr=w;
+  for( j=0; j<N-1; j++ ) {
+    j1=order1[j]; j2=order1[j+1]; h=hs[j1]-1;
+    if(split==0) {
+      // gini = 1-\sum_h p_h^2; v = gini_l*pl + gini_r*pr
+      wl+=ws[j1]; gl-=gini(Wl[h]); Wl[h]+=ws[j1]; gl+=gini(Wl[h]);
+      wr-=ws[j1]; gr-=gini(Wr[h]); Wr[h]-=ws[j1]; gr+=gini(Wr[h]);
+      v = (wl-gl/wl)/w + (wr-gr/wr)/w;
+    } else if (split==1) {
+      // entropy = -\sum_h p_h log(p_h); v = entropy_l*pl + entropy_r*pr
+      gl+=entropy(wl); wl+=ws[j1]; gl-=entropy(wl);
+      gr+=entropy(wr); wr-=ws[j1]; gr-=entropy(wr);
+      gl-=entropy(Wl[h]); Wl[h]+=ws[j1]; gl+=entropy(Wl[h]);
+      gr-=entropy(Wr[h]); Wr[h]-=ws[j1]; gr+=entropy(Wr[h]);
+      v = gl/w + gr/w;
+    } else {
+      // twoing: v = pl*pr*\sum_h(|p_h_left - p_h_right|)^2 [slow if H>>0]
+      wl+=ws[j1]; Wl[h]+=ws[j1]; wr-=ws[j1]; Wr[h]-=ws[j1];
+      double s=0; for( int h1=0; h1<H; h1++ ) s+=fabs(Wl[h1]/wl-Wr[h1]/wr);
+      v = - wl/w*wr/w*s*s;
+    }
+    if( v<vBst && data1[j2]-data1[j1]>=1e-6f ) {
+      vBst=v; thr=0.5f*(data1[j1]+data1[j2]); found=true; }
+  }
+  return found;
+}
+
+// best threshold for a single feature with its values quantized into nBins
+// equal width bins (no sorting needed), thresholds lie between the largest
+// value of a bin and the smallest value of the next non-empty bin. Hb holds
+// the class weights per bin, lo/hi the value range of each bin.
+bool featureThrQ( int H, int N, const float *data1, const uint32 *hs,
+  const float *ws, const int split, const double *W, double w, int nBins,
+  double *Wl, double *Wr, double *Hb, float *lo, float *hi, double &vBst,
+  float &thr )
+{
+  int b, b0, j, h; double v, wl, wr, gl, gr; bool found=false;
+  float mn=data1[0], mx=data1[0];
+  for( j=1; j<N; j++ ) { mn=min(mn,data1[j]); mx=max(mx,data1[j]); }
+  if( !(mx-mn>=1e-6f) ) return false;
+  const double scale=nBins/(double(mx)-mn);
+  for( b=0; b<nBins*H; b++ ) Hb[b]=0;
+  for( b=0; b<nBins; b++ ) { lo[b]=mx; hi[b]=mn; }
+  for( j=0; j<N; j++ ) {
+    b=int((data1[j]-double(mn))*scale); if(b>=nBins) b=nBins-1;
+    Hb[b*H+hs[j]-1]+=ws[j]; lo[b]=min(lo[b],data1[j]); hi[b]=max(hi[b],data1[j]);
+  }
+  for( j=0; j<H; j++ ) { Wl[j]=0; Wr[j]=W[j]; } wl=0; wr=w;
+  for( b0=-1, b=0; b<nBins; b++ ) {
+    if( lo[b]>hi[b] ) continue;
+    if( b0>=0 ) {
+      // evaluate split between bins b0 and b (same values of v as above)
+      gl=gr=v=0;
       if(split==0) {
-        // gini = 1-\sum_h p_h^2; v = gini_l*pl + gini_r*pr
-        wl+=ws[j1]; gl-=gini(Wl[h]); Wl[h]+=ws[j1]; gl+=gini(Wl[h]);
-        wr-=ws[j1]; gr-=gini(Wr[h]); Wr[h]-=ws[j1]; gr+=gini(Wr[h]);
+        for( h=0; h<H; h++ ) { gl+=gini(Wl[h]); gr+=gini(Wr[h]); }
         v = (wl-gl/wl)/w + (wr-gr/wr)/w;
-      } else if (split==1) {
-        // entropy = -\sum_h p_h log(p_h); v = entropy_l*pl + entropy_r*pr
-        gl+=entropy(wl); wl+=ws[j1]; gl-=entropy(wl);
-        gr+=entropy(wr); wr-=ws[j1]; gr-=entropy(wr);
-        gl-=entropy(Wl[h]); Wl[h]+=ws[j1]; gl+=entropy(Wl[h]);
-        gr-=entropy(Wr[h]); Wr[h]-=ws[j1]; gr+=entropy(Wr[h]);
-        v = gl/w + gr/w;
-      } else if (split==2) {
-        // twoing: v = pl*pr*\sum_h(|p_h_left - p_h_right|)^2 [slow if H>>0]
-        j1=order1[j]; j2=order1[j+1]; h=hs[j1]-1;
-        wl+=ws[j1]; Wl[h]+=ws[j1]; wr-=ws[j1]; Wr[h]-=ws[j1];
-        g=0; for( int h1=0; h1<H; h1++ ) g+=fabs(Wl[h1]/wl-Wr[h1]/wr);
-        v = - wl/w*wr/w*g*g;
+      } else if(split==1) {
+        for( h=0; h<H; h++ ) { gl+=entropy(Wl[h]); gr+=entropy(Wr[h]); }
+        v = (gl-entropy(wl))/w + (gr-entropy(wr)+entropy(w))/w;
+      } else {
+        double s=0; for( h=0; h<H; h++ ) s+=fabs(Wl[h]/wl-Wr[h]/wr);
+        v = - wl/w*wr/w*s*s;
       }
-      if( v<vBst && data1[j2]-data1[j1]>=1e-6f ) {
-        vBst=v; fid=i+1; thr=0.5f*(data1[j1]+data1[j2]); }
+      if( v<vBst && lo[b]-hi[b0]>=1e-6f ) {
+        vBst=v; thr=0.5f*(hi[b0]+lo[b]); found=true; }
+    }
+    for( h=0; h<H; h++ ) {
+      double d=Hb[b*H+h]; wl+=d; Wl[h]+=d; wr-=d; Wr[h]-=d; }
+    b0=b;
+  }
+  return found;
+}
+
+// perform actual computation (features are processed in parallel, each
+// thread keeps its best split, ties are resolved in favor of the smaller
+// feature index so results do not depend on the number of threads)
+void forestFindThr( int H, int N, int F, const float *data,
+  const uint32 *hs, const float *ws, const uint32 *order, const int split,
+  int nBins, int nThreads, uint32 &fid, float &thr, double &gain )
+{
+  double *W, vInit, w, g; W=new double[H];
+  vInit=nodeImpurity(H,N,hs,ws,split,W,w,g);
+  vector<double> vBst(F,vInit); vector<float> thrs(F,0);
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel num_threads(nThreads)
+  #endif
+  {
+    // thread local histograms
+    vector<double> Wl(H), Wr(H), Hb(nBins>0 ? size_t(nBins)*H : 0);
+    vector<float> lo(nBins>0 ? nBins : 0), hi(lo.size());
+    #ifdef USEOMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for( int i=0; i<F; i++ ) {
+      const float *data1=data+i*size_t(N);
+      if( nBins>0 ) featureThrQ(H,N,data1,hs,ws,split,W,w,nBins,&Wl[0],
+        &Wr[0],&Hb[0],&lo[0],&hi[0],vBst[i],thrs[i]);
+      else featureThr(H,N,data1,hs,ws,order+i*size_t(N),split,W,w,g,
+        &Wl[0],&Wr[0],vBst[i],thrs[i]);
     }
   }
-  delete [] Wl; delete [] Wr; delete [] W; gain = vInit-vBst;
+  // reduce (in order of the features)
+  double v=vInit; fid=1; thr=0;
+  for( int i=0; i<F; i++ ) if( vBst[i]<v ) { v=vBst[i]; fid=i+1; thr=thrs[i]; }
+  delete [] W; gain = vInit-v;
 }
 
-// [fid,thr,gain] = mexFunction(data,hs,ws,order,H,split);
+// [fid,thr,gain] = mexFunction(data,hs,ws,order,H,split,[nBins],[nThreads]);
+// if nBins>0 thresholds are searched over quantized values (order unused)
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  int H, N, F, split; float *data, *ws, thr;
+  int H, N, F, split, nBins, nThreads; float *data, *ws, thr;
   double gain; uint32 *hs, *order, fid;
   data = (float*) mxGetData(prhs[0]);
   hs = (uint32*) mxGetData(prhs[1]);
@@ -77,9 +165,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   order = (uint32*) mxGetData(prhs[3]);
   H = (int) mxGetScalar(prhs[4]);
   split = (int) mxGetScalar(prhs[5]);
+  nBins = (nrhs<7) ? 0 : (int) mxGetScalar(prhs[6]);
+  nThreads = (nrhs<8) ? 100000 : (int) mxGetScalar(prhs[7]);
   N = (int) mxGetM(prhs[0]);
   F = (int) mxGetN(prhs[0]);
-  forestFindThr(H,N,F,data,hs,ws,order,split,fid,thr,gain);
+  if( nBins<=0 && mxGetNumberOfElements(prhs[3])!=size_t(N)*F )
+    mexErrMsgTxt("order must be the same size as data.");
+  forestFindThr(H,N,F,data,hs,ws,order,split,nBins,nThreads,fid,thr,gain);
   plhs[0] = mxCreateDoubleScalar(fid);
   plhs[1] = mxCreateDoubleScalar(thr);
   plhs[2] = mxCreateDoubleScalar(gain);
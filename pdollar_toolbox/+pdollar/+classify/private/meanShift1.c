@@ -4,8 +4,14 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include "mex.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+typedef long long int64;
 
 /*******************************************************************************
 * Calculates mean of all the points in data that lie on a sphere of
@@ -37,6 +43,116 @@ double dist( double *A, double *B, int n ) {
   return d;
 }
 
+/*******************************************************************************
+* Uniform grid (spatial hash) over the first q<=3 dimensions of the data with
+* cells slightly larger than the radius, so all points within the radius of
+* x lie in the 3^q cells around the cell of x. The points of a cell are
+* stored in increasing order, cells are found by hashing their coordinates.
+*******************************************************************************/
+typedef struct {
+  int q, nCells, tblSize;  /* grid dims, number of cells, hash table size */
+  double mn[3], step;      /* grid origin and cell size */
+  int64 *coords;           /* [q x nCells] integer coordinates of each cell */
+  int *tbl;                /* hash table (cell index or -1) */
+  int *start, *ids;        /* points of cell c are ids[start[c]..start[c+1]) */
+} Grid;
+
+unsigned int gridHash( const int64 *c, int q ) {
+  unsigned long long h=0; int d;
+  for( d=0; d<q; d++ ) h = h*0x9E3779B97F4A7C15ULL + (unsigned long long) c[d];
+  return (unsigned int) (h ^ (h>>29) ^ (h>>47));
+}
+
+void gridCoords( const Grid *g, const double *x, int64 *c ) {
+  int d; for( d=0; d<g->q; d++ ) c[d]=(int64) floor((x[d]-g->mn[d])/g->step);
+}
+
+/* Find cell with coordinates c (if insert add it if missing), or -1. */
+int gridFind( Grid *g, const int64 *c, int insert ) {
+  unsigned int k=gridHash(c,g->q)&(g->tblSize-1); int d, e;
+  while( (e=g->tbl[k])>=0 ) {
+    for( d=0; d<g->q; d++ ) if( g->coords[e*g->q+d]!=c[d] ) break;
+    if( d==g->q ) return e;
+    k=(k+1)&(g->tblSize-1);
+  }
+  if( !insert ) return -1;
+  e=g->nCells++; g->tbl[k]=e;
+  for( d=0; d<g->q; d++ ) g->coords[e*g->q+d]=c[d];
+  return e;
+}
+
+/* Build grid over data [p x n] with cells of size >= radius. */
+void gridBuild( Grid *g, double *data, int p, int n, double radius ) {
+  int i, d, *cell; int64 c[3];
+  g->q = p<3 ? p : 3; g->step = radius*(1+1e-6); g->nCells=0;
+  for( d=0; d<g->q; d++ ) g->mn[d] = n ? data[d] : 0;
+  for( i=1; i<n; i++ ) for( d=0; d<g->q; d++ )
+    if( data[i*p+d]<g->mn[d] ) g->mn[d]=data[i*p+d];
+  for( g->tblSize=1; g->tblSize<2*n; ) g->tblSize*=2;
+  g->tbl = (int*) malloc(sizeof(int)*g->tblSize);
+  for( i=0; i<g->tblSize; i++ ) g->tbl[i]=-1;
+  g->coords = (int64*) malloc(sizeof(int64)*(g->q*n+1));
+  cell = (int*) malloc(sizeof(int)*(n+1));
+  for( i=0; i<n; i++ ) { gridCoords(g,data+i*p,c); cell[i]=gridFind(g,c,1); }
+  g->start = (int*) calloc(g->nCells+1,sizeof(int));
+  g->ids = (int*) malloc(sizeof(int)*(n+1));
+  for( i=0; i<n; i++ ) g->start[cell[i]+1]++;
+  for( i=0; i<g->nCells; i++ ) g->start[i+1]+=g->start[i];
+  for( i=0; i<n; i++ ) g->ids[g->start[cell[i]]++]=i;
+  for( i=g->nCells; i>0; i-- ) g->start[i]=g->start[i-1];
+  g->start[0]=0;
+  free(cell);
+}
+
+void gridFree( Grid *g ) {
+  free(g->tbl); free(g->coords); free(g->start); free(g->ids);
+}
+
+/* Merge the ns<=27 sorted segments a[s[i]..s[i+1]) of a (tmp has s[ns]
+ * elements, s is modified). */
+void mergeSegs( int *a, int *tmp, int *s, int ns ) {
+  int *src=a, *dst=tmp, *t, s1[28], ns1, i, j, k, o, e, m=s[ns];
+  while( ns>1 ) {
+    for( ns1=0, i=0; i<ns; i+=2 ) {
+      o=k=s[i]; j=s[i+1]; e=(i+1<ns) ? s[i+2] : j; s1[ns1++]=o;
+      while( k<s[i+1] && j<e ) dst[o++] = src[k]<src[j] ? src[k++] : src[j++];
+      while( k<s[i+1] ) dst[o++]=src[k++];
+      while( j<e ) dst[o++]=src[j++];
+    }
+    s1[ns1]=m; ns=ns1; for( i=0; i<=ns; i++ ) s[i]=s1[i];
+    t=src; src=dst; dst=t;
+  }
+  if( src!=a ) memcpy(a,src,m*sizeof(int));
+}
+
+/* Indices (sorted) of all points in data within radius2 of x, returns count.
+ * The points of each cell are in order, the cells are merged (tmp is used). */
+int gridQuery( Grid *g, double *x, double *data, int p, double radius2,
+        int *nbrs, int *tmp ) {
+  int64 c0[3], c[3]; int o, nOff=1, d, e, k, m=0, i, s[28], ns=0;
+  gridCoords(g,x,c0); for( d=0; d<g->q; d++ ) nOff*=3;
+  for( o=0; o<nOff; o++ ) {
+    for( k=o, d=0; d<g->q; d++, k/=3 ) c[d]=c0[d]+k%3-1;
+    if( (e=gridFind(g,c,0))<0 ) continue;
+    s[ns]=m;
+    for( k=g->start[e]; k<g->start[e+1]; k++ ) {
+      i=g->ids[k]; if( dist(x,data+i*p,p) < radius2 ) nbrs[m++]=i; }
+    if( m>s[ns] ) ns++;
+  }
+  s[ns]=m; if( ns>1 ) mergeSegs(nbrs,tmp,s,ns);
+  return m;
+}
+
+/* Same as meanVec but only visits the points nbrs found via the grid. */
+int meanVecGrid( Grid *g, double *x, double *data, int p, double radius2,
+        int *nbrs, int *tmp, double *mean ) {
+  int j, k, m=gridQuery(g,x,data,p,radius2,nbrs,tmp);
+  for( j=0; j<p; j++ ) mean[j]=0;
+  for( k=0; k<m; k++ ) for( j=0; j<p; j++ ) mean[j]+=data[nbrs[k]*p+j];
+  if( m ) for( j=0; j<p; j++ ) mean[j]/=m;
+  return m;
+}
+
 /*******************************************************************************
 * data      - p x n column matrix of data points
 * p         - dimension of data points
@@ -45,15 +161,18 @@ double dist( double *A, double *B, int n ) {
 * rate      - gradient descent proportionality factor
 * maxIter   - max allowed number of iterations
 * blur      - specifies algorithm mode
+* nThreads  - max number of computational threads to use
 * labels    - labels for each cluster
 * means     - output (final clusters)
+* The neighbors of each point are found using a grid (rebuilt every iteration
+* if blur) and points are shifted in parallel. The points within the radius
+* are summed in the same order as by meanVec so results do not change.
 *******************************************************************************/
 void meanShift( double data[], int p, int n, double radius, double rate,
-        int maxIter, bool blur, double labels[], double *means ) {
+        int maxIter, bool blur, int nThreads, double labels[], double *means ) {
   double radius2;    /* radius^2 */
   int iter;          /* number of iterations */
-  double *mean;      /* mean vector */
-  int i, j, o, m;    /* looping and temporary variables */
+  int i, j;          /* looping and temporary variables */
   int delta = 1;     /* indicator if change occurred between iterations */
   int *deltas;       /* indicator if change occurred between iterations per point */
   double *meansCur;  /* calculated means for current iter */
@@ -61,76 +180,109 @@ void meanShift( double data[], int p, int n, double radius, double rate,
   double *data1;     /* If blur data1 points to meansCur else it points to data */
   int *consolidated; /* Needed in the assignment of cluster labels */
   int nLabels = 1;   /* Needed in the assignment of cluster labels */
-  
+  int useGrid;       /* use grid to find neighbors (requires radius>0) */
+  Grid grid;         /* grid over data1 */
+  int *nbrs;         /* neighbors of a point */
+
   /* initialization */
   meansCur = (double*) malloc( sizeof(double)*p*n );
   meansNxt = (double*) malloc( sizeof(double)*p*n );
-  mean = (double*) malloc( sizeof(double)*p );
   consolidated = (int*) malloc( sizeof(int)*n );
   deltas = (int*) malloc( sizeof(int)*n );
+  nbrs = (int*) malloc( sizeof(int)*(2*n+1) );
   for(i=0; i<n; i++) deltas[i] = 1;
-  radius2 = radius * radius;
+  radius2 = radius * radius; useGrid = radius>0 && p>0;
   meansCur = (double*) memcpy(meansCur, data, p*n*sizeof(double) );
   if( blur ) data1=meansCur; else data1=data;
-  
+  if( useGrid && !blur ) gridBuild( &grid, data1, p, n, radius );
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #endif
+
   /* main loop */
   mexPrintf("Progress: 0.000000"); mexEvalString("drawnow;");
   for(iter=0; iter<maxIter; iter++) {
     delta = 0;
-    for( i=0; i<n; i++ ) {
-      if( deltas[i] ) {
-        /* shift meansNxt in direction of mean (if m>0) */
-        o=i*p; m=meanVec( meansCur+o, data1, p, n, radius2, mean );
-        if( m ) {
-          for( j=0; j<p; j++ ) meansNxt[o+j] = (1-rate)*meansCur[o+j] + rate*mean[j];
-          if( dist(meansNxt+o, meansCur+o, p)>0.001) delta=1; else deltas[i]=0;
-        } else {
-          for( j=0; j<p; j++ ) meansNxt[o+j] = meansCur[o+j]; deltas[i]=0;
+    if( useGrid && blur ) gridBuild( &grid, data1, p, n, radius );
+    #ifdef USEOMP
+    #pragma omp parallel num_threads(nThreads) reduction(|:delta)
+    #endif
+    {
+      double *mean = (double*) malloc( sizeof(double)*p );
+      int *nbrs1 = (int*) malloc( sizeof(int)*(2*n+1) ); int i1, j1, o, m;
+      #ifdef USEOMP
+      #pragma omp for schedule(dynamic,64)
+      #endif
+      for( i1=0; i1<n; i1++ ) {
+        if( deltas[i1] ) {
+          /* shift meansNxt in direction of mean (if m>0) */
+          o=i1*p; m = useGrid ?
+            meanVecGrid( &grid, meansCur+o, data1, p, radius2, nbrs1, nbrs1+n, mean ) :
+            meanVec( meansCur+o, data1, p, n, radius2, mean );
+          if( m ) {
+            for( j1=0; j1<p; j1++ ) meansNxt[o+j1] = (1-rate)*meansCur[o+j1] + rate*mean[j1];
+            if( dist(meansNxt+o, meansCur+o, p)>0.001) delta=1; else deltas[i1]=0;
+          } else {
+            for( j1=0; j1<p; j1++ ) meansNxt[o+j1] = meansCur[o+j1];
+            deltas[i1]=0;
+          }
         }
       }
+      free(mean); free(nbrs1);
     }
+    if( useGrid && blur ) gridFree( &grid );
     mexPrintf( "\b\b\b\b\b\b\b\b%f", (float)(iter+1)/maxIter ); mexEvalString("drawnow;");
     memcpy( meansCur, meansNxt, p*n*sizeof(double) ); if(!delta) break;
   }
   mexPrintf( "\n" );
-  
-  /* Consolidate: assign all points that are within radius2 to same cluster. */
+  if( useGrid && !blur ) gridFree( &grid );
+
+  /* Consolidate: assign all points that are within radius2 to same cluster
+   * (uses a grid over the final means to find all points close to mode i). */
   for( i=0; i<n; i++ ) { consolidated[i]=0; labels[i]=0; }
+  if( useGrid ) gridBuild( &grid, meansCur, p, n, radius );
   for( i=0; i<n; i++ ) if( !consolidated[i]) {
-    for( j=0; j<n; j++ ) if( !consolidated[j]) {
+    if( useGrid ) {
+      int k, m=gridQuery( &grid, meansCur+i*p, meansCur, p, radius2, nbrs, nbrs+n );
+      for( k=0; k<m; k++ ) if( !consolidated[nbrs[k]] ) {
+        labels[nbrs[k]]=nLabels; consolidated[nbrs[k]]=1; }
+    } else for( j=0; j<n; j++ ) if( !consolidated[j]) {
       if( dist(meansCur+i*p, meansCur+j*p, p) < radius2) {
         labels[j]=nLabels; consolidated[j]=1;
       }
     }
     nLabels++;
   }
+  if( useGrid ) gridFree( &grid );
   nLabels--; memcpy( means, meansCur, p*n*sizeof(double) );
-  
+
   /* free memory */
-  free(meansNxt); free(meansCur); free(mean); free(consolidated); free(deltas);
+  free(meansNxt); free(meansCur); free(consolidated); free(deltas); free(nbrs);
 }
 
 /* see meanShift.m for usage info */
 void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[] ) {
-  double radius, rate, *data, *labels, *means; int p, n, maxIter; bool blur;
-  
+  double radius, rate, *data, *labels, *means; int p, n, maxIter, nThreads;
+  bool blur=false;
+
   /* Check inputs */
   if(nrhs < 4) mexErrMsgTxt("At least four input arguments required.");
   if(nlhs > 2) mexErrMsgTxt("Too many output arguments.");
-  if(nrhs==5) blur = mxGetScalar(prhs[4])!=0;
-  
+  if(nrhs>=5) blur = mxGetScalar(prhs[4])!=0;
+  nThreads = (nrhs<6) ? 100000 : (int) mxGetScalar(prhs[5]);
+
   /* Get inputs */
   data = mxGetPr(prhs[0]);
   radius = mxGetScalar(prhs[1]);
   rate = mxGetScalar(prhs[2]);
   maxIter = (int) mxGetScalar(prhs[3]);
   p=mxGetM(prhs[0]); n=mxGetN(prhs[0]);
-  
+
   /* Create outputs */
   plhs[0] = mxCreateNumericMatrix(n, 1, mxDOUBLE_CLASS, mxREAL);
   plhs[1] = mxCreateNumericMatrix(p, n, mxDOUBLE_CLASS, mxREAL);
   labels=mxGetPr(plhs[0]); means=mxGetPr(plhs[1]);
-  
+
   /* Do the actual computations in a subroutine */
-  meanShift( data, p, n, radius, rate, maxIter, blur, labels, means );
+  meanShift( data, p, n, radius, rate, maxIter, blur, nThreads, labels, means );
 }
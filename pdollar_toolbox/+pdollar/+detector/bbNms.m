@@ -33,6 +33,13 @@ function bbs = bbNms( bbs, varargin )
 % change the results of nms. Moreover, setting maxn too small will cause an
 % increase in overall performance time.
 %
+% If compiled, the nms is performed by bbNmsMex (see toolboxCompile) which
+% gives the same results as the Matlab code below. It visits candidate pairs
+% in sorted order, skips bbs that are already suppressed and only tests bbs
+% that share a cell of a coarse spatial grid. A cell array of bbs (one per
+% frame) can be given, in which case all frames are processed in a single
+% (multithreaded) call and a cell array of suppressed bbs is returned.
+%
 % Finally, the bbs are optionally resized before performing nms. The
 % resizing is important as some detectors return bbs that are padded. For
 % example, if a detector returns a bounding box of size 128x64 around
@@ -45,6 +52,7 @@ function bbs = bbNms( bbs, varargin )
 %
 % INPUTS
 %  bbs        - original bbs (must be of form [x y w h wt bbType])
+%               or cell array of bbs (one per frame)
 %  varargin   - additional params (struct or name/value pairs)
 %   .type       - ['max'] 'max', 'maxg', 'ms', 'cover', or 'none'
 %   .thr        - [-inf] threshold below which to discard (0 for 'ms')
@@ -56,7 +64,7 @@ function bbs = bbNms( bbs, varargin )
 %   .separate   - [0] run nms separately on each bb type (bbType)
 %
 % OUTPUTS
-%  bbs      - suppressed bbs
+%  bbs      - suppressed bbs (or cell array of bbs)
 %
 % EXAMPLE
 %  bbs=[0 0 1 1 1; .1 .1 1 1 1.1; 2 2 1 1 1];
@@ -79,16 +87,30 @@ if(strcmp(ovrDnm,'union')), ovrDnm=1; elseif(strcmp(ovrDnm,'min')),
   ovrDnm=0; else assert(false); end
 assert(maxn>=2); assert(numel(overlap)==1);
 
-% discard bbs below threshold and run nms1
-if(isempty(bbs)), bbs=zeros(0,5); end; if(strcmp(type,'none')), return; end
-kp=bbs(:,5)>thr; bbs=bbs(kp,:); if(isempty(bbs)), return; end
-if(~isempty(resize)), bbs=bbApply('resize',bbs,resize{:}); end
-pNms1={type,thr,maxn,radii,overlap,0};
-if(~separate || size(bbs,2)<6), bbs=nms1(bbs,pNms1{:}); else
-  ts=unique(bbs(:,6)); m=length(ts); bbs1=cell(1,m);
-  for t=1:m, bbs1{t}=nms1(bbs(bbs(:,6)==ts(t),:),pNms1{:}); end
-  bbs=cat(1,bbs1{:});
+% discard bbs below threshold and split by type (for each frame)
+multiple=iscell(bbs); if(~multiple), bbs={bbs}; end
+nFrm=numel(bbs); gs=cell(1,nFrm); gs(:)={{}}; fs=cell(1,nFrm);
+for f=1:nFrm, b=bbs{f};
+  if(isempty(b)), b=zeros(0,5); end
+  if(strcmp(type,'none')), bbs{f}=b; continue; end
+  kp=b(:,5)>thr; b=b(kp,:); bbs{f}=b; if(isempty(b)), continue; end
+  if(~isempty(resize)), b=bbApply('resize',b,resize{:}); end
+  if(~separate || size(b,2)<6), gs{f}={b}; else
+    ts=unique(b(:,6)); m=length(ts); gs{f}=cell(1,m);
+    for t=1:m, gs{f}{t}=b(b(:,6)==ts(t),:); end
+  end
+  fs{f}=f*ones(1,length(gs{f}));
+end
+
+% run nms1 on every group of bbs (natively on all groups at once if possible)
+gs=[gs{:}]; fs=[fs{:}]; pNms1={type,thr,maxn,radii,overlap,0};
+if(any(strcmp(type,{'max','maxg','cover'})) && exist('bbNmsMex','file')==3 ...
+    && all(cellfun('isclass',gs,'double')))
+  gs=bbNmsMex(type,gs,overlap,ovrDnm,maxn,-1);
+else for g=1:length(gs), gs{g}=nms1(gs{g},pNms1{:}); end
 end
+for f=unique(fs), bbs{f}=cat(1,gs{fs==f}); end
+if(~multiple), bbs=bbs{1}; end
 
   function bbs = nms1( bbs, type, thr, maxn, radii, overlap, isy )
     % if big split in two, recurse, merge, then run on merged
@@ -130,7 +152,8 @@ end
     ps=[bbs(:,1)+w/2 bbs(:,2)+h/2 log2(w) log2(h)];
     % find modes starting from each elt, then merge nodes that are same
     ps1=zeros(n,4); ws1=zeros(n,1); stopThr=1e-2;
-    for i=1:n, [ps1(i,:), ws1(i,:)]=nmsMs1(i); end
+    if(exist('bbNmsMex','file')==3), [ps1,ws1]=bbNmsMex('ms',ps,ws,radii);
+    else for i=1:n, [ps1(i,:), ws1(i,:)]=nmsMs1(i); end; end
     [ps,ws] = nonMaxSuprList(ps1,ws1,stopThr*100,[],[],2);
     % convert back to bbs format and sort by weight
     w=pow2(ps(:,3)); h=pow2(ps(:,4));
@@ -6,18 +6,117 @@
 #include "mex.h"
 #include <vector>
 #include <cmath>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+#if (defined(USEAVX2) || defined(USEAVX512)) && defined(__AVX2__)
+#define USEGATHER
+#include <immintrin.h>
+#endif
 using namespace std;
 
 typedef unsigned int uint32;
 
-inline void getChild( float *chns1, uint32 *cids, uint32 *fids,
-  float *thrs, uint32 offset, uint32 &k0, uint32 &k )
+// packed tree node: channel offset of the feature, threshold, child and leaf
+// value are interleaved so that evaluating a node touches a single 16 bytes
+struct Node { uint32 cid; float thr; uint32 child; float h; };
+
+// detections of one band of columns
+struct Dets { vector<int> rs, cs; vector<float> hs; };
+
+inline void getChild( float *chns1, const Node *tree, uint32 &k )
+{
+  float ftr = chns1[tree[k].cid];
+  k = 2*k + 2 - (ftr<tree[k].thr);
+}
+
+// evaluate the cascade at a single window (starting at tree t0 with score h)
+inline float evalWindow( float *chns1, const Node *nodes, int nTrees,
+  int nTreeNodes, int treeDepth, float cascThr, int t0=0, float h=0 )
 {
-  float ftr = chns1[cids[fids[k]]];
-  k = (ftr<thrs[k]) ? 1 : 2;
-  k0=k+=k0*2; k+=offset;
+  if( treeDepth==1 ) {
+    // specialized case for treeDepth==1
+    for( int t = t0; t < nTrees; t++ ) {
+      const Node *tree=nodes+t*nTreeNodes; uint32 k=0;
+      getChild(chns1,tree,k);
+      h += tree[k].h; if( h<=cascThr ) break;
+    }
+  } else if( treeDepth==2 ) {
+    // specialized case for treeDepth==2
+    for( int t = t0; t < nTrees; t++ ) {
+      const Node *tree=nodes+t*nTreeNodes; uint32 k=0;
+      getChild(chns1,tree,k);
+      getChild(chns1,tree,k);
+      h += tree[k].h; if( h<=cascThr ) break;
+    }
+  } else if( treeDepth>2) {
+    // specialized case for treeDepth>2
+    for( int t = t0; t < nTrees; t++ ) {
+      const Node *tree=nodes+t*nTreeNodes; uint32 k=0;
+      for( int i=0; i<treeDepth; i++ )
+        getChild(chns1,tree,k);
+      h += tree[k].h; if( h<=cascThr ) break;
+    }
+  } else {
+    // general case (variable tree depth)
+    for( int t = t0; t < nTrees; t++ ) {
+      const Node *tree=nodes+t*nTreeNodes; uint32 k=0;
+      while( tree[k].child ) {
+        float ftr = chns1[tree[k].cid];
+        k = tree[k].child - (ftr<tree[k].thr);
+      }
+      h += tree[k].h; if( h<=cascThr ) break;
+    }
+  }
+  return h;
 }
 
+#ifdef USEGATHER
+// evaluate the cascade (fixed treeDepth) at 8 windows of a column at once,
+// the windows start at chns1+offs[i] (compile with -mavx2 -DUSEAVX2 to
+// enable, pays off mostly for shallow trees); the nodes of all 8 windows are
+// fetched with gathers and a window stops accumulating once its score drops
+// below cascThr, so every window sees the same sequence of additions as in
+// evalWindow() and the scores are identical. Once only a couple of windows
+// are left the remaining trees are evaluated by evalWindow() instead.
+inline void evalWindows8( float *chns1, const int *offs, const Node *nodes,
+  int nTrees, int nTreeNodes, int treeDepth, float cascThr, float *hs )
+{
+  const __m256i off=_mm256_loadu_si256((const __m256i*) offs);
+  const __m256i two=_mm256_set1_epi32(2);
+  const __m256 thr=_mm256_set1_ps(cascThr);
+  __m256 h=_mm256_setzero_ps(), alive=_mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  int t, live=0xFF;
+  for( t = 0; t < nTrees; t++ ) {
+    const Node *tree=nodes+t*nTreeNodes;
+    const int *treei=(const int*) tree; const float *treef=(const float*) tree;
+    // root is shared by all windows
+    __m256i cid=_mm256_add_epi32(off,_mm256_set1_epi32(tree[0].cid));
+    __m256 ftr=_mm256_i32gather_ps(chns1,cid,4);
+    __m256i lt=_mm256_castps_si256(_mm256_cmp_ps(ftr,
+      _mm256_set1_ps(tree[0].thr),_CMP_LT_OQ));
+    __m256i k=_mm256_add_epi32(two,lt); // 1 if ftr<thr else 2
+    for( int i=1; i<treeDepth; i++ ) {
+      __m256i k4=_mm256_slli_epi32(k,2);
+      cid=_mm256_add_epi32(off,_mm256_i32gather_epi32(treei,k4,4));
+      ftr=_mm256_i32gather_ps(chns1,cid,4);
+      __m256 thrs=_mm256_i32gather_ps(treef+1,k4,4);
+      lt=_mm256_castps_si256(_mm256_cmp_ps(ftr,thrs,_CMP_LT_OQ));
+      k=_mm256_add_epi32(_mm256_add_epi32(k,k),_mm256_add_epi32(two,lt));
+    }
+    __m256 hk=_mm256_i32gather_ps(treef+3,_mm256_slli_epi32(k,2),4);
+    h=_mm256_blendv_ps(h,_mm256_add_ps(h,hk),alive);
+    alive=_mm256_and_ps(alive,_mm256_cmp_ps(h,thr,_CMP_NLE_UQ));
+    live=_mm256_movemask_ps(alive);
+    if( _mm_popcnt_u32(live)<=2 ) { t++; break; }
+  }
+  _mm256_storeu_ps(hs,h);
+  for( int i=0; i<8; i++ ) if( live>>i & 1 )
+    hs[i]=evalWindow(chns1+offs[i],nodes,nTrees,nTreeNodes,treeDepth,
+      cascThr,t,hs[i]);
+}
+#endif
+
 void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[] )
 {
   // get inputs
@@ -28,6 +127,7 @@ void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[] )
   const int modelWd = (int) mxGetScalar(prhs[4]);
   const int stride = (int) mxGetScalar(prhs[5]);
   const float cascThr = (float) mxGetScalar(prhs[6]);
+  int nThreads = (nrhs<8) ? 100000 : (int) mxGetScalar(prhs[7]);
 
   // extract relevant fields from trees
   float *thrs = (float*) mxGetData(mxGetField(trees,0,"thrs"));
@@ -56,55 +156,55 @@ void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[] )
       for( int r=0; r<modelHt/shrink; r++ )
         cids[m++] = z*width*height + c*height + r;
 
-  // apply classifier to each patch
-  vector<int> rs, cs; vector<float> hs1;
-  for( int c=0; c<width1; c++ ) for( int r=0; r<height1; r++ ) {
-    float h=0, *chns1=chns+(r*stride/shrink) + (c*stride/shrink)*height;
-    if( treeDepth==1 ) {
-      // specialized case for treeDepth==1
-      for( int t = 0; t < nTrees; t++ ) {
-        uint32 offset=t*nTreeNodes, k=offset, k0=0;
-        getChild(chns1,cids,fids,thrs,offset,k0,k);
-        h += hs[k]; if( h<=cascThr ) break;
-      }
-    } else if( treeDepth==2 ) {
-      // specialized case for treeDepth==2
-      for( int t = 0; t < nTrees; t++ ) {
-        uint32 offset=t*nTreeNodes, k=offset, k0=0;
-        getChild(chns1,cids,fids,thrs,offset,k0,k);
-        getChild(chns1,cids,fids,thrs,offset,k0,k);
-        h += hs[k]; if( h<=cascThr ) break;
-      }
-    } else if( treeDepth>2) {
-      // specialized case for treeDepth>2
-      for( int t = 0; t < nTrees; t++ ) {
-        uint32 offset=t*nTreeNodes, k=offset, k0=0;
-        for( int i=0; i<treeDepth; i++ )
-          getChild(chns1,cids,fids,thrs,offset,k0,k);
-        h += hs[k]; if( h<=cascThr ) break;
+  // construct packed trees (cids[fids[k]] is resolved once per node)
+  const int nNodes = nTrees*nTreeNodes;
+  Node *nodes = new Node[nNodes];
+  for( int k=0; k<nNodes; k++ ) {
+    nodes[k].cid = fids[k]<uint32(nFtrs) ? cids[fids[k]] : 0;
+    nodes[k].thr = thrs[k]; nodes[k].child = child[k]; nodes[k].h = hs[k];
+  }
+  delete [] cids;
+
+  // row offsets of the windows within a column of chns
+  int *offs = new int[height1+8];
+  for( int r=0; r<height1+8; r++ ) offs[r] = r*stride/shrink;
+
+  // apply classifier to each patch, columns are split into bands that are
+  // processed in parallel and the detections are merged in band order
+  int nBands = width1<1 ? 0 : min(width1,64);
+  vector<Dets> dets(nBands);
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+  #endif
+  for( int b=0; b<nBands; b++ ) {
+    int c0=b*width1/nBands, c1=(b+1)*width1/nBands; Dets &d=dets[b];
+    for( int c=c0; c<c1; c++ ) {
+      float *chnsc=chns+(c*stride/shrink)*height; int r=0;
+      #ifdef USEGATHER
+      if( treeDepth>0 ) for( ; r+8<=height1; r+=8 ) {
+        float h8[8]; evalWindows8(chnsc,offs+r,nodes,nTrees,nTreeNodes,
+          treeDepth,cascThr,h8);
+        for( int i=0; i<8; i++ ) if(h8[i]>cascThr) {
+          d.cs.push_back(c); d.rs.push_back(r+i); d.hs.push_back(h8[i]); }
       }
-    } else {
-      // general case (variable tree depth)
-      for( int t = 0; t < nTrees; t++ ) {
-        uint32 offset=t*nTreeNodes, k=offset, k0=k;
-        while( child[k] ) {
-          float ftr = chns1[cids[fids[k]]];
-          k = (ftr<thrs[k]) ? 1 : 0;
-          k0 = k = child[k0]-k+offset;
-        }
-        h += hs[k]; if( h<=cascThr ) break;
+      #endif
+      for( ; r<height1; r++ ) {
+        float h=evalWindow(chnsc+offs[r],nodes,nTrees,nTreeNodes,
+          treeDepth,cascThr);
+        if(h>cascThr) { d.cs.push_back(c); d.rs.push_back(r); d.hs.push_back(h); }
       }
     }
-    if(h>cascThr) { cs.push_back(c); rs.push_back(r); hs1.push_back(h); }
   }
-  delete [] cids; m=cs.size();
+  delete [] nodes; delete [] offs;
+  m=0; for( int b=0; b<nBands; b++ ) m+=(int) dets[b].cs.size();
 
   // convert to bbs
   plhs[0] = mxCreateNumericMatrix(m,5,mxDOUBLE_CLASS,mxREAL);
   double *bbs = (double*) mxGetData(plhs[0]);
-  for( int i=0; i<m; i++ ) {
-    bbs[i+0*m]=cs[i]*stride; bbs[i+2*m]=modelWd;
-    bbs[i+1*m]=rs[i]*stride; bbs[i+3*m]=modelHt;
-    bbs[i+4*m]=hs1[i];
+  for( int b=0, i=0; b<nBands; b++ ) for( size_t j=0; j<dets[b].cs.size(); j++, i++ ) {
+    bbs[i+0*m]=dets[b].cs[j]*stride; bbs[i+2*m]=modelWd;
+    bbs[i+1*m]=dets[b].rs[j]*stride; bbs[i+3*m]=modelHt;
+    bbs[i+4*m]=dets[b].hs[j];
   }
 }
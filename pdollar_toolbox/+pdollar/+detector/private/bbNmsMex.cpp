@@ -0,0 +1,338 @@
+/*******************************************************************************
+* Piotr's Computer Vision Matlab Toolbox      Version 3.30
+* Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#include "mex.h"
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+using namespace std;
+
+// set of n bbs with m columns [x y w h wt ...] stored row by row
+struct Bbs {
+  int n, m; vector<double> d;
+  Bbs( int n=0, int m=5 ) : n(n), m(m), d(size_t(n)*m) {}
+  double* row( int i ) { return &d[size_t(i)*m]; }
+};
+
+// nms parameters (see bbNms.m), binSize>0 sets the grid cell size (see
+// Grid), binSize<0 picks it automatically and binSize==0 disables the grid
+struct NmsPrm { int greedy, cover, ovrDnm, maxn; double overlap, binSize;
+  bool grid( int n ) const { return binSize>0 || (binSize<0 && n>=64); } };
+
+// boxes stored per coordinate (xs, xe, ys, ye, area) so they can be tested
+// against a box two at a time, and their index into the sorted bbs
+struct BoxList {
+  vector<double> xs, xe, ys, ye, as; vector<int> ind;
+  void push( const BoxList &B, int i ) {
+    xs.push_back(B.xs[i]); xe.push_back(B.xe[i]); ys.push_back(B.ys[i]);
+    ye.push_back(B.ye[i]); as.push_back(B.as[i]); ind.push_back(B.ind[i]);
+  }
+  void set( int k, const BoxList &B, int i ) {
+    xs[k]=B.xs[i]; xe[k]=B.xe[i]; ys[k]=B.ys[i];
+    ye[k]=B.ye[i]; as[k]=B.as[i]; ind[k]=B.ind[i];
+  }
+  void resize( int n ) {
+    xs.resize(n); xe.resize(n); ys.resize(n);
+    ye.resize(n); as.resize(n); ind.resize(n);
+  }
+  int size() const { return (int) ind.size(); }
+};
+
+BoxList boxList( Bbs &B ) {
+  BoxList L; L.resize(B.n);
+  for( int i=0; i<B.n; i++ ) {
+    double *b=B.row(i); L.xs[i]=b[0]; L.xe[i]=b[0]+b[2];
+    L.ys[i]=b[1]; L.ye[i]=b[1]+b[3]; L.as[i]=b[2]*b[3]; L.ind[i]=i;
+  }
+  return L;
+}
+
+// test box i of A against boxes [j0,j1) of L, sets o[j]=1 if the overlap
+// exceeds the threshold (same arithmetic as bbNms.m, two boxes at a time)
+void overlaps( const BoxList &A, int i, const BoxList &L, int j0, int j1,
+  double overlap, int ovrDnm, char *o )
+{
+  const double xs=A.xs[i], xe=A.xe[i], ys=A.ys[i], ye=A.ye[i], as=A.as[i];
+  const __m128d _xs=_mm_set1_pd(xs), _xe=_mm_set1_pd(xe), _ys=_mm_set1_pd(ys);
+  const __m128d _ye=_mm_set1_pd(ye), _as=_mm_set1_pd(as), z=_mm_setzero_pd();
+  const __m128d thr=_mm_set1_pd(overlap); int j=j0;
+  for( ; j<j1-1; j+=2 ) {
+    __m128d iw=_mm_sub_pd(_mm_min_pd(_xe,_mm_loadu_pd(&L.xe[j])),
+      _mm_max_pd(_xs,_mm_loadu_pd(&L.xs[j])));
+    __m128d ih=_mm_sub_pd(_mm_min_pd(_ye,_mm_loadu_pd(&L.ye[j])),
+      _mm_max_pd(_ys,_mm_loadu_pd(&L.ys[j])));
+    __m128d a=_mm_loadu_pd(&L.as[j]), ov=_mm_mul_pd(iw,ih), u;
+    if(ovrDnm) u=_mm_sub_pd(_mm_add_pd(_as,a),ov); else u=_mm_min_pd(_as,a);
+    __m128d m=_mm_and_pd(_mm_cmpgt_pd(iw,z),_mm_cmpgt_pd(ih,z));
+    m=_mm_and_pd(m,_mm_cmpgt_pd(_mm_div_pd(ov,u),thr));
+    int k=_mm_movemask_pd(m); o[j]=k&1; o[j+1]=(k>>1)&1;
+  }
+  for( ; j<j1; j++ ) {
+    double iw=min(xe,L.xe[j])-max(xs,L.xs[j]); o[j]=0; if(iw<=0) continue;
+    double ih=min(ye,L.ye[j])-max(ys,L.ys[j]); if(ih<=0) continue;
+    double ov=iw*ih, u=ovrDnm ? as+L.as[j]-ov : min(as,L.as[j]);
+    o[j]=ov/u>overlap;
+  }
+}
+
+// uniform grid of cells, each holding the (increasing) indices of the boxes
+// that intersect it; boxes can only overlap if they share a cell
+struct Grid {
+  double x0, y0, cs; int nx, ny; vector< vector<int> > cells;
+  Grid( const BoxList &L, double binSize ) {
+    int n=L.size(); x0=y0=1e300; double x1=-1e300, y1=-1e300;
+    for( int i=0; i<n; i++ ) {
+      x0=min(x0,L.xs[i]); x1=max(x1,L.xe[i]);
+      y0=min(y0,L.ys[i]); y1=max(y1,L.ye[i]);
+    }
+    cs=binSize; if( cs<=0 ) {
+      // automatic cell size: median extent of the boxes
+      vector<double> e(n); for( int i=0; i<n; i++ )
+        e[i]=max(L.xe[i]-L.xs[i],L.ye[i]-L.ys[i]);
+      nth_element(e.begin(),e.begin()+n/2,e.end()); cs=e[n/2];
+    }
+    // keep the number of cells in check (a single cell if degenerate)
+    if( !(cs>0) ) cs=max(x1-x0,y1-y0)+1;
+    while( ((x1-x0)/cs+1)*((y1-y0)/cs+1) > 4.0*n+16 ) cs*=2;
+    nx=cell(x1-x0,1<<30)+1; ny=cell(y1-y0,1<<30)+1;
+    if( !(x1-x0<1e300 && y1-y0<1e300) ) nx=ny=1;
+    cells.resize(size_t(nx)*ny);
+    for( int i=0; i<n; i++ ) {
+      int c0, c1, r0, r1; range(L,i,c0,c1,r0,r1);
+      for( int c=c0; c<=c1; c++ ) for( int r=r0; r<=r1; r++ )
+        cells[size_t(c)*ny+r].push_back(i);
+    }
+  }
+  void range( const BoxList &L, int i, int &c0, int &c1, int &r0, int &r1 ) {
+    c0=cell(L.xs[i]-x0,nx); c1=cell(L.xe[i]-x0,nx);
+    r0=cell(L.ys[i]-y0,ny); r1=cell(L.ye[i]-y0,ny);
+  }
+  int cell( double v, int n ) {
+    double c=floor(v/cs); return !(c>0) ? 0 : (c>=n ? n-1 : (int) c);
+  }
+  // collect boxes j>i (with kp[j]) sharing a cell with box i into C
+  void candidates( const BoxList &L, int i, const char *kp, int *stamp,
+    BoxList &C ) {
+    int c0, c1, r0, r1; range(L,i,c0,c1,r0,r1); C.resize(0);
+    for( int c=c0; c<=c1; c++ ) for( int r=r0; r<=r1; r++ ) {
+      const vector<int> &cl=cells[size_t(c)*ny+r];
+      vector<int>::const_iterator j=upper_bound(cl.begin(),cl.end(),i);
+      for( ; j!=cl.end(); j++ ) if( kp[*j] && stamp[*j]!=i ) {
+        stamp[*j]=i; C.push(L,*j); }
+    }
+  }
+};
+
+// comparison for a stable sort of bbs by decreasing (or increasing) value
+struct Cmp { const double *v; bool dsc; Cmp( const double *v, bool dsc ) :
+  v(v), dsc(dsc) {} bool operator()( int a, int b ) const {
+  return dsc ? v[a]>v[b] : v[a]<v[b]; } };
+Bbs reorder( Bbs &B, const vector<int> &ord, int i0, int i1 ) {
+  Bbs R(i1-i0,B.m);
+  for( int i=i0; i<i1; i++ ) memcpy(R.row(i-i0),B.row(ord[i]),B.m*sizeof(double));
+  return R;
+}
+
+// for each i suppress all j st j>i and area-overlap>overlap (see bbNms.m)
+Bbs nmsMax( Bbs &B0, const NmsPrm &p ) {
+  const int n=B0.n; vector<int> ord(n); vector<double> wt(n);
+  for( int i=0; i<n; i++ ) { ord[i]=i; wt[i]=B0.row(i)[4]; }
+  stable_sort(ord.begin(),ord.end(),Cmp(&wt[0],true));
+  Bbs B=reorder(B0,ord,0,n); BoxList L=boxList(B);
+  vector<char> kp(n,1), o(n+1);
+  if( !p.grid(n) ) {
+    // boxes j>i that are still kept are compacted into A, so the work per
+    // box shrinks as boxes get suppressed (A[q..] holds the boxes j>i)
+    BoxList A=L; int q=0;
+    for( int i=0; i<n; i++ ) {
+      while( q<A.size() && A.ind[q]<=i ) q++;
+      if( p.greedy && !kp[i] ) continue;
+      int na=A.size(); overlaps(L,i,A,q,na,p.overlap,p.ovrDnm,&o[0]);
+      int k=q; for( int j=q; j<na; j++ ) {
+        if( o[j] ) kp[A.ind[j]]=0; else A.set(k++,A,j); }
+      A.resize(k);
+    }
+  } else {
+    // only test boxes that share a grid cell with box i
+    Grid G(L,p.binSize); vector<int> stamp(n,-1); BoxList C;
+    for( int i=0; i<n; i++ ) {
+      if( p.greedy && !kp[i] ) continue;
+      G.candidates(L,i,&kp[0],&stamp[0],C); int nc=C.size();
+      overlaps(L,i,C,0,nc,p.overlap,p.ovrDnm,&o[0]);
+      for( int j=0; j<nc; j++ ) if( o[j] ) kp[C.ind[j]]=0;
+    }
+  }
+  int m=0; for( int i=0; i<n; i++ ) if(kp[i]) ord[m++]=i;
+  return reorder(B,ord,0,m);
+}
+
+// greedy weighted set cover of the bbs (see bbNms.m)
+Bbs nmsCover( Bbs &B, const NmsPrm &p ) {
+  const int n=B.n; BoxList L=boxList(B); vector< vector<int> > N(n);
+  vector<char> o(n+1), all(n,1);
+  // neighbors of each bb (including itself), in increasing order
+  for( int i=0; i<n; i++ ) N[i].push_back(i);
+  if( !p.grid(n) ) for( int i=0; i<n; i++ ) {
+    overlaps(L,i,L,i+1,n,p.overlap,p.ovrDnm,&o[0]);
+    for( int j=i+1; j<n; j++ ) if(o[j]) { N[i].push_back(j); N[j].push_back(i); }
+  } else {
+    Grid G(L,p.binSize); vector<int> stamp(n,-1); BoxList C;
+    for( int i=0; i<n; i++ ) {
+      G.candidates(L,i,&all[0],&stamp[0],C); int nc=C.size();
+      overlaps(L,i,C,0,nc,p.overlap,p.ovrDnm,&o[0]);
+      for( int j=0; j<nc; j++ ) if(o[j]) {
+        N[i].push_back(C.ind[j]); N[C.ind[j]].push_back(i); }
+    }
+  }
+  for( int i=0; i<n; i++ ) sort(N[i].begin(),N[i].end());
+  // score of a bb is the sum of the weights of its remaining neighbors
+  vector<char> kp(n,1); vector<double> s(n); vector<int> N0, st(n,-1);
+  for( int i=0; i<n; i++ ) { s[i]=0; for( size_t k=0; k<N[i].size(); k++ )
+    s[i]+=B.row(N[i][k])[4]; }
+  Bbs R(n,5); int n1=n, c=0;
+  while( n1>0 ) {
+    int i0=-1; for( int i=0; i<n; i++ ) if(kp[i] && (i0<0 || s[i]>s[i0])) i0=i;
+    N0.clear(); double w=0; for( size_t k=0; k<N[i0].size(); k++ ) {
+      int j=N[i0][k]; if(kp[j]) { N0.push_back(j); w+=B.row(j)[4]; } }
+    n1-=(int) N0.size(); for( size_t k=0; k<N0.size(); k++ ) kp[N0[k]]=0;
+    memcpy(R.row(c),B.row(i0),4*sizeof(double)); R.row(c)[4]=w; c++;
+    // recompute the scores of bbs that lost a neighbor
+    for( size_t k=0; k<N0.size(); k++ ) for( size_t l=0; l<N[N0[k]].size(); l++ ) {
+      int i=N[N0[k]][l]; if( !kp[i] || st[i]==c ) continue; st[i]=c; s[i]=0;
+      for( size_t k1=0; k1<N[i].size(); k1++ ) if(kp[N[i][k1]])
+        s[i]+=B.row(N[i][k1])[4];
+    }
+  }
+  R.n=c; R.d.resize(size_t(c)*5); return R;
+}
+
+// if big split in two, recurse, merge, then run nms on merged (see bbNms.m)
+Bbs nms1( Bbs &B, const NmsPrm &p, int isy ) {
+  if( B.n>p.maxn ) {
+    const int n=B.n, n2=n/2; vector<int> ord(n); vector<double> c(n);
+    for( int i=0; i<n; i++ ) { ord[i]=i; c[i]=B.row(i)[isy]+B.row(i)[2+isy]/2; }
+    stable_sort(ord.begin(),ord.end(),Cmp(&c[0],false));
+    Bbs B0=reorder(B,ord,0,n2), B1=reorder(B,ord,n2,n);
+    B0=nms1(B0,p,!isy); B1=nms1(B1,p,!isy);
+    Bbs M(B0.n+B1.n,B0.m); copy(B0.d.begin(),B0.d.end(),M.d.begin());
+    copy(B1.d.begin(),B1.d.end(),M.d.begin()+B0.d.size()); B=M;
+  }
+  return p.cover ? nmsCover(B,p) : nmsMax(B,p);
+}
+
+// find the mode (and its weight) reached by mean shift from ps(ind,:) with
+// a variable bandwidth kernel (see bbNms>nmsMs), ps is n x 4 (column major)
+void nmsMs1( const double *ps, const double *ws, const double *hInv, int n,
+  int ind, double *p1, double *w1, double *wMask )
+{
+  const int m=4; const double stopThr=1e-2; double p[4], diff;
+  for( int k=0; k<m; k++ ) p[k]=ps[ind+k*n];
+  while( 1 ) {
+    // compute (weighted) squared Euclidean distance to each neighbor
+    double sw=0; for( int j=0; j<n; j++ ) {
+      double d=0; for( int k=0; k<m; k++ ) {
+        double e=(ps[j+k*n]-p[k])*hInv[j+k*n]; d+=e*e; }
+      wMask[j]=ws[j]*exp(-d); sw+=wMask[j];
+    }
+    // compute new mode
+    for( int k=0; k<m; k++ ) p1[k]=0;
+    for( int j=0; j<n; j++ ) { wMask[j]/=sw;
+      for( int k=0; k<m; k++ ) p1[k]+=wMask[j]*ps[j+k*n]; }
+    // stopping criteria
+    diff=0; for( int k=0; k<m; k++ ) { diff+=fabs(p1[k]-p[k]); p[k]=p1[k]; }
+    if( diff/m<stopThr ) break;
+  }
+  *w1=0; for( int j=0; j<n; j++ ) *w1+=ws[j]*wMask[j];
+}
+
+// convert bbs (n x m double matrix) to and from row major storage
+Bbs getBbs( const mxArray *M ) {
+  if( !mxIsDouble(M) || mxIsComplex(M) || mxGetNumberOfDimensions(M)!=2 ||
+    (mxGetNumberOfElements(M)>0 && mxGetN(M)<5) )
+    mexErrMsgTxt("bbs must be a real nxm double matrix with m>=5.");
+  int n=(int) mxGetM(M), m=(int) mxGetN(M); if(n==0) m=max(m,5);
+  Bbs B(n,m); double *b=mxGetPr(M);
+  for( int i=0; i<n; i++ ) for( int j=0; j<m; j++ ) B.row(i)[j]=b[i+j*n];
+  return B;
+}
+
+mxArray* setBbs( Bbs &B ) {
+  mxArray *M=mxCreateDoubleMatrix(B.n,B.m,mxREAL); double *b=mxGetPr(M);
+  for( int i=0; i<B.n; i++ ) for( int j=0; j<B.m; j++ ) b[i+j*B.n]=B.row(i)[j];
+  return M;
+}
+
+// bbs = bbNmsMex(type,bbs,overlap,ovrDnm,maxn,binSize,[nThreads])
+// [ps1,ws1] = bbNmsMex('ms',ps,ws,radii,[nThreads])
+void mexFunction( int nl, mxArray *pl[], int nr, const mxArray *pr[] )
+{
+  char type[8]; int nThreads;
+  if( nr<1 || mxGetString(pr[0],type,8) ) mexErrMsgTxt("Invalid type.");
+
+  if( !strcmp(type,"ms") ) {
+    // mean shift from every bb (see bbNms>nmsMs) in parallel
+    if( nr<4 || nr>5 ) mexErrMsgTxt("Incorrect number of inputs.");
+    if( nl>2 ) mexErrMsgTxt("Two outputs expected.");
+    const int n=(int) mxGetM(pr[1]);
+    if( !mxIsDouble(pr[1]) || mxGetN(pr[1])!=4 || !mxIsDouble(pr[2]) ||
+      (int) mxGetNumberOfElements(pr[2])!=n || !mxIsDouble(pr[3]) ||
+      mxGetNumberOfElements(pr[3])!=4 ) mexErrMsgTxt("Invalid inputs.");
+    const double *ps=mxGetPr(pr[1]), *ws=mxGetPr(pr[2]), *radii=mxGetPr(pr[3]);
+    nThreads = (nr<5) ? 100000 : (int) mxGetScalar(pr[4]);
+    pl[0]=mxCreateDoubleMatrix(n,4,mxREAL); double *ps1=mxGetPr(pl[0]);
+    pl[1]=mxCreateDoubleMatrix(n,1,mxREAL); double *ws1=mxGetPr(pl[1]);
+    vector<double> hInv(size_t(n)*4);
+    for( int j=0; j<n; j++ ) {
+      hInv[j]=1/(pow(2.0,ps[j+2*n])*radii[0]);
+      hInv[j+n]=1/(pow(2.0,ps[j+3*n])*radii[1]);
+      hInv[j+2*n]=1/radii[2]; hInv[j+3*n]=1/radii[3];
+    }
+    #ifdef USEOMP
+    nThreads = min(nThreads,omp_get_max_threads());
+    #pragma omp parallel num_threads(nThreads)
+    #endif
+    {
+      vector<double> wMask(n+1);
+      #ifdef USEOMP
+      #pragma omp for schedule(dynamic)
+      #endif
+      for( int i=0; i<n; i++ ) {
+        double p1[4]; nmsMs1(ps,ws,&hInv[0],n,i,p1,ws1+i,&wMask[0]);
+        for( int k=0; k<4; k++ ) ps1[i+k*n]=p1[k];
+      }
+    }
+    return;
+  }
+
+  // max, maxg or cover nms of bbs (or of a cell array of bbs, one per frame)
+  NmsPrm p; p.greedy=!strcmp(type,"maxg"); p.cover=!strcmp(type,"cover");
+  if( !p.greedy && !p.cover && strcmp(type,"max") )
+    mexErrMsgTxt("Unknown type.");
+  if( nr<6 || nr>7 ) mexErrMsgTxt("Incorrect number of inputs.");
+  if( nl>1 ) mexErrMsgTxt("One output expected.");
+  p.overlap=mxGetScalar(pr[2]); p.ovrDnm=(int) mxGetScalar(pr[3]);
+  double maxn=mxGetScalar(pr[4]); p.maxn=maxn>1e9 ? 1000000000 : (int) maxn;
+  p.binSize=mxGetScalar(pr[5]); if( p.maxn<2 ) mexErrMsgTxt("maxn must be >=2.");
+  nThreads = (nr<7) ? 100000 : (int) mxGetScalar(pr[6]);
+  const bool multiple=mxIsCell(pr[1]);
+  const int nFrm=multiple ? (int) mxGetNumberOfElements(pr[1]) : 1;
+  vector<Bbs> bbs(nFrm);
+  for( int f=0; f<nFrm; f++ )
+    bbs[f]=getBbs(multiple ? mxGetCell(pr[1],f) : pr[1]);
+  #ifdef USEOMP
+  nThreads = min(nThreads,omp_get_max_threads());
+  #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+  #endif
+  for( int f=0; f<nFrm; f++ ) if( bbs[f].n>0 ) bbs[f]=nms1(bbs[f],p,0);
+  if( !multiple ) { pl[0]=setBbs(bbs[0]); return; }
+  pl[0]=mxCreateCellArray(mxGetNumberOfDimensions(pr[1]),
+    mxGetDimensions(pr[1]));
+  for( int f=0; f<nFrm; f++ ) mxSetCell(pl[0],f,setBbs(bbs[f]));
+}
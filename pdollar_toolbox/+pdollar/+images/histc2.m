@@ -29,6 +29,11 @@ function h = histc2( A, edges, wtMask )
 % which should have the same number of elements as A. If not specified, the
 % default is wtMask=ones(n,1).
 %
+% The histogram is computed by histc2c (a mex file shared with the kernel
+% tracker). For uniformly spaced edges the bin of each value is computed
+% directly (otherwise a binary search is used), and large inputs are split
+% among multiple threads if OpenMP is enabled (see toolboxCompile).
+%
 % USAGE
 %  h = histc2( A, edges, [wtMask] )
 %
@@ -51,6 +56,9 @@ function h = histc2( A, edges, wtMask )
 %  h=histc2( [A A], 25 );    figure(1); im(h);  % decreasing along diag
 %  h=histc2( [A A], 25, A ); figure(2); im(h);  % constant along diag
 %
+% EXAMPLE - timing on 10^8 values
+%  A=rand(1e8,1); tic, h=histc2(A,0:1/256:1); toc
+%
 % See also HISTC, ASSIGNTOBINS, BAR
 %
 % Piotr's Computer Vision Matlab Toolbox      Version 2.0
@@ -71,14 +79,8 @@ if( nd==1 )
   end
 
   % create 1d histogram
-  if(isempty(wtMask))
-    h = histc( A, edges );
-    h(end-1) = h(end-1)+h(end);
-    h = h(1:end-1); h = h / sum(h);
-  else
-    h = histc2c( A, wtMask, edges );
-    h = h / sum(h);
-  end
+  h = histc2c( A, wtMask, edges(:)' );
+  h = h / sum(h);
 
 else
   % if nBins given instead of edges calculate edges per dimension
@@ -94,7 +96,6 @@ else
   end
 
   % create multidimensional histogram
-  if( isempty(wtMask) ); wtMask=ones(1,n); end;
   h = histc2c( A, wtMask, edges{:} );
   h = h / sum(h(:));
 end
@@ -11,11 +11,16 @@ function J = imtransform2( I, H, varargin )
 % transformed image and is the same size as I. The 'loose' flag is
 % currently inexact (because of some padding/cropping). Preserves I's type.
 %
+% I may be an MxNxK stack (channels or the frames of a video). The sampling
+% table (source location and interpolation weights of every target pixel)
+% is computed just once and applied to all K frames in a single (threaded)
+% call, rather than being recomputed when transforming frames one at a time.
+%
 % USAGE
 %  J = imtransform2( I, H, varargin )
 %
 % INPUTS - common
-%  I          - input image [converted to double]
+%  I          - MxNxK input image or stack [converted to double]
 %  H          - 3x3 nonsingular homography matrix
 %  varargin   - additional params (struct or name/value pairs)
 %    .method    - ['linear'] 'nearest', 'spline', 'cubic' (for interp2)
@@ -94,7 +94,7 @@ for s=1:nScl, S=[scls(s,1) 0; 0 scls(s,2)];
 end
 % apply each transformation HS(:,:,i) to image I
 if(nOps>maxn), HS=HS(:,:,randSample(nOps,maxn)); nOps=maxn; end
-siz=size(I); nd=ndims(I); nCh=size(I,3);
+siz=size(I); nd=ndims(I);
 I1=I; p=(siz-jsiz)/2; IJ=zeros([jsiz nOps],class(I));
 for i=1:nOps, H=HS(:,:,i); d=H(1:2,3)';
   if( all(all(H(1:2,1:2)==eye(2))) && all(mod(d,1)==0) )
@@ -102,7 +102,7 @@ for i=1:nOps, H=HS(:,:,i); d=H(1:2,3)';
     s=max(1-d,1); e=min(siz(1:2)-d,siz(1:2)); s1=2-min(1-d,1); e1=e-s+s1;
     I1(s1(1):e1(1),s1(2):e1(2),:) = I(s(1):e(1),s(2):e(2),:);
   else % handle general transformations
-    for j=1:nCh, I1(:,:,j)=imtransform2(I(:,:,j),H,'method',method); end
+    I1=imtransform2(I,H,'method',method);
   end
   % crop and store result
   I2 = I1(p(1)+1:end-p(1),p(2)+1:end-p(2),:);
@@ -0,0 +1,181 @@
+/*******************************************************************************
+* Piotr's Computer Vision Matlab Toolbox      Version 2.2
+* Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef _HISTCND_H_
+#define _HISTCND_H_
+#include <stdlib.h>
+#include <math.h>
+#include "mex.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
+
+/*******************************************************************************
+* Weighted multidimensional histogram engine (used by histc2c, ktHistcRgb_c
+* and ktComputeW_c). Samples are either rows of a double array A [n x nd],
+* where dimension j is quantized by the edges of a HistDim, or rows of an
+* uint8 array B [n x 3] holding rgb values already quantized to [0,2^nBits).
+* Samples are processed in chunks: first the flat bin index of every sample
+* in the chunk is computed (one dimension at a time), then the indices are
+* used to accumulate weights or to look up values. When run in parallel
+* every thread accumulates a contiguous range of samples into a private
+* histogram and the histograms are summed in thread order afterwards.
+*******************************************************************************/
+#define HIST_CHUNK 2048
+
+/*******************************************************************************
+* Quantization along one dimension given the (nBins+1) element vector edges.
+* x falls into bin k if edges[k] <= x < edges[k+1], or if x==edges[nBins] in
+* which case k=nBins-1. Values outside of the edges are assigned k=nBins and
+* should be ignored. For (nearly) uniformly spaced edges the bin is guessed
+* directly and then corrected against the edges, otherwise a binary search
+* is used (adapted from \MATLAB6p5\toolbox\matlab\datafun\histc.c). Both
+* give identical results for any non-decreasing edges.
+*******************************************************************************/
+typedef struct {
+  const double *edges; int nBins, uniform; double scale;
+} HistDim;
+
+void histDimInit( HistDim *d, const double *edges, int nBins ) {
+  int k; double e0=edges[0], e1=edges[nBins], step=(e1-e0)/nBins;
+  d->edges=edges; d->nBins=nBins;
+  d->uniform = nBins>1 && step>0 && !mxIsInf(step);
+  for( k=1; k<=nBins && d->uniform; k++ )
+    if( !(edges[k]>edges[k-1]) || fabs(edges[k]-(e0+k*step))>step*1e-3 )
+      d->uniform=0;
+  d->scale = d->uniform ? nBins/(e1-e0) : 0;
+}
+
+int histDimBin( const HistDim *d, double x ) {
+  const double *e=d->edges; int nBins=d->nBins, k=nBins, k0=0, k1=nBins;
+  if( x >= e[0] && x < e[nBins] ) {
+    if( d->uniform ) {
+      k=(int) ((x-e[0])*d->scale); if(k<0) k=0; if(k>nBins-1) k=nBins-1;
+      while( x<e[k] ) k--;
+      while( k<nBins-1 && x>=e[k+1] ) k++;
+      return k;
+    }
+    k = (k0+k1)/2;
+    while( k0 < k1-1 ) {
+      if(x >= e[k]) k0 = k; else k1 = k;
+      k = (k0+k1)/2;
+    }
+    k = k0;
+  }
+  /* check for special case */
+  if(x == e[nBins]) k = nBins-1;
+  return k;
+}
+
+/*******************************************************************************
+* Source of samples, use histSrcNd or histSrcRgb to initialize. For A the
+* flat index of bin (k1,...,knd) is sum_j kj*mul[j] (column major order).
+*******************************************************************************/
+typedef struct {
+  size_t n; int nd, nBits, *mul; const double *A; const HistDim *dims;
+  const unsigned char *B;
+} HistSrc;
+
+/* samples are the rows of A [n x nd] (mul is an array with nd elements) */
+size_t histSrcNd( HistSrc *s, const double *A, size_t n, int nd,
+  const HistDim *dims, int *mul )
+{
+  int j; size_t nBins=1;
+  for( j=0; j<nd; j++ ) { mul[j]=(int) nBins; nBins*=dims[j].nBins; }
+  s->n=n; s->nd=nd; s->nBits=0; s->mul=mul; s->A=A; s->dims=dims; s->B=0;
+  return nBins;
+}
+
+/* samples are the rows of B [n x 3] with values in [0,2^nBits) */
+size_t histSrcRgb( HistSrc *s, const unsigned char *B, size_t n, int nBits ) {
+  s->n=n; s->nd=3; s->nBits=nBits; s->mul=0; s->A=0; s->dims=0; s->B=B;
+  return (size_t) 1<<(3*nBits);
+}
+
+/* flat bin index of samples [i0,i1) (or -1 if out of range) */
+void histInds( const HistSrc *s, size_t i0, size_t i1, int *inds ) {
+  size_t i, n=s->n; int j, m=(int) (i1-i0);
+  if( s->B ) {
+    const unsigned char *B=s->B+i0; int b=s->nBits, b2=b+b, msk=-(1<<b);
+    for( j=0; j<m; j++ ) {
+      int r=B[j], g=B[j+n], v=B[j+n+n];
+      inds[j] = ((r|g|v)&msk) ? -1 : r + (g<<b) + (v<<b2);
+    }
+    return;
+  }
+  for( j=0; j<m; j++ ) inds[j]=0;
+  for( j=0; j<s->nd; j++ ) {
+    const HistDim *d=s->dims+j; const double *A=s->A+n*j+i0;
+    int k, nBins=d->nBins, mul=s->mul[j];
+    for( i=0; i<(size_t) m; i++ ) if( inds[i]>=0 ) {
+      k=histDimBin(d,A[i]); inds[i] = (k==nBins) ? -1 : inds[i]+k*mul;
+    }
+  }
+}
+
+/* number of threads to use for n samples (and histograms with nBins bins) */
+int histThreads( size_t n, size_t nBins, int nThreads ) {
+  size_t m=n/4/(nBins>HIST_CHUNK ? nBins : HIST_CHUNK);
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #else
+  nThreads=1;
+  #endif
+  if( m<(size_t) nThreads ) nThreads=(int) m;
+  return nThreads<1 ? 1 : nThreads;
+}
+
+/* accumulate (weighted) samples [i0,i1) into h (wts may be NULL) */
+void histAccum( double *h, const HistSrc *s, const double *wts, size_t i0,
+  size_t i1 )
+{
+  int inds[HIST_CHUNK], j, m; size_t i;
+  for( i=i0; i<i1; i+=HIST_CHUNK ) {
+    m=(int) ((i1-i<HIST_CHUNK) ? i1-i : HIST_CHUNK); histInds(s,i,i+m,inds);
+    if( wts ) { for( j=0; j<m; j++ ) if(inds[j]>=0) h[inds[j]]+=wts[i+j]; }
+    else { for( j=0; j<m; j++ ) if(inds[j]>=0) h[inds[j]]+=1; }
+  }
+}
+
+/* histogram h (nBins elements, must be zero) of the samples in s */
+void histcNd( double *h, size_t nBins, const HistSrc *s, const double *wts,
+  int nThreads )
+{
+  int t, T=histThreads(s->n,nBins,nThreads), b; double **hs;
+  if( T==1 ) { histAccum(h,s,wts,0,s->n); return; }
+  /* mxCalloc'ed so that MATLAB reclaims them if it runs out of memory */
+  hs=(double**) mxMalloc(T*sizeof(double*)); hs[0]=h;
+  for( t=1; t<T; t++ ) hs[t]=(double*) mxCalloc(nBins,sizeof(double));
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(T) schedule(static,1)
+  #endif
+  for( t=0; t<T; t++ )
+    histAccum(hs[t],s,wts,s->n*t/T,s->n*(t+1)/T);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(T) private(t)
+  #endif
+  for( b=0; b<(int) nBins; b++ ) for( t=1; t<T; t++ ) h[b]+=hs[t][b];
+  for( t=1; t<T; t++ ) mxFree(hs[t]);
+  mxFree(hs);
+}
+
+/* look up w[i]=vals[k] for each sample with bin k (or w[i]=0 if none) */
+void histLookup( double *w, const double *vals, const HistSrc *s,
+  int nThreads )
+{
+  int c, nChunks=(int) ((s->n+HIST_CHUNK-1)/HIST_CHUNK);
+  nThreads=histThreads(s->n,0,nThreads);
+  #ifdef USEOMP
+  #pragma omp parallel for num_threads(nThreads)
+  #endif
+  for( c=0; c<nChunks; c++ ) {
+    int inds[HIST_CHUNK], j; size_t i=(size_t) c*HIST_CHUNK;
+    int m=(int) ((s->n-i<HIST_CHUNK) ? s->n-i : HIST_CHUNK);
+    histInds(s,i,i+m,inds);
+    for( j=0; j<m; j++ ) w[i+j] = (inds[j]>=0) ? vals[inds[j]] : 0;
+  }
+}
+
+#endif
@@ -4,7 +4,11 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include "mex.h"
+#include <stdlib.h>
 #include <string.h>
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
 /*******************************************************************************
 %% initialize test data
@@ -23,8 +27,38 @@ for i=1:rep, if(i==1), tic; end
   J2 = imtransform2_c('applyTransform',I,rs2,cs2,is2,flag);
 end; toc
 [mean2(abs(is1-is2)) mean2(abs(J1-J2))]
+%% method: apply a single transform to a stack of frames (tables reused)
+I3=I(:,:,ones(1,20)); tic
+J3 = imtransform2_c('applyTransform',I3,rs2,cs2,is2,flag); toc
 *******************************************************************************/
 
+/* clamp k source coordinates rs/cs (1-indexed) into an mxn image and compute
+ * the ids (and bilinear weights) according to flag, in place */
+void clampInds( double *rs, double *cs, int *is, int k, int m, int n,
+  int flag )
+{
+  int i, fr, fc; double r, c;
+  if( flag==1 ) { /* nearest neighbor */
+    for(i=0; i<k; i++) {
+      r = rs[i]<1 ? 1 : (rs[i]>m ? m : rs[i]);
+      c = cs[i]<1 ? 1 : (cs[i]>n ? n : cs[i]);
+      is[i] = ((int) (r-.5)) + ((int) (c-.5)) * m;
+    }
+  } else if(flag==2) { /* bilinear */
+    for(i=0; i<k; i++) {
+      r = rs[i]<2 ? 2 : (rs[i]>m-1 ? m-1 : rs[i]);
+      c = cs[i]<2 ? 2 : (cs[i]>n-1 ? n-1 : cs[i]);
+      fr = (int) r; fc = (int) c;
+      rs[i]=r-fr; cs[i]=c-fc; is[i]=(fr-1)+(fc-1)*m;
+    }
+  } else { /* other cases - clamp only */
+    for(i=0; i<k; i++) {
+      rs[i] = rs[i]<2 ? 2 : (rs[i]>m-1 ? m-1 : rs[i]);
+      cs[i] = cs[i]<2 ? 2 : (cs[i]>n-1 ? n-1 : cs[i]);
+    }
+  }
+}
+
 void homogToFlow(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   /* [us,vs]=homogToFlow(H,m,n,[r0],[r1],[c0],[c1]); */
   int ind=0, i, j, m, n, m1, n1; double *H, *us, *vs;
@@ -129,9 +163,9 @@ void homogsToFlow(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 }
 
 void flowToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  /* [rs,cs,is]=flowToInds(us,vs,m,n,flag); */
-  int m, n, m1, n1, flag; double *us, *vs;
-  int *is, ind=0, i, j, fr, fc; double *rs, *cs, r, c;
+  /* [rs,cs,is]=flowToInds(us,vs,m,n,flag,[nThreads]); */
+  int m, n, m1, n1, flag, nThreads, i; double *us, *vs;
+  int *is; double *rs, *cs;
 
   /* extract inputs */
   us = (double*) mxGetData(prhs[0]);
@@ -139,6 +173,7 @@ void flowToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   m  = (int) mxGetScalar(prhs[2]);
   n  = (int) mxGetScalar(prhs[3]);
   flag = (int) mxGetScalar(prhs[4]);
+  nThreads = (nrhs<6) ? 100000 : (int) mxGetScalar(prhs[5]);
 
   /* initialize memory */
   m1=(int)mxGetM(prhs[0]); n1=(int)mxGetN(prhs[0]);
@@ -146,24 +181,15 @@ void flowToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   cs  = mxMalloc(sizeof(double)*m1*n1);
   is  = mxMalloc(sizeof(int)*m1*n1);
 
-  /* clamp and compute ids according to flag */
-  if( flag==1 ) { /* nearest neighbor */
-    for(i=0; i<n1; i++) for(j=0; j<m1; j++) {
-      r=us[ind]+j+1; r = r<1 ? 1 : (r>m ? m : r);
-      c=vs[ind]+i+1; c = c<1 ? 1 : (c>n ? n : c);
-      is[ind] = ((int) (r-.5)) + ((int) (c-.5)) * m; ind++;
-    }
-  } else if(flag==2) { /* bilinear */
-    for(i=0; i<n1; i++) for(j=0; j<m1; j++) {
-      r=us[ind]+j+1; r = r<2 ? 2 : (r>m-1 ? m-1 : r); fr = (int) r;
-      c=vs[ind]+i+1; c = c<2 ? 2 : (c>n-1 ? n-1 : c); fc = (int) c;
-      rs[ind]=r-fr; cs[ind]=c-fc; is[ind]=(fr-1)+(fc-1)*m; ind++;
-    }
-  } else { /* other cases - clamp only */
-    for(i=0; i<n1; i++) for(j=0; j<m1; j++) {
-      r=us[ind]+j+1; rs[ind] = r<2 ? 2 : (r>m-1 ? m-1 : r);
-      c=vs[ind]+i+1; cs[ind] = c<2 ? 2 : (c>n-1 ? n-1 : c); ind++;
-    }
+  /* clamp and compute ids according to flag (in parallel over columns) */
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #pragma omp parallel for num_threads(nThreads)
+  #endif
+  for( i=0; i<n1; i++ ) {
+    int j, ind=i*m1;
+    for(j=0; j<m1; j++) { rs[ind+j]=us[ind+j]+j+1; cs[ind+j]=vs[ind+j]+i+1; }
+    clampInds(rs+ind,cs+ind,is+ind,m1,m,n,flag);
   }
 
   /* create output array */
@@ -176,9 +202,9 @@ void flowToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 }
 
 void homogToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  /* [rs,cs,is]=homogToInds(H,m,n,r0,r1,c0,c1,flag); */
-  int m, n, flag; double *H, r0, r1, c0, c1;
-  int *is, m1, n1, ind=0, i, j, fr, fc; double *rs, *cs, r, c, m2, n2, z;
+  /* [rs,cs,is]=homogToInds(H,m,n,r0,r1,c0,c1,flag,[nThreads]); */
+  int m, n, flag, nThreads, affine; double *H, r0, r1, c0, c1;
+  int *is, m1, n1, i; double *rs, *cs, m2, n2;
 
   /* extract inputs */
   H  = (double*) mxGetData(prhs[0]);
@@ -189,6 +215,7 @@ void homogToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   c0 = mxGetScalar(prhs[5]);
   c1 = mxGetScalar(prhs[6]);
   flag = (int) mxGetScalar(prhs[7]);
+  nThreads = (nrhs<9) ? 100000 : (int) mxGetScalar(prhs[8]);
 
   /* initialize memory */
   m1  = (int) (r1-r0+1); m2 = (m+1.0)/2.0;
@@ -197,47 +224,32 @@ void homogToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   cs  = mxMalloc(sizeof(double)*m1*n1);
   is  = mxMalloc(sizeof(int)*m1*n1);
 
-  /* Compute rs an cs */
-  if( H[2]==0 && H[5]==0 ) {
-    for( i=0; i<n1; i++ ) {
+  /* Compute rs an cs, then clamp and compute ids according to flag (in
+   * parallel over columns, each column is computed independently) */
+  affine = H[2]==0 && H[5]==0;
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #pragma omp parallel for num_threads(nThreads)
+  #endif
+  for( i=0; i<n1; i++ ) {
+    int j, ind=i*m1; double r, c, z;
+    if( affine ) {
       r = H[0]*r0 + H[3]*(c0+i) + H[6] + m2;
       c = H[1]*r0 + H[4]*(c0+i) + H[7] + n2;
       for(j=0; j<m1; j++) {
-        rs[ind]=r; cs[ind]=c;
-        r+=H[0]; c+=H[1]; ind++;
+        rs[ind+j]=r; cs[ind+j]=c;
+        r+=H[0]; c+=H[1];
       }
-    }
-  } else {
-    for( i=0; i<n1; i++ ) {
+    } else {
       r = H[0]*r0 + H[3]*(c0+i) + H[6];
       c = H[1]*r0 + H[4]*(c0+i) + H[7];
       z = H[2]*r0 + H[5]*(c0+i) + 1;
       for(j=0; j<m1; j++) {
-        rs[ind]=r/z+m2; cs[ind]=c/z+n2;
-        r+=H[0]; c+=H[1]; z+=H[2]; ind++;
+        rs[ind+j]=r/z+m2; cs[ind+j]=c/z+n2;
+        r+=H[0]; c+=H[1]; z+=H[2];
       }
     }
-  }
-
-  /* clamp and compute ids according to flag */
-  if( flag==1 ) { /* nearest neighbor */
-    for(i=0; i<n1*m1; i++) {
-      r = rs[i]<1 ? 1 : (rs[i]>m ? m : rs[i]);
-      c = cs[i]<1 ? 1 : (cs[i]>n ? n : cs[i]);
-      is[i] = ((int) (r-.5)) + ((int) (c-.5)) * m;
-    }
-  } else if(flag==2) { /* bilinear */
-    for(i=0; i<n1*m1; i++) {
-      r = rs[i]<2 ? 2 : (rs[i]>m-1 ? m-1 : rs[i]);
-      c = cs[i]<2 ? 2 : (cs[i]>n-1 ? n-1 : cs[i]);
-      fr = (int) r; fc = (int) c;
-      rs[i]=r-fr; cs[i]=c-fc; is[i]=(fr-1)+(fc-1)*m;
-    }
-  } else { /* other cases - clamp only */
-    for(i=0; i<n1*m1; i++) {
-      rs[i] = rs[i]<2 ? 2 : (rs[i]>m-1 ? m-1 : rs[i]);
-      cs[i] = cs[i]<2 ? 2 : (cs[i]>n-1 ? n-1 : cs[i]);
-    }
+    clampInds(rs+ind,cs+ind,is+ind,m1,m,n,flag);
   }
 
   /* create output array */
@@ -250,9 +262,10 @@ void homogToInds(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 }
 
 void applyTransform(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  /* J=applyTransform(I,rs,cs,is,flag); */
-  int flag, *nsI, nsJ[3], areaJ, areaI, nDims, i, k, id, *is;
-  double *I, *J, *I1, *J1, *rs, *cs, wr, wc, wrc, r, c;
+  /* J=applyTransform(I,rs,cs,is,flag,[nThreads]); */
+  int flag, nThreads, m, m1, n1, nDims, nb, nBlocks, b, *is;
+  const mwSize *nsI; mwSize nsJ[3];
+  size_t areaJ, areaI; double *I, *J, *rs, *cs;
 
   /* extract inputs */
   I   = (double*) mxGetData(prhs[0]);
@@ -260,28 +273,44 @@ void applyTransform(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   cs  = (double*) mxGetData(prhs[2]);
   is  = (int*) mxGetData(prhs[3]);
   flag = (int) mxGetScalar(prhs[4]);
+  nThreads = (nrhs<6) ? 100000 : (int) mxGetScalar(prhs[5]);
 
-  /* get dimensions */
+  /* get dimensions (I may be a stack of channels or frames) */
   nDims = mxGetNumberOfDimensions(prhs[0]);
-  nsI = (int*) mxGetDimensions(prhs[0]);
-  nsJ[0]=(int)mxGetM(prhs[1]); nsJ[1]=(int)mxGetN(prhs[1]);
-  nsJ[2]=(nDims==2) ? 1 : nsI[2];
-  areaJ=nsJ[0]*nsJ[1]; areaI=nsI[0]*nsI[1];
+  nsI = mxGetDimensions(prhs[0]); m=(int)nsI[0];
+  nsJ[0]=m1=(int)mxGetM(prhs[1]); nsJ[1]=n1=(int)mxGetN(prhs[1]);
+  nsJ[2]=(nDims==2) ? 1 : (int)nsI[2];
+  areaJ=(size_t)m1*n1; areaI=(size_t)m*nsI[1];
 
-  /* Perform interpolation */
+  /* empty sampling table (no block to process) */
+  if( m1==0 || n1==0 ) {
+    plhs[0] = mxCreateNumericArray(3,nsJ,mxDOUBLE_CLASS,mxREAL); return;
+  }
+
+  /* Perform interpolation in parallel over blocks of columns of J. Blocks
+   * hold about 8K pixels so that the block of the sampling table (rs,cs,is)
+   * stays in cache while it is applied to every channel (or frame) of I.
+   * The inner loops are simple enough for the compiler to vectorize. */
   J = mxMalloc(sizeof(double)*areaJ*nsJ[2]);
-  if( flag==1 ) { /* nearest neighbor */
+  nb=8192/m1+1; nBlocks=(n1+nb-1)/nb;
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #pragma omp parallel for num_threads(nThreads)
+  #endif
+  for( b=0; b<nBlocks; b++ ) {
+    int j, k, id; double wr, wc, wrc, *J1; const double *I1;
+    size_t o=(size_t)b*nb*m1, o1=(size_t)(b+1<nBlocks ? (b+1)*nb : n1)*m1;
+    const int *is1=is+o; const double *rs1=rs+o, *cs1=cs+o; int len=(int)(o1-o);
     for( k=0; k<nsJ[2]; k++ ) {
-      J1=J+areaJ*k; I1=I+areaI*k;
-      for( i=0; i<areaJ; i++ ) J1[i]=I1[is[i]];
-    }
-  } else if( flag==2 ) { /* bilinear */
-    for( k=0; k<nsJ[2]; k++ ) {
-      J1=J+areaJ*k; I1=I+areaI*k;
-      for( i=0; i<areaJ; i++ ) {
-        id=is[i]; wr=rs[i]; wc=cs[i]; wrc=wr*wc;
-        J1[i]=I1[id]*(1-wr-wc+wrc) + I1[id+1]*(wr-wrc)
-          + I1[id+nsI[0]]*(wc-wrc) + I1[id+nsI[0]+1]*wrc;
+      J1=J+areaJ*k+o; I1=I+areaI*k;
+      if( flag==1 ) { /* nearest neighbor */
+        for( j=0; j<len; j++ ) J1[j]=I1[is1[j]];
+      } else if( flag==2 ) { /* bilinear */
+        for( j=0; j<len; j++ ) {
+          id=is1[j]; wr=rs1[j]; wc=cs1[j]; wrc=wr*wc;
+          J1[j]=I1[id]*(1-wr-wc+wrc) + I1[id+1]*(wr-wrc)
+            + I1[id+m]*(wc-wrc) + I1[id+m+1]*wrc;
+        }
       }
     }
   }
@@ -290,7 +319,6 @@ void applyTransform(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   plhs[0] = mxCreateNumericMatrix(0,0,mxDOUBLE_CLASS,mxREAL);
   mxSetData(plhs[0],J); mxSetDimensions(plhs[0],nsJ,3);
 }
-
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   /* switchyard - apply appropriate action */
   int fail; char action[1024]; fail=mxGetString(prhs[0],action,1024);
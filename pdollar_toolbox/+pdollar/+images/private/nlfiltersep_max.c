@@ -4,8 +4,13 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include "mex.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
-#define arraymax(A, m, s, e, i) m=A[s]; for(i=s+1; i<=e; i++) { m=((A[i])>(m)?(A[i]):(m)); };
 int maxi( int x, int y ) { return (x > y) ? x : y; };
 int mini( int x, int y ) { return (x < y) ? x : y; };
 
@@ -14,36 +19,69 @@ int mini( int x, int y ) { return (x < y) ? x : y; };
 *  x = nlfiltersep_max( [ 1 9; 5 9; 0 0; 4 8; 7 3; 2 6], 1, 1 )
 *  y = [5 9; 5 9; 5 9; 7 8; 7 8; 7 6]; x-y
 * B(i,j) is the max of A(i-r1:i+r2,j). It has the same dims as A.
-* Border calculations are done separately for efficiency.
+* Uses the van Herk/Gil-Werman algorithm so the cost per element does not
+* depend on the window size w=r1+r2+1. Each column is padded by r1 values
+* before and r2 after (that never win) and split into blocks of length w.
+* Within each block g holds running maxes from the left and h from the
+* right, any window then covers the end of one block and the start of the
+* next so B(i)=max(h(i),g(i+w-1)) in padded coordinates. Ties go to the
+* earlier element, so results are identical to scanning each window. Small
+* windows and columns with NaNs (whose effect depends on the scan order)
+* are handled by scanning each window directly.
+* x, g and h must have room for mRows+r1+r2 values.
 *******************************************************************************/
-void nlfiltersep_max( const double *A, double *B, int r1, int r2, int mRows, int nCols ) {
-  int i, row0, e, s, r, c; double m;
-  for( c=0; c<nCols; c++ ) {
-    row0 = mRows * c;
-    /* leading border calculations */
-    for(r=0; r<mini(r1, mRows-1); r++) {
-      e = mini( r+r2, mRows-1 );
-      arraymax( A, m, row0, row0+e, i );
-      B[r+row0] = m;
+void nlfiltersep_max1( const double *A, double *B, int r1, int r2, int mRows,
+  double *x, double *g, double *h )
+{
+  int i, j, s, e, t, t1, w=r1+r2+1, L=mRows+r1+r2, nan=0; double m;
+  if( w>5 ) for( i=0; i<mRows; i++ ) if( A[i]!=A[i] ) { nan=1; break; }
+  if( w<=5 || nan ) {
+    for( i=0; i<mRows; i++ ) {
+      s=maxi(i-r1,0); e=mini(i+r2,mRows-1); m=A[s];
+      for( j=s+1; j<=e; j++ ) if( A[j]>m ) m=A[j];
+      B[i]=m;
     }
-    /* main caclulations */
-    for(r=r1; r<mRows-r2; r++) {
-      arraymax( A, m, r-r1+row0, r+r2+row0, i ); B[r+row0]=m;
-    }
-    /* end border calculations */
-    for(r=maxi(mRows-r2-1, 0); r<mRows; r++) {
-      s = maxi( r-r1, 0 );
-      arraymax( A, m, s+row0, mRows-1+row0, i );
-      B[r+row0] = m;
+    return;
+  }
+  for( t=0; t<r1; t++ ) x[t]=-HUGE_VAL;
+  memcpy(x+r1,A,sizeof(double)*mRows);
+  for( t=r1+mRows; t<L; t++ ) x[t]=-HUGE_VAL;
+  for( s=0; s<L; s+=w ) {
+    t1=mini(s+w,L); g[s]=x[s]; h[t1-1]=x[t1-1];
+    for( t=s+1; t<t1; t++ ) g[t] = x[t]>g[t-1] ? x[t] : g[t-1];
+    for( t=t1-2; t>=s; t-- ) h[t] = x[t]>=h[t+1] ? x[t] : h[t+1];
+  }
+  for( i=0; i<mRows; i++ ) B[i] = h[i]>=g[i+w-1] ? h[i] : g[i+w-1];
+}
+
+void nlfiltersep_max( const double *A, double *B, int r1, int r2, int mRows,
+  int nCols, int nThreads )
+{
+  /* windows are clipped to the column so r1 and r2 beyond mRows-1 are moot */
+  r1=mini(r1,mRows-1); r2=mini(r2,mRows-1);
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #pragma omp parallel num_threads(nThreads)
+  #endif
+  {
+    int c, L=mRows+r1+r2; double *x, *g, *h;
+    x=(double*) malloc(sizeof(double)*L*3); g=x+L; h=g+L;
+    #ifdef USEOMP
+    #pragma omp for
+    #endif
+    for( c=0; c<nCols; c++ ) {
+      size_t row0 = (size_t) mRows * c;
+      nlfiltersep_max1( A+row0, B+row0, r1, r2, mRows, x, g, h );
     }
+    free(x);
   }
 }
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  int mRows, nCols, r1, r2; double *A, *B;
+  int mRows, nCols, r1, r2, nThreads; double *A, *B;
   
   /* Error checking on arguments */
-  if( nrhs!=3 ) mexErrMsgTxt("Three input arguments required.");
+  if( nrhs<3 || nrhs>4 ) mexErrMsgTxt("Three or four input arguments required.");
   if( nlhs>1 ) mexErrMsgTxt("Too many output arguments.");
   mRows = mxGetM(prhs[0]); nCols = mxGetN(prhs[0]);
   if(!mxIsDouble(prhs[0])) mexErrMsgTxt("Input array must be of type double.");
@@ -52,11 +90,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   A = (double*) mxGetData(prhs[0]);
   r1 = (int) mxGetScalar(prhs[1]);
   r2 = (int) mxGetScalar(prhs[2]);
+  nThreads = (nrhs<4) ? 100000 : (int) mxGetScalar(prhs[3]);
+  if( r1<0 || r2<0 ) mexErrMsgTxt("Radii must be nonnegative.");
   
   /* create outputs */
   plhs[0] = mxCreateDoubleMatrix(mRows, nCols, mxREAL );
   B = (double*) mxGetData(plhs[0]);
   
   /* Apply filter */
-  nlfiltersep_max( A, B, r1, r2, mRows, nCols );
+  if( mRows>0 ) nlfiltersep_max( A, B, r1, r2, mRows, nCols, nThreads );
 }
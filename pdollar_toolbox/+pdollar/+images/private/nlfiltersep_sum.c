@@ -4,8 +4,10 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include "mex.h"
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
-#define arraysum(A, m, s, e, i) m=0; for(i=s; i<=e; i++) { m+=A[i]; };
 int maxi( int x, int y ) { return (x > y) ? x : y; };
 int mini( int x, int y ) { return (x < y) ? x : y; };
 
@@ -16,36 +18,43 @@ int mini( int x, int y ) { return (x < y) ? x : y; };
 * B(i,j) is the sum of A(i-r1:i+r2,j). It has the same dims as A.
 * This can be implemented effiicently because:
 *  B[i] = B[i-1] + A[i+r2] - A[i-r1-1];
-* Does not work for initial (r1+1) and final r2 values in each row.
+* The initial (r1+1) values in each row are running sums of A (windows grow
+* at the end) and in the final r2 values the window only shrinks at the
+* start, so the cost per element does not depend on the window size.
 *******************************************************************************/
-void nlfiltersep_sum( const double *A, double *B, int r1, int r2, int mRows, int nCols ) {
-  int i, row0, e, s, r, c; double m;
+void nlfiltersep_sum( const double *A, double *B, int r1, int r2, int mRows,
+  int nCols, int nThreads )
+{
+  int c;
+  #ifdef USEOMP
+  if( nThreads>omp_get_max_threads() ) nThreads=omp_get_max_threads();
+  #pragma omp parallel for num_threads(nThreads)
+  #endif
   for( c=0; c<nCols; c++ ) {
-    row0 = mRows * c;
+    int i=0, e, r; double m=0; const double *a=A+(size_t)mRows*c;
+    double *b=B+(size_t)mRows*c;
     /* leading border calculations */
     for(r=0; r<=mini(r1, mRows-1); r++) {
       e = mini( r+r2, mRows-1 );
-      arraysum( A, m, row0, row0+e, i );
-      B[r+row0] = m;
+      for( ; i<=e; i++ ) m+=a[i];
+      b[r] = m;
     }
     /* main caclulations */
     for(r=r1+1; r<mRows-r2; r++) {
-      B[r+row0] = B[r+row0-1] + A[r+row0+r2] - A[r+row0-r1-1];
+      b[r] = b[r-1] + a[r+r2] - a[r-r1-1];
     }
     /* end border calculations */
-    for(r=maxi(mRows-r2, 0); r<mRows; r++) {
-      s = maxi( r-r1, 0 );
-      arraysum( A, m, s+row0, mRows-1+row0, i );
-      B[r+row0] = m;
+    for(r=maxi(mRows-r2, r1+1); r<mRows; r++) {
+      b[r] = b[r-1] - a[r-r1-1];
     }
   }
 }
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  int mRows, nCols, r1, r2; double *A, *B;
+  int mRows, nCols, r1, r2, nThreads; double *A, *B;
   
   /* Error checking on arguments */
-  if( nrhs!=3 ) mexErrMsgTxt("Three input arguments required.");
+  if( nrhs<3 || nrhs>4 ) mexErrMsgTxt("Three or four input arguments required.");
   if( nlhs>1 ) mexErrMsgTxt("Too many output arguments.");
   mRows = mxGetM(prhs[0]); nCols = mxGetN(prhs[0]);
   if(!mxIsDouble(prhs[0])) mexErrMsgTxt("Input array must be of type double.");
@@ -54,11 +63,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   A = (double*) mxGetData(prhs[0]);
   r1 = (int) mxGetScalar(prhs[1]);
   r2 = (int) mxGetScalar(prhs[2]);
+  nThreads = (nrhs<4) ? 100000 : (int) mxGetScalar(prhs[3]);
+  if( r1<0 || r2<0 ) mexErrMsgTxt("Radii must be nonnegative.");
   
   /* create outputs */
   plhs[0] = mxCreateDoubleMatrix(mRows, nCols, mxREAL );
   B = (double*) mxGetData(plhs[0]);
   
   /* Apply filter */
-  nlfiltersep_sum( A, B, r1, r2, mRows, nCols );
+  nlfiltersep_sum( A, B, r1, r2, mRows, nCols, nThreads );
 }
@@ -2,27 +2,41 @@ function [D,P] = dijkstra( G, varargin )
 % Runs Dijkstra's shortest path algorithm on a distance matrix.
 %
 % Runs Dijkstra's on the given SPARSE nxn distance matrix G, where missing
-% values mean no edge (infinite distance). Uses a Finonacci heap resulting
-% in fast computation. Finds the shortest path distance from every point
-% S(i) in the 1xp source vector S to every other point j, resulting in a
-% pxn distance matrix D. P(i,j) contains the second to last node on the
-% path from S(i) to j. If point j is not reachable from point S(i) then
-% D(i,j)=inf and P(i,j)=-1.
+% values mean no edge (infinite distance) and G(j,i) is the length of the
+% edge from i to j (edge lengths must be non-negative). The sparse matrix
+% is used directly and an indexed 4-ary heap results in fast computation.
+% Finds the shortest path distance from every point S(i) in the 1xp source
+% vector S to every other point j, resulting in a pxn distance matrix D.
+% P(i,j) contains the second to last node on the path from S(i) to j. If
+% point j is not reachable from point S(i) then D(i,j)=inf and P(i,j)=-1.
+% Sources are processed in parallel if OpenMP is enabled (see
+% toolboxCompile).
+%
+% If a 1xp target vector T is given, only the shortest path from S(i) to
+% T(i) is computed for each i. A bidirectional search is used (from S(i)
+% along G and from T(i) along G') that stops as soon as the two searches
+% meet, which is typically much faster than computing all distances. In
+% this case D is px1 with the path lengths and P is a px1 cell array where
+% P{i} is the path [S(i) ... T(i)] (empty if T(i) is unreachable).
 %
 % USAGE
-%   [D P] = dijkstra( G, [S] )
+%   [D P] = dijkstra( G, [S], [T], [nThreads] )
 %
 % INPUT
-%   G   - sparse nxn distance matrix
-%   S   - 1xp array of source indices i
+%   G        - sparse nxn distance matrix
+%   S        - [1:n] 1xp array of source indices i
+%   T        - [] optional 1xp array of target indices
+%   nThreads - [inf] max number of computational threads to use
 %
 % OUPUT
-%   D   - pxn - shortest path lengths from S(i) to j
+%   D   - pxn - shortest path lengths from S(i) to j (px1 if T is given)
 %   P   - pxn - indicies of second to last node on path from S(i) to j
+%         (px1 cell of paths from S(i) to T(i) if T is given)
 %
 % EXAMPLE
 %  n=11; G=sparse(n,n); for i=1:n-1, G(i,i+1)=1; end; G=G+G';
 %  [D,P] = dijkstra(G,5), % D=[4:-1:0 1:6]; P=[2:5 -1 5:10];
+%  [d,p] = dijkstra(G,[5 1],[9 3]), % d=[4; 2]; p={5:9; 1:3}
 %
 % See also
 %
@@ -30,4 +44,5 @@ function [D,P] = dijkstra( G, varargin )
 % Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
 % Licensed under the Simplified BSD License [see external/bsd.txt]
 
+if(nargin<2 || isempty(varargin{1})), varargin{1}=1:size(G,1); end
 [D,P] = dijkstra1( G, varargin{:} );
@@ -3,182 +3,247 @@
 * Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
+#include <mex.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#ifdef USEOMP
+#include <omp.h>
+#endif
+using namespace std;
 
-/*******************************************************************************
-* Based on ISOMAP code which can be found at http:*isomap.stanford.edu/.
-* See accompanying m file (dijkstra.m) for usage.
-*******************************************************************************/
+static const double INF=numeric_limits<double>::infinity();
 
-/*******************************************************************************
-* Bug fix for certain versions of VC++ compiler when used in Matlab.
-* http://www.mathworks.com/matlabcentral/newsreader/view_thread/281754
-*******************************************************************************/
-#if (_MSC_VER >= 1600)
-#define __STDC_UTF_16__
-typedef unsigned short char16_t;
-#endif
+// sparse graph in compressed column form (column j lists the edges leaving
+// node j: the rows ir[jc[j]..jc[j+1]-1] with lengths pr[jc[j]..jc[j+1]-1])
+struct Graph { int n; const double *pr; const mwIndex *ir, *jc; };
 
-#include "mex.h"
-#include "fibheap.h"
-#define DIJKSTRA_CPP
+// transpose of a graph (column j lists the edges entering node j)
+void transpose( const Graph &G, Graph &T, vector<double> &pr,
+  vector<mwIndex> &ir, vector<mwIndex> &jc )
+{
+  const int n=G.n; const mwIndex m=G.jc[n];
+  pr.resize(m+1); ir.resize(m+1); jc.assign(n+1,0);
+  for( mwIndex k=0; k<m; k++ ) jc[G.ir[k]+1]++;
+  for( int i=0; i<n; i++ ) jc[i+1]+=jc[i];
+  vector<mwIndex> nxt(jc.begin(),jc.end()-1);
+  for( int j=0; j<n; j++ ) for( mwIndex k=G.jc[j]; k<G.jc[j+1]; k++ ) {
+    mwIndex k1=nxt[G.ir[k]]++; pr[k1]=G.pr[k]; ir[k1]=j; }
+  T.n=n; T.pr=&pr[0]; T.ir=&ir[0]; T.jc=&jc[0];
+}
 
-/*******************************************************************************
-* class HeapNode
-*******************************************************************************/
-class HeapNode : public FibHeapNode {
-  double   N;
-  long int IndexV;
-  
+// indexed 4-ary min heap over node ids (pos[i]<0 if i is not in the heap)
+class Heap {
 public:
-  HeapNode() : FibHeapNode() { N = 0; };
-  virtual void operator =(FibHeapNode& RHS);
-  virtual int  operator ==(FibHeapNode& RHS);
-  virtual int  operator <(FibHeapNode& RHS);
-  virtual void operator =(double NewKeyVal );
-  virtual void Print();
-  double GetKeyValue() { return N; };
-  void SetKeyValue(double n) { N = n; };
-  long int GetIndexValue() { return IndexV; };
-  void SetIndexValue( long int v) { IndexV = v; };
-};
+  void init( int n ) { pos.assign(n,-1); ids.reserve(n); keys.reserve(n); }
+  bool empty() const { return ids.empty(); }
+  double topKey() const { return keys[0]; }
+  void clear() {
+    for( size_t k=0; k<ids.size(); k++ ) pos[ids[k]]=-1;
+    ids.clear(); keys.clear();
+  }
 
-void HeapNode::Print() {
-  FibHeapNode::Print();
-  mexPrintf( "%f (%d)" , N , IndexV );
-}
+  // insert node i or decrease its key to d
+  void push( int i, double d ) {
+    int k=pos[i]; if( k<0 ) {
+      k=int(ids.size()); ids.push_back(i); keys.push_back(d); }
+    up(k,i,d);
+  }
 
-void HeapNode::operator =(double NewKeyVal) {
-  HeapNode Tmp;
-  Tmp.N = N = NewKeyVal;
-  FHN_Assign(Tmp);
-}
+  // remove node with smallest key
+  int pop() {
+    int i=ids[0]; pos[i]=-1; int j=ids.back(); double d=keys.back();
+    ids.pop_back(); keys.pop_back(); if(!ids.empty()) down(0,j,d);
+    return i;
+  }
 
-void HeapNode::operator =(FibHeapNode& RHS) {
-  FHN_Assign(RHS);
-  N = ((HeapNode&) RHS).N;
-}
+private:
+  vector<int> pos, ids; vector<double> keys;
 
-int  HeapNode::operator ==(FibHeapNode& RHS) {
-  if (FHN_Cmp(RHS)) return 0;
-  return N == ((HeapNode&) RHS).N ? 1 : 0;
-}
+  void up( int k, int i, double d ) {
+    while( k>0 ) {
+      int p=(k-1)>>2; if( keys[p]<=d ) break;
+      ids[k]=ids[p]; keys[k]=keys[p]; pos[ids[k]]=k; k=p;
+    }
+    ids[k]=i; keys[k]=d; pos[i]=k;
+  }
 
-int  HeapNode::operator <(FibHeapNode& RHS) {
-  int X;
-  if ((X=FHN_Cmp(RHS)) != 0)
-    return X < 0 ? 1 : 0;
-    return N < ((HeapNode&) RHS).N ? 1 : 0;
+  void down( int k, int i, double d ) {
+    const int m=int(ids.size());
+    while( true ) {
+      int c=4*k+1, c1=min(c+4,m), b=-1; double db=d;
+      for( ; c<c1; c++ ) if( keys[c]<db ) { db=keys[c]; b=c; }
+      if( b<0 ) break;
+      ids[k]=ids[b]; keys[k]=db; pos[ids[k]]=k; k=b;
+    }
+    ids[k]=i; keys[k]=d; pos[i]=k;
+  }
 };
 
-/*******************************************************************************
-* main
-*******************************************************************************/
-void dijkstra1( long int n, long int s, double *D1, double *P1, double *Gpr, mwIndex *Gir, mwIndex *Gjc) {
-  int      finished;
-  long int i, startInd, endInd, whichNeigh, nDone, closest;
-  double   closestD, arcLength, INF, SMALL, oldDist;
-  HeapNode *A, *hnMin, hnTmp; FibHeap *heap;
-  INF=mxGetInf(); SMALL=mxGetEps();
-  
-  // setup heap
-  if ((heap = new FibHeap) == NULL || (A = new HeapNode[n+1]) == NULL )
-    mexErrMsgTxt( "Memory allocation failed-- ABORTING.\n" );
-  heap->ClearHeapOwnership();
-  
-  // initialize
-  for (i=0; i<n; i++) {
-    if (i!=s) A[ i ] = (double) INF; else A[ i ] = (double) SMALL;
-    if (i!=s) D1[ i ] = (double) INF; else D1[ i ] = (double) SMALL;
-    P1[ i ] = -1;
-    heap->Insert( &A[i] );
-    A[ i ].SetIndexValue( (long int) i );
+// per thread work space (D, P and visited node list are reset lazily)
+struct Work {
+  Heap heap; vector<double> D[2]; vector<int> P[2], seen;
+  void init( int n, int nSides ) {
+    heap.init(n*nSides); for( int s=0; s<nSides; s++ ) {
+      D[s].assign(n,INF); P[s].assign(n,-1); }
   }
-  
-  // Insert 0 then extract it, which will balance heap
-  heap->Insert(&hnTmp); heap->ExtractMin();
-  
-  // loop over nonreached nodes
-  finished = nDone = 0;
-  while ((finished==0) && (nDone < n)) {
-    hnMin = (HeapNode *) heap->ExtractMin();
-    closest  = hnMin->GetIndexValue();
-    closestD = hnMin->GetKeyValue();
-    if ((closest<0) || (closest>=n))
-      mexErrMsgTxt( "Minimum Index out of bound..." );
-    D1[ closest ] = closestD;
-    if (closestD == INF) finished=1; else {
-      // relax all nodes adjacent to closest
-      nDone++;
-      startInd = Gjc[ closest   ];
-      endInd   = Gjc[ closest+1 ] - 1;
-      if( startInd!=endInd+1 )
-        for( i=startInd; i<=endInd; i++ ) {
-        whichNeigh = Gir[ i ];
-        arcLength = Gpr[ i ];
-        oldDist = D1[ whichNeigh ];
-        if ( oldDist > ( closestD + arcLength )) {
-          D1[ whichNeigh ] = closestD + arcLength;
-          P1[ whichNeigh ] = closest + 1;
-          hnTmp = A[ whichNeigh ];
-          hnTmp.SetKeyValue( closestD + arcLength );
-          heap->DecreaseKey( &A[ whichNeigh ], hnTmp );
-        }
-        }
+  void reset( int nSides ) {
+    for( size_t k=0; k<seen.size(); k++ ) for( int s=0; s<nSides; s++ ) {
+      D[s][seen[k]]=INF; P[s][seen[k]]=-1; }
+    seen.clear();
+  }
+};
+
+// single source shortest paths from s, D1 and P1 (1-indexed) are strided
+// by nSrc (the source itself has distance eps, unreached nodes inf and -1)
+void dijkstra1( const Graph &G, int s, Work &w, double *D1, double *P1,
+  int nSrc )
+{
+  vector<double> &D=w.D[0]; vector<int> &P=w.P[0]; Heap &heap=w.heap;
+  D[s]=numeric_limits<double>::epsilon(); w.seen.push_back(s);
+  heap.push(s,D[s]);
+  while( !heap.empty() ) {
+    const int u=heap.pop(); const double du=D[u];
+    for( mwIndex k=G.jc[u]; k<G.jc[u+1]; k++ ) {
+      const int v=int(G.ir[k]); const double d=du+G.pr[k];
+      if( D[v]>d ) {
+        if( D[v]==INF ) w.seen.push_back(v);
+        D[v]=d; P[v]=u; heap.push(v,d);
+      }
     }
   }
-  
-  // cleanup
-  delete heap; delete[] A;
+  for( int j=0; j<G.n; j++ ) {
+    D1[size_t(j)*nSrc]=D[j]; P1[size_t(j)*nSrc]=P[j]<0 ? -1 : P[j]+1; }
+  w.reset(1);
 }
 
-void dijkstra( long int n, long int nSrc, double *sources, double *D, double *P, const mxArray *G ) {
-  // dealing with sparse array
-  double *Gpr = mxGetPr(G);
-  mwIndex *Gir = mxGetIr(G);
-  mwIndex *Gjc = mxGetJc(G);
-  
-  // allocate memory for single source results (automatically recycled)
-  double *D1 = (double *) mxCalloc( n , sizeof( double ));
-  double *P1 = (double *) mxCalloc( n , sizeof( double ));
-  
-  // loop over sources
-  long int s, i, j;
-  for( i=0; i<nSrc; i++ ) {
-    
-    // run the dijkstra1 code for single source (0 indexed)
-    s = (long int) *( sources + i ) - 1;
-    if (s<0 || s > n-1) mexErrMsgTxt( "Source node(s) out of bound" );
-    dijkstra1( n, s, D1, P1, Gpr, Gir, Gjc );
-    
-    // store results
-    for( j=0; j<n; j++ ) {
-      *( D + j*nSrc + i ) = *( D1 + j );
-      *( P + j*nSrc + i ) = *( P1 + j );
+// relax all edges of node u (in graph G) from one side of the search and
+// update the best meeting edge (a->b) with length mu found so far
+inline void relax( const Graph &G, int u, int side, Work &w, double &mu,
+  int &a, int &b )
+{
+  Heap &heap=w.heap; vector<int> &P=w.P[side];
+  vector<double> &D=w.D[side], &D1=w.D[1-side]; const double du=D[u];
+  for( mwIndex k=G.jc[u]; k<G.jc[u+1]; k++ ) {
+    const int v=int(G.ir[k]); const double d=du+G.pr[k];
+    if( D1[v]<INF && d+D1[v]<mu ) {
+      mu=d+D1[v]; if(side==0) { a=u; b=v; } else { a=v; b=u; } }
+    if( D[v]>d ) {
+      if( D[v]==INF && D1[v]==INF ) w.seen.push_back(v);
+      D[v]=d; P[v]=u; heap.push(v+side*G.n,d);
     }
   }
 }
 
+// shortest path from s to t using bidirectional search (forward search on
+// G, backward on its transpose T), stops as soon as the two searches meet
+double dijkstraPair( const Graph &G, const Graph &T, int s, int t, Work &w,
+  vector<int> &path )
+{
+  const int n=G.n; Heap &heap=w.heap;
+  double mu=INF; int a=-1, b=-1; path.clear();
+  if( s==t ) { path.push_back(s); return 0; }
+  w.D[0][s]=0; w.D[1][t]=0; w.seen.push_back(s); w.seen.push_back(t);
+  heap.push(s,0); heap.push(t+n,0);
+
+  // nodes of both searches share one heap (ids n..2n-1 are backward), the
+  // searches can stop once the smallest key of each side sums to >=mu
+  double top[2]={0,0};
+  while( !heap.empty() ) {
+    const double d=heap.topKey(); int u=heap.pop(), side=u>=n; if(side) u-=n;
+    top[side]=d;
+    if( top[0]+top[1]>=mu || d>=mu ) break;
+    relax(side ? T : G,u,side,w,mu,a,b);
+  }
+  heap.clear();
+
+  // path is s->..->a->b->..->t
+  if( a>=0 ) {
+    for( int u=a; u>=0; u=w.P[0][u] ) path.push_back(u);
+    reverse(path.begin(),path.end());
+    for( int u=b; u>=0; u=w.P[1][u] ) path.push_back(u);
+  }
+  w.reset(2); return mu;
+}
+
+// [D,P] = mexFunction( G, S, [T], [nThreads] )
 void mexFunction( int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[] ) {
-  double    *D, *P, *sources;
-  long int  n, mSrc, nSrc;
-  
+  int n, nSrc, nTrg=0, nThreads; Graph G; double *S, *T=0;
+
   // get / check inputs
-  if (nrhs != 2) mexErrMsgTxt( "Only 2 input arguments allowed." );
-  if (nlhs > 2) mexErrMsgTxt( "Only 2 output argument allowed." );
-  n = mxGetN( prhs[0] );
-  if (mxGetM( prhs[0] ) != n) mexErrMsgTxt( "Input matrix G needs to be square." );
-  sources = mxGetPr(prhs[1]); mSrc = mxGetM(prhs[1]); nSrc=mxGetN(prhs[1]);
-  if ((mSrc==0) || (nSrc==0) || ((mSrc>1) && (nSrc>1)))
+  if( nrhs<2 || nrhs>4 ) mexErrMsgTxt( "Two to four inputs expected." );
+  if( nlhs>2 ) mexErrMsgTxt( "Only 2 output argument allowed." );
+  if( !mxIsSparse(prhs[0]) || !mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]) )
+    mexErrMsgTxt( "Distance Matrix must be sparse" );
+  n = (int) mxGetN(prhs[0]);
+  if( int(mxGetM(prhs[0]))!=n )
+    mexErrMsgTxt( "Input matrix G needs to be square." );
+  if( !mxIsDouble(prhs[1]) ) mexErrMsgTxt( "Source nodes must be double." );
+  S = mxGetPr(prhs[1]); nSrc = (int) mxGetNumberOfElements(prhs[1]);
+  if( nSrc==0 || (mxGetM(prhs[1])>1 && mxGetN(prhs[1])>1) )
     mexErrMsgTxt( "Source nodes are specified in vector only" );
-  if(mSrc>nSrc) nSrc=mSrc;
-  if(mxIsSparse(prhs[0])==0) mexErrMsgTxt( "Distance Matrix must be sparse" );
-  
-  // create outputs arrays D and P
-  plhs[0] = mxCreateDoubleMatrix( nSrc, n, mxREAL );
-  plhs[1] = mxCreateDoubleMatrix( nSrc, n, mxREAL );
-  D = mxGetPr(plhs[0]);
-  P = mxGetPr(plhs[1]) ;
-  
-  // run dijkstras to fill D and P
-  dijkstra( n, nSrc, sources, D, P, prhs[0] );
+  if( nrhs>2 && !mxIsEmpty(prhs[2]) ) {
+    if( !mxIsDouble(prhs[2]) ) mexErrMsgTxt( "Target nodes must be double." );
+    T = mxGetPr(prhs[2]); nTrg = (int) mxGetNumberOfElements(prhs[2]);
+    if( nTrg!=nSrc ) mexErrMsgTxt( "Need one target node per source node." );
+  }
+  nThreads = (nrhs<4) ? 100000 : (int) mxGetScalar(prhs[3]);
+  if( nThreads<1 ) nThreads=1;
+  for( int i=0; i<nSrc; i++ ) if( S[i]<1 || S[i]>n || S[i]!=int(S[i]) )
+    mexErrMsgTxt( "Source node(s) out of bound" );
+  for( int i=0; i<nTrg; i++ ) if( T[i]<1 || T[i]>n || T[i]!=int(T[i]) )
+    mexErrMsgTxt( "Target node(s) out of bound" );
+  G.n=n; G.pr=mxGetPr(prhs[0]); G.ir=mxGetIr(prhs[0]); G.jc=mxGetJc(prhs[0]);
+  for( mwIndex k=0; k<G.jc[n]; k++ ) if( G.pr[k]<0 )
+    mexErrMsgTxt( "Edge lengths must be non-negative." );
+
+  // thread work spaces
+  #ifdef USEOMP
+  nThreads = min(min(nThreads,omp_get_max_threads()),nSrc);
+  #else
+  nThreads = 1;
+  #endif
+  vector<Work> work(nThreads);
+  for( int i=0; i<nThreads; i++ ) work[i].init(n,T ? 2 : 1);
+
+  if( !T ) {
+    // shortest paths from every source to every node (D and P are pxn)
+    plhs[0] = mxCreateDoubleMatrix( nSrc, n, mxREAL );
+    plhs[1] = mxCreateDoubleMatrix( nSrc, n, mxREAL );
+    double *D = mxGetPr(plhs[0]), *P = mxGetPr(plhs[1]);
+    #ifdef USEOMP
+    #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+    #endif
+    for( int i=0; i<nSrc; i++ ) {
+      int tid=0;
+      #ifdef USEOMP
+      tid=omp_get_thread_num();
+      #endif
+      dijkstra1(G,int(S[i])-1,work[tid],D+i,P+i,nSrc);
+    }
+  } else {
+    // shortest path from S(i) to T(i) (D is px1 and P a px1 cell of paths)
+    Graph Gt; vector<double> pr; vector<mwIndex> ir, jc;
+    transpose(G,Gt,pr,ir,jc);
+    vector<vector<int> > paths(nSrc);
+    plhs[0] = mxCreateDoubleMatrix( nSrc, 1, mxREAL );
+    double *D = mxGetPr(plhs[0]);
+    #ifdef USEOMP
+    #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+    #endif
+    for( int i=0; i<nSrc; i++ ) {
+      int tid=0;
+      #ifdef USEOMP
+      tid=omp_get_thread_num();
+      #endif
+      D[i]=dijkstraPair(G,Gt,int(S[i])-1,int(T[i])-1,work[tid],paths[i]);
+    }
+    plhs[1] = mxCreateCellMatrix( nSrc, 1 );
+    for( int i=0; i<nSrc; i++ ) {
+      const int m=int(paths[i].size());
+      mxArray *A=mxCreateDoubleMatrix( 1, m, mxREAL ); double *p=mxGetPr(A);
+      for( int j=0; j<m; j++ ) p[j]=paths[i][j]+1;
+      mxSetCell(plhs[1],i,A);
+    }
+  }
 }
@@ -21,11 +21,18 @@ function [Vx,Vy,reliab] = opticalFlow( I1, I2, varargin )
 % between data and smoothness term (and smoothness of flow) and 'nIter'
 % determines number of gradient decent steps.
 %
+% For LK and HS, I1 and I2 may also be [hxwxK] stacks in which case the
+% flow between every pair of frames I1(:,:,k) and I2(:,:,k) is computed in
+% a single call (e.g. I1=I(:,:,1:end-1) and I2=I(:,:,2:end) for a video I).
+% For HS the iterations of all pairs are run together (in parallel if
+% OpenMP is enabled, see toolboxCompile), which is considerably faster than
+% computing the flow for each pair of frames separately.
+%
 % USAGE
 %  [Vx,Vy,reliab] = opticalFlow( I1, I2, pFlow )
 %
 % INPUTS
-%  I1, I2   - input images to calculate flow between
+%  I1, I2   - input images (or [hxwxK] stacks) to calculate flow between
 %  pFlow    - parameters (struct or name/value pairs)
 %   .type       - ['LK'] may be 'LK', 'HS' or 'SD'
 %   .smooth     - [1] smoothing radius for triangle filter (may be 0)
@@ -40,6 +47,7 @@ function [Vx,Vy,reliab] = opticalFlow( I1, I2, varargin )
 % OUTPUTS
 %  Vx, Vy   - x,y components of flow  [Vx>0->right, Vy>0->down]
 %  reliab   - reliability of flow in given window
+%  (all outputs are [hxwxK] if I1 and I2 are stacks)
 %
 % EXAMPLE - compute LK flow on test images
 %  load opticalFlowTest;
@@ -61,6 +69,11 @@ function [Vx,Vy,reliab] = opticalFlow( I1, I2, varargin )
 %  tic, [Vx3,Vy3]=opticalFlow(I1,I2,prm{:},'SD','minScale',1); toc
 %  figure(1); im([Vx1 Vy1; Vx2 Vy2; Vx3 Vy3]); colormap jet;
 %
+% EXAMPLE - HS flow between consecutive frames of a sequence
+%  load opticalFlowTest; I=cat(3,I1,I2,I1,I2);
+%  tic, [Vx,Vy]=opticalFlow(I(:,:,1:3),I(:,:,2:4),'type','HS'); toc
+%  figure(1); montage2([Vx Vy]); colormap jet;
+%
 % See also convTri, imtransform2, medfilt2
 %
 % Piotr's Computer Vision Matlab Toolbox      Version NEW
@@ -73,22 +86,26 @@ dfs={ 'type','LK', 'smooth',1, 'filt',0, 'minScale',1/64, ...
 [type,smooth,filt,minScale,maxScale,radius,nBlock,alpha,nIter] = ...
   getPrmDflt(varargin,dfs,1);
 assert(any(strcmp(type,{'LK','HS','SD'})));
-if( ~ismatrix(I1) || ~ismatrix(I2) || any(size(I1)~=size(I2)) )
+if( ndims(I1)>3 || ndims(I2)>3 || any(size(I1)~=size(I2)) )
   error('Input images must be 2D and have same dimensions.'); end
+if( size(I1,3)>1 && strcmp(type,'SD') )
+  error('SD flow requires 2D input images.'); end
 
 % run optical flow in coarse to fine fashion
 if(~isa(I1,'single')), I1=single(I1); I2=single(I2); end
-[h,w]=size(I1); nScales=max(1,floor(log2(min([h w 1/minScale])))+1);
+[h,w,K]=size(I1); nScales=max(1,floor(log2(min([h w 1/minScale])))+1);
 for s=1:max(1,nScales + round(log2(maxScale)))
   % get current scale and I1s and I2s at given scale
   scale=2^(nScales-s); h1=round(h/scale); w1=round(w/scale);
   if( scale==1 ), I1s=I1; I2s=I2; else
     I1s=imResample(I1,[h1 w1]); I2s=imResample(I2,[h1 w1]); end
   % initialize Vx,Vy or upsample from previous scale
-  if(s==1), Vx=zeros(h1,w1,'single'); Vy=Vx; else r=sqrt(h1*w1/numel(Vx));
+  if(s==1), Vx=zeros(h1,w1,K,'single'); Vy=Vx; else
+    r=sqrt(h1*w1/size(Vx,1)/size(Vx,2));
     Vx=imResample(Vx,[h1 w1])*r; Vy=imResample(Vy,[h1 w1])*r; end
   % transform I2s according to current estimate of Vx and Vy
-  if(s>1), I2s=imtransform2(I2s,[],'pad','replciate','vs',Vx,'us',Vy); end
+  if(s>1), for k=1:K, I2s(:,:,k)=imtransform2(I2s(:,:,k),[],...
+        'pad','replciate','vs',Vx(:,:,k),'us',Vy(:,:,k)); end; end
   % smooth images
   I1s=convTri(I1s,smooth); I2s=convTri(I2s,smooth);
   % run optical flow on current scale
@@ -99,10 +116,12 @@ for s=1:max(1,nScales + round(log2(maxScale)))
   end
   Vx=Vx+Vx1; Vy=Vy+Vy1;
   % finally median filter the resulting flow field
-  if(filt), Vx=medfilt2(Vx,[filt filt],'symmetric'); end
-  if(filt), Vy=medfilt2(Vy,[filt filt],'symmetric'); end
+  for k=1:K*(filt>0)
+    Vx(:,:,k)=medfilt2(Vx(:,:,k),[filt filt],'symmetric');
+    Vy(:,:,k)=medfilt2(Vy(:,:,k),[filt filt],'symmetric');
+  end
 end
-r=sqrt(h*w/numel(Vx));
+r=sqrt(h*w/size(Vx,1)/size(Vx,2));
 if(r~=1), Vx=imResample(Vx,[h w])*r; Vy=imResample(Vy,[h w])*r; end
 if(r~=1 && nargout==3), reliab=imResample(reliab,[h w]); end
 
@@ -127,15 +146,15 @@ end
 function [Vx,Vy,reliab] = opticalFlowHs( I1, I2, alpha, nIter )
 % compute derivatives (averaging over 2x2 neighborhoods)
 pad = @(I,p) imPad(I,p,'replicate');
-crop = @(I,c) I(1+c:end-c,1+c:end-c);
-Ex = I1(:,2:end)-I1(:,1:end-1) + I2(:,2:end)-I2(:,1:end-1);
-Ey = I1(2:end,:)-I1(1:end-1,:) + I2(2:end,:)-I2(1:end-1,:);
+crop = @(I,c) I(1+c:end-c,1+c:end-c,:);
+Ex = I1(:,2:end,:)-I1(:,1:end-1,:) + I2(:,2:end,:)-I2(:,1:end-1,:);
+Ey = I1(2:end,:,:)-I1(1:end-1,:,:) + I2(2:end,:,:)-I2(1:end-1,:,:);
 Ex = Ex/4; Ey = Ey/4; Et = (I2-I1)/4;
 Ex = pad(Ex,[1 1 1 2]) + pad(Ex,[0 2 1 2]);
 Ey = pad(Ey,[1 2 1 1]) + pad(Ey,[1 2 0 2]);
 Et=pad(Et,[0 2 1 1])+pad(Et,[1 1 1 1])+pad(Et,[1 1 0 2])+pad(Et,[0 2 0 2]);
 Z=1./(alpha*alpha + Ex.*Ex + Ey.*Ey); reliab=crop(Z,1);
-% iterate updating Ux and Vx in each iter
+% iterate updating Ux and Vx in each iter (all frames at once)
 if( 1 )
   [Vx,Vy]=opticalFlowHsMex(Ex,Ey,Et,Z,nIter);
   Vx=crop(Vx,1); Vy=crop(Vy,1);
@@ -144,7 +163,7 @@ else
   Vx=zeros(size(I1),'single'); Vy=Vx;
   f=single([0 1 0; 1 0 1; 0 1 0])/4;
   for i = 1:nIter
-    Mx=conv2(Vx,f,'same'); My=conv2(Vy,f,'same');
+    Mx=convn(Vx,f,'same'); My=convn(Vy,f,'same');
     m=(Ex.*Mx+Ey.*My+Et).*Z; Vx=Mx-Ex.*m; Vy=My-Ey.*m;
   end
 end
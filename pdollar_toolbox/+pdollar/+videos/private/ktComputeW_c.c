@@ -5,43 +5,50 @@
 **************************************************************************/
 #include "mex.h"
 #include "math.h"
+#include "../../+images/private/histcNd.h"
 typedef unsigned char uchar;
 
 /* Construct W for kernel tracker. */
-void ktComputeW( double* w, uchar* B, double* q, double *p, int n, int nBits ) {
-  int i, indFlat, nBits2=nBits+nBits, nBins=1<<nBits;
-  int nBins3=nBins*nBins*nBins; double *qp;
+void ktComputeW( double* w, uchar* B, double* q, double *p, int n, int nBits,
+  int nThreads )
+{
+  int i, nBins3; double *qp; HistSrc src;
+  nBins3 = (int) histSrcRgb( &src, B, n, nBits );
   qp = (double*) mxMalloc( nBins3 * sizeof(double) );
   for( i=0; i<nBins3; i++ )
     qp[i] = ( p[i]>0 ) ? sqrt(q[i]/p[i]) : 0.0;
-    for( i=0; i<n; i++ ) {
-      indFlat = B[i] + (B[i+n]<<nBits) + (B[i+n+n]<<nBits2);
-      w[i] = qp[ indFlat ];
-    }
-    mxFree( qp );
+  histLookup( w, qp, &src, nThreads );
+  mxFree( qp );
 }
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
   /* Declare variables. */
-  int n, nBits, dims[2];
+  int n, nBits, nThreads; mwSize dims[2];
   uchar *B; double *q, *p, *w;
-  
-  /* PRHS=[B, q, p, nBits]; PLHS=[w] */
-  if( nrhs != 4) mexErrMsgTxt("Four input arguments required.");
+
+  /* PRHS=[B, q, p, nBits, [nThreads]]; PLHS=[w] */
+  if( nrhs<4 || nrhs>5 ) mexErrMsgTxt("Four or five input arguments required.");
   if( nlhs > 1) mexErrMsgTxt("Too many output arguments.");
-  
+  if( mxGetClassID(prhs[0])!=mxUINT8_CLASS || mxGetN(prhs[0])!=3 )
+    mexErrMsgTxt("B must be a uint8 array of size nx3.");
+
   /* extract inputs */
-  n = mxGetM( prhs[0] );
+  n = (int) mxGetM( prhs[0] );
   B = (uchar*) mxGetData(prhs[0]);
   q = mxGetPr(prhs[1]);
   p = mxGetPr(prhs[2]);
   nBits = (int) mxGetScalar(prhs[3]);
-  
+  if( nBits<1 || nBits>8 ) mexErrMsgTxt("nBits must be in [1,8].");
+  if( mxGetNumberOfElements(prhs[1])!=(size_t) 1<<(3*nBits) ||
+      mxGetNumberOfElements(prhs[2])!=(size_t) 1<<(3*nBits) )
+    mexErrMsgTxt("q and p must have 2^(3*nBits) elements.");
+  nThreads = (nrhs<5) ? 100000 : (int) mxGetScalar(prhs[4]);
+
   /* create outputs */
   dims[0]=n; dims[1]=1;
-  plhs[0] = mxCreateNumericArray(1, dims, mxDOUBLE_CLASS, mxREAL);
+  plhs[0] = mxCreateNumericArray(2, dims, mxDOUBLE_CLASS, mxREAL);
   w = mxGetPr( plhs[0] );
-  
+
   /* call main function */
-  ktComputeW( w, B, q, p, n, nBits );
+  ktComputeW( w, B, q, p, n, nBits, nThreads );
 }
@@ -4,6 +4,7 @@
 * Licensed under the Simplified BSD License [see external/bsd.txt]
 *******************************************************************************/
 #include "mex.h"
+#include "../../+images/private/histcNd.h"
 typedef unsigned char uchar;
 
 /*******************************************************************************
@@ -14,35 +15,40 @@ typedef unsigned char uchar;
 *  3) Bins are restricted to powers of 2 (nBins=2^nBits)
 * Finding the bin index is simply a matter of dividing/multiplying by
 * powers of 2, which can be done efficiently with the left and right shift
-* operators. See also histc2c.c in toolbox for more general histogramming
-* implementation. This is about 5x faster. Note: nBins = 2^nBits = 1<<nBits
+* operators (see histSrcRgb in histcNd.h, which is also used by histc2c.c
+* for more general histogramming). Note: nBins = 2^nBits = 1<<nBits
 *******************************************************************************/
-void ktHistcRgb( double* h, uchar* B, double* wtMask, int n, int nBits ) {
-  int i, indFlat, nBits2=nBits+nBits;
-  for( i=0; i<n; i++ ) {
-    indFlat = B[i] + (B[i+n]<<nBits) + (B[i+n+n]<<nBits2);
-    h[ indFlat ] += wtMask[i];
-  }
+void ktHistcRgb( double* h, uchar* B, double* wtMask, int n, int nBits,
+  int nThreads )
+{
+  HistSrc src; size_t nBins=histSrcRgb( &src, B, n, nBits );
+  histcNd( h, nBins, &src, wtMask, nThreads );
 }
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  int n, nBits, dims[3]; uchar *B; double *wtMask, *h;
-  
-  /* PRHS=[B, wtMask, nBits]; PLHS=[h] */
-  if( nrhs != 3) mexErrMsgTxt("Three input arguments required.");
+  int n, nBits, nThreads; mwSize dims[3]; uchar *B; double *wtMask, *h;
+
+  /* PRHS=[B, wtMask, nBits, [nThreads]]; PLHS=[h] */
+  if( nrhs<3 || nrhs>4 ) mexErrMsgTxt("Three or four input arguments required.");
   if( nlhs > 1) mexErrMsgTxt("Too many output arguments.");
-  
+  if( mxGetClassID(prhs[0])!=mxUINT8_CLASS || mxGetN(prhs[0])!=3 )
+    mexErrMsgTxt("B must be a uint8 array of size nx3.");
+
   /* extract inputs */
-  n = mxGetM( prhs[0] );
+  n = (int) mxGetM( prhs[0] );
   B = (uchar*) mxGetData(prhs[0]);
+  if( mxGetNumberOfElements(prhs[1])!=(size_t) n || !mxIsDouble(prhs[1]) )
+    mexErrMsgTxt("wtMask must be a double vector of length n.");
   wtMask = mxGetPr(prhs[1]);
   nBits = (int) mxGetScalar(prhs[2]);
-  
+  if( nBits<1 || nBits>8 ) mexErrMsgTxt("nBits must be in [1,8].");
+  nThreads = (nrhs<4) ? 100000 : (int) mxGetScalar(prhs[3]);
+
   /* create outputs-- nBins = 2^nBits */
   dims[0]=dims[1]=dims[2]=1<<nBits;
   plhs[0] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
   h = mxGetPr( plhs[0] );
-  
+
   /* call main function */
-  ktHistcRgb( h, B, wtMask, n, nBits );
+  ktHistcRgb( h, B, wtMask, n, nBits, nThreads );
 }
@@ -5,63 +5,145 @@
 *******************************************************************************/
 #include "string.h"
 #include "mex.h"
-#include "../../channels/private/sse.hpp"
+#include "../../+channels/private/sse.hpp"
+#include <algorithm>
+#ifdef USEOMP
+#include <omp.h>
+#endif
 
-// run nIter iterations of Horn & Schunk optical flow (alters Vx, Vy)
+// tiles have TH x TW pixels, each tile runs up to TT iterations at a time on
+// a local copy of the flow (with a halo of TT pixels) that stays in cache
+static const int TH=128, TW=64, TT=8;
+
+// one Horn & Schunk update of n consecutive pixels of a column, Ux and Uy
+// hold the previous flow (neighboring columns are at offsets -s and +s)
+inline void hsColumn( float *Vx, float *Vy, const float *Ux, const float *Uy,
+  const int s, const float *Ex, const float *Ey, const float *Et,
+  const float *Z, const int n )
+{
+  int i; float mx, my, m;
+  // do as much work as possible in SSE/AVX (assume non-aligned memory)
+  for( i=0; i<=n-VW; i+=VW ) {
+    VEC _mx, _my, _m;
+    _my=MUL(ADD(LDuv(Uy[i-s]),LDuv(Uy[i+s]),LDuv(Uy[i-1]),LDuv(Uy[i+1])),.25f);
+    _mx=MUL(ADD(LDuv(Ux[i-s]),LDuv(Ux[i+s]),LDuv(Ux[i-1]),LDuv(Ux[i+1])),.25f);
+    _m=MUL(ADD(MUL(LDuv(Ey[i]),_my),MUL(LDuv(Ex[i]),_mx),LDuv(Et[i])),
+      LDuv(Z[i]));
+    STRu(Vx[i],SUB(_mx,MUL(LDuv(Ex[i]),_m)));
+    STRu(Vy[i],SUB(_my,MUL(LDuv(Ey[i]),_m)));
+  }
+  // do remainder of work in regular loop
+  for( ; i<n; i++ ) {
+    mx=.25f*(Ux[i-s]+Ux[i+s]+Ux[i-1]+Ux[i+1]);
+    my=.25f*(Uy[i-s]+Uy[i+s]+Uy[i-1]+Uy[i+1]);
+    m = (Ex[i]*mx + Ey[i]*my + Et[i])*Z[i];
+    Vx[i]=mx-Ex[i]*m; Vy[i]=my-Ey[i]*m;
+  }
+}
+
+// run nIter iterations on the tile with rows [y0,y1) and columns [x0,x1)
+// reading the flow from (Ux,Uy) and writing it to (Vx,Vy). The tile and a
+// halo of nIter pixels are copied into the buffer B (4*(TH+2*TT)*(TW+2*TT)
+// floats), each iteration shrinks the region that is valid by one pixel.
+void hsTile( float *Vx, float *Vy, const float *Ux, const float *Uy,
+  const float *Ex, const float *Ey, const float *Et, const float *Z,
+  const int h, const int w, const int y0, const int y1, const int x0,
+  const int x1, const int nIter, float *B )
+{
+  const int a0=std::max(y0-nIter,0), a1=std::min(y1+nIter,h);
+  const int b0=std::max(x0-nIter,0), b1=std::min(x1+nIter,w);
+  const int s=a1-a0, n=s*(b1-b0); float *L[2][2];
+  L[0][0]=B; L[0][1]=B+n; L[1][0]=B+2*n; L[1][1]=B+3*n;
+  for( int x=b0; x<b1; x++ ) for( int j=0; j<2; j++ ) {
+    memcpy(L[j][0]+(x-b0)*s,Ux+x*h+a0,s*sizeof(float));
+    memcpy(L[j][1]+(x-b0)*s,Uy+x*h+a0,s*sizeof(float));
+  }
+  for( int t=0; t<nIter; t++ ) {
+    // sides of the tile on the image boundary do not shrink
+    const int ya=(a0==0) ? 1 : a0+t+1, yb=(a1==h) ? h-1 : a1-t-1;
+    const int xa=(b0==0) ? 1 : b0+t+1, xb=(b1==w) ? w-1 : b1-t-1;
+    float **U=L[t&1], **V=L[1-(t&1)];
+    for( int x=xa; x<xb; x++ ) {
+      const int i=(x-b0)*s+ya-a0, j=x*h+ya;
+      hsColumn(V[0]+i,V[1]+i,U[0]+i,U[1]+i,s,Ex+j,Ey+j,Et+j,Z+j,yb-ya);
+    }
+  }
+  float **V=L[nIter&1];
+  for( int x=x0; x<x1; x++ ) {
+    memcpy(Vx+x*h+y0,V[0]+(x-b0)*s+y0-a0,(y1-y0)*sizeof(float));
+    memcpy(Vy+x*h+y0,V[1]+(x-b0)*s+y0-a0,(y1-y0)*sizeof(float));
+  }
+}
+
+// run nIter iterations of Horn & Schunk optical flow on K frames (Vx and Vy
+// must be zero). Blocks of TT iterations are applied tile by tile (tiles of
+// all frames in parallel), alternating between Vx/Vy and a second buffer.
 void opticalFlowHsMex( float *Vx, float *Vy, const float *Ex, const float *Ey,
-  const float *Et, const float *Z, const int h, const int w, const int nIter )
+  const float *Et, const float *Z, const int h, const int w, const int K,
+  const int nIter, int nThreads )
 {
-  int x, y, x1, i, t, s; float my, mx, m, *Vx0, *Vy0;
-  s=w*h*sizeof(float); Vx0=new float[s]; Vy0=new float[s];
-  for( t=0; t<nIter; t++ ) {
-    memcpy(Vx0,Vx,s); memcpy(Vy0,Vy,s);
-    for( x=1; x<w-1; x++ ) {
-      // do as much work as possible in SSE (assume non-aligned memory)
-      for( y=1; y<h-4; y+=4 ) {
-        x1=x*h; i=x1+y; __m128 _mx, _my, _m;
-        _my=MUL(ADD(LDu(Vy0[x1-h+y]),LDu(Vy0[x1+h+y]),
-          LDu(Vy0[x1+y-1]),LDu(Vy0[x1+y+1])),.25f);
-        _mx=MUL(ADD(LDu(Vx0[x1-h+y]),LDu(Vx0[x1+h+y]),
-          LDu(Vx0[x1+y-1]),LDu(Vx0[x1+y+1])),.25f);
-        _m=MUL(ADD(MUL(LDu(Ey[i]),_my),MUL(LDu(Ex[i]),_mx),
-          LDu(Et[i])),LDu(Z[i]));
-        STRu(Vx[i],SUB(_mx,MUL(LDu(Ex[i]),_m)));
-        STRu(Vy[i],SUB(_my,MUL(LDu(Ey[i]),_m)));
-      }
-      // do remainder of work in regular loop
-      for( ; y<h-1; y++ ) {
-        x1=x*h; i=x1+y;
-        mx=.25f*(Vx0[x1-h+y]+Vx0[x1+h+y]+Vx0[x1+y-1]+Vx0[x1+y+1]);
-        my=.25f*(Vy0[x1-h+y]+Vy0[x1+h+y]+Vy0[x1+y-1]+Vy0[x1+y+1]);
-        m = (Ex[i]*mx + Ey[i]*my + Et[i])*Z[i];
-        Vx[i]=mx-Ex[i]*m; Vy[i]=my-Ey[i]*m;
-      }
+  if( h<3 || w<3 || nIter<1 ) return;
+  const int nty=(h+TH-1)/TH, ntx=(w+TW-1)/TW, nTiles=nty*ntx*K;
+  const int nBlocks=(nIter+TT-1)/TT; const size_t n=size_t(h)*w;
+  float *Wx=new float[n*K](), *Wy=new float[n*K]();
+  #ifdef USEOMP
+  nThreads = std::min(std::min(nThreads,omp_get_max_threads()),nTiles);
+  #else
+  nThreads = 1;
+  #endif
+  nThreads = std::max(nThreads,1);
+  const int nBuf=4*(TH+2*TT)*(TW+2*TT); float *B=new float[nBuf*nThreads];
+  // choose the initial buffer so that the last block writes to Vx and Vy
+  float *U[2][2]={{Vx,Vy},{Wx,Wy}}; int u=nBlocks&1;
+  for( int b=0; b<nBlocks; b++, u=1-u ) {
+    const int nIter1=std::min(TT,nIter-b*TT);
+    float *Ux=U[u][0], *Uy=U[u][1], *Vx1=U[1-u][0], *Vy1=U[1-u][1];
+    #ifdef USEOMP
+    #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+    #endif
+    for( int i=0; i<nTiles; i++ ) {
+      int tid=0;
+      #ifdef USEOMP
+      tid=omp_get_thread_num();
+      #endif
+      const int k=i/(nty*ntx), ty=i%nty, tx=(i/nty)%ntx;
+      const int y0=ty*TH, y1=std::min(y0+TH,h);
+      const int x0=tx*TW, x1=std::min(x0+TW,w); const size_t o=n*k;
+      hsTile(Vx1+o,Vy1+o,Ux+o,Uy+o,Ex+o,Ey+o,Et+o,Z+o,h,w,y0,y1,x0,x1,
+        nIter1,B+size_t(nBuf)*tid);
     }
   }
-  delete [] Vx0; delete [] Vy0;
+  delete [] Wx; delete [] Wy; delete [] B;
 }
 
-// [Vx,Vy]=opticalFlowHsMex(Ex,Ey,Et,Z,nIter); - helper for opticalFlow
+// [Vx,Vy]=opticalFlowHsMex(Ex,Ey,Et,Z,nIter,[nThreads]); - helper for
+// opticalFlow (inputs may be [hxwxK] stacks, one flow field per frame)
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  size_t h, w, nIter; float *Is[4], *Vx, *Vy;
+  int h, w, K, nIter, nThreads; float *Is[4], *Vx, *Vy;
+  mwSize nd; const mwSize *dims;
 
   // Error checking on arguments
-  if( nrhs!=5 ) mexErrMsgTxt("Five inputs expected.");
+  if( nrhs<5 || nrhs>6 ) mexErrMsgTxt("Five or six inputs expected.");
   if( nlhs!=2 ) mexErrMsgTxt("Two outputs expected.");
-  h = mxGetM(prhs[0]); w = mxGetN(prhs[0]);
+  nd = mxGetNumberOfDimensions(prhs[0]); dims = mxGetDimensions(prhs[0]);
+  if( nd>3 ) mexErrMsgTxt("Invalid dims.");
   for( int i=0; i<4; i++ ) {
-    if(mxGetM(prhs[i])!=h || mxGetN(prhs[i])!=w) mexErrMsgTxt("Invalid dims.");
+    if( mxGetNumberOfDimensions(prhs[i])!=nd ) mexErrMsgTxt("Invalid dims.");
+    for( mwSize j=0; j<nd; j++ ) if( mxGetDimensions(prhs[i])[j]!=dims[j] )
+      mexErrMsgTxt("Invalid dims.");
     if(mxGetClassID(prhs[i])!=mxSINGLE_CLASS) mexErrMsgTxt("Invalid type.");
     Is[i] = (float*) mxGetData(prhs[i]);
   }
+  h = (int) dims[0]; w = (int) dims[1]; K = (nd<3) ? 1 : (int) dims[2];
   nIter = (int) mxGetScalar(prhs[4]);
+  nThreads = (nrhs<6) ? 100000 : (int) mxGetScalar(prhs[5]);
 
   // create output matricies
-  plhs[0] = mxCreateNumericMatrix(int(h),int(w),mxSINGLE_CLASS,mxREAL);
-  plhs[1] = mxCreateNumericMatrix(int(h),int(w),mxSINGLE_CLASS,mxREAL);
+  plhs[0] = mxCreateNumericArray(nd,dims,mxSINGLE_CLASS,mxREAL);
+  plhs[1] = mxCreateNumericArray(nd,dims,mxSINGLE_CLASS,mxREAL);
   Vx = (float*) mxGetData(plhs[0]);
   Vy = (float*) mxGetData(plhs[1]);
 
   // run optical flow
-  opticalFlowHsMex(Vx,Vy,Is[0],Is[1],Is[2],Is[3],int(h),int(w),nIter);
+  opticalFlowHsMex(Vx,Vy,Is[0],Is[1],Is[2],Is[3],h,w,K,nIter,nThreads);
 }
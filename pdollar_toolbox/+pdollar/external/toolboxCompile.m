@@ -6,6 +6,11 @@
 % toolboxCompile. Note that this will disable parallelization and make some
 % routines (in particular training certain classifier) much slower.
 %
+% The sse kernels used for computing channels (see channels/private/sse.hpp)
+% can be compiled to use AVX2 or AVX-512 instead by setting simd='avx2' or
+% simd='avx512' below. Only do so if every machine the mex files will run on
+% supports the instruction set; results are identical to the sse version.
+%
 % USAGE
 %  toolboxCompile
 %
@@ -21,17 +26,25 @@
 % Copyright 2014 Piotr Dollar.  [pdollar-at-gmail.com]
 % Licensed under the Simplified BSD License [see external/bsd.txt]
 
-% compile options including openmp support for C++ files
+% compile options including openmp support (CFLAGS are used for C files)
 opts = {'-output'};
 if(exist('OCTAVE_VERSION','builtin')), opts={'-o'}; end
-if( ispc ), optsOmp={'OPTIMFLAGS="$OPTIMFLAGS','/openmp"'}; else
-  optsOmp={'CXXFLAGS="\$CXXFLAGS','-fopenmp"'};
-  optsOmp=[optsOmp,'LDFLAGS="\$LDFLAGS','-fopenmp"'];
+if( ispc ), flags='OPTIMFLAGS="$OPTIMFLAGS'; fOmp={'/openmp'}; else
+  flags='CXXFLAGS="\$CXXFLAGS'; fOmp={'-fopenmp'};
 end
-optsOmp=[optsOmp '-DUSEOMP'];
+optsOmp={'-DUSEOMP'};
+if(~ispc), optsOmp=[optsOmp,'LDFLAGS="\$LDFLAGS','-fopenmp"']; end
+
+% optional avx2/avx512 code paths (simd='', 'avx2' or 'avx512')
+simd=''; fSimd={}; optsSimd={};
+if(strcmp(simd,'avx2')), fSimd={'-mavx2'}; optsSimd={'-DUSEAVX2'}; end
+if(strcmp(simd,'avx512')), fSimd={'-mavx512f'}; optsSimd={'-DUSEAVX512'}; end
+if(~isempty(fSimd)), if(ispc), fSimd={['/arch:' upper(simd)]}; else
+    fSimd=[fSimd '-ffp-contract=off']; end; end
 
 % list of files (missing /private/ part of directory)
-fs={'channels/convConst.cpp', 'channels/gradientMex.cpp',...
+fs={'channels/chnsPyramidMex.cpp', ...
+  'channels/convConst.cpp', 'channels/gradientMex.cpp',...
   'channels/imPadMex.cpp', 'channels/imResampleMex.cpp',...
   'channels/rgbConvertMex.cpp', 'classify/binaryTreeTrain1.cpp', ...
   'classify/fernsInds1.c', 'classify/forestFindThr.cpp',...
@@ -40,23 +53,24 @@ fs={'channels/convConst.cpp', 'channels/gradientMex.cpp',...
   'images/histc2c.c', 'images/imtransform2_c.c', ...
   'images/nlfiltersep_max.c', 'images/nlfiltersep_sum.c', ...
   'videos/ktComputeW_c.c', 'videos/ktHistcRgb_c.c', ...
-  'videos/opticalFlowHsMex.cpp' };
-n=length(fs); useOmp=zeros(1,n); if(~ismac), useOmp([6 9])=1; end
+  'videos/opticalFlowHsMex.cpp', 'detector/bbNmsMex.cpp', ...
+  'classify/forestApply1.cpp', 'matlab/dijkstra1.cpp' };
+n=length(fs); useOmp=zeros(1,n); if(~ismac), useOmp([1:3 5 7 9 10 11 12 14:23])=1; end
+useSimd=zeros(1,n); useSimd([1:6 12 20])=1;
 
-% compile every funciton in turn (special case for dijkstra)
+% compile every funciton in turn
 disp('Compiling Piotr''s Toolbox.......................');
 rd=fileparts(mfilename('fullpath')); rd=rd(1:end-9); tic;
 errmsg=' -> COMPILE FAILURE: ''%s'' %s\n';
 for i=1:n
   try %#ok<ALIGN>
     [d,f1,e]=fileparts(fs{i}); f=[rd '/' d '/private/' f1];
-    if(useOmp(i)), optsi=[optsOmp opts]; else optsi=opts; end
+    fl={}; optsi=opts;
+    if(useOmp(i)), fl=fOmp; optsi=[optsOmp optsi]; end
+    if(useSimd(i)), fl=[fl fSimd]; optsi=[optsSimd optsi]; end
+    flagsi=flags; if(strcmp(e,'.c')), flagsi=strrep(flags,'CXX','C'); end
+    if(~isempty(fl)), fl{end}=[fl{end} '"']; optsi=[flagsi fl optsi]; end
     fprintf(' -> %s\n',[f e]); mex([f e],optsi{:},[f '.' mexext]);
   catch err, fprintf(errmsg,[f1 e],err.message); end
 end
-try %#ok<ALIGN>
-  d=[rd '/matlab/private/']; fprintf(' -> %s\n',[d 'dijkstra1.cpp']);
-  mex([d 'fibheap.cpp'], [d 'dijkstra1.cpp'], '-largeArrayDims', ...
-    opts{:}, [d 'dijkstra1.' mexext]);
-catch err, fprintf(errmsg,[f1 e],err.message); end
 disp('..................................Done Compiling'); toc;